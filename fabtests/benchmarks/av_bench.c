@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Measures how address vector operations scale with the number of
+ * entries.  For every AV size, synthetic addresses derived from the
+ * endpoint's own address are inserted with a single fi_av_insert call,
+ * looked up one at a time, and removed with a single fi_av_remove call.
+ * If the provider supports FI_SOURCE, the endpoint also sends messages
+ * to itself while the AV is full, which measures the cost of mapping
+ * the source of every received message back to an fi_addr_t.  Memory
+ * per entry is the growth of the resident set size since startup,
+ * divided by the number of entries.  If the provider limits the number
+ * of peers, the last size reported is the number of addresses that fit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <netinet/in.h>
+
+#include <rdma/fi_cm.h>
+#include <rdma/fi_errno.h>
+
+#include <shared.h>
+
+#define AV_BENCH_PORTS	60000
+
+static size_t max_cnt = 100000;
+static char *addrs;
+static size_t addr_size;
+static fi_addr_t *fi_addrs;
+static char name[FT_MAX_CTRL_MSG];
+static size_t namelen;
+static long base_rss;
+static bool av_full;
+
+static long av_bench_rss(void)
+{
+	long pages = 0;
+	FILE *file;
+
+	file = fopen("/proc/self/statm", "r");
+	if (!file)
+		return 0;
+
+	if (fscanf(file, "%*s %ld", &pages) != 1)
+		pages = 0;
+	fclose(file);
+	return pages * sysconf(_SC_PAGESIZE);
+}
+
+static void av_bench_sin(struct sockaddr_in *sin, size_t i)
+{
+	sin->sin_addr.s_addr = htonl(ntohl(sin->sin_addr.s_addr) + 1 +
+				     i / AV_BENCH_PORTS);
+	sin->sin_port = htons(1024 + i % AV_BENCH_PORTS);
+}
+
+static void av_bench_sin6(struct sockaddr_in6 *sin6, size_t i)
+{
+	uint32_t tail;
+
+	memcpy(&tail, &sin6->sin6_addr.s6_addr[12], sizeof(tail));
+	tail = htonl(ntohl(tail) + 1 + i / AV_BENCH_PORTS);
+	memcpy(&sin6->sin6_addr.s6_addr[12], &tail, sizeof(tail));
+	sin6->sin6_port = htons(1024 + i % AV_BENCH_PORTS);
+}
+
+static int av_bench_gen_addrs(size_t cnt)
+{
+	uint32_t format = fi->addr_format;
+	char *addr;
+	size_t i;
+
+	if (format == FI_SOCKADDR)
+		format = ((struct sockaddr *) name)->sa_family == AF_INET ?
+			 FI_SOCKADDR_IN : FI_SOCKADDR_IN6;
+
+	switch (format) {
+	case FI_SOCKADDR_IN:
+	case FI_SOCKADDR_IN6:
+		addr_size = namelen;
+		break;
+	case FI_ADDR_STR:
+		/* Strings are packed, each followed by its terminator. */
+		addr_size = strlen(name) + 12;
+		break;
+	default:
+		FT_ERR("address format %s is not supported",
+		       fi_tostr(&fi->addr_format, FI_TYPE_ADDR_FORMAT));
+		return -FI_ENOSYS;
+	}
+
+	addrs = malloc(cnt * addr_size);
+	if (!addrs)
+		return -FI_ENOMEM;
+
+	for (i = 0, addr = addrs; i < cnt; i++) {
+		if (format == FI_ADDR_STR) {
+			addr += sprintf(addr, "%s_%zu", name, i) + 1;
+			continue;
+		}
+
+		memcpy(addr, name, namelen);
+		if (format == FI_SOCKADDR_IN)
+			av_bench_sin((struct sockaddr_in *) addr, i);
+		else
+			av_bench_sin6((struct sockaddr_in6 *) addr, i);
+		addr += addr_size;
+	}
+
+	return 0;
+}
+
+static int av_bench_recv_from(size_t iters, uint64_t *elapsed)
+{
+	struct fi_cq_tagged_entry comp;
+	fi_addr_t src_addr;
+	uint64_t start;
+	size_t i;
+	int ret;
+
+	start = ft_gettime_ns();
+	for (i = 0; i < iters; i++) {
+		ret = ft_post_tx(ep, remote_fi_addr, 4, NO_CQ_DATA, &tx_ctx);
+		if (ret)
+			return ret;
+
+		do {
+			ret = fi_cq_readfrom(rxcq, &comp, 1, &src_addr);
+		} while (ret == -FI_EAGAIN);
+		if (ret < 0) {
+			FT_PRINTERR("fi_cq_readfrom", ret);
+			return ret;
+		}
+		if (src_addr != remote_fi_addr) {
+			FT_ERR("source address %" PRIu64 " does not match %"
+			       PRIu64, src_addr, remote_fi_addr);
+			return -FI_EOTHER;
+		}
+		rx_cq_cntr++;
+
+		ret = ft_get_tx_comp(tx_seq);
+		if (ret)
+			return ret;
+
+		ret = ft_post_rx(ep, 4, &rx_ctx);
+		if (ret)
+			return ret;
+	}
+	*elapsed = ft_gettime_ns() - start;
+	return 0;
+}
+
+static void av_bench_print(const char *label, size_t cnt, uint64_t ns)
+{
+	if (ns)
+		printf(" %12.0f", (double) cnt * 1000000000 / ns);
+	else
+		printf(" %12s", label);
+}
+
+/*
+ * Providers with a fixed number of peers insert as many addresses as fit.
+ * Keep the inserted ones at the start of the array and report the count.
+ */
+static size_t av_bench_compact(size_t cnt)
+{
+	size_t i, j;
+
+	for (i = 0, j = 0; i < cnt; i++) {
+		if (fi_addrs[i] != FI_ADDR_NOTAVAIL)
+			fi_addrs[j++] = fi_addrs[i];
+	}
+	return j;
+}
+
+static int av_bench(size_t cnt)
+{
+	uint64_t start, insert_ns, lookup_ns, recv_ns = 0, remove_ns;
+	char addr[FT_MAX_CTRL_MSG];
+	size_t i, len;
+	long rss;
+	int ret;
+
+	ret = av_bench_gen_addrs(cnt);
+	if (ret)
+		return ret;
+
+	fi_addrs = calloc(cnt, sizeof(*fi_addrs));
+	if (!fi_addrs) {
+		ret = -FI_ENOMEM;
+		goto out;
+	}
+
+	start = ft_gettime_ns();
+	ret = fi_av_insert(av, addrs, cnt, fi_addrs, 0, NULL);
+	insert_ns = ft_gettime_ns() - start;
+	if (ret <= 0) {
+		FT_ERR("fi_av_insert inserted %d of %zu addresses", ret, cnt);
+		ret = ret < 0 ? ret : -FI_ENOSPC;
+		goto out;
+	}
+	if (ret < cnt) {
+		av_full = true;
+		cnt = av_bench_compact(cnt);
+	}
+	rss = av_bench_rss();
+
+	start = ft_gettime_ns();
+	for (i = 0; i < cnt; i++) {
+		len = sizeof(addr);
+		ret = fi_av_lookup(av, fi_addrs[i], addr, &len);
+		if (ret) {
+			FT_PRINTERR("fi_av_lookup", ret);
+			goto out;
+		}
+	}
+	lookup_ns = ft_gettime_ns() - start;
+
+	if (fi->caps & FI_SOURCE) {
+		ret = av_bench_recv_from(opts.iterations, &recv_ns);
+		if (ret)
+			goto out;
+	}
+
+	start = ft_gettime_ns();
+	ret = fi_av_remove(av, fi_addrs, cnt, 0);
+	remove_ns = ft_gettime_ns() - start;
+	if (ret) {
+		FT_PRINTERR("fi_av_remove", ret);
+		goto out;
+	}
+
+	printf("%-10zu", cnt);
+	av_bench_print("", cnt, insert_ns);
+	av_bench_print("", cnt, lookup_ns);
+	av_bench_print("n/a", opts.iterations, recv_ns);
+	av_bench_print("", cnt, remove_ns);
+	if (rss && base_rss)
+		printf(" %12.1f\n", (double) (rss - base_rss) / cnt);
+	else
+		printf(" %12s\n", "n/a");
+
+out:
+	free(fi_addrs);
+	free(addrs);
+	fi_addrs = NULL;
+	addrs = NULL;
+	return ret;
+}
+
+static int av_bench_init(void)
+{
+	int ret;
+
+	/* FI_SOURCE is optional, but needed to measure receives. */
+	hints->caps |= FI_SOURCE;
+	ret = ft_getinfo(hints, &fi);
+	if (ret == -FI_ENODATA) {
+		hints->caps &= ~FI_SOURCE;
+		ret = ft_getinfo(hints, &fi);
+	}
+	if (ret)
+		return ret;
+
+	ret = ft_open_fabric_res();
+	if (ret)
+		return ret;
+
+	ret = ft_alloc_active_res(fi);
+	if (ret)
+		return ret;
+
+	ret = ft_enable_ep_recv();
+	if (ret)
+		return ret;
+
+	namelen = sizeof(name);
+	ret = fi_getname(&ep->fid, name, &namelen);
+	if (ret) {
+		FT_PRINTERR("fi_getname", ret);
+		return ret;
+	}
+
+	opts.dst_addr = fi->src_addr;
+	fi->dest_addr = fi->src_addr;
+	fi->dest_addrlen = fi->src_addrlen;
+	ret = ft_init_av();
+	fi->dest_addr = NULL;
+	fi->dest_addrlen = 0;
+	return ret;
+}
+
+static int run(void)
+{
+	size_t cnt;
+	int ret;
+
+	ret = av_bench_init();
+	if (ret)
+		return ret;
+
+	base_rss = av_bench_rss();
+	printf("%-10s %12s %12s %12s %12s %12s\n", "entries", "insert/s",
+	       "lookup/s", "recv_from/s", "remove/s", "bytes/entry");
+	for (cnt = 1000; cnt <= max_cnt && !av_full; cnt *= 10) {
+		ret = av_bench(cnt);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.iterations = 10000;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	opts.src_addr = "127.0.0.1";
+	hints->caps = FI_LOCAL_COMM | FI_MSG;
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->mode = FI_CONTEXT;
+
+	while ((op = getopt(argc, argv, "hN:" CS_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		case 'N':
+			max_cnt = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case '?':
+		case 'h':
+			ft_usage(argv[0], "Address vector scaling benchmark.");
+			FT_PRINT_OPTS_USAGE("-N <count>",
+				"largest number of AV entries (default 100000)");
+			FT_PRINT_OPTS_USAGE("-I <iterations>",
+				"messages received per AV size (default 10000)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
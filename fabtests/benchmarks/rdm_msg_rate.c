@@ -0,0 +1,841 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL); Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Multi-pair message rate test, similar to osu_mbw_mr.  The client and
+ * the server each run N threads, or N processes with -X, and thread i of
+ * the client streams messages to thread i of the server.  Each pair sends
+ * windows of messages, after which the receiver acknowledges the window.
+ * Every pair uses its own endpoint, unless -T is given, in which case all
+ * pairs of a process share a single FI_THREAD_SAFE endpoint.
+ *
+ * The aggregate rate is the number of messages sent by all pairs, divided
+ * by the time from the first pair starting until the last one finished.
+ * Fairness is reported as the rates of the slowest and fastest pairs and
+ * Jain's fairness index, which is 1 when all pairs ran at the same rate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+#include <rdma/fi_cm.h>
+#include <rdma/fi_errno.h>
+#include <rdma/fi_tagged.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+#define RATE_CQ_BATCH	16
+
+enum {
+	RATE_INJECT,
+	RATE_SEND,
+	RATE_TAGGED,
+	RATE_OP_CNT
+};
+
+static const char * const rate_op_names[] = {
+	"inject", "send", "tagged"
+};
+
+struct rate_pair;
+
+struct rate_ctx {
+	struct fi_context2	ctx;
+	struct rate_pair	*pair;
+};
+
+struct rate_pair {
+	int			id;
+	struct fid_ep		*ep;
+	struct fid_cq		*txcq;
+	struct fid_cq		*rxcq;
+	fi_addr_t		addr;
+	struct rate_ctx		*tx_ctx;
+	struct rate_ctx		*rx_ctx;
+	struct rate_ctx		ack_ctx;
+	uint64_t		tx_done;
+	uint64_t		rx_done;
+	uint64_t		tx_posted;
+	uint64_t		rx_posted;
+	int			op;
+	int			ret;
+	pthread_t		thread;
+};
+
+struct rate_result {
+	uint64_t	start;
+	uint64_t	end;
+	uint64_t	msgs;
+};
+
+/* Shared by the processes of the test with -X */
+struct rate_shared {
+	pthread_barrier_t	barrier;
+	struct rate_result	res[];
+};
+
+static int pair_cnt = 1;
+static int op_mask = (1 << RATE_OP_CNT) - 1;
+static bool shared_ep;
+static bool use_procs;
+
+static struct rate_shared *shared;
+static struct rate_pair *pairs;
+static struct fi_info *ep_fi;
+static int local_cnt;
+
+static struct rate_result *rate_result(int op, int id)
+{
+	return &shared->res[op * pair_cnt + id];
+}
+
+/* Count completions toward the pair that posted the operation */
+static int rate_read_cq(struct fid_cq *cq, bool tx)
+{
+	struct fi_cq_tagged_entry comp[RATE_CQ_BATCH];
+	struct rate_ctx *ctx;
+	int i, ret;
+
+	ret = fi_cq_read(cq, comp, RATE_CQ_BATCH);
+	if (ret > 0) {
+		for (i = 0; i < ret; i++) {
+			ctx = comp[i].op_context;
+			__atomic_fetch_add(tx ? &ctx->pair->tx_done :
+					   &ctx->pair->rx_done, 1,
+					   __ATOMIC_RELAXED);
+		}
+		return 0;
+	}
+
+	if (ret == -FI_EAGAIN)
+		return 0;
+
+	if (ret == -FI_EAVAIL)
+		return ft_cq_readerr(cq);
+
+	FT_PRINTERR("fi_cq_read", ret);
+	return ret;
+}
+
+static int rate_poll(struct rate_pair *pair)
+{
+	int ret;
+
+	ret = rate_read_cq(pair->txcq, true);
+	if (ret)
+		return ret;
+
+	return rate_read_cq(pair->rxcq, false);
+}
+
+static int rate_wait(struct rate_pair *pair, uint64_t *done, uint64_t cnt)
+{
+	int ret;
+
+	while (__atomic_load_n(done, __ATOMIC_RELAXED) < cnt) {
+		ret = rate_poll(pair);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static int rate_post_tx(struct rate_pair *pair, struct rate_ctx *ctx)
+{
+	int ret;
+
+	do {
+		switch (pair->op) {
+		case RATE_INJECT:
+			ret = fi_inject(pair->ep, tx_buf, opts.transfer_size,
+					pair->addr);
+			break;
+		case RATE_SEND:
+			ret = fi_send(pair->ep, tx_buf, opts.transfer_size,
+				      mr_desc, pair->addr, ctx);
+			break;
+		default:
+			ret = fi_tsend(pair->ep, tx_buf, opts.transfer_size,
+				       mr_desc, pair->addr, pair->id, ctx);
+			break;
+		}
+		if (ret == -FI_EAGAIN && rate_poll(pair))
+			return -FI_EOTHER;
+	} while (ret == -FI_EAGAIN);
+
+	if (ret)
+		FT_ERR("%s: %s", rate_op_names[pair->op], fi_strerror(-ret));
+	else if (pair->op != RATE_INJECT)
+		pair->tx_posted++;
+	return ret;
+}
+
+static int rate_post_rx(struct rate_pair *pair, struct rate_ctx *ctx,
+			bool tagged)
+{
+	int ret;
+
+	do {
+		if (tagged)
+			ret = fi_trecv(pair->ep, rx_buf, opts.transfer_size,
+				       mr_desc, FI_ADDR_UNSPEC, pair->id, 0,
+				       ctx);
+		else
+			ret = fi_recv(pair->ep, rx_buf, opts.transfer_size,
+				      mr_desc, FI_ADDR_UNSPEC, ctx);
+		if (ret == -FI_EAGAIN && rate_poll(pair))
+			return -FI_EOTHER;
+	} while (ret == -FI_EAGAIN);
+
+	if (ret)
+		FT_PRINTERR("fi_recv", ret);
+	else
+		pair->rx_posted++;
+	return ret;
+}
+
+/*
+ * Acknowledgements are untagged, even when all pairs share an endpoint.
+ * A pair may then receive the acknowledgement of another one, but every
+ * pair waits for as many as it receives, so the counts always balance.
+ */
+static int rate_send_ack(struct rate_pair *pair)
+{
+	int ret;
+
+	do {
+		ret = fi_inject(pair->ep, tx_buf, 0, pair->addr);
+		if (ret == -FI_EAGAIN && rate_poll(pair))
+			return -FI_EOTHER;
+	} while (ret == -FI_EAGAIN);
+
+	if (ret)
+		FT_PRINTERR("fi_inject", ret);
+	return ret;
+}
+
+static int rate_sender(struct rate_pair *pair, struct rate_result *res)
+{
+	int i, j, ret;
+
+	for (i = 0; i < opts.warmup_iterations + opts.iterations; i++) {
+		if (i == opts.warmup_iterations)
+			res->start = ft_gettime_ns();
+
+		ret = rate_post_rx(pair, &pair->ack_ctx, false);
+		if (ret)
+			return ret;
+
+		for (j = 0; j < opts.window_size; j++) {
+			ret = rate_post_tx(pair, &pair->tx_ctx[j]);
+			if (ret)
+				return ret;
+		}
+
+		ret = rate_wait(pair, &pair->tx_done, pair->tx_posted);
+		if (ret)
+			return ret;
+
+		ret = rate_wait(pair, &pair->rx_done, pair->rx_posted);
+		if (ret)
+			return ret;
+	}
+	res->end = ft_gettime_ns();
+	return 0;
+}
+
+static int rate_receiver(struct rate_pair *pair, struct rate_result *res)
+{
+	int i, j, ret;
+
+	for (i = 0; i < opts.warmup_iterations + opts.iterations; i++) {
+		if (i == opts.warmup_iterations)
+			res->start = ft_gettime_ns();
+
+		for (j = 0; j < opts.window_size; j++) {
+			ret = rate_post_rx(pair, &pair->rx_ctx[j],
+					   pair->op == RATE_TAGGED);
+			if (ret)
+				return ret;
+		}
+
+		ret = rate_wait(pair, &pair->rx_done, pair->rx_posted);
+		if (ret)
+			return ret;
+
+		ret = rate_send_ack(pair);
+		if (ret)
+			return ret;
+	}
+	res->end = ft_gettime_ns();
+	return 0;
+}
+
+static void *rate_run_pair(void *arg)
+{
+	struct rate_pair *pair = arg;
+	struct rate_result *res = rate_result(pair->op, pair->id);
+
+	pair->tx_done = pair->rx_done = 0;
+	pair->tx_posted = pair->rx_posted = 0;
+	pthread_barrier_wait(&shared->barrier);
+
+	if (opts.dst_addr)
+		pair->ret = rate_sender(pair, res);
+	else
+		pair->ret = rate_receiver(pair, res);
+
+	if (!pair->ret)
+		res->msgs = (uint64_t) opts.iterations * opts.window_size;
+	return NULL;
+}
+
+static int rate_run_op(int op)
+{
+	int i, ret;
+
+	if (op == RATE_INJECT && opts.transfer_size > fi->tx_attr->inject_size)
+		return 0;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	for (i = 0; i < local_cnt; i++) {
+		pairs[i].op = op;
+		if (local_cnt == 1) {
+			rate_run_pair(&pairs[i]);
+			continue;
+		}
+
+		ret = pthread_create(&pairs[i].thread, NULL, rate_run_pair,
+				     &pairs[i]);
+		if (ret) {
+			FT_PRINTERR("pthread_create", -ret);
+			return -ret;
+		}
+	}
+
+	for (i = 0, ret = 0; i < local_cnt; i++) {
+		if (local_cnt > 1)
+			pthread_join(pairs[i].thread, NULL);
+		if (pairs[i].ret && !ret)
+			ret = pairs[i].ret;
+	}
+	return ret;
+}
+
+static void rate_print(int op)
+{
+	uint64_t start = UINT64_MAX, end = 0, msgs = 0;
+	double rate, min = 0, max = 0, sum = 0, sum_sq = 0;
+	struct rate_result *res;
+	char str[FT_STR_LEN];
+	int i;
+
+	for (i = 0; i < pair_cnt; i++) {
+		res = rate_result(op, i);
+		if (!res->msgs)
+			continue;
+
+		rate = res->msgs * 1000.0 / (res->end - res->start);
+		min = (!msgs || rate < min) ? rate : min;
+		max = rate > max ? rate : max;
+		sum += rate;
+		sum_sq += rate * rate;
+		start = res->start < start ? res->start : start;
+		end = res->end > end ? res->end : end;
+		msgs += res->msgs;
+	}
+
+	if (opts.machr) {
+		printf("- { op: %s, pairs: %d, shared_ep: %d, xfer_size: %zu, ",
+		       rate_op_names[op], pair_cnt, shared_ep,
+		       opts.transfer_size);
+		if (msgs)
+			printf("msgs: %" PRIu64 ", time: %f, Mmsgs/sec: %f, "
+			       "min_pair: %f, max_pair: %f, fairness: %f",
+			       msgs, (end - start) / 1e9,
+			       msgs * 1000.0 / (end - start), min, max,
+			       sum * sum / (pair_cnt * sum_sq));
+		printf(" }\n");
+		return;
+	}
+
+	printf("%-8s%-7d%-8s", rate_op_names[op], pair_cnt,
+	       size_str(str, opts.transfer_size));
+	if (!msgs) {
+		printf("%-8s\n", "n/a");
+		return;
+	}
+
+	printf("%-8s%8.2fs%12.3f%12.3f%12.3f%10.3f\n", cnt_str(str, msgs),
+	       (end - start) / 1e9, msgs * 1000.0 / (end - start), min, max,
+	       sum * sum / (pair_cnt * sum_sq));
+}
+
+static void rate_print_all(int argc, char **argv)
+{
+	int i, op;
+
+	if (opts.machr) {
+		printf("---\n");
+		for (i = 0; i < argc; i++)
+			printf("%s ", argv[i]);
+		printf(":\n");
+	} else {
+		printf("%-8s%-7s%-8s%-8s%9s%12s%12s%12s%10s\n", "op", "pairs",
+		       "bytes", "msgs", "time", "Mmsgs/sec", "min/pair",
+		       "max/pair", "fairness");
+	}
+
+	for (op = 0; op < RATE_OP_CNT; op++) {
+		if (op_mask & (1 << op))
+			rate_print(op);
+	}
+}
+
+static int rate_alloc_ctx(struct rate_pair *pair)
+{
+	int i;
+
+	pair->tx_ctx = calloc(opts.window_size, sizeof(*pair->tx_ctx));
+	pair->rx_ctx = calloc(opts.window_size, sizeof(*pair->rx_ctx));
+	if (!pair->tx_ctx || !pair->rx_ctx)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < opts.window_size; i++) {
+		pair->tx_ctx[i].pair = pair;
+		pair->rx_ctx[i].pair = pair;
+	}
+	pair->ack_ctx.pair = pair;
+	return 0;
+}
+
+/*
+ * The pair endpoints must not bind to the address of the main endpoint.
+ * Socket addresses keep their IP address, so that peers can reach them,
+ * with the port chosen by the provider.  Other formats are looked up
+ * again without a source address, which lets the provider pick one.
+ */
+static int rate_getinfo(void)
+{
+	struct fi_info *ep_hints;
+	struct sockaddr *sa;
+	int ret;
+
+	ep_hints = fi_dupinfo(fi);
+	if (!ep_hints)
+		return -FI_ENOMEM;
+
+	sa = ep_hints->src_addr;
+	if (sa && (ep_hints->addr_format == FI_SOCKADDR ||
+		   ep_hints->addr_format == FI_SOCKADDR_IN ||
+		   ep_hints->addr_format == FI_SOCKADDR_IN6)) {
+		if (sa->sa_family == AF_INET)
+			((struct sockaddr_in *) sa)->sin_port = 0;
+		else if (sa->sa_family == AF_INET6)
+			((struct sockaddr_in6 *) sa)->sin6_port = 0;
+		ep_fi = ep_hints;
+		return 0;
+	}
+
+	free(ep_hints->src_addr);
+	ep_hints->src_addr = NULL;
+	ep_hints->src_addrlen = 0;
+
+	ret = fi_getinfo(FT_FIVERSION, opts.src_addr, NULL, 0, ep_hints,
+			 &ep_fi);
+	if (ret)
+		FT_PRINTERR("fi_getinfo", ret);
+	fi_freeinfo(ep_hints);
+	return ret;
+}
+
+static bool rate_is_sockaddr(void)
+{
+	return fi->addr_format == FI_SOCKADDR ||
+	       fi->addr_format == FI_SOCKADDR_IN ||
+	       fi->addr_format == FI_SOCKADDR_IN6;
+}
+
+/*
+ * A server started without -s binds the pair endpoints to the wildcard
+ * address, which the client cannot send to.  Use the address the client
+ * reached the server at instead, with the port of the pair endpoint.
+ */
+static void rate_fix_name(void *name)
+{
+	struct sockaddr *sa = name, *dst = fi->dest_addr;
+
+	if (!dst || sa->sa_family != dst->sa_family)
+		return;
+
+	if (sa->sa_family == AF_INET &&
+	    ((struct sockaddr_in *) sa)->sin_addr.s_addr ==
+	    htonl(INADDR_ANY)) {
+		((struct sockaddr_in *) sa)->sin_addr =
+			((struct sockaddr_in *) dst)->sin_addr;
+	} else if (sa->sa_family == AF_INET6 &&
+		   IN6_IS_ADDR_UNSPECIFIED(
+			&((struct sockaddr_in6 *) sa)->sin6_addr)) {
+		((struct sockaddr_in6 *) sa)->sin6_addr =
+			((struct sockaddr_in6 *) dst)->sin6_addr;
+	}
+}
+
+/* As ft_init_av_addr, but fixes up the server's name on the client. */
+static int rate_init_av_addr(struct rate_pair *pair)
+{
+	char name[FT_MAX_CTRL_MSG];
+	size_t len = sizeof(name);
+	int ret;
+
+	if (!opts.dst_addr || !rate_is_sockaddr() ||
+	    (opts.options & FT_OPT_SKIP_ADDR_EXCH))
+		return ft_init_av_addr(av, pair->ep, &pair->addr);
+
+	memset(name, 0, sizeof(name));
+	ret = fi_getname(&pair->ep->fid, name, &len);
+	if (ret) {
+		FT_PRINTERR("fi_getname", ret);
+		return ret;
+	}
+
+	if (opts.options & FT_OPT_OOB_ADDR_EXCH) {
+		ret = ft_sock_send(oob_sock, name, FT_MAX_CTRL_MSG);
+		if (!ret)
+			ret = ft_sock_recv(oob_sock, name, FT_MAX_CTRL_MSG);
+	} else {
+		memcpy((char *) tx_buf + ft_tx_prefix_size(), name, len);
+		ret = (int) ft_tx(ep, remote_fi_addr, len, &tx_ctx);
+		if (!ret)
+			ret = (int) ft_rx(ep, FT_MAX_CTRL_MSG);
+		if (!ret)
+			memcpy(name, (char *) rx_buf + ft_rx_prefix_size(),
+			       FT_MAX_CTRL_MSG);
+	}
+	if (ret)
+		return ret;
+
+	rate_fix_name(name);
+	return ft_av_insert(av, name, 1, &pair->addr, 0, NULL);
+}
+
+static int rate_open_ep(struct rate_pair *pair)
+{
+	int ret;
+
+	ret = fi_endpoint(domain, ep_fi, &pair->ep, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_endpoint", ret);
+		return ret;
+	}
+
+	ret = ft_alloc_ep_res(ep_fi, &pair->txcq, &pair->rxcq, NULL, NULL,
+			      NULL, &av);
+	if (ret)
+		return ret;
+
+	ret = ft_enable_ep(pair->ep, eq, av, pair->txcq, pair->rxcq, NULL,
+			   NULL, NULL);
+	if (ret)
+		return ret;
+
+	return rate_init_av_addr(pair);
+}
+
+static void rate_free_pairs(void)
+{
+	int i;
+
+	for (i = 0; pairs && i < local_cnt; i++) {
+		free(pairs[i].tx_ctx);
+		free(pairs[i].rx_ctx);
+		if (i && shared_ep)
+			continue;
+		FT_CLOSE_FID(pairs[i].ep);
+		FT_CLOSE_FID(pairs[i].txcq);
+		FT_CLOSE_FID(pairs[i].rxcq);
+	}
+	free(pairs);
+	pairs = NULL;
+	fi_freeinfo(ep_fi);
+	ep_fi = NULL;
+}
+
+/* Run the pairs of this process, starting with pair id first */
+static int rate_run(int first)
+{
+	int i, op, ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	ret = rate_getinfo();
+	if (ret)
+		return ret;
+
+	pairs = calloc(local_cnt, sizeof(*pairs));
+	if (!pairs) {
+		ret = -FI_ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < local_cnt; i++) {
+		pairs[i].id = first + i;
+		ret = rate_alloc_ctx(&pairs[i]);
+		if (ret)
+			goto out;
+
+		if (i && shared_ep) {
+			pairs[i].ep = pairs[0].ep;
+			pairs[i].txcq = pairs[0].txcq;
+			pairs[i].rxcq = pairs[0].rxcq;
+			pairs[i].addr = pairs[0].addr;
+			continue;
+		}
+
+		ret = rate_open_ep(&pairs[i]);
+		if (ret)
+			goto out;
+	}
+
+	for (op = 0; op < RATE_OP_CNT; op++) {
+		if (!(op_mask & (1 << op)))
+			continue;
+
+		ret = rate_run_op(op);
+		if (ret)
+			goto out;
+	}
+
+	ret = ft_finalize();
+out:
+	rate_free_pairs();
+	return ret;
+}
+
+static void rate_set_port(char **port, char *buf, int offset)
+{
+	snprintf(buf, 8, "%d", atoi(*port ? *port : default_port) + offset);
+	*port = buf;
+}
+
+/*
+ * Fork one process per pair.  Every process listens on, or connects to,
+ * its own ports, offset by the pair id from the configured ones.
+ */
+static int rate_run_procs(void)
+{
+	static char src_port[8], dst_port[8], oob_port[8];
+	int i, j, status, ret = 0;
+	pid_t *pids;
+
+	pids = calloc(pair_cnt, sizeof(*pids));
+	if (!pids)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < pair_cnt; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			ret = -errno;
+			FT_PRINTERR("fork", ret);
+			break;
+		}
+		if (pids[i])
+			continue;
+
+		if (opts.dst_addr) {
+			rate_set_port(&opts.dst_port, dst_port, i);
+			if (opts.src_port)
+				rate_set_port(&opts.src_port, src_port, i);
+		} else {
+			rate_set_port(&opts.src_port, src_port, i);
+		}
+		if (opts.oob_port)
+			rate_set_port(&opts.oob_port, oob_port, i);
+
+		ret = rate_run(i);
+		ft_free_res();
+		exit(ft_exit_code(ret));
+	}
+
+	/* If a pair fails, the others would wait at the barrier forever */
+	for (i = 0; i < pair_cnt; i++) {
+		if (pids[i] <= 0)
+			continue;
+
+		if (ret) {
+			for (j = 0; j < pair_cnt && pids[j] > 0; j++)
+				kill(pids[j], SIGTERM);
+		}
+
+		if (waitpid(-1, &status, 0) < 0 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status))
+			ret = ret ? ret : -FI_EOTHER;
+	}
+	free(pids);
+	return ret;
+}
+
+static int rate_parse_op(const char *op)
+{
+	int i;
+
+	if (!strcasecmp(op, "all")) {
+		op_mask = (1 << RATE_OP_CNT) - 1;
+		return 0;
+	}
+
+	for (i = 0; i < RATE_OP_CNT; i++) {
+		if (!strcasecmp(op, rate_op_names[i])) {
+			op_mask = 1 << i;
+			return 0;
+		}
+	}
+	return -FI_EINVAL;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_barrierattr_t attr;
+	size_t size;
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.transfer_size = 8;
+	opts.threading = FI_THREAD_COMPLETION;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt_long(argc, argv, "n:o:TXh" CS_OPTS INFO_OPTS
+				 BENCHMARK_OPTS, long_opts, &lopt_idx)) != -1) {
+		switch (op) {
+		default:
+			if (!ft_parse_long_opts(op, optarg))
+				continue;
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'n':
+			pair_cnt = atoi(optarg);
+			break;
+		case 'o':
+			if (rate_parse_op(optarg)) {
+				FT_ERR("unknown operation %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'T':
+			shared_ep = true;
+			opts.threading = FI_THREAD_SAFE;
+			break;
+		case 'X':
+			use_procs = true;
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Multi-pair message rate test for RDM endpoints.");
+			FT_PRINT_OPTS_USAGE("-n <pairs>",
+				"number of sender/receiver pairs (default 1)");
+			FT_PRINT_OPTS_USAGE("-o <op>",
+				"inject|send|tagged|all (default all)");
+			FT_PRINT_OPTS_USAGE("-T",
+				"pairs share one FI_THREAD_SAFE endpoint");
+			FT_PRINT_OPTS_USAGE("-X",
+				"run the pairs as processes instead of threads");
+			ft_benchmark_usage();
+			ft_longopts_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	if (pair_cnt < 1 || opts.window_size < 1 || (use_procs && shared_ep)) {
+		FT_ERR("invalid pair count, window size or -T with -X");
+		return EXIT_FAILURE;
+	}
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->domain_attr->resource_mgmt = FI_RM_ENABLED;
+	hints->caps = FI_MSG | FI_TAGGED;
+	hints->mode |= FI_CONTEXT | FI_CONTEXT2;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->addr_format = opts.address_format;
+
+	size = sizeof(*shared) +
+	       sizeof(struct rate_result) * RATE_OP_CNT * pair_cnt;
+	shared = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED) {
+		FT_PRINTERR("mmap", -errno);
+		return EXIT_FAILURE;
+	}
+
+	pthread_barrierattr_init(&attr);
+	pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_barrier_init(&shared->barrier, &attr, pair_cnt);
+	pthread_barrierattr_destroy(&attr);
+
+	if (use_procs) {
+		local_cnt = 1;
+		ret = rate_run_procs();
+	} else {
+		local_cnt = pair_cnt;
+		opts.av_size = pair_cnt + 1;
+		ret = rate_run(0);
+	}
+
+	if (!ret)
+		rate_print_all(argc, argv);
+
+	pthread_barrier_destroy(&shared->barrier);
+	munmap(shared, size);
+	ft_free_res();
+	return ft_exit_code(ret);
+}
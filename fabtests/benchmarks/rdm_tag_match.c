@@ -0,0 +1,549 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Measures the cost of tag matching as the matching queues grow.  The
+ * endpoint sends tagged messages to itself, so both sides of the match
+ * run in one process and the result reflects the provider's matching
+ * engine rather than the network.  For every queue depth K, two cases
+ * are timed:
+ *
+ * expected   - K receives with distinct tags are posted, then K messages
+ *              are sent.  Each arriving message searches the posted
+ *              receive queue.
+ * unexpected - K messages are sent and flushed with a marker message,
+ *              then K receives are posted.  Each receive searches the
+ *              unexpected message queue.
+ *
+ * By default messages are matched in the reverse of the order in which
+ * the queue was filled, which makes every search walk the queue.  A
+ * percentage of the receives may be posted with FI_ADDR_UNSPEC instead
+ * of the peer address, to compare wildcard and directed receives.  If a
+ * provider cannot queue K receives or unexpected messages, the depth and
+ * all larger ones are reported as n/a.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_tagged.h>
+
+#include <shared.h>
+
+#define TM_CTRL_TAG	(1ULL << 40)
+#define TM_MSG_SIZE	4
+#define TM_CQ_BATCH	64
+#define TM_STALL_NS	1000000000ULL
+
+enum {
+	TM_EXPECTED,
+	TM_UNEXPECTED,
+	TM_CASE_CNT
+};
+
+static const char *tm_case_names[] = {
+	[TM_EXPECTED] = "expected",
+	[TM_UNEXPECTED] = "unexpected",
+};
+
+static size_t max_depth = 100000;
+static int wildcard_pct = -1;
+static bool fifo;
+static size_t msg_size = TM_MSG_SIZE;
+static size_t case_limit[TM_CASE_CNT];
+static struct fi_context2 *tm_ctx;
+static size_t rx_done;
+static bool marker_done;
+
+static int tm_poll_rx(void)
+{
+	struct fi_cq_tagged_entry comp[TM_CQ_BATCH];
+	ssize_t ret, i;
+
+	ret = fi_cq_read(rxcq, comp, TM_CQ_BATCH);
+	if (ret > 0) {
+		for (i = 0; i < ret; i++) {
+			if (comp[i].op_context == &rx_ctx)
+				marker_done = true;
+			else
+				rx_done++;
+		}
+		return 0;
+	}
+	if (ret == -FI_EAVAIL)
+		return ft_cq_readerr(rxcq);
+	if (ret != -FI_EAGAIN) {
+		FT_PRINTERR("fi_cq_read", ret);
+		return (int) ret;
+	}
+	return 0;
+}
+
+static int tm_wait_rx(size_t cnt)
+{
+	int ret;
+
+	while (rx_done < cnt) {
+		ret = tm_poll_rx();
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * Retries an operation that returned -FI_EAGAIN while progressing the
+ * receive side.  If it cannot complete for TM_STALL_NS without any
+ * receive completing, the provider has run out of queue space.
+ */
+static int tm_retry(uint64_t *stall, size_t *last_done)
+{
+	uint64_t now;
+	int ret;
+
+	ret = tm_poll_rx();
+	if (ret)
+		return ret;
+
+	now = ft_gettime_ns();
+	if (!*stall || rx_done != *last_done) {
+		*stall = now;
+		*last_done = rx_done;
+	} else if (now - *stall > TM_STALL_NS) {
+		return -FI_EAGAIN;
+	}
+	return 1;
+}
+
+static int tm_send(uint64_t tag)
+{
+	uint64_t stall = 0;
+	size_t last_done = 0;
+	ssize_t ret;
+
+	do {
+		ret = fi_tinject(ep, tx_buf, msg_size, remote_fi_addr, tag);
+		if (!ret)
+			return 0;
+		if (ret != -FI_EAGAIN) {
+			FT_PRINTERR("fi_tinject", ret);
+			return (int) ret;
+		}
+	} while ((ret = tm_retry(&stall, &last_done)) > 0);
+
+	return (int) ret;
+}
+
+static int tm_recv(size_t i, int pct, uint64_t tag)
+{
+	uint64_t stall = 0;
+	size_t last_done = 0;
+	fi_addr_t addr;
+	ssize_t ret;
+
+	/* Spread the wildcard receives evenly across the queue. */
+	addr = (i + 1) * pct / 100 != i * pct / 100 ?
+	       FI_ADDR_UNSPEC : remote_fi_addr;
+
+	do {
+		ret = fi_trecv(ep, rx_buf, msg_size, mr_desc, addr, tag, 0,
+			       &tm_ctx[i]);
+		if (!ret)
+			return 0;
+		if (ret != -FI_EAGAIN) {
+			FT_PRINTERR("fi_trecv", ret);
+			return (int) ret;
+		}
+	} while ((ret = tm_retry(&stall, &last_done)) > 0);
+
+	return (int) ret;
+}
+
+static uint64_t tm_tag(size_t i, size_t depth)
+{
+	return fifo ? i + 1 : depth - i;
+}
+
+/*
+ * The marker is sent on the control tag and lands in the receive posted
+ * by the common code, which is reposted once the marker arrives.
+ */
+static int tm_wait_marker(bool stall)
+{
+	uint64_t start;
+	int ret;
+
+	start = ft_gettime_ns();
+	while (!marker_done) {
+		ret = tm_poll_rx();
+		if (ret)
+			return ret;
+		if (stall && ft_gettime_ns() - start > TM_STALL_NS)
+			return -FI_EAGAIN;
+	}
+
+	rx_cq_cntr++;
+	return ft_post_rx(ep, rx_size, &rx_ctx);
+}
+
+static int tm_flush(void)
+{
+	int ret;
+
+	marker_done = false;
+	ret = tm_send(TM_CTRL_TAG);
+	if (ret)
+		return ret;
+
+	return tm_wait_marker(true);
+}
+
+/*
+ * If the provider ran out of space part way through filling a queue, the
+ * entries already queued are matched and reaped so that the next case
+ * starts with empty queues.
+ */
+static int tm_drain_expected(size_t posted)
+{
+	size_t i;
+	int ret;
+
+	for (i = 0; i < posted; i++) {
+		ret = tm_send(i + 1);
+		if (ret)
+			return ret;
+	}
+	return tm_wait_rx(posted);
+}
+
+static int tm_drain_unexpected(size_t sent)
+{
+	size_t i;
+	int ret;
+
+	for (i = 0; i < sent; i++) {
+		ret = tm_recv(i, 100, i + 1);
+		if (ret)
+			return ret;
+	}
+	return tm_wait_rx(sent);
+}
+
+static int tm_expected(size_t depth, int pct, uint64_t *elapsed)
+{
+	uint64_t start;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < depth; i++) {
+		ret = tm_recv(i, pct, i + 1);
+		if (ret == -FI_EAGAIN) {
+			ret = tm_drain_expected(i);
+			return ret ? ret : -FI_EAGAIN;
+		}
+		if (ret)
+			return ret;
+	}
+
+	start = ft_gettime_ns();
+	for (i = 0; i < depth; i++) {
+		ret = tm_send(tm_tag(i, depth));
+		if (ret)
+			return ret;
+
+		ret = tm_poll_rx();
+		if (ret)
+			return ret;
+	}
+
+	ret = tm_wait_rx(depth);
+	*elapsed += ft_gettime_ns() - start;
+	return ret;
+}
+
+static int tm_unexpected(size_t depth, int pct, uint64_t *elapsed)
+{
+	uint64_t start;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < depth; i++) {
+		ret = tm_send(i + 1);
+		if (ret == -FI_EAGAIN) {
+			ret = tm_drain_unexpected(i);
+			return ret ? ret : -FI_EAGAIN;
+		}
+		if (ret)
+			return ret;
+	}
+
+	/*
+	 * Messages are ordered, so the marker arrives after all of them.
+	 * Providers that leave unexpected messages in the network once
+	 * their queue is full never deliver it.
+	 */
+	ret = tm_flush();
+	if (ret == -FI_EAGAIN) {
+		ret = tm_drain_unexpected(depth);
+		if (!ret)
+			ret = tm_wait_marker(false);
+		return ret ? ret : -FI_EAGAIN;
+	}
+	if (ret)
+		return ret;
+
+	start = ft_gettime_ns();
+	for (i = 0; i < depth; i++) {
+		ret = tm_recv(i, pct, tm_tag(i, depth));
+		if (ret)
+			return ret;
+
+		ret = tm_poll_rx();
+		if (ret)
+			return ret;
+	}
+
+	ret = tm_wait_rx(depth);
+	*elapsed += ft_gettime_ns() - start;
+	return ret;
+}
+
+static void tm_print(int tm_case, int pct, size_t depth, size_t reps,
+		     uint64_t elapsed)
+{
+	double usec = elapsed / 1000.0 / (depth * reps);
+
+	if (opts.machr) {
+		if (elapsed)
+			printf("\"%s %d%% wildcard %zu\": %f\n",
+			       tm_case_names[tm_case], pct, depth, usec);
+		else
+			printf("\"%s %d%% wildcard %zu\": n/a\n",
+			       tm_case_names[tm_case], pct, depth);
+		return;
+	}
+
+	printf("%-12s%-10d%-10zu%-8zu", tm_case_names[tm_case], pct, depth,
+	       reps);
+	if (elapsed)
+		printf("%12.3f\n", usec);
+	else
+		printf("%12s\n", "n/a");
+}
+
+static int tm_run(int tm_case, int pct, size_t depth)
+{
+	uint64_t elapsed = 0;
+	size_t i, reps;
+	int ret;
+
+	reps = MAX(1, opts.iterations / depth);
+	if (depth > case_limit[tm_case])
+		goto out;
+
+	for (i = 0; i < reps; i++) {
+		rx_done = 0;
+		ret = tm_case == TM_EXPECTED ?
+		      tm_expected(depth, pct, &elapsed) :
+		      tm_unexpected(depth, pct, &elapsed);
+		if (ret == -FI_EAGAIN) {
+			case_limit[tm_case] = depth - 1;
+			elapsed = 0;
+			break;
+		}
+		if (ret)
+			return ret;
+	}
+out:
+	tm_print(tm_case, pct, depth, reps, elapsed);
+	return 0;
+}
+
+static int tm_init(void)
+{
+	int ret;
+
+	/* Directed receives are optional, wildcard ones are always run. */
+	hints->caps |= FI_DIRECTED_RECV;
+	ret = ft_getinfo(hints, &fi);
+	if (ret == -FI_ENODATA && wildcard_pct < 0) {
+		hints->caps &= ~FI_DIRECTED_RECV;
+		wildcard_pct = 100;
+		ret = ft_getinfo(hints, &fi);
+	}
+	if (ret)
+		return ret;
+
+	if (msg_size > fi->tx_attr->inject_size) {
+		FT_ERR("message size %zu exceeds inject size %zu", msg_size,
+		       fi->tx_attr->inject_size);
+		return -FI_EINVAL;
+	}
+
+	tm_ctx = calloc(max_depth, sizeof(*tm_ctx));
+	if (!tm_ctx)
+		return -FI_ENOMEM;
+
+	ret = ft_open_fabric_res();
+	if (ret)
+		return ret;
+
+	/* Completions are read in batches of fi_cq_tagged_entry. */
+	cq_attr.format = FI_CQ_FORMAT_TAGGED;
+	ret = ft_alloc_active_res(fi);
+	if (ret)
+		return ret;
+
+	ret = ft_enable_ep_recv();
+	if (ret)
+		return ret;
+
+	opts.dst_addr = fi->src_addr;
+	fi->dest_addr = fi->src_addr;
+	fi->dest_addrlen = fi->src_addrlen;
+	ret = ft_init_av();
+	fi->dest_addr = NULL;
+	fi->dest_addrlen = 0;
+	return ret;
+}
+
+static int run(void)
+{
+	size_t depth;
+	int tm_case, pct;
+	int ret;
+
+	for (tm_case = 0; tm_case < TM_CASE_CNT; tm_case++)
+		case_limit[tm_case] = SIZE_MAX;
+
+	ret = tm_init();
+	if (ret)
+		return ret;
+
+	if (opts.machr) {
+		printf("---\n");
+	} else {
+		printf("%-12s%-10s%-10s%-8s%12s\n", "case", "wildcard",
+		       "depth", "reps", "usec/msg");
+	}
+
+	for (tm_case = 0; tm_case < TM_CASE_CNT; tm_case++) {
+		for (pct = wildcard_pct < 0 ? 0 : wildcard_pct; pct <= 100;
+		     pct += 100) {
+			for (depth = 1;; depth = MIN(depth * 10, max_depth)) {
+				ret = tm_run(tm_case, pct, depth);
+				if (ret)
+					return ret;
+				if (depth == max_depth)
+					break;
+			}
+			if (wildcard_pct >= 0)
+				break;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	opts.src_addr = "127.0.0.1";
+	hints->caps = FI_LOCAL_COMM | FI_TAGGED;
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->mode = FI_CONTEXT | FI_CONTEXT2;
+	hints->domain_attr->resource_mgmt = FI_RM_ENABLED;
+	hints->tx_attr->msg_order = FI_ORDER_SAS;
+	hints->rx_attr->msg_order = FI_ORDER_SAS;
+
+	while ((op = getopt(argc, argv, "hN:x:o:" CS_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		case 'N':
+			max_depth = strtoul(optarg, NULL, 0);
+			break;
+		case 'x':
+			wildcard_pct = atoi(optarg);
+			break;
+		case 'o':
+			if (!strcasecmp(optarg, "fifo")) {
+				fifo = true;
+			} else if (strcasecmp(optarg, "reverse")) {
+				FT_ERR("unknown order %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case '?':
+		case 'h':
+			ft_usage(argv[0], "Tag matching queue depth benchmark.");
+			FT_PRINT_OPTS_USAGE("-N <depth>",
+				"largest matching queue depth (default 100000)");
+			FT_PRINT_OPTS_USAGE("-x <percent>",
+				"percentage of wildcard receives "
+				"(default: run 0 and 100)");
+			FT_PRINT_OPTS_USAGE("-o <fifo|reverse>",
+				"order in which queued entries are matched "
+				"(default: reverse)");
+			FT_PRINT_OPTS_USAGE("-I <iterations>",
+				"messages matched per queue depth (default 1000)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!max_depth || max_depth >= TM_CTRL_TAG || wildcard_pct > 100) {
+		FT_ERR("invalid queue depth or wildcard percentage");
+		return EXIT_FAILURE;
+	}
+
+	if (opts.options & FT_OPT_SIZE)
+		msg_size = opts.transfer_size;
+
+	ft_tag = TM_CTRL_TAG;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	ret = run();
+
+	free(tm_ctx);
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -12,3 +12,9 @@ def test_av_xfer(cmdline_args, endpoint_type):
     from common import ClientServerTest
     test = ClientServerTest(cmdline_args, "fi_av_xfer -e " + endpoint_type)
     test.run()
+
+@pytest.mark.unit
+def test_av_bench(cmdline_args):
+    from common import UnitTest
+    test = UnitTest(cmdline_args, "fi_av_bench -N 10000 -I 100")
+    test.run()
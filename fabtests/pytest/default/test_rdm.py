@@ -87,4 +87,9 @@ def test_rdm_tagged_bw(cmdline_args, iteration_type, datacheck_type, completion_
                             completion_semantic, datacheck_type=datacheck_type)
     test.run()
 
-
+@pytest.mark.parametrize("pair_type", ["", "-T", "-X"])
+def test_rdm_msg_rate(cmdline_args, pair_type):
+    from common import ClientServerTest
+    test = ClientServerTest(cmdline_args,
+                            "fi_rdm_msg_rate -n 2 -I 100 " + pair_type)
+    test.run()
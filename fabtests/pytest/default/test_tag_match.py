@@ -0,0 +1,7 @@
+import pytest
+
+@pytest.mark.unit
+def test_rdm_tag_match(cmdline_args):
+    from common import UnitTest
+    test = UnitTest(cmdline_args, "fi_rdm_tag_match -N 1000 -I 100")
+    test.run()
@@ -232,6 +232,8 @@ standard_tests=(
 	"fi_rdm_tagged_bw -U"
 	"fi_rdm_tagged_bw -v"
 	"fi_rdm_tagged_bw -v -U"
+	"fi_rdm_msg_rate -n 2 -I 100"
+	"fi_rdm_msg_rate -n 2 -T -I 100"
 	"fi_dgram_pingpong"
 	"fi_dgram_pingpong -k"
 )
@@ -246,6 +248,8 @@ unit_tests=(
 	"fi_mr_test"
 	"fi_cntr_test"
 	"fi_setopt_test"
+	"fi_av_bench -N 10000 -I 100"
+	"fi_rdm_tag_match -N 1000 -I 100"
 )
 
 regression_tests=(
@@ -76,6 +76,23 @@ static inline size_t ofi_ifaddr_get_speed(struct ifaddrs *ifa)
 	return 0;
 }
 
+struct fid_nic;
+
+static inline int ofi_numa_node(void)
+{
+	return -FI_ENOSYS;
+}
+
+static inline int ofi_numa_bind(void *addr, size_t len, int node)
+{
+	return -FI_ENOSYS;
+}
+
+static inline int ofi_nic_numa_node(const struct fid_nic *nic)
+{
+	return -FI_ENOSYS;
+}
+
 static inline ssize_t ofi_process_vm_readv(pid_t pid,
 			const struct iovec *local_iov,
 			unsigned long liovcnt,
@@ -92,6 +92,12 @@ static inline int ofi_hugepage_enabled(void)
 
 size_t ofi_ifaddr_get_speed(struct ifaddrs *ifa);
 
+struct fid_nic;
+
+int ofi_numa_node(void);
+int ofi_numa_bind(void *addr, size_t len, int node);
+int ofi_nic_numa_node(const struct fid_nic *nic);
+
 #ifndef __NR_process_vm_readv
 # define __NR_process_vm_readv 310
 #endif
@@ -135,17 +135,20 @@ static inline void name ## _init(struct name *aq, size_t size)	\
 static inline struct name * name ## _create(size_t size)	\
 {								\
 	struct name *aq;					\
-	aq = (struct name*) calloc(1, sizeof(*aq) +		\
+	size_t len = sizeof(*aq) +				\
 		sizeof(struct name ## _entry) *			\
-		(roundup_power_of_two(size)));			\
-	if (aq)							\
-		name ##_init(aq, roundup_power_of_two(size));	\
+		(roundup_power_of_two(size));			\
+	if (ofi_memalign((void **) &aq, OFI_CACHE_LINE_SIZE,	\
+			 len))					\
+		return NULL;					\
+	memset(aq, 0, len);					\
+	name ##_init(aq, roundup_power_of_two(size));		\
 	return aq;						\
 }								\
 								\
 static inline void name ## _free(struct name *aq)		\
 {								\
-	free(aq);						\
+	ofi_freealign(aq);					\
 }								\
 static inline int name ## _next(struct name *aq,		\
 		entrytype **buf, int64_t *pos)			\
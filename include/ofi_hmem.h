@@ -41,6 +41,7 @@
 #include <rdma/fi_domain.h>
 #include <stdbool.h>
 #include "ofi_mr.h"
+#include "ofi_mem.h"
 
 extern bool ofi_hmem_disable_p2p;
 
@@ -270,7 +271,7 @@ int synapseai_host_unregister(void *ptr);
 static inline int ofi_memcpy(uint64_t device, void *dest, const void *src,
 			     size_t size)
 {
-	memcpy(dest, src, size);
+	ofi_copy(dest, src, size);
 	return FI_SUCCESS;
 }
 
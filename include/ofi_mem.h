@@ -37,6 +37,7 @@
 #include <config.h>
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ofi.h>
@@ -327,8 +328,14 @@ enum {
 	OFI_BUFPOOL_NO_TRACK		= 1 << 2,
 	OFI_BUFPOOL_HUGEPAGES		= 1 << 3,
 	OFI_BUFPOOL_NONSHARED		= 1 << 4,
+	OFI_BUFPOOL_MAGAZINE		= 1 << 5,
+	OFI_BUFPOOL_NUMA		= 1 << 6,
 };
 
+/* ofi_bufpool_attr.numa_node: the node of the thread growing the pool */
+#define OFI_BUFPOOL_NUMA_LOCAL		(-1)
+#define OFI_BUFPOOL_MAX_NODES		64
+
 struct ofi_bufpool_region;
 
 struct ofi_bufpool_attr {
@@ -341,8 +348,39 @@ struct ofi_bufpool_attr {
 	void		(*init_fn)(struct ofi_bufpool_region *region, void *buf);
 	void 		*context;
 	int		flags;
+	size_t		magazine_size;
+	int		numa_node;
 };
 
+/*
+ * With OFI_BUFPOOL_MAGAZINE, every thread allocates from and frees to its
+ * own magazine, a stack of up to magazine_size free buffers.  Only when a
+ * magazine runs empty or full are buffers moved in bulk from or to the
+ * pool's free list, under the pool's lock.  Such pools may be used from
+ * multiple threads without the caller serializing access.  Indexed pools
+ * are not supported.
+ *
+ * A thread's magazines are kept in one array per thread, indexed by the
+ * pool's mag_id and reached through a key shared by all magazine pools.
+ */
+struct ofi_bufpool_mag {
+	struct slist			bufs;
+	size_t				cnt;
+	struct ofi_bufpool		*pool;
+	struct ofi_bufpool_mags		*mags;
+	struct dlist_entry		entry;
+};
+
+struct ofi_bufpool_mags {
+	struct dlist_entry		entry;
+	pthread_t			owner;
+	bool				active;
+	size_t				cnt;
+	struct ofi_bufpool_mag		**mag;
+};
+
+extern pthread_key_t ofi_bufpool_mag_key;
+
 struct ofi_bufpool {
 	union {
 		struct slist		entries;
@@ -357,6 +395,19 @@ struct ofi_bufpool {
 	size_t				alloc_size;
 	size_t				region_size;
 	struct ofi_bufpool_attr		attr;
+
+	size_t				mag_id;
+	pthread_mutex_t			mag_lock;
+	struct dlist_entry		mag_list;
+	/*
+	 * With OFI_BUFPOOL_NUMA, region memory is bound to numa_node.  If
+	 * the magazine pool is created with OFI_BUFPOOL_NUMA_LOCAL, each
+	 * region is bound to the node of the thread growing the pool, and
+	 * its buffers are kept on node_list[node].  Magazines are then
+	 * refilled from the list of the calling thread's node, and other
+	 * nodes' buffers are only used when the pool cannot grow.
+	 */
+	struct slist			*node_list;
 };
 
 struct ofi_bufpool_region {
@@ -368,6 +419,7 @@ struct ofi_bufpool_region {
 	void 				*context;
 	struct ofi_bufpool 		*pool;
 	int				flags;
+	int				numa_node;
 	OFI_DBG_VAR(ofi_atomic32_t,	use_cnt)
 };
 
@@ -451,16 +503,43 @@ static inline bool ofi_bufpool_ibuf_is_valid(struct ofi_bufpool *pool, size_t in
 	return ofi_buf_is_valid(buf);
 }
 
+struct ofi_bufpool_mag *ofi_bufpool_mag_fill(struct ofi_bufpool *pool);
+void ofi_bufpool_mag_put(struct ofi_bufpool *pool, void *buf);
+
+/* Returns the calling thread's magazine of the pool, if it has one */
+static inline struct ofi_bufpool_mag *ofi_bufpool_mag(struct ofi_bufpool *pool)
+{
+	struct ofi_bufpool_mags *mags;
+
+	mags = pthread_getspecific(ofi_bufpool_mag_key);
+	return mags && pool->mag_id < mags->cnt ? mags->mag[pool->mag_id] :
+						  NULL;
+}
+
 static inline void ofi_buf_free(void *buf)
 {
+	struct ofi_bufpool *pool = ofi_buf_pool(buf);
+	struct ofi_bufpool_mag *mag;
+
 	assert(ofi_atomic_dec32(&ofi_buf_region(buf)->use_cnt) >= 0);
-	assert(!(ofi_buf_pool(buf)->attr.flags & OFI_BUFPOOL_INDEXED));
+	assert(!(pool->attr.flags & OFI_BUFPOOL_INDEXED));
 	assert(ofi_buf_hdr(buf)->magic == OFI_MAGIC_SIZE_T);
 	assert(ofi_buf_hdr(buf)->ftr->magic == OFI_MAGIC_SIZE_T);
 	assert(ofi_buf_is_valid(buf));
 
+	if (pool->attr.flags & OFI_BUFPOOL_MAGAZINE) {
+		mag = ofi_bufpool_mag(pool);
+		if (OFI_UNLIKELY(!mag || mag->cnt >= pool->attr.magazine_size)) {
+			ofi_bufpool_mag_put(pool, buf);
+			return;
+		}
+		slist_insert_head(&ofi_buf_hdr(buf)->entry.slist, &mag->bufs);
+		mag->cnt++;
+		return;
+	}
+
 	slist_insert_head(&ofi_buf_hdr(buf)->entry.slist,
-			  &ofi_buf_pool(buf)->free_list.entries);
+			  &pool->free_list.entries);
 }
 
 int ofi_ibuf_is_lower(struct dlist_entry *item, const void *arg);
@@ -519,8 +598,22 @@ static inline int ofi_ibufpool_empty(struct ofi_bufpool *pool)
 static inline void *ofi_buf_alloc(struct ofi_bufpool *pool)
 {
 	struct ofi_bufpool_hdr *buf_hdr;
+	struct ofi_bufpool_mag *mag;
 
 	assert(!(pool->attr.flags & OFI_BUFPOOL_INDEXED));
+	if (pool->attr.flags & OFI_BUFPOOL_MAGAZINE) {
+		mag = ofi_bufpool_mag(pool);
+		if (OFI_UNLIKELY(!mag || !mag->cnt)) {
+			mag = ofi_bufpool_mag_fill(pool);
+			if (!mag)
+				return NULL;
+		}
+		slist_remove_head_container(&mag->bufs, struct ofi_bufpool_hdr,
+					    buf_hdr, entry.slist);
+		mag->cnt--;
+		goto out;
+	}
+
 	if (ofi_bufpool_empty(pool)) {
 		if (ofi_bufpool_grow(pool))
 			return NULL;
@@ -528,6 +621,7 @@ static inline void *ofi_buf_alloc(struct ofi_bufpool *pool)
 
 	slist_remove_head_container(&pool->free_list.entries,
 				struct ofi_bufpool_hdr, buf_hdr, entry.slist);
+out:
 	assert(ofi_atomic_inc32(&buf_hdr->region->use_cnt));
 	assert(!ofi_buf_is_valid(ofi_buf_data(buf_hdr)));
 
@@ -610,5 +704,35 @@ void ofi_pmem_init(void);
 extern uint64_t OFI_RMA_PMEM;
 extern void (*ofi_pmem_commit)(const void *addr, size_t len);
 
+/*
+ * Large copy support
+ *
+ * Copies of at least ofi_copy_nt_threshold bytes are made with a kernel
+ * that uses non-temporal stores, so that the destination, which is
+ * usually read by another process, does not evict the copying CPU's
+ * working set.  The kernel is selected at start-up based on CPU support.
+ */
+struct ofi_copy_kernel {
+	const char *name;
+	bool (*supported)(void);
+	void (*copy)(void *dest, const void *src, size_t len);
+};
+
+/* Most preferred first, terminated by an entry with a NULL name. */
+extern const struct ofi_copy_kernel ofi_copy_kernels[];
+
+void ofi_copy_init(void);
+
+extern size_t ofi_copy_nt_threshold;
+extern void (*ofi_copy_nt)(void *dest, const void *src, size_t len);
+
+static inline void ofi_copy(void *dest, const void *src, size_t len)
+{
+	if (len >= ofi_copy_nt_threshold)
+		ofi_copy_nt(dest, src, len);
+	else
+		memcpy(dest, src, len);
+}
+
 
 #endif /* _OFI_MEM_H_ */
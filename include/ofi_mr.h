@@ -151,6 +151,8 @@ struct ofi_mr_entry {
 	struct ofi_mr_info		info;
 	struct ofi_rbnode		*node;
 	int				use_cnt;
+	bool				referenced;
+	bool				coalesced;
 	struct dlist_entry		list_entry;
 	union ofi_mr_hmem_info		hmem_info;
 	uint8_t				data[];
@@ -387,12 +389,41 @@ struct ofi_mr_cache_params {
 	int				cuda_monitor_enabled;
 	int				rocr_monitor_enabled;
 	int				ze_monitor_enabled;
+	size_t				shard_cnt;
+	size_t				align;
+	int				merge;
+	size_t				reap_max;
 };
 
 extern struct ofi_mr_cache_params	cache_params;
 
 #define OFI_HMEM_MAX 6
 
+/*
+ * A sharded cache splits the address space into windows of
+ * 1 << OFI_MR_CACHE_WINDOW_SHIFT bytes.  Regions that fit in a single window are
+ * stored in the shard selected by hashing the window and peer, regions
+ * crossing a window boundary in a separate spanning shard.  Cache hits
+ * only take the shard lock for reading.  Each shard's LRU list holds all
+ * of its cached regions, in use or not; regions that were hit since the
+ * last eviction pass get a second chance.
+ */
+#define OFI_MR_CACHE_WINDOW_SHIFT	21
+#define OFI_MR_CACHE_MAX_SHARDS		32
+
+struct ofi_mr_cache_shard {
+	pthread_rwlock_t		lock;
+	struct ofi_rbmap		tree;
+	struct dlist_entry		lru_list;
+	struct dlist_entry		dead_region_list;
+	size_t				cached_cnt;
+	size_t				coalesce_cnt;
+	ofi_atomic64_t			search_cnt;
+	ofi_atomic64_t			delete_cnt;
+	ofi_atomic64_t			hit_cnt;
+	ofi_atomic64_t			coalesce_hit_cnt;
+};
+
 struct ofi_mr_cache {
 	struct util_domain		*domain;
 	const struct fi_provider	*prov;
@@ -417,6 +448,37 @@ struct ofi_mr_cache {
 	size_t				notify_cnt;
 	struct ofi_bufpool		*entry_pool;
 
+	/* Host registrations are rounded out to align bytes, if set, and
+	 * merged with the unused cached regions they overlap or adjoin, if
+	 * merge is set.  coalesce_cnt counts the regions replaced by rounded
+	 * or merged ones, and coalesce_hit_cnt the hits on those.
+	 */
+	size_t				align;
+	bool				merge;
+	size_t				coalesce_cnt;
+	size_t				coalesce_hit_cnt;
+
+	/* Regions removed while searching are deregistered by the reaper
+	 * thread, if reap_max is set.  reap_cnt counts the regions queued
+	 * or being deregistered, and is at most reap_max.
+	 */
+	size_t				reap_max;
+	size_t				reap_cnt;
+	struct dlist_entry		reap_list;
+	bool				reap_stop;
+	pthread_t			reap_thread;
+	pthread_mutex_t			reap_lock;
+	pthread_cond_t			reap_cond;
+
+	/* Set if sharded, the last shard holds regions spanning windows.
+	 * The cached and uncached counts are then protected by count_lock.
+	 */
+	struct ofi_mr_cache_shard	*shards;
+	size_t				shard_cnt;
+	ofi_spin_t			count_lock;
+	ofi_atomic32_t			dead_cnt;
+	ofi_atomic32_t			evict_pos;
+
 	int				(*add_region)(struct ofi_mr_cache *cache,
 						      struct ofi_mr_entry *entry);
 	void				(*delete_region)(struct ofi_mr_cache *cache,
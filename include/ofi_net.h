@@ -152,6 +152,8 @@ typedef struct {
 struct ofi_sockctx {
 	void *context;
 	bool uring_sqe_inuse;
+	/* receives are delivered by a multishot request into provided buffers */
+	bool uring_mshot;
 };
 
 struct ofi_sockapi_uring {
@@ -182,11 +184,33 @@ struct ofi_sockapi {
 			 struct ofi_sockctx *ctx);
 };
 
+/*
+ * Provided buffer ring - a group of equally sized receive buffers registered
+ * with an io_uring.  The kernel selects a buffer for each completion of a
+ * multishot receive and reports its index in the CQE flags.  The owner must
+ * recycle the buffer back to the ring once the data has been consumed.
+ */
+struct ofi_uring_buf_ring {
+	void *ring;
+	char *bufs;
+	size_t buf_size;
+	unsigned int count;
+	uint16_t bgid;
+};
+
+static inline void *
+ofi_uring_buf_ring_buf(struct ofi_uring_buf_ring *buf_ring, uint16_t bid)
+{
+	assert(bid < buf_ring->count);
+	return buf_ring->bufs + (size_t) bid * buf_ring->buf_size;
+}
+
 static inline void
 ofi_sockctx_init(struct ofi_sockctx *sockctx, void *context)
 {
 	sockctx->context = context;
 	sockctx->uring_sqe_inuse = false;
+	sockctx->uring_mshot = false;
 }
 
 static inline int
@@ -321,6 +345,23 @@ int ofi_sockctx_uring_cancel(struct ofi_sockapi_uring *uring,
 int ofi_sockctx_uring_poll_add(struct ofi_sockapi_uring *uring,
 			       int fd, short poll_mask, bool multishot,
 			       struct ofi_sockctx *ctx);
+int ofi_sockctx_uring_recv_multishot(struct ofi_sockapi_uring *uring,
+				     int fd, struct ofi_uring_buf_ring *buf_ring,
+				     struct ofi_sockctx *ctx);
+
+int ofi_uring_buf_ring_init(ofi_io_uring_t *io_uring,
+			    struct ofi_uring_buf_ring *buf_ring,
+			    uint16_t bgid, unsigned int count, size_t buf_size);
+void ofi_uring_buf_ring_destroy(ofi_io_uring_t *io_uring,
+				struct ofi_uring_buf_ring *buf_ring);
+void ofi_uring_buf_ring_recycle(struct ofi_uring_buf_ring *buf_ring,
+				uint16_t bid);
+
+static inline uint16_t ofi_uring_cqe_bid(ofi_io_uring_cqe_t *cqe)
+{
+	assert(cqe->flags & IORING_CQE_F_BUFFER);
+	return (uint16_t) (cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+}
 
 int ofi_uring_init(ofi_io_uring_t *io_uring, size_t entries);
 int ofi_uring_destroy(ofi_io_uring_t *io_uring);
@@ -362,7 +403,9 @@ static inline void ofi_uring_cq_advance(ofi_io_uring_t *io_uring, unsigned int c
 	io_uring_cq_advance(io_uring, count);
 }
 #else
+#define IORING_CQE_F_BUFFER	(1U << 0)
 #define IORING_CQE_F_MORE	(1U << 1)
+#define IORING_CQE_BUFFER_SHIFT	16
 
 static inline int
 ofi_sockapi_connect_uring(struct ofi_sockapi *sockapi, SOCKET sock,
@@ -427,6 +470,20 @@ ofi_sockctx_uring_poll_add(struct ofi_sockapi_uring *uring,
 	return -FI_ENOSYS;
 }
 
+static inline int
+ofi_sockctx_uring_recv_multishot(struct ofi_sockapi_uring *uring,
+				 int fd, struct ofi_uring_buf_ring *buf_ring,
+				 struct ofi_sockctx *ctx)
+{
+	return -FI_ENOSYS;
+}
+
+#define ofi_uring_buf_ring_init(io_uring, buf_ring, bgid, count, buf_size) \
+	-FI_ENOSYS
+#define ofi_uring_buf_ring_destroy(io_uring, buf_ring) do {} while(0)
+#define ofi_uring_buf_ring_recycle(buf_ring, bid) do {} while(0)
+#define ofi_uring_cqe_bid(cqe) ((uint16_t) ((cqe)->flags >> IORING_CQE_BUFFER_SHIFT))
+
 #define ofi_uring_init(io_uring, entries) -FI_ENOSYS
 #define ofi_uring_destroy(io_uring) -FI_ENOSYS
 #define ofi_uring_get_fd(io_uring) INVALID_SOCKET
@@ -216,6 +216,7 @@ int ofi_prof_init(struct util_profile *prof, struct fid *fid,
 		  uint64_t flags, void *context, struct fi_profile_ops *ops,
 		  int prov_vars_size, int prov_events_size);
 
+void ofi_prof_fini(struct util_profile *prof);
 void ofi_prof_reset(struct util_profile *prof, uint64_t flags);
 ssize_t ofi_prof_query_vars(struct util_profile *prof,
 			    struct fi_profile_desc *varlist, size_t *count);
@@ -231,6 +232,8 @@ int ofi_prof_add_var(struct util_profile *prof, uint32_t var_id,
 int ofi_prof_add_event(struct util_profile *prof, uint32_t event_id,
 		       struct fi_profile_desc *desc);
 
+extern struct fi_profile_ops ofi_prof_ops;
+
 int ofi_prof_pcb_noop(struct fid_profile *prof_fid, 
 		      struct fi_profile_desc *event, void *param,
 		      size_t size, void *context);
@@ -267,6 +267,39 @@ HOOK_DEBUG_INI ;
 #  define HOOK_DEBUG_INIT NULL
 #endif
 
+#if (HAVE_HOOK_LATENCY) && (HAVE_HOOK_LATENCY_DL)
+#  define HOOK_LATENCY_INI FI_EXT_INI
+#  define HOOK_LATENCY_INIT NULL
+#elif (HAVE_HOOK_LATENCY)
+#  define HOOK_LATENCY_INI INI_SIG(fi_hook_latency_ini)
+#  define HOOK_LATENCY_INIT fi_hook_latency_ini()
+HOOK_LATENCY_INI ;
+#else
+#  define HOOK_LATENCY_INIT NULL
+#endif
+
+#if (HAVE_HOOK_BINTRACE) && (HAVE_HOOK_BINTRACE_DL)
+#  define HOOK_BINTRACE_INI FI_EXT_INI
+#  define HOOK_BINTRACE_INIT NULL
+#elif (HAVE_HOOK_BINTRACE)
+#  define HOOK_BINTRACE_INI INI_SIG(fi_hook_bintrace_ini)
+#  define HOOK_BINTRACE_INIT fi_hook_bintrace_ini()
+HOOK_BINTRACE_INI ;
+#else
+#  define HOOK_BINTRACE_INIT NULL
+#endif
+
+#if (HAVE_HOOK_STATS) && (HAVE_HOOK_STATS_DL)
+#  define HOOK_STATS_INI FI_EXT_INI
+#  define HOOK_STATS_INIT NULL
+#elif (HAVE_HOOK_STATS)
+#  define HOOK_STATS_INI INI_SIG(fi_hook_stats_ini)
+#  define HOOK_STATS_INIT fi_hook_stats_ini()
+HOOK_STATS_INI ;
+#else
+#  define HOOK_STATS_INIT NULL
+#endif
+
 #if (HAVE_HOOK_HMEM) && (HAVE_HOOK_HMEM_DL)
 #  define HOOK_HMEM_INI FI_EXT_INI
 #  define HOOK_HMEM_INIT NULL
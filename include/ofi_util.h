@@ -59,6 +59,7 @@
 #include <ofi_mr.h>
 #include <ofi_list.h>
 #include <ofi_mem.h>
+#include <ofi_atomic_queue.h>
 #include <ofi_rbuf.h>
 #include <ofi_signal.h>
 #include <ofi_enosys.h>
@@ -144,6 +145,10 @@ enum {
 struct ofi_common_locks {
 	pthread_mutex_t ini_lock;
 	pthread_mutex_t util_fabric_lock;
+	/* guards the link between a profile and the object it monitors */
+	pthread_mutex_t prof_lock;
+	/* guards the link between a magazine and its buffer pool */
+	pthread_mutex_t bufpool_mag_lock;
 };
 
 /*
@@ -497,6 +502,14 @@ struct util_cq_aux_entry {
 
 OFI_DECLARE_CIRQUE(struct fi_cq_tagged_entry, util_comp_cirq);
 
+/* Completions written without taking the CQ lock, see ofi_cq_write_mpsc() */
+struct util_cq_mpsc_comp {
+	struct fi_cq_tagged_entry	comp;
+	fi_addr_t			src;
+};
+
+OFI_DECLARE_ATOMIC_Q(struct util_cq_mpsc_comp, util_cq_mpsc);
+
 typedef void (*ofi_cq_progress_func)(struct util_cq *cq);
 
 struct util_cq {
@@ -525,6 +538,11 @@ struct util_cq {
 	fi_addr_t		*src;
 	struct slist		aux_queue;
 	fi_cq_read_func		read_entry;
+
+	/* Optional lock-free queue in front of cirq, moved into cirq by
+	 * whoever holds cq_lock.  Only set when cq_lock is a real lock.
+	 */
+	struct util_cq_mpsc	*mpsc;
 };
 
 int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
@@ -552,6 +570,47 @@ const char *ofi_cq_strerror(struct fid_cq *cq, int prov_errno,
 int ofi_cq_write_overflow(struct util_cq *cq, void *context, uint64_t flags,
 			  size_t len, void *buf, uint64_t data, uint64_t tag,
 			  fi_addr_t src);
+void ofi_cq_drain_mpsc(struct util_cq *cq, bool wait);
+
+/* Moves completions written to the lock-free queue into cirq.  Must be
+ * called with cq_lock held before touching cirq.  Readers may stop at a
+ * slot that a writer has claimed but not yet filled.  Writers set wait,
+ * so that their own earlier completions cannot end up behind this one.
+ * The wait is bounded: if the writer of that slot stays descheduled,
+ * later completions may be reported ahead of the ones queued behind it.
+ */
+static inline void ofi_cq_drain(struct util_cq *cq, bool wait)
+{
+	if (cq->mpsc)
+		ofi_cq_drain_mpsc(cq, wait);
+}
+
+static inline bool ofi_cq_isempty(struct util_cq *cq)
+{
+	return ofi_cirque_isempty(cq->cirq) &&
+	       (!cq->mpsc ||
+		ofi_atomic_load_explicit64(&cq->mpsc->read_pos,
+					   memory_order_acquire) ==
+		ofi_atomic_load_explicit64(&cq->mpsc->write_pos,
+					   memory_order_acquire));
+}
+
+/* Providers that write cirq directly must use this instead of
+ * ofi_cirque_isfull(), since completions still in the lock-free queue
+ * will take cirq slots when drained.  Providers that write cirq under
+ * cq_lock call ofi_cq_drain() first.
+ */
+static inline bool ofi_cq_isfull(struct util_cq *cq)
+{
+	size_t pending = 0;
+
+	if (cq->mpsc)
+		pending = ofi_atomic_load_explicit64(&cq->mpsc->write_pos,
+						     memory_order_acquire) -
+			  ofi_atomic_load_explicit64(&cq->mpsc->read_pos,
+						     memory_order_acquire);
+	return ofi_cirque_usedcnt(cq->cirq) + pending >= cq->cirq->size;
+}
 
 static inline
 ssize_t ofi_cq_read_entries(struct util_cq *cq, void *buf, size_t count,
@@ -562,6 +621,7 @@ ssize_t ofi_cq_read_entries(struct util_cq *cq, void *buf, size_t count,
 	ssize_t i;
 
 	ofi_genlock_lock(&cq->cq_lock);
+	ofi_cq_drain(cq, false);
 
 	if (cq->err_data) {
 		free(cq->err_data);
@@ -640,13 +700,40 @@ ofi_cq_write_src_entry(struct util_cq *cq, void *context, uint64_t flags,
 	ofi_cq_write_entry(cq, context, flags, len, buf, data, tag);
 }
 
+static inline int
+ofi_cq_write_mpsc(struct util_cq *cq, void *context, uint64_t flags,
+		  size_t len, void *buf, uint64_t data, uint64_t tag,
+		  fi_addr_t src)
+{
+	struct util_cq_mpsc_comp *entry;
+	int64_t pos;
+
+	if (util_cq_mpsc_next(cq->mpsc, &entry, &pos))
+		return -FI_EAGAIN;
+
+	entry->comp.op_context = context;
+	entry->comp.flags = flags;
+	entry->comp.len = len;
+	entry->comp.buf = buf;
+	entry->comp.data = data;
+	entry->comp.tag = tag;
+	entry->src = src;
+	util_cq_mpsc_commit(entry, pos);
+	return 0;
+}
+
 static inline int
 ofi_cq_write(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 	     void *buf, uint64_t data, uint64_t tag)
 {
 	int ret;
 
+	if (cq->mpsc && !ofi_cq_write_mpsc(cq, context, flags, len, buf, data,
+					   tag, FI_ADDR_NOTAVAIL))
+		return 0;
+
 	ofi_genlock_lock(&cq->cq_lock);
+	ofi_cq_drain(cq, true);
 	if (ofi_cirque_freecnt(cq->cirq) > 1) {
 		ofi_cq_write_entry(cq, context, flags, len, buf, data, tag);
 		ret = 0;
@@ -664,7 +751,12 @@ ofi_cq_write_src(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 {
 	int ret;
 
+	if (cq->mpsc && !ofi_cq_write_mpsc(cq, context, flags, len, buf, data,
+					   tag, src))
+		return 0;
+
 	ofi_genlock_lock(&cq->cq_lock);
+	ofi_cq_drain(cq, true);
 	if (ofi_cirque_freecnt(cq->cirq) > 1) {
 		ofi_cq_write_src_entry(cq, context, flags, len, buf, data,
 				       tag, src);
@@ -866,7 +958,6 @@ struct util_av_set {
 
 struct util_av_entry {
 	ofi_atomic32_t	use_cnt;
-	UT_hash_handle	hh;
 	/*
 	 * data includes 'addr' and any other additional fields
 	 * associated with av_entry. 'addr' must be the first
@@ -876,6 +967,26 @@ struct util_av_entry {
 	char		data[];
 };
 
+/*
+ * Open addressing table mapping addresses to fi_addr.  Each slot has a
+ * control byte holding 7 bits of the address hash, and slots are probed
+ * a group at a time by comparing all control bytes of the group at once.
+ * Addresses up to UTIL_AV_HASH_KEY_MAX bytes are copied into the table,
+ * so that a lookup does not need to touch the AV entries.
+ */
+#define UTIL_AV_HASH_GROUP	16
+#define UTIL_AV_HASH_KEY_MAX	32
+
+struct util_av_hash {
+	int8_t			*ctrl;
+	fi_addr_t		*fi_addr;
+	char			*keys;
+	size_t			key_size;
+	size_t			size;
+	size_t			cnt;
+	size_t			used;
+};
+
 struct util_av {
 	struct fid_av		av_fid;
 	struct util_domain	*domain;
@@ -883,7 +994,7 @@ struct util_av {
 	ofi_mutex_t		lock;
 	const struct fi_provider *prov;
 
-	struct util_av_entry	*hash;
+	struct util_av_hash	hash;
 	struct ofi_bufpool	*av_entry_pool;
 
 	struct util_av_set	*av_set;
@@ -955,6 +1066,7 @@ struct rxm_av {
 	struct fid_peer_av peer_av;
 	struct fid_av *util_coll_av;
 	struct fid_av *offload_coll_av;
+	void (*insert_handler)(struct util_ep *util_ep, fi_addr_t fi_addr);
 };
 
 int rxm_util_av_open(struct fid_domain *domain_fid, struct fi_av_attr *attr,
@@ -982,6 +1094,8 @@ size_t ofi_av_size(struct util_av *av);
 int ofi_av_insert_addr_at(struct util_av *av, const void *addr, fi_addr_t fi_addr);
 int ofi_av_insert_addr(struct util_av *av, const void *addr, fi_addr_t *fi_addr);
 int ofi_av_remove_addr(struct util_av *av, fi_addr_t fi_addr);
+void ofi_av_hash_remove(struct util_av *av, struct util_av_entry *entry);
+int ofi_av_hash_reserve(struct util_av *av, size_t cnt);
 fi_addr_t ofi_av_lookup_fi_addr_unsafe(struct util_av *av, const void *addr);
 fi_addr_t ofi_av_lookup_fi_addr(struct util_av *av, const void *addr);
 
@@ -1286,6 +1400,8 @@ struct util_rx_entry {
 	uint64_t		seq_no;
 	uint64_t		ignore;
 	int			multi_recv_ref;
+	/* time queued as unexpected, only set while profiling */
+	uint64_t		unexp_ts;
 	/* extra memory allocated at the end of each entry to hold iovecs and
 	 * MR descriptors. The amount of memory is determined by the provider's
 	 * iov limit.
@@ -1295,6 +1411,7 @@ struct util_rx_entry {
 };
 
 struct util_srx_ctx;
+struct util_srx_prof;
 
 typedef void(*ofi_update_func_t)(struct util_srx_ctx *srx,
 				 struct util_rx_entry *rx_entry);
@@ -1320,6 +1437,12 @@ struct util_srx_ctx {
 	uint64_t		rx_seq_no;
 	struct slist		msg_queue;
 	struct slist		tag_queue;
+	/* Optional hash of tagged receives posted with no ignore bits,
+	 * keyed by tag and source.  Entries with ignore bits set remain
+	 * on tag_queue/src_trecv_queues, ordering is resolved by seq_no.
+	 */
+	struct slist		*tag_buckets;
+	size_t			tag_bucket_mask;
 	struct ofi_dyn_arr	src_recv_queues;
 	struct ofi_dyn_arr	src_trecv_queues;
 
@@ -1331,6 +1454,9 @@ struct util_srx_ctx {
 
 	struct ofi_bufpool	*rx_pool;
 	struct ofi_genlock	*lock;
+
+	/* allocated while a profile is open on the SRX */
+	struct util_srx_prof	*prof;
 };
 
 struct util_match_attr {
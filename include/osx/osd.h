@@ -99,6 +99,23 @@ static inline size_t ofi_ifaddr_get_speed(struct ifaddrs *ifa)
 	return 0;
 }
 
+struct fid_nic;
+
+static inline int ofi_numa_node(void)
+{
+	return -FI_ENOSYS;
+}
+
+static inline int ofi_numa_bind(void *addr, size_t len, int node)
+{
+	return -FI_ENOSYS;
+}
+
+static inline int ofi_nic_numa_node(const struct fid_nic *nic)
+{
+	return -FI_ENOSYS;
+}
+
 static inline int ofi_hugepage_enabled(void)
 {
 	return 0;
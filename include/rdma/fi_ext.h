@@ -65,6 +65,7 @@ extern "C" {
 
 #define FI_PROV_SPECIFIC_EFA   (0xefa << 16)
 #define FI_PROV_SPECIFIC_TCP   (0x7cb << 16)
+#define FI_PROV_SPECIFIC_RXM   (0x4e3 << 16)
 
 
 /* negative options are provider specific */
@@ -78,6 +79,16 @@ enum {
 	FI_OPT_EFA_WRITE_IN_ORDER_ALIGNED_128_BYTES, /* bool */
 };
 
+enum {
+	FI_OPT_RXM_PREWARM = -FI_PROV_SPECIFIC_RXM, /* struct fi_rxm_prewarm */
+};
+
+/* Peers that ofi_rxm should connect to ahead of the first transfer */
+struct fi_rxm_prewarm {
+	const fi_addr_t *fi_addr;
+	size_t count;
+};
+
 struct fi_fid_export {
 	struct fid **fid;
 	uint64_t flags;
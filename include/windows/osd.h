@@ -990,6 +990,23 @@ static inline int ofi_hugepage_enabled(void)
 	return 0;
 }
 
+struct fid_nic;
+
+static inline int ofi_numa_node(void)
+{
+	return -FI_ENOSYS;
+}
+
+static inline int ofi_numa_bind(void *addr, size_t len, int node)
+{
+	return -FI_ENOSYS;
+}
+
+static inline int ofi_nic_numa_node(const struct fid_nic *nic)
+{
+	return -FI_ENOSYS;
+}
+
 static inline int ofi_is_loopback_addr(struct sockaddr *addr) {
 	return (addr->sa_family == AF_INET &&
 		((struct sockaddr_in *)addr)->sin_addr.s_addr == htonl(INADDR_LOOPBACK)) ||
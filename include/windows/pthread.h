@@ -111,6 +111,34 @@ static inline int pthread_create(pthread_t* thread, void* attr, void *(*routine)
 	return *thread == 0;
 }
 
+typedef DWORD			pthread_key_t;
+
+/*
+ * Fiber local storage runs the destructor on thread exit, like pthreads,
+ * but also for all threads when the key is deleted.
+ */
+static inline int pthread_key_create(pthread_key_t *key,
+				     void (*destructor)(void *))
+{
+	*key = FlsAlloc((PFLS_CALLBACK_FUNCTION) destructor);
+	return *key == FLS_OUT_OF_INDEXES ? EAGAIN : 0;
+}
+
+static inline int pthread_key_delete(pthread_key_t key)
+{
+	return FlsFree(key) ? 0 : EINVAL;
+}
+
+static inline void *pthread_getspecific(pthread_key_t key)
+{
+	return FlsGetValue(key);
+}
+
+static inline int pthread_setspecific(pthread_key_t key, const void *value)
+{
+	return FlsSetValue(key, (PVOID) value) ? 0 : ENOMEM;
+}
+
 static inline int pthread_equal(pthread_t t1, pthread_t t2)
 {
 	(void)t1;
@@ -139,6 +139,7 @@ EFA_INI
 #if HAVE_EFA_DL
 	ofi_mem_init();
 	ofi_hmem_init();
+	ofi_copy_init();
 	ofi_monitors_init();
 #endif
 	int err;
@@ -0,0 +1,16 @@
+dnl Configury specific to the libfabrics binary trace hooking provider
+
+dnl Called to configure this provider
+dnl
+dnl Arguments:
+dnl
+dnl $1: action if configured successfully
+dnl $2: action if not configured successfully
+dnl
+
+AC_DEFUN([FI_HOOK_BINTRACE_CONFIGURE],[
+    # Determine if we can support the binary trace hooking provider
+    hook_bintrace_happy=0
+    AS_IF([test x"$enable_hook_bintrace" != x"no"], [hook_bintrace_happy=1])
+    AS_IF([test $hook_bintrace_happy -eq 1], [$1], [$2])
+])
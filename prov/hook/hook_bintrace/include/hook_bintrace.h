@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL); Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _HOOK_BINTRACE_H_
+#define _HOOK_BINTRACE_H_
+
+#include <stdint.h>
+
+/*
+ * Trace file format, shared with the fi_bintrace decoder.
+ *
+ * The file starts with a header page, followed by one ring per traced
+ * thread.  Each ring is written by its thread only, and holds the most
+ * recent ring_events events, a power of two.  The ring head counts every
+ * event written to the ring, and is updated after the event itself.
+ */
+#define BT_MAGIC		0x6563617274696662ULL	/* "bfitrace" */
+#define BT_VERSION		1
+#define BT_HDR_SIZE		4096
+
+/*
+ * Operations that generate a completion are listed first, followed by
+ * the injects and the CQ calls.  bt_cq_comp records a completion
+ * returned by a CQ read, rather than a call.
+ */
+#define BT_APIS(DECL)			\
+	DECL(bt_fi_recv),		\
+	DECL(bt_fi_recvv),		\
+	DECL(bt_fi_recvmsg),		\
+	DECL(bt_fi_send),		\
+	DECL(bt_fi_sendv),		\
+	DECL(bt_fi_sendmsg),		\
+	DECL(bt_fi_senddata),		\
+	DECL(bt_fi_trecv),		\
+	DECL(bt_fi_trecvv),		\
+	DECL(bt_fi_trecvmsg),		\
+	DECL(bt_fi_tsend),		\
+	DECL(bt_fi_tsendv),		\
+	DECL(bt_fi_tsendmsg),		\
+	DECL(bt_fi_tsenddata),		\
+	DECL(bt_fi_read),		\
+	DECL(bt_fi_readv),		\
+	DECL(bt_fi_readmsg),		\
+	DECL(bt_fi_write),		\
+	DECL(bt_fi_writev),		\
+	DECL(bt_fi_writemsg),		\
+	DECL(bt_fi_writedata),		\
+	DECL(bt_fi_atomic),		\
+	DECL(bt_fi_atomicv),		\
+	DECL(bt_fi_atomicmsg),		\
+	DECL(bt_fi_fetch_atomic),	\
+	DECL(bt_fi_fetch_atomicv),	\
+	DECL(bt_fi_fetch_atomicmsg),	\
+	DECL(bt_fi_compare_atomic),	\
+	DECL(bt_fi_compare_atomicv),	\
+	DECL(bt_fi_compare_atomicmsg),	\
+	DECL(bt_fi_inject),		\
+	DECL(bt_fi_injectdata),		\
+	DECL(bt_fi_tinject),		\
+	DECL(bt_fi_tinjectdata),	\
+	DECL(bt_fi_inject_write),	\
+	DECL(bt_fi_inject_writedata),	\
+	DECL(bt_fi_inject_atomic),	\
+	DECL(bt_fi_cq_read),		\
+	DECL(bt_fi_cq_readfrom),	\
+	DECL(bt_fi_cq_readerr),		\
+	DECL(bt_fi_cq_sread),		\
+	DECL(bt_fi_cq_sreadfrom),	\
+	DECL(bt_cq_comp),		\
+	DECL(bt_api_max)
+
+#define BT_ENUM_VAL(X) X
+enum bt_api {
+	BT_APIS(BT_ENUM_VAL)
+};
+
+static inline int bt_api_posted(uint32_t api)
+{
+	return api < bt_fi_inject;
+}
+
+/*
+ * Timestamps are in ticks of the CPU timestamp counter where available,
+ * and in nanoseconds otherwise.  The header holds two pairs of tick and
+ * nanosecond readings, used to convert between them.
+ */
+struct bt_hdr {
+	uint64_t	magic;
+	uint32_t	version;
+	uint32_t	event_size;
+	uint32_t	ring_cnt;
+	uint32_t	ring_used;
+	uint64_t	ring_events;
+	uint64_t	ticks[2];
+	uint64_t	ns[2];
+	uint64_t	dropped;
+	int32_t		pid;
+};
+
+struct bt_ring {
+	uint64_t	head;
+	int32_t		tid;
+	uint8_t		pad[52];
+};
+
+/*
+ * One event per call.  For calls, fid is the endpoint or CQ used, and ret
+ * the return value.  For completions, ret is 0 or the negative error code.
+ */
+struct bt_event {
+	uint64_t	start;
+	uint64_t	end;
+	uint64_t	fid;
+	uint64_t	context;
+	uint64_t	len;
+	uint64_t	tag;
+	int64_t		ret;
+	uint32_t	api;
+	uint32_t	rsvd;
+};
+
+static inline uint64_t bt_ring_size(const struct bt_hdr *hdr)
+{
+	return sizeof(struct bt_ring) +
+	       hdr->ring_events * sizeof(struct bt_event);
+}
+
+static inline struct bt_ring *bt_ring(const struct bt_hdr *hdr, uint32_t i)
+{
+	return (struct bt_ring *) ((char *) hdr + BT_HDR_SIZE +
+				   i * bt_ring_size(hdr));
+}
+
+static inline struct bt_event *
+bt_ring_event(const struct bt_hdr *hdr, struct bt_ring *ring, uint64_t seq)
+{
+	return (struct bt_event *) (ring + 1) + (seq & (hdr->ring_events - 1));
+}
+
+#endif /* _HOOK_BINTRACE_H_ */
@@ -0,0 +1,1110 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL); Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "ofi_hook.h"
+#include "ofi_prov.h"
+#include "ofi_iov.h"
+#include "ofi_atomic.h"
+#include "hook_prov.h"
+
+#include "hook_bintrace.h"
+
+struct hook_prov_ctx hook_bintrace_prov_ctx;
+
+static char *bt_file = "fi_bintrace";
+static size_t bt_events = 1 << 20;
+static size_t bt_threads = 16;
+
+static pthread_mutex_t bt_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t bt_key;
+static struct bt_hdr *bt_hdr;
+static size_t bt_map_size;
+static bool bt_opened;
+
+/* Marks threads that found no free ring */
+static struct bt_ring bt_no_ring;
+
+/* Rings of exited threads, reused before unclaimed ones */
+static struct bt_ring **bt_free_rings;
+static size_t bt_free_cnt;
+
+static inline uint64_t bt_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t ticks;
+
+	asm volatile("mrs %0, cntvct_el0" : "=r" (ticks));
+	return ticks;
+#else
+	return ofi_gettime_ns();
+#endif
+}
+
+static void bt_calibrate(int i)
+{
+	bt_hdr->ticks[i] = bt_ticks();
+	bt_hdr->ns[i] = ofi_gettime_ns();
+}
+
+static struct bt_ring *bt_claim_ring(void)
+{
+	struct bt_ring *ring = &bt_no_ring;
+
+	pthread_mutex_lock(&bt_lock);
+	if (bt_free_cnt) {
+		ring = bt_free_rings[--bt_free_cnt];
+		__atomic_store_n(&ring->head, 0, __ATOMIC_RELEASE);
+	} else if (bt_hdr->ring_used < bt_hdr->ring_cnt)
+		ring = bt_ring(bt_hdr, bt_hdr->ring_used++);
+
+	if (ring != &bt_no_ring) {
+#ifdef SYS_gettid
+		ring->tid = (int32_t) syscall(SYS_gettid);
+#else
+		ring->tid = (int32_t) (ring - bt_ring(bt_hdr, 0)) + 1;
+#endif
+		/* Refresh the conversion, in case the process is killed */
+		bt_calibrate(1);
+	}
+	pthread_mutex_unlock(&bt_lock);
+
+	pthread_setspecific(bt_key, ring);
+	return ring;
+}
+
+/*
+ * Runs on thread exit.  The ring keeps the events of the exited thread
+ * until it is handed to a new thread, which starts it over.
+ */
+static void bt_release_ring(void *arg)
+{
+	struct bt_ring *ring = arg;
+
+	if (ring == &bt_no_ring)
+		return;
+
+	pthread_mutex_lock(&bt_lock);
+	if (bt_hdr)
+		bt_free_rings[bt_free_cnt++] = ring;
+	pthread_mutex_unlock(&bt_lock);
+}
+
+static inline void
+bt_record(uint32_t api, uint64_t start, uint64_t end, const void *fid,
+	  const void *context, size_t len, uint64_t tag, int64_t ret)
+{
+	struct bt_ring *ring;
+	struct bt_event *event;
+
+	if (!bt_hdr)
+		return;
+
+	ring = pthread_getspecific(bt_key);
+	if (OFI_UNLIKELY(!ring))
+		ring = bt_claim_ring();
+	if (OFI_UNLIKELY(ring == &bt_no_ring)) {
+		__atomic_fetch_add(&bt_hdr->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	event = bt_ring_event(bt_hdr, ring, ring->head);
+	event->start = start;
+	event->end = end;
+	event->fid = (uintptr_t) fid;
+	event->context = (uintptr_t) context;
+	event->len = len;
+	event->tag = tag;
+	event->ret = ret;
+	event->api = api;
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+static inline void
+bt_call(uint32_t api, uint64_t start, const void *fid, const void *context,
+	size_t len, uint64_t tag, int64_t ret)
+{
+	bt_record(api, start, bt_ticks(), fid, context, len, tag, ret);
+}
+
+static int bt_open(struct fi_provider *hprov)
+{
+	char path[PATH_MAX];
+	uint64_t start;
+	size_t events;
+	int fd, ret;
+
+	events = roundup_power_of_two(MAX(bt_events, 1));
+	bt_map_size = BT_HDR_SIZE + bt_threads * (sizeof(struct bt_ring) +
+			events * sizeof(struct bt_event));
+
+	snprintf(path, sizeof(path), "%s.%d", bt_file, getpid());
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		ret = -errno;
+		goto err;
+	}
+
+	/* The file stays sparse until threads write to their rings */
+	if (ftruncate(fd, bt_map_size)) {
+		ret = -errno;
+		close(fd);
+		goto err;
+	}
+
+	bt_hdr = mmap(NULL, bt_map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		      fd, 0);
+	close(fd);
+	if (bt_hdr == MAP_FAILED) {
+		bt_hdr = NULL;
+		ret = -errno;
+		goto err;
+	}
+
+	bt_free_rings = calloc(bt_threads, sizeof(*bt_free_rings));
+	if (!bt_free_rings) {
+		munmap(bt_hdr, bt_map_size);
+		bt_hdr = NULL;
+		ret = -FI_ENOMEM;
+		goto err;
+	}
+
+	ret = pthread_key_create(&bt_key, bt_release_ring);
+	if (ret) {
+		free(bt_free_rings);
+		bt_free_rings = NULL;
+		munmap(bt_hdr, bt_map_size);
+		bt_hdr = NULL;
+		ret = -ret;
+		goto err;
+	}
+
+	bt_hdr->version = BT_VERSION;
+	bt_hdr->event_size = sizeof(struct bt_event);
+	bt_hdr->ring_cnt = bt_threads;
+	bt_hdr->ring_events = events;
+	bt_hdr->pid = getpid();
+
+	/* Measure the tick rate over 1ms, refined later */
+	bt_calibrate(0);
+	start = bt_hdr->ns[0];
+	while (ofi_gettime_ns() - start < 1000000)
+		;
+	bt_calibrate(1);
+
+	__atomic_store_n(&bt_hdr->magic, BT_MAGIC, __ATOMIC_RELEASE);
+	FI_INFO(hprov, FI_LOG_FABRIC, "tracing to %s\n", path);
+	return 0;
+
+err:
+	FI_WARN(hprov, FI_LOG_FABRIC, "unable to create trace file %s: %s\n",
+		path, fi_strerror(-ret));
+	return ret;
+}
+
+/*
+ * Messages
+ */
+static ssize_t
+bt_msg_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
+	    fi_addr_t src_addr, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_recv(myep->hep, buf, len, desc, src_addr, context);
+	bt_call(bt_fi_recv, start, ep, context, len, 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_msg_recvv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+	     size_t count, fi_addr_t src_addr, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_recvv(myep->hep, iov, desc, count, src_addr, context);
+	bt_call(bt_fi_recvv, start, ep, context,
+		ofi_total_iov_len(iov, count), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_msg_recvmsg(struct fid_ep *ep, const struct fi_msg *msg, uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_recvmsg(myep->hep, msg, flags);
+	bt_call(bt_fi_recvmsg, start, ep, msg->context,
+		ofi_total_iov_len(msg->msg_iov, msg->iov_count), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_msg_send(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+	    fi_addr_t dest_addr, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_send(myep->hep, buf, len, desc, dest_addr, context);
+	bt_call(bt_fi_send, start, ep, context, len, 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_msg_sendv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+	     size_t count, fi_addr_t dest_addr, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_sendv(myep->hep, iov, desc, count, dest_addr, context);
+	bt_call(bt_fi_sendv, start, ep, context,
+		ofi_total_iov_len(iov, count), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_msg_sendmsg(struct fid_ep *ep, const struct fi_msg *msg, uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_sendmsg(myep->hep, msg, flags);
+	bt_call(bt_fi_sendmsg, start, ep, msg->context,
+		ofi_total_iov_len(msg->msg_iov, msg->iov_count), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_msg_inject(struct fid_ep *ep, const void *buf, size_t len,
+	      fi_addr_t dest_addr)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_inject(myep->hep, buf, len, dest_addr);
+	bt_call(bt_fi_inject, start, ep, NULL, len, 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_msg_senddata(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+		uint64_t data, fi_addr_t dest_addr, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_senddata(myep->hep, buf, len, desc, data, dest_addr, context);
+	bt_call(bt_fi_senddata, start, ep, context, len, 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_msg_injectdata(struct fid_ep *ep, const void *buf, size_t len,
+		  uint64_t data, fi_addr_t dest_addr)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_injectdata(myep->hep, buf, len, data, dest_addr);
+	bt_call(bt_fi_injectdata, start, ep, NULL, len, 0, ret);
+	return ret;
+}
+
+static struct fi_ops_msg bt_msg_ops = {
+	.size = sizeof(struct fi_ops_msg),
+	.recv = bt_msg_recv,
+	.recvv = bt_msg_recvv,
+	.recvmsg = bt_msg_recvmsg,
+	.send = bt_msg_send,
+	.sendv = bt_msg_sendv,
+	.sendmsg = bt_msg_sendmsg,
+	.inject = bt_msg_inject,
+	.senddata = bt_msg_senddata,
+	.injectdata = bt_msg_injectdata,
+};
+
+/*
+ * Tagged messages
+ */
+static ssize_t
+bt_tagged_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
+	       fi_addr_t src_addr, uint64_t tag, uint64_t ignore,
+	       void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_trecv(myep->hep, buf, len, desc, src_addr, tag, ignore,
+		       context);
+	bt_call(bt_fi_trecv, start, ep, context, len, tag, ret);
+	return ret;
+}
+
+static ssize_t
+bt_tagged_recvv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+		size_t count, fi_addr_t src_addr, uint64_t tag,
+		uint64_t ignore, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_trecvv(myep->hep, iov, desc, count, src_addr, tag, ignore,
+			context);
+	bt_call(bt_fi_trecvv, start, ep, context,
+		ofi_total_iov_len(iov, count), tag, ret);
+	return ret;
+}
+
+static ssize_t
+bt_tagged_recvmsg(struct fid_ep *ep, const struct fi_msg_tagged *msg,
+		  uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_trecvmsg(myep->hep, msg, flags);
+	bt_call(bt_fi_trecvmsg, start, ep, msg->context,
+		ofi_total_iov_len(msg->msg_iov, msg->iov_count), msg->tag,
+		ret);
+	return ret;
+}
+
+static ssize_t
+bt_tagged_send(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+	       fi_addr_t dest_addr, uint64_t tag, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_tsend(myep->hep, buf, len, desc, dest_addr, tag, context);
+	bt_call(bt_fi_tsend, start, ep, context, len, tag, ret);
+	return ret;
+}
+
+static ssize_t
+bt_tagged_sendv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+		size_t count, fi_addr_t dest_addr, uint64_t tag,
+		void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_tsendv(myep->hep, iov, desc, count, dest_addr, tag, context);
+	bt_call(bt_fi_tsendv, start, ep, context,
+		ofi_total_iov_len(iov, count), tag, ret);
+	return ret;
+}
+
+static ssize_t
+bt_tagged_sendmsg(struct fid_ep *ep, const struct fi_msg_tagged *msg,
+		  uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_tsendmsg(myep->hep, msg, flags);
+	bt_call(bt_fi_tsendmsg, start, ep, msg->context,
+		ofi_total_iov_len(msg->msg_iov, msg->iov_count), msg->tag,
+		ret);
+	return ret;
+}
+
+static ssize_t
+bt_tagged_inject(struct fid_ep *ep, const void *buf, size_t len,
+		 fi_addr_t dest_addr, uint64_t tag)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_tinject(myep->hep, buf, len, dest_addr, tag);
+	bt_call(bt_fi_tinject, start, ep, NULL, len, tag, ret);
+	return ret;
+}
+
+static ssize_t
+bt_tagged_senddata(struct fid_ep *ep, const void *buf, size_t len,
+		   void *desc, uint64_t data, fi_addr_t dest_addr,
+		   uint64_t tag, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_tsenddata(myep->hep, buf, len, desc, data, dest_addr, tag,
+			   context);
+	bt_call(bt_fi_tsenddata, start, ep, context, len, tag, ret);
+	return ret;
+}
+
+static ssize_t
+bt_tagged_injectdata(struct fid_ep *ep, const void *buf, size_t len,
+		     uint64_t data, fi_addr_t dest_addr, uint64_t tag)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_tinjectdata(myep->hep, buf, len, data, dest_addr, tag);
+	bt_call(bt_fi_tinjectdata, start, ep, NULL, len, tag, ret);
+	return ret;
+}
+
+static struct fi_ops_tagged bt_tagged_ops = {
+	.size = sizeof(struct fi_ops_tagged),
+	.recv = bt_tagged_recv,
+	.recvv = bt_tagged_recvv,
+	.recvmsg = bt_tagged_recvmsg,
+	.send = bt_tagged_send,
+	.sendv = bt_tagged_sendv,
+	.sendmsg = bt_tagged_sendmsg,
+	.inject = bt_tagged_inject,
+	.senddata = bt_tagged_senddata,
+	.injectdata = bt_tagged_injectdata,
+};
+
+/*
+ * RMA
+ */
+static ssize_t
+bt_rma_read(struct fid_ep *ep, void *buf, size_t len, void *desc,
+	    fi_addr_t src_addr, uint64_t addr, uint64_t key, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_read(myep->hep, buf, len, desc, src_addr, addr, key, context);
+	bt_call(bt_fi_read, start, ep, context, len, 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_rma_readv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+	     size_t count, fi_addr_t src_addr, uint64_t addr, uint64_t key,
+	     void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_readv(myep->hep, iov, desc, count, src_addr, addr, key,
+		       context);
+	bt_call(bt_fi_readv, start, ep, context,
+		ofi_total_iov_len(iov, count), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_rma_readmsg(struct fid_ep *ep, const struct fi_msg_rma *msg,
+	       uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_readmsg(myep->hep, msg, flags);
+	bt_call(bt_fi_readmsg, start, ep, msg->context,
+		ofi_total_iov_len(msg->msg_iov, msg->iov_count), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_rma_write(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+	     fi_addr_t dest_addr, uint64_t addr, uint64_t key, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_write(myep->hep, buf, len, desc, dest_addr, addr, key,
+		       context);
+	bt_call(bt_fi_write, start, ep, context, len, 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_rma_writev(struct fid_ep *ep, const struct iovec *iov, void **desc,
+	      size_t count, fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+	      void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_writev(myep->hep, iov, desc, count, dest_addr, addr, key,
+			context);
+	bt_call(bt_fi_writev, start, ep, context,
+		ofi_total_iov_len(iov, count), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_rma_writemsg(struct fid_ep *ep, const struct fi_msg_rma *msg,
+		uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_writemsg(myep->hep, msg, flags);
+	bt_call(bt_fi_writemsg, start, ep, msg->context,
+		ofi_total_iov_len(msg->msg_iov, msg->iov_count), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_rma_inject(struct fid_ep *ep, const void *buf, size_t len,
+	      fi_addr_t dest_addr, uint64_t addr, uint64_t key)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_inject_write(myep->hep, buf, len, dest_addr, addr, key);
+	bt_call(bt_fi_inject_write, start, ep, NULL, len, 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_rma_writedata(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+		 uint64_t data, fi_addr_t dest_addr, uint64_t addr,
+		 uint64_t key, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_writedata(myep->hep, buf, len, desc, data, dest_addr, addr,
+			   key, context);
+	bt_call(bt_fi_writedata, start, ep, context, len, 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_rma_injectdata(struct fid_ep *ep, const void *buf, size_t len,
+		  uint64_t data, fi_addr_t dest_addr, uint64_t addr,
+		  uint64_t key)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_inject_writedata(myep->hep, buf, len, data, dest_addr, addr,
+				  key);
+	bt_call(bt_fi_inject_writedata, start, ep, NULL, len, 0, ret);
+	return ret;
+}
+
+static struct fi_ops_rma bt_rma_ops = {
+	.size = sizeof(struct fi_ops_rma),
+	.read = bt_rma_read,
+	.readv = bt_rma_readv,
+	.readmsg = bt_rma_readmsg,
+	.write = bt_rma_write,
+	.writev = bt_rma_writev,
+	.writemsg = bt_rma_writemsg,
+	.inject = bt_rma_inject,
+	.writedata = bt_rma_writedata,
+	.injectdata = bt_rma_injectdata,
+};
+
+/*
+ * Atomics
+ */
+static ssize_t
+bt_atomic_write(struct fid_ep *ep, const void *buf, size_t count,
+		void *desc, fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+		enum fi_datatype datatype, enum fi_op op, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_atomic(myep->hep, buf, count, desc, dest_addr, addr, key,
+			datatype, op, context);
+	bt_call(bt_fi_atomic, start, ep, context,
+		count * ofi_datatype_size(datatype), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_atomic_writev(struct fid_ep *ep, const struct fi_ioc *iov, void **desc,
+		 size_t count, fi_addr_t dest_addr, uint64_t addr,
+		 uint64_t key, enum fi_datatype datatype, enum fi_op op,
+		 void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_atomicv(myep->hep, iov, desc, count, dest_addr, addr, key,
+			 datatype, op, context);
+	bt_call(bt_fi_atomicv, start, ep, context,
+		ofi_total_ioc_cnt(iov, count) * ofi_datatype_size(datatype),
+		0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_atomic_writemsg(struct fid_ep *ep, const struct fi_msg_atomic *msg,
+		   uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_atomicmsg(myep->hep, msg, flags);
+	bt_call(bt_fi_atomicmsg, start, ep, msg->context,
+		ofi_total_ioc_cnt(msg->msg_iov, msg->iov_count) *
+		ofi_datatype_size(msg->datatype), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_atomic_inject(struct fid_ep *ep, const void *buf, size_t count,
+		 fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+		 enum fi_datatype datatype, enum fi_op op)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_inject_atomic(myep->hep, buf, count, dest_addr, addr, key,
+			       datatype, op);
+	bt_call(bt_fi_inject_atomic, start, ep, NULL,
+		count * ofi_datatype_size(datatype), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_atomic_readwrite(struct fid_ep *ep, const void *buf, size_t count,
+		    void *desc, void *result, void *result_desc,
+		    fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+		    enum fi_datatype datatype, enum fi_op op, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_fetch_atomic(myep->hep, buf, count, desc, result,
+			      result_desc, dest_addr, addr, key, datatype, op,
+			      context);
+	bt_call(bt_fi_fetch_atomic, start, ep, context,
+		count * ofi_datatype_size(datatype), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_atomic_readwritev(struct fid_ep *ep, const struct fi_ioc *iov,
+		     void **desc, size_t count, struct fi_ioc *resultv,
+		     void **result_desc, size_t result_count,
+		     fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+		     enum fi_datatype datatype, enum fi_op op, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_fetch_atomicv(myep->hep, iov, desc, count, resultv,
+			       result_desc, result_count, dest_addr, addr, key,
+			       datatype, op, context);
+	bt_call(bt_fi_fetch_atomicv, start, ep, context,
+		ofi_total_ioc_cnt(resultv, result_count) *
+		ofi_datatype_size(datatype), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_atomic_readwritemsg(struct fid_ep *ep, const struct fi_msg_atomic *msg,
+		       struct fi_ioc *resultv, void **result_desc,
+		       size_t result_count, uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_fetch_atomicmsg(myep->hep, msg, resultv, result_desc,
+				 result_count, flags);
+	bt_call(bt_fi_fetch_atomicmsg, start, ep, msg->context,
+		ofi_total_ioc_cnt(resultv, result_count) *
+		ofi_datatype_size(msg->datatype), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_atomic_compwrite(struct fid_ep *ep, const void *buf, size_t count,
+		    void *desc, const void *compare, void *compare_desc,
+		    void *result, void *result_desc, fi_addr_t dest_addr,
+		    uint64_t addr, uint64_t key, enum fi_datatype datatype,
+		    enum fi_op op, void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_compare_atomic(myep->hep, buf, count, desc, compare,
+				compare_desc, result, result_desc, dest_addr,
+				addr, key, datatype, op, context);
+	bt_call(bt_fi_compare_atomic, start, ep, context,
+		count * ofi_datatype_size(datatype), 0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_atomic_compwritev(struct fid_ep *ep, const struct fi_ioc *iov,
+		     void **desc, size_t count, const struct fi_ioc *comparev,
+		     void **compare_desc, size_t compare_count,
+		     struct fi_ioc *resultv, void **result_desc,
+		     size_t result_count, fi_addr_t dest_addr, uint64_t addr,
+		     uint64_t key, enum fi_datatype datatype, enum fi_op op,
+		     void *context)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_compare_atomicv(myep->hep, iov, desc, count, comparev,
+				 compare_desc, compare_count, resultv,
+				 result_desc, result_count, dest_addr, addr,
+				 key, datatype, op, context);
+	bt_call(bt_fi_compare_atomicv, start, ep, context,
+		ofi_total_ioc_cnt(iov, count) * ofi_datatype_size(datatype),
+		0, ret);
+	return ret;
+}
+
+static ssize_t
+bt_atomic_compwritemsg(struct fid_ep *ep, const struct fi_msg_atomic *msg,
+		       const struct fi_ioc *comparev, void **compare_desc,
+		       size_t compare_count, struct fi_ioc *resultv,
+		       void **result_desc, size_t result_count,
+		       uint64_t flags)
+{
+	struct hook_ep *myep = container_of(ep, struct hook_ep, ep);
+	uint64_t start = bt_ticks();
+	ssize_t ret;
+
+	ret = fi_compare_atomicmsg(myep->hep, msg, comparev, compare_desc,
+				   compare_count, resultv, result_desc,
+				   result_count, flags);
+	bt_call(bt_fi_compare_atomicmsg, start, ep, msg->context,
+		ofi_total_ioc_cnt(msg->msg_iov, msg->iov_count) *
+		ofi_datatype_size(msg->datatype), 0, ret);
+	return ret;
+}
+
+static struct fi_ops_atomic bt_atomic_ops;
+
+/*
+ * CQ reads that find no completion are not recorded, so that polling
+ * does not flush the rings.
+ */
+static void bt_comps(struct hook_cq *cq, const void *buf, ssize_t count,
+		     uint64_t now)
+{
+	const struct fi_cq_tagged_entry *entry;
+	const struct fi_cq_entry *comp;
+	ssize_t i;
+
+	for (i = 0; i < count; i++) {
+		switch (cq->format) {
+		case FI_CQ_FORMAT_CONTEXT:
+			comp = (const struct fi_cq_entry *) buf + i;
+			bt_record(bt_cq_comp, now, now, cq, comp->op_context,
+				  0, 0, 0);
+			break;
+		case FI_CQ_FORMAT_MSG:
+			entry = (const struct fi_cq_tagged_entry *)
+				((const struct fi_cq_msg_entry *) buf + i);
+			bt_record(bt_cq_comp, now, now, cq, entry->op_context,
+				  entry->len, 0, 0);
+			break;
+		case FI_CQ_FORMAT_DATA:
+			entry = (const struct fi_cq_tagged_entry *)
+				((const struct fi_cq_data_entry *) buf + i);
+			bt_record(bt_cq_comp, now, now, cq, entry->op_context,
+				  entry->len, 0, 0);
+			break;
+		case FI_CQ_FORMAT_TAGGED:
+			entry = (const struct fi_cq_tagged_entry *) buf + i;
+			bt_record(bt_cq_comp, now, now, cq, entry->op_context,
+				  entry->len, entry->tag, 0);
+			break;
+		default:
+			return;
+		}
+	}
+}
+
+static ssize_t bt_cq_read(struct fid_cq *cq, void *buf, size_t count)
+{
+	struct hook_cq *mycq = container_of(cq, struct hook_cq, cq);
+	uint64_t start = bt_ticks(), end;
+	ssize_t ret;
+
+	ret = fi_cq_read(mycq->hcq, buf, count);
+	if (ret == -FI_EAGAIN)
+		return ret;
+
+	end = bt_ticks();
+	bt_record(bt_fi_cq_read, start, end, cq, NULL, count, 0, ret);
+	bt_comps(mycq, buf, ret, end);
+	return ret;
+}
+
+static ssize_t
+bt_cq_readfrom(struct fid_cq *cq, void *buf, size_t count,
+	       fi_addr_t *src_addr)
+{
+	struct hook_cq *mycq = container_of(cq, struct hook_cq, cq);
+	uint64_t start = bt_ticks(), end;
+	ssize_t ret;
+
+	ret = fi_cq_readfrom(mycq->hcq, buf, count, src_addr);
+	if (ret == -FI_EAGAIN)
+		return ret;
+
+	end = bt_ticks();
+	bt_record(bt_fi_cq_readfrom, start, end, cq, NULL, count, 0, ret);
+	bt_comps(mycq, buf, ret, end);
+	return ret;
+}
+
+static ssize_t
+bt_cq_readerr(struct fid_cq *cq, struct fi_cq_err_entry *buf,
+	      uint64_t flags)
+{
+	struct hook_cq *mycq = container_of(cq, struct hook_cq, cq);
+	uint64_t start = bt_ticks(), end;
+	ssize_t ret;
+
+	ret = fi_cq_readerr(mycq->hcq, buf, flags);
+	if (ret == -FI_EAGAIN)
+		return ret;
+
+	end = bt_ticks();
+	bt_record(bt_fi_cq_readerr, start, end, cq, NULL, 1, 0, ret);
+	if (ret > 0)
+		bt_record(bt_cq_comp, end, end, cq, buf->op_context, buf->len,
+			  buf->tag, -(int64_t) buf->err);
+	return ret;
+}
+
+static ssize_t
+bt_cq_sread(struct fid_cq *cq, void *buf, size_t count, const void *cond,
+	    int timeout)
+{
+	struct hook_cq *mycq = container_of(cq, struct hook_cq, cq);
+	uint64_t start = bt_ticks(), end;
+	ssize_t ret;
+
+	ret = fi_cq_sread(mycq->hcq, buf, count, cond, timeout);
+	if (ret == -FI_EAGAIN)
+		return ret;
+
+	end = bt_ticks();
+	bt_record(bt_fi_cq_sread, start, end, cq, NULL, count, 0, ret);
+	bt_comps(mycq, buf, ret, end);
+	return ret;
+}
+
+static ssize_t
+bt_cq_sreadfrom(struct fid_cq *cq, void *buf, size_t count,
+		fi_addr_t *src_addr, const void *cond, int timeout)
+{
+	struct hook_cq *mycq = container_of(cq, struct hook_cq, cq);
+	uint64_t start = bt_ticks(), end;
+	ssize_t ret;
+
+	ret = fi_cq_sreadfrom(mycq->hcq, buf, count, src_addr, cond,
+			      timeout);
+	if (ret == -FI_EAGAIN)
+		return ret;
+
+	end = bt_ticks();
+	bt_record(bt_fi_cq_sreadfrom, start, end, cq, NULL, count, 0, ret);
+	bt_comps(mycq, buf, ret, end);
+	return ret;
+}
+
+static struct fi_ops_cq bt_cq_ops;
+
+static int bt_ep_init(struct fid *fid)
+{
+	struct fid_ep *ep = container_of(fid, struct fid_ep, fid);
+
+	ep->msg = &bt_msg_ops;
+	ep->tagged = &bt_tagged_ops;
+	ep->rma = &bt_rma_ops;
+	ep->atomic = &bt_atomic_ops;
+	return 0;
+}
+
+static int bt_cq_init(struct fid *fid)
+{
+	struct fid_cq *cq = container_of(fid, struct fid_cq, fid);
+
+	cq->ops = &bt_cq_ops;
+	return 0;
+}
+
+static int bt_fabric(struct fi_fabric_attr *attr,
+		     struct fid_fabric **fabric, void *context)
+{
+	struct fi_provider *hprov = context;
+	struct hook_fabric *fab;
+
+	FI_TRACE(hprov, FI_LOG_FABRIC, "Installing bintrace hook\n");
+	fab = calloc(1, sizeof *fab);
+	if (!fab)
+		return -FI_ENOMEM;
+
+	/* All fabrics of the process share the trace file */
+	pthread_mutex_lock(&bt_lock);
+	if (!bt_opened) {
+		bt_open(hprov);
+		bt_opened = true;
+	}
+	pthread_mutex_unlock(&bt_lock);
+
+	hook_fabric_init(fab, HOOK_BINTRACE, attr->fabric, hprov,
+			 &hook_fid_ops, &hook_bintrace_prov_ctx);
+	*fabric = &fab->fabric;
+	return 0;
+}
+
+static void bt_cleanup(void)
+{
+	if (!bt_hdr)
+		return;
+
+	pthread_mutex_lock(&bt_lock);
+	bt_calibrate(1);
+	munmap(bt_hdr, bt_map_size);
+	bt_hdr = NULL;
+	free(bt_free_rings);
+	bt_free_rings = NULL;
+	bt_free_cnt = 0;
+	pthread_mutex_unlock(&bt_lock);
+	pthread_key_delete(bt_key);
+}
+
+struct hook_prov_ctx hook_bintrace_prov_ctx = {
+	.prov = {
+		.version = OFI_VERSION_DEF_PROV,
+		/* We're a pass-through provider, so the fi_version is always the latest */
+		.fi_version = OFI_VERSION_LATEST,
+		.name = "ofi_hook_bintrace",
+		.getinfo = NULL,
+		.fabric = bt_fabric,
+		.cleanup = bt_cleanup,
+	},
+};
+
+HOOK_BINTRACE_INI
+{
+	fi_param_define(&hook_bintrace_prov_ctx.prov, "file", FI_PARAM_STRING,
+			"Trace file, with the process id added as suffix "
+			"(default: fi_bintrace)");
+	fi_param_define(&hook_bintrace_prov_ctx.prov, "events",
+			FI_PARAM_SIZE_T,
+			"Number of events kept per thread, rounded up to a "
+			"power of two.  Older events are overwritten. "
+			"(default: 1048576)");
+	fi_param_define(&hook_bintrace_prov_ctx.prov, "threads",
+			FI_PARAM_SIZE_T,
+			"Maximum number of threads traced.  Events of "
+			"additional threads are dropped. (default: 16)");
+	fi_param_get_str(&hook_bintrace_prov_ctx.prov, "file", &bt_file);
+	fi_param_get_size_t(&hook_bintrace_prov_ctx.prov, "events",
+			    &bt_events);
+	fi_param_get_size_t(&hook_bintrace_prov_ctx.prov, "threads",
+			    &bt_threads);
+
+	bt_atomic_ops = hook_atomic_ops;
+	bt_atomic_ops.write = bt_atomic_write;
+	bt_atomic_ops.writev = bt_atomic_writev;
+	bt_atomic_ops.writemsg = bt_atomic_writemsg;
+	bt_atomic_ops.inject = bt_atomic_inject;
+	bt_atomic_ops.readwrite = bt_atomic_readwrite;
+	bt_atomic_ops.readwritev = bt_atomic_readwritev;
+	bt_atomic_ops.readwritemsg = bt_atomic_readwritemsg;
+	bt_atomic_ops.compwrite = bt_atomic_compwrite;
+	bt_atomic_ops.compwritev = bt_atomic_compwritev;
+	bt_atomic_ops.compwritemsg = bt_atomic_compwritemsg;
+
+	bt_cq_ops = hook_cq_ops;
+	bt_cq_ops.read = bt_cq_read;
+	bt_cq_ops.readfrom = bt_cq_readfrom;
+	bt_cq_ops.readerr = bt_cq_readerr;
+	bt_cq_ops.sread = bt_cq_sread;
+	bt_cq_ops.sreadfrom = bt_cq_sreadfrom;
+
+	hook_bintrace_prov_ctx.ini_fid[FI_CLASS_EP] = bt_ep_init;
+	hook_bintrace_prov_ctx.ini_fid[FI_CLASS_TX_CTX] = bt_ep_init;
+	hook_bintrace_prov_ctx.ini_fid[FI_CLASS_RX_CTX] = bt_ep_init;
+	hook_bintrace_prov_ctx.ini_fid[FI_CLASS_CQ] = bt_cq_init;
+
+	return &hook_bintrace_prov_ctx.prov;
+}
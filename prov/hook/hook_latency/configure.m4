@@ -0,0 +1,16 @@
+dnl Configury specific to the libfabrics latency hooking provider
+
+dnl Called to configure this provider
+dnl
+dnl Arguments:
+dnl
+dnl $1: action if configured successfully
+dnl $2: action if not configured successfully
+dnl
+
+AC_DEFUN([FI_HOOK_LATENCY_CONFIGURE],[
+    # Determine if we can support the latency hooking provider
+    hook_latency_happy=0
+    AS_IF([test x"$enable_hook_latency" != x"no"], [hook_latency_happy=1])
+    AS_IF([test $hook_latency_happy -eq 1], [$1], [$2])
+])
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL); Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _HOOK_LATENCY_H_
+#define _HOOK_LATENCY_H_
+
+#include "ofi_hook.h"
+#include "ofi.h"
+#include "ofi_lock.h"
+
+#define LAT_OPS(DECL)		\
+	DECL(lat_send),		\
+	DECL(lat_tsend),	\
+	DECL(lat_recv),		\
+	DECL(lat_trecv),	\
+	DECL(lat_read),		\
+	DECL(lat_write),	\
+	DECL(lat_atomic),	\
+	DECL(lat_op_max)
+
+enum lat_op {
+	LAT_OPS(OFI_ENUM_VAL)
+};
+
+/* Transfers are grouped by size: up to 64 bytes, 512, 4K, ... 16M, more */
+#define LAT_SIZE_MAX		8
+
+/*
+ * Latencies are kept in log-linear histograms: values below 2 *
+ * LAT_SUB_BUCKETS ns are exact, and every power of two above is split
+ * into LAT_SUB_BUCKETS buckets, bounding the error to 1/LAT_SUB_BUCKETS.
+ * Values of 2^LAT_MAX_BITS ns (about 18 minutes) and more share the last
+ * bucket.
+ */
+#define LAT_SUB_BITS		4
+#define LAT_SUB_BUCKETS		(1 << LAT_SUB_BITS)
+#define LAT_MAX_BITS		40
+#define LAT_BUCKETS		((LAT_MAX_BITS - LAT_SUB_BITS + 1) * \
+				 LAT_SUB_BUCKETS)
+
+struct lat_hist {
+	uint64_t	count;
+	uint64_t	sum;
+	uint64_t	min;
+	uint64_t	max;
+	uint64_t	bucket[LAT_BUCKETS];
+};
+
+void lat_hist_add(struct lat_hist *hist, uint64_t ns);
+uint64_t lat_hist_percentile(const struct lat_hist *hist, double pct);
+
+/* Posted operation, keyed by the application context */
+struct lat_entry {
+	void		*context;
+	uint64_t	start;
+	uint8_t		op;
+	uint8_t		size;
+};
+
+struct lat_table {
+	struct lat_entry	*entries;
+	size_t			size;
+	size_t			cnt;
+};
+
+struct lat_domain {
+	struct hook_domain	hook_domain;
+	enum ofi_lock_type	lock_type;
+};
+
+struct lat_cq {
+	struct hook_cq		hook_cq;
+	struct ofi_genlock	lock;
+	size_t			entry_size;
+	struct lat_table	table;
+	uint64_t		lost;
+	uint64_t		errors[lat_op_max];
+	struct lat_hist		*hist[lat_op_max][LAT_SIZE_MAX];
+	int			dump_gen;
+};
+
+struct lat_ep {
+	struct hook_ep		hook_ep;
+	struct lat_cq		*tx_cq;
+	struct lat_cq		*rx_cq;
+	uint64_t		tx_op_flags;
+	uint64_t		rx_op_flags;
+	uint64_t		tx_msg_flags;
+	uint64_t		rx_msg_flags;
+};
+
+void lat_report_init(struct fi_provider *prov);
+void lat_report(struct lat_cq *cq);
+
+#endif /* _HOOK_LATENCY_H_ */
@@ -0,0 +1,1146 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL); Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <signal.h>
+
+#include "ofi_hook.h"
+#include "ofi_prov.h"
+#include "ofi_iov.h"
+#include "ofi_atomic.h"
+#include "hook_prov.h"
+
+#include "hook_latency.h"
+
+#define LAT_TABLE_MIN	1024
+
+struct hook_prov_ctx hook_latency_prov_ctx;
+
+static int lat_signal;
+static struct sigaction lat_old_action;
+static volatile sig_atomic_t lat_dump_gen;
+
+static size_t cq_entry_size[] = {
+	[FI_CQ_FORMAT_UNSPEC] = 0,
+	[FI_CQ_FORMAT_CONTEXT] = sizeof(struct fi_cq_entry),
+	[FI_CQ_FORMAT_MSG] = sizeof(struct fi_cq_msg_entry),
+	[FI_CQ_FORMAT_DATA] = sizeof(struct fi_cq_data_entry),
+	[FI_CQ_FORMAT_TAGGED] = sizeof(struct fi_cq_tagged_entry)
+};
+
+static inline uint8_t lat_size(size_t len)
+{
+	size_t limit = 64;
+	uint8_t size = 0;
+
+	while (len > limit && size < LAT_SIZE_MAX - 1) {
+		limit <<= 3;
+		size++;
+	}
+	return size;
+}
+
+/*
+ * Posted operations are kept in an open addressing table with linear
+ * probing, keyed by their context.  Removal shifts the following entries
+ * back, so the table never holds tombstones.
+ */
+static inline size_t lat_hash(const struct lat_table *table, void *context)
+{
+	return (size_t) ((((uintptr_t) context >> 3) *
+			  0x9e3779b97f4a7c15ULL) >> 32) & (table->size - 1);
+}
+
+static bool lat_table_set(struct lat_table *table,
+			  const struct lat_entry *entry)
+{
+	size_t i;
+
+	for (i = lat_hash(table, entry->context); table->entries[i].context;
+	     i = (i + 1) & (table->size - 1)) {
+		if (table->entries[i].context == entry->context) {
+			table->entries[i] = *entry;
+			return true;
+		}
+	}
+
+	table->entries[i] = *entry;
+	table->cnt++;
+	return false;
+}
+
+static int lat_table_grow(struct lat_table *table)
+{
+	struct lat_entry *entries = table->entries;
+	size_t i, size = table->size;
+
+	table->size = size ? size * 2 : LAT_TABLE_MIN;
+	table->entries = calloc(table->size, sizeof(*table->entries));
+	if (!table->entries) {
+		table->entries = entries;
+		table->size = size;
+		return -FI_ENOMEM;
+	}
+
+	table->cnt = 0;
+	for (i = 0; i < size; i++) {
+		if (entries[i].context)
+			lat_table_set(table, &entries[i]);
+	}
+	free(entries);
+	return 0;
+}
+
+static bool lat_table_remove(struct lat_table *table, void *context,
+			     struct lat_entry *entry)
+{
+	size_t i, j, home, mask = table->size - 1;
+
+	if (!table->cnt)
+		return false;
+
+	for (i = lat_hash(table, context); table->entries[i].context != context;
+	     i = (i + 1) & mask) {
+		if (!table->entries[i].context)
+			return false;
+	}
+	*entry = table->entries[i];
+
+	for (j = (i + 1) & mask; table->entries[j].context; j = (j + 1) & mask) {
+		home = lat_hash(table, table->entries[j].context);
+		/* Move the entry up, unless its home lies in (i, j] */
+		if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+			table->entries[i] = table->entries[j];
+			i = j;
+		}
+	}
+	table->entries[i].context = NULL;
+	table->cnt--;
+	return true;
+}
+
+static void lat_signal_handler(int signum)
+{
+	lat_dump_gen++;
+}
+
+static void lat_check_dump(struct lat_cq *cq)
+{
+	if (cq->dump_gen == lat_dump_gen)
+		return;
+
+	ofi_genlock_lock(&cq->lock);
+	cq->dump_gen = lat_dump_gen;
+	lat_report(cq);
+	ofi_genlock_unlock(&cq->lock);
+}
+
+/*
+ * The operation is added to the table before it is posted, so that a
+ * completion read by another thread always finds it.
+ */
+static bool lat_start(struct lat_cq *cq, uint64_t flags, void *context,
+		      enum lat_op op, size_t len)
+{
+	struct lat_entry entry;
+
+	if (!cq || !context || !(flags & FI_COMPLETION) ||
+	    (flags & FI_MULTI_RECV))
+		return false;
+
+	entry.context = context;
+	entry.op = op;
+	entry.size = lat_size(len);
+
+	ofi_genlock_lock(&cq->lock);
+	if (cq->table.cnt * 2 >= cq->table.size &&
+	    lat_table_grow(&cq->table)) {
+		ofi_genlock_unlock(&cq->lock);
+		return false;
+	}
+
+	entry.start = ofi_gettime_ns();
+	if (lat_table_set(&cq->table, &entry))
+		cq->lost++;
+	ofi_genlock_unlock(&cq->lock);
+	return true;
+}
+
+static void lat_end(struct lat_cq *cq, bool tracked, void *context,
+		    ssize_t ret)
+{
+	struct lat_entry entry;
+
+	if (!tracked || !ret)
+		return;
+
+	ofi_genlock_lock(&cq->lock);
+	lat_table_remove(&cq->table, context, &entry);
+	ofi_genlock_unlock(&cq->lock);
+}
+
+static void lat_complete(struct lat_cq *cq, const void *buf, ssize_t count)
+{
+	const struct fi_cq_entry *comp;
+	struct lat_entry entry;
+	struct lat_hist *hist;
+	uint64_t now;
+	ssize_t i;
+
+	if (count <= 0 || !cq->table.cnt)
+		return;
+
+	now = ofi_gettime_ns();
+	ofi_genlock_lock(&cq->lock);
+	for (i = 0; i < count; i++) {
+		comp = (const struct fi_cq_entry *)
+		       ((const char *) buf + i * cq->entry_size);
+		if (!comp->op_context ||
+		    !lat_table_remove(&cq->table, comp->op_context, &entry))
+			continue;
+
+		hist = cq->hist[entry.op][entry.size];
+		if (!hist) {
+			hist = calloc(1, sizeof(*hist));
+			if (!hist)
+				continue;
+			cq->hist[entry.op][entry.size] = hist;
+		}
+		lat_hist_add(hist, now - entry.start);
+	}
+	ofi_genlock_unlock(&cq->lock);
+}
+
+/*
+ * Messages
+ */
+static ssize_t
+lat_msg_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
+	     fi_addr_t src_addr, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->rx_cq, myep->rx_op_flags, context,
+			    lat_recv, len);
+	ret = fi_recv(myep->hook_ep.hep, buf, len, desc, src_addr, context);
+	lat_end(myep->rx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_msg_recvv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+	      size_t count, fi_addr_t src_addr, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->rx_cq, myep->rx_op_flags, context,
+			    lat_recv, ofi_total_iov_len(iov, count));
+	ret = fi_recvv(myep->hook_ep.hep, iov, desc, count, src_addr, context);
+	lat_end(myep->rx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_msg_recvmsg(struct fid_ep *ep, const struct fi_msg *msg, uint64_t flags)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->rx_cq, flags | myep->rx_msg_flags,
+			    msg->context, lat_recv,
+			    ofi_total_iov_len(msg->msg_iov, msg->iov_count));
+	ret = fi_recvmsg(myep->hook_ep.hep, msg, flags);
+	lat_end(myep->rx_cq, tracked, msg->context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_msg_send(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+	     fi_addr_t dest_addr, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_send, len);
+	ret = fi_send(myep->hook_ep.hep, buf, len, desc, dest_addr, context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_msg_sendv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+	      size_t count, fi_addr_t dest_addr, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_send, ofi_total_iov_len(iov, count));
+	ret = fi_sendv(myep->hook_ep.hep, iov, desc, count, dest_addr, context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_msg_sendmsg(struct fid_ep *ep, const struct fi_msg *msg, uint64_t flags)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, flags | myep->tx_msg_flags,
+			    msg->context, lat_send,
+			    ofi_total_iov_len(msg->msg_iov, msg->iov_count));
+	ret = fi_sendmsg(myep->hook_ep.hep, msg, flags);
+	lat_end(myep->tx_cq, tracked, msg->context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_msg_senddata(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+		 uint64_t data, fi_addr_t dest_addr, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_send, len);
+	ret = fi_senddata(myep->hook_ep.hep, buf, len, desc, data, dest_addr,
+			  context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static struct fi_ops_msg lat_msg_ops;
+
+/*
+ * Tagged messages
+ */
+static ssize_t
+lat_tagged_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
+		fi_addr_t src_addr, uint64_t tag, uint64_t ignore,
+		void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->rx_cq, myep->rx_op_flags, context,
+			    lat_trecv, len);
+	ret = fi_trecv(myep->hook_ep.hep, buf, len, desc, src_addr, tag,
+		       ignore, context);
+	lat_end(myep->rx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_tagged_recvv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+		 size_t count, fi_addr_t src_addr, uint64_t tag,
+		 uint64_t ignore, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->rx_cq, myep->rx_op_flags, context,
+			    lat_trecv, ofi_total_iov_len(iov, count));
+	ret = fi_trecvv(myep->hook_ep.hep, iov, desc, count, src_addr, tag,
+			ignore, context);
+	lat_end(myep->rx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_tagged_recvmsg(struct fid_ep *ep, const struct fi_msg_tagged *msg,
+		   uint64_t flags)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	/* Peeks and claims of unexpected messages are not timed */
+	tracked = !(flags & (FI_PEEK | FI_CLAIM)) &&
+		  lat_start(myep->rx_cq, flags | myep->rx_msg_flags,
+			    msg->context, lat_trecv,
+			    ofi_total_iov_len(msg->msg_iov, msg->iov_count));
+	ret = fi_trecvmsg(myep->hook_ep.hep, msg, flags);
+	lat_end(myep->rx_cq, tracked, msg->context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_tagged_send(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+		fi_addr_t dest_addr, uint64_t tag, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_tsend, len);
+	ret = fi_tsend(myep->hook_ep.hep, buf, len, desc, dest_addr, tag,
+		       context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_tagged_sendv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+		 size_t count, fi_addr_t dest_addr, uint64_t tag,
+		 void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_tsend, ofi_total_iov_len(iov, count));
+	ret = fi_tsendv(myep->hook_ep.hep, iov, desc, count, dest_addr, tag,
+			context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_tagged_sendmsg(struct fid_ep *ep, const struct fi_msg_tagged *msg,
+		   uint64_t flags)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, flags | myep->tx_msg_flags,
+			    msg->context, lat_tsend,
+			    ofi_total_iov_len(msg->msg_iov, msg->iov_count));
+	ret = fi_tsendmsg(myep->hook_ep.hep, msg, flags);
+	lat_end(myep->tx_cq, tracked, msg->context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_tagged_senddata(struct fid_ep *ep, const void *buf, size_t len,
+		    void *desc, uint64_t data, fi_addr_t dest_addr,
+		    uint64_t tag, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_tsend, len);
+	ret = fi_tsenddata(myep->hook_ep.hep, buf, len, desc, data, dest_addr,
+			   tag, context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static struct fi_ops_tagged lat_tagged_ops;
+
+/*
+ * RMA
+ */
+static ssize_t
+lat_rma_read(struct fid_ep *ep, void *buf, size_t len, void *desc,
+	     fi_addr_t src_addr, uint64_t addr, uint64_t key, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_read, len);
+	ret = fi_read(myep->hook_ep.hep, buf, len, desc, src_addr, addr, key,
+		      context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_rma_readv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+	      size_t count, fi_addr_t src_addr, uint64_t addr, uint64_t key,
+	      void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_read, ofi_total_iov_len(iov, count));
+	ret = fi_readv(myep->hook_ep.hep, iov, desc, count, src_addr, addr,
+		       key, context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_rma_readmsg(struct fid_ep *ep, const struct fi_msg_rma *msg,
+		uint64_t flags)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, flags | myep->tx_msg_flags,
+			    msg->context, lat_read,
+			    ofi_total_iov_len(msg->msg_iov, msg->iov_count));
+	ret = fi_readmsg(myep->hook_ep.hep, msg, flags);
+	lat_end(myep->tx_cq, tracked, msg->context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_rma_write(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+	      fi_addr_t dest_addr, uint64_t addr, uint64_t key, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_write, len);
+	ret = fi_write(myep->hook_ep.hep, buf, len, desc, dest_addr, addr, key,
+		       context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_rma_writev(struct fid_ep *ep, const struct iovec *iov, void **desc,
+	       size_t count, fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+	       void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_write, ofi_total_iov_len(iov, count));
+	ret = fi_writev(myep->hook_ep.hep, iov, desc, count, dest_addr, addr,
+			key, context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_rma_writemsg(struct fid_ep *ep, const struct fi_msg_rma *msg,
+		 uint64_t flags)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, flags | myep->tx_msg_flags,
+			    msg->context, lat_write,
+			    ofi_total_iov_len(msg->msg_iov, msg->iov_count));
+	ret = fi_writemsg(myep->hook_ep.hep, msg, flags);
+	lat_end(myep->tx_cq, tracked, msg->context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_rma_writedata(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+		  uint64_t data, fi_addr_t dest_addr, uint64_t addr,
+		  uint64_t key, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_write, len);
+	ret = fi_writedata(myep->hook_ep.hep, buf, len, desc, data, dest_addr,
+			   addr, key, context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static struct fi_ops_rma lat_rma_ops;
+
+/*
+ * Atomics
+ */
+static ssize_t
+lat_atomic_write(struct fid_ep *ep, const void *buf, size_t count,
+		 void *desc, fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+		 enum fi_datatype datatype, enum fi_op op, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_atomic, count * ofi_datatype_size(datatype));
+	ret = fi_atomic(myep->hook_ep.hep, buf, count, desc, dest_addr, addr,
+			key, datatype, op, context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_atomic_writev(struct fid_ep *ep, const struct fi_ioc *iov, void **desc,
+		  size_t count, fi_addr_t dest_addr, uint64_t addr,
+		  uint64_t key, enum fi_datatype datatype, enum fi_op op,
+		  void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_atomic, ofi_total_ioc_cnt(iov, count) *
+			    ofi_datatype_size(datatype));
+	ret = fi_atomicv(myep->hook_ep.hep, iov, desc, count, dest_addr, addr,
+			 key, datatype, op, context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_atomic_writemsg(struct fid_ep *ep, const struct fi_msg_atomic *msg,
+		    uint64_t flags)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, flags | myep->tx_msg_flags,
+			    msg->context, lat_atomic,
+			    ofi_total_ioc_cnt(msg->msg_iov, msg->iov_count) *
+			    ofi_datatype_size(msg->datatype));
+	ret = fi_atomicmsg(myep->hook_ep.hep, msg, flags);
+	lat_end(myep->tx_cq, tracked, msg->context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_atomic_readwrite(struct fid_ep *ep, const void *buf, size_t count,
+		     void *desc, void *result, void *result_desc,
+		     fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+		     enum fi_datatype datatype, enum fi_op op, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_atomic, count * ofi_datatype_size(datatype));
+	ret = fi_fetch_atomic(myep->hook_ep.hep, buf, count, desc, result,
+			      result_desc, dest_addr, addr, key, datatype, op,
+			      context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_atomic_readwritev(struct fid_ep *ep, const struct fi_ioc *iov,
+		      void **desc, size_t count, struct fi_ioc *resultv,
+		      void **result_desc, size_t result_count,
+		      fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+		      enum fi_datatype datatype, enum fi_op op, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_atomic, ofi_total_ioc_cnt(resultv, result_count) *
+			    ofi_datatype_size(datatype));
+	ret = fi_fetch_atomicv(myep->hook_ep.hep, iov, desc, count, resultv,
+			       result_desc, result_count, dest_addr, addr, key,
+			       datatype, op, context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_atomic_readwritemsg(struct fid_ep *ep, const struct fi_msg_atomic *msg,
+			struct fi_ioc *resultv, void **result_desc,
+			size_t result_count, uint64_t flags)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, flags | myep->tx_msg_flags,
+			    msg->context, lat_atomic,
+			    ofi_total_ioc_cnt(resultv, result_count) *
+			    ofi_datatype_size(msg->datatype));
+	ret = fi_fetch_atomicmsg(myep->hook_ep.hep, msg, resultv, result_desc,
+				 result_count, flags);
+	lat_end(myep->tx_cq, tracked, msg->context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_atomic_compwrite(struct fid_ep *ep, const void *buf, size_t count,
+		     void *desc, const void *compare, void *compare_desc,
+		     void *result, void *result_desc, fi_addr_t dest_addr,
+		     uint64_t addr, uint64_t key, enum fi_datatype datatype,
+		     enum fi_op op, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_atomic, count * ofi_datatype_size(datatype));
+	ret = fi_compare_atomic(myep->hook_ep.hep, buf, count, desc, compare,
+				compare_desc, result, result_desc, dest_addr,
+				addr, key, datatype, op, context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_atomic_compwritev(struct fid_ep *ep, const struct fi_ioc *iov,
+		      void **desc, size_t count,
+		      const struct fi_ioc *comparev, void **compare_desc,
+		      size_t compare_count, struct fi_ioc *resultv,
+		      void **result_desc, size_t result_count,
+		      fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+		      enum fi_datatype datatype, enum fi_op op, void *context)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, myep->tx_op_flags, context,
+			    lat_atomic, ofi_total_ioc_cnt(iov, count) *
+			    ofi_datatype_size(datatype));
+	ret = fi_compare_atomicv(myep->hook_ep.hep, iov, desc, count,
+				 comparev, compare_desc, compare_count,
+				 resultv, result_desc, result_count,
+				 dest_addr, addr, key, datatype, op, context);
+	lat_end(myep->tx_cq, tracked, context, ret);
+	return ret;
+}
+
+static ssize_t
+lat_atomic_compwritemsg(struct fid_ep *ep, const struct fi_msg_atomic *msg,
+			const struct fi_ioc *comparev, void **compare_desc,
+			size_t compare_count, struct fi_ioc *resultv,
+			void **result_desc, size_t result_count,
+			uint64_t flags)
+{
+	struct lat_ep *myep = container_of(ep, struct lat_ep, hook_ep.ep);
+	bool tracked;
+	ssize_t ret;
+
+	tracked = lat_start(myep->tx_cq, flags | myep->tx_msg_flags,
+			    msg->context, lat_atomic,
+			    ofi_total_ioc_cnt(msg->msg_iov, msg->iov_count) *
+			    ofi_datatype_size(msg->datatype));
+	ret = fi_compare_atomicmsg(myep->hook_ep.hep, msg, comparev,
+				   compare_desc, compare_count, resultv,
+				   result_desc, result_count, flags);
+	lat_end(myep->tx_cq, tracked, msg->context, ret);
+	return ret;
+}
+
+static struct fi_ops_atomic lat_atomic_ops;
+
+/*
+ * CQ
+ */
+static ssize_t lat_cq_read(struct fid_cq *cq, void *buf, size_t count)
+{
+	struct lat_cq *mycq = container_of(cq, struct lat_cq, hook_cq.cq);
+	ssize_t ret;
+
+	ret = fi_cq_read(mycq->hook_cq.hcq, buf, count);
+	lat_complete(mycq, buf, ret);
+	lat_check_dump(mycq);
+	return ret;
+}
+
+static ssize_t
+lat_cq_readfrom(struct fid_cq *cq, void *buf, size_t count,
+		fi_addr_t *src_addr)
+{
+	struct lat_cq *mycq = container_of(cq, struct lat_cq, hook_cq.cq);
+	ssize_t ret;
+
+	ret = fi_cq_readfrom(mycq->hook_cq.hcq, buf, count, src_addr);
+	lat_complete(mycq, buf, ret);
+	lat_check_dump(mycq);
+	return ret;
+}
+
+static ssize_t
+lat_cq_readerr(struct fid_cq *cq, struct fi_cq_err_entry *buf,
+	       uint64_t flags)
+{
+	struct lat_cq *mycq = container_of(cq, struct lat_cq, hook_cq.cq);
+	struct lat_entry entry;
+	ssize_t ret;
+
+	ret = fi_cq_readerr(mycq->hook_cq.hcq, buf, flags);
+	if (ret > 0 && buf->op_context) {
+		ofi_genlock_lock(&mycq->lock);
+		if (lat_table_remove(&mycq->table, buf->op_context, &entry))
+			mycq->errors[entry.op]++;
+		ofi_genlock_unlock(&mycq->lock);
+	}
+	return ret;
+}
+
+static ssize_t
+lat_cq_sread(struct fid_cq *cq, void *buf, size_t count, const void *cond,
+	     int timeout)
+{
+	struct lat_cq *mycq = container_of(cq, struct lat_cq, hook_cq.cq);
+	ssize_t ret;
+
+	ret = fi_cq_sread(mycq->hook_cq.hcq, buf, count, cond, timeout);
+	lat_complete(mycq, buf, ret);
+	lat_check_dump(mycq);
+	return ret;
+}
+
+static ssize_t
+lat_cq_sreadfrom(struct fid_cq *cq, void *buf, size_t count,
+		 fi_addr_t *src_addr, const void *cond, int timeout)
+{
+	struct lat_cq *mycq = container_of(cq, struct lat_cq, hook_cq.cq);
+	ssize_t ret;
+
+	ret = fi_cq_sreadfrom(mycq->hook_cq.hcq, buf, count, src_addr, cond,
+			      timeout);
+	lat_complete(mycq, buf, ret);
+	lat_check_dump(mycq);
+	return ret;
+}
+
+static struct fi_ops_cq lat_cq_ops;
+
+static int lat_cq_close(struct fid *fid)
+{
+	struct lat_cq *mycq = container_of(fid, struct lat_cq,
+					   hook_cq.cq.fid);
+	int i, j, ret;
+
+	ret = fi_close(&mycq->hook_cq.hcq->fid);
+	if (ret)
+		return ret;
+
+	lat_report(mycq);
+	for (i = 0; i < lat_op_max; i++) {
+		for (j = 0; j < LAT_SIZE_MAX; j++)
+			free(mycq->hist[i][j]);
+	}
+	free(mycq->table.entries);
+	ofi_genlock_destroy(&mycq->lock);
+	free(mycq);
+	return 0;
+}
+
+static struct fi_ops lat_cq_fid_ops;
+
+static int
+lat_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
+	    struct fid_cq **cq, void *context)
+{
+	struct lat_domain *dom = container_of(domain, struct lat_domain,
+					      hook_domain.domain);
+	struct lat_cq *mycq;
+	int ret;
+
+	mycq = calloc(1, sizeof(*mycq));
+	if (!mycq)
+		return -FI_ENOMEM;
+
+	ret = ofi_genlock_init(&mycq->lock, dom->lock_type);
+	if (ret)
+		goto free;
+
+	ret = hook_cq_init(domain, attr, cq, context, &mycq->hook_cq);
+	if (ret)
+		goto destroy;
+
+	mycq->hook_cq.cq.fid.ops = &lat_cq_fid_ops;
+	mycq->hook_cq.cq.ops = &lat_cq_ops;
+	mycq->entry_size = cq_entry_size[mycq->hook_cq.format];
+	mycq->dump_gen = lat_dump_gen;
+	return 0;
+
+destroy:
+	ofi_genlock_destroy(&mycq->lock);
+free:
+	free(mycq);
+	return ret;
+}
+
+/*
+ * Endpoint
+ */
+static int lat_ep_bind(struct fid *fid, struct fid *bfid, uint64_t flags)
+{
+	struct lat_ep *myep = container_of(fid, struct lat_ep, hook_ep.ep.fid);
+	struct lat_cq *cq;
+	struct fid *hfid, *hbfid;
+
+	hfid = hook_to_hfid(fid);
+	hbfid = hook_to_hfid(bfid);
+	if (!hfid || !hbfid)
+		return -FI_EINVAL;
+
+	/* Completions are matched only if the CQ format has a context */
+	if (bfid->fclass == FI_CLASS_CQ) {
+		cq = container_of(bfid, struct lat_cq, hook_cq.cq.fid);
+		if (!cq->entry_size)
+			cq = NULL;
+
+		if (flags & FI_TRANSMIT) {
+			myep->tx_cq = cq;
+			if (!(flags & FI_SELECTIVE_COMPLETION)) {
+				myep->tx_op_flags |= FI_COMPLETION;
+				myep->tx_msg_flags = FI_COMPLETION;
+			}
+		}
+		if (flags & FI_RECV) {
+			myep->rx_cq = cq;
+			if (!(flags & FI_SELECTIVE_COMPLETION)) {
+				myep->rx_op_flags |= FI_COMPLETION;
+				myep->rx_msg_flags = FI_COMPLETION;
+			}
+		}
+	}
+
+	return hfid->ops->bind(hfid, hbfid, flags);
+}
+
+static struct fi_ops lat_ep_fid_ops;
+
+static int
+lat_endpoint(struct fid_domain *domain, struct fi_info *info,
+	     struct fid_ep **ep, void *context)
+{
+	struct lat_ep *myep;
+	int ret;
+
+	myep = calloc(1, sizeof(*myep));
+	if (!myep)
+		return -FI_ENOMEM;
+
+	ret = hook_endpoint_init(domain, info, ep, context, &myep->hook_ep);
+	if (ret) {
+		free(myep);
+		return ret;
+	}
+
+	myep->tx_op_flags = info->tx_attr->op_flags;
+	myep->rx_op_flags = info->rx_attr->op_flags;
+	myep->hook_ep.ep.fid.ops = &lat_ep_fid_ops;
+	myep->hook_ep.ep.msg = &lat_msg_ops;
+	myep->hook_ep.ep.tagged = &lat_tagged_ops;
+	myep->hook_ep.ep.rma = &lat_rma_ops;
+	myep->hook_ep.ep.atomic = &lat_atomic_ops;
+	return 0;
+}
+
+/*
+ * Domain
+ */
+static struct fi_ops_domain lat_domain_ops;
+
+static int
+lat_domain(struct fid_fabric *fabric, struct fi_info *info,
+	   struct fid_domain **domain, void *context)
+{
+	struct lat_domain *dom;
+	int ret;
+
+	dom = calloc(1, sizeof(*dom));
+	if (!dom)
+		return -FI_ENOMEM;
+
+	ret = hook_domain_init(fabric, info, domain, context,
+			       &dom->hook_domain);
+	if (ret) {
+		free(dom);
+		return ret;
+	}
+
+	/* A CQ and its endpoints are serialized by these threading levels */
+	dom->lock_type = info->domain_attr->threading == FI_THREAD_DOMAIN ||
+			 info->domain_attr->threading == FI_THREAD_COMPLETION ?
+			 OFI_LOCK_NOOP : OFI_LOCK_MUTEX;
+	(*domain)->ops = &lat_domain_ops;
+	return 0;
+}
+
+/*
+ * Fabric
+ */
+static struct fi_ops_fabric lat_fabric_ops;
+
+static void lat_install_signal(struct fi_provider *hprov)
+{
+	struct sigaction action = { .sa_handler = lat_signal_handler };
+	static bool installed;
+
+	if (!lat_signal || installed)
+		return;
+
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	if (sigaction(lat_signal, &action, &lat_old_action)) {
+		FI_WARN(hprov, FI_LOG_FABRIC,
+			"unable to install handler for signal %d\n", lat_signal);
+		return;
+	}
+	installed = true;
+}
+
+static int lat_fabric(struct fi_fabric_attr *attr,
+		      struct fid_fabric **fabric, void *context)
+{
+	struct fi_provider *hprov = context;
+	struct hook_fabric *fab;
+
+	FI_TRACE(hprov, FI_LOG_FABRIC, "Installing latency hook\n");
+	fab = calloc(1, sizeof *fab);
+	if (!fab)
+		return -FI_ENOMEM;
+
+	hook_fabric_init(fab, HOOK_LATENCY, attr->fabric, hprov,
+			 &hook_fid_ops, &hook_latency_prov_ctx);
+	*fabric = &fab->fabric;
+	fab->fabric.ops = &lat_fabric_ops;
+	lat_install_signal(hprov);
+	return 0;
+}
+
+static void lat_cleanup(void)
+{
+	struct sigaction action;
+
+	if (!lat_signal || sigaction(lat_signal, NULL, &action) ||
+	    action.sa_handler != lat_signal_handler)
+		return;
+
+	sigaction(lat_signal, &lat_old_action, NULL);
+}
+
+struct hook_prov_ctx hook_latency_prov_ctx = {
+	.prov = {
+		.version = OFI_VERSION_DEF_PROV,
+		/* We're a pass-through provider, so the fi_version is always the latest */
+		.fi_version = OFI_VERSION_LATEST,
+		.name = "ofi_hook_latency",
+		.getinfo = NULL,
+		.fabric = lat_fabric,
+		.cleanup = lat_cleanup,
+	},
+};
+
+HOOK_LATENCY_INI
+{
+	fi_param_define(&hook_latency_prov_ctx.prov, "signal", FI_PARAM_INT,
+			"Report the latency histograms collected so far when "
+			"the process receives this signal, for example 10 for "
+			"SIGUSR1 on Linux.  The report of each CQ is written "
+			"the next time the CQ is read.  (default: 0, disabled)");
+	fi_param_define(&hook_latency_prov_ctx.prov, "file", FI_PARAM_STRING,
+			"Append reports to this file, with the process id "
+			"added as suffix, instead of logging them at the info "
+			"level.");
+	fi_param_get_int(&hook_latency_prov_ctx.prov, "signal", &lat_signal);
+	lat_report_init(&hook_latency_prov_ctx.prov);
+
+	lat_fabric_ops = hook_fabric_ops;
+	lat_fabric_ops.domain = lat_domain;
+
+	lat_domain_ops = hook_domain_ops;
+	lat_domain_ops.cq_open = lat_cq_open;
+	lat_domain_ops.endpoint = lat_endpoint;
+
+	lat_cq_fid_ops = hook_fid_ops;
+	lat_cq_fid_ops.close = lat_cq_close;
+	lat_cq_ops = hook_cq_ops;
+	lat_cq_ops.read = lat_cq_read;
+	lat_cq_ops.readfrom = lat_cq_readfrom;
+	lat_cq_ops.readerr = lat_cq_readerr;
+	lat_cq_ops.sread = lat_cq_sread;
+	lat_cq_ops.sreadfrom = lat_cq_sreadfrom;
+
+	lat_ep_fid_ops = hook_fid_ops;
+	lat_ep_fid_ops.bind = lat_ep_bind;
+
+	lat_msg_ops = hook_msg_ops;
+	lat_msg_ops.recv = lat_msg_recv;
+	lat_msg_ops.recvv = lat_msg_recvv;
+	lat_msg_ops.recvmsg = lat_msg_recvmsg;
+	lat_msg_ops.send = lat_msg_send;
+	lat_msg_ops.sendv = lat_msg_sendv;
+	lat_msg_ops.sendmsg = lat_msg_sendmsg;
+	lat_msg_ops.senddata = lat_msg_senddata;
+
+	lat_tagged_ops = hook_tagged_ops;
+	lat_tagged_ops.recv = lat_tagged_recv;
+	lat_tagged_ops.recvv = lat_tagged_recvv;
+	lat_tagged_ops.recvmsg = lat_tagged_recvmsg;
+	lat_tagged_ops.send = lat_tagged_send;
+	lat_tagged_ops.sendv = lat_tagged_sendv;
+	lat_tagged_ops.sendmsg = lat_tagged_sendmsg;
+	lat_tagged_ops.senddata = lat_tagged_senddata;
+
+	lat_rma_ops = hook_rma_ops;
+	lat_rma_ops.read = lat_rma_read;
+	lat_rma_ops.readv = lat_rma_readv;
+	lat_rma_ops.readmsg = lat_rma_readmsg;
+	lat_rma_ops.write = lat_rma_write;
+	lat_rma_ops.writev = lat_rma_writev;
+	lat_rma_ops.writemsg = lat_rma_writemsg;
+	lat_rma_ops.writedata = lat_rma_writedata;
+
+	lat_atomic_ops = hook_atomic_ops;
+	lat_atomic_ops.write = lat_atomic_write;
+	lat_atomic_ops.writev = lat_atomic_writev;
+	lat_atomic_ops.writemsg = lat_atomic_writemsg;
+	lat_atomic_ops.readwrite = lat_atomic_readwrite;
+	lat_atomic_ops.readwritev = lat_atomic_readwritev;
+	lat_atomic_ops.readwritemsg = lat_atomic_readwritemsg;
+	lat_atomic_ops.compwrite = lat_atomic_compwrite;
+	lat_atomic_ops.compwritev = lat_atomic_compwritev;
+	lat_atomic_ops.compwritemsg = lat_atomic_compwritemsg;
+
+	return &hook_latency_prov_ctx.prov;
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL); Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "hook_latency.h"
+
+static struct fi_provider *lat_prov;
+static char *lat_file;
+static pthread_mutex_t lat_file_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char * const lat_op_names[] = {
+	LAT_OPS(OFI_STR)
+};
+
+static const char * const lat_size_names[] = {
+	"<=64", "<=512", "<=4K", "<=32K", "<=256K", "<=2M", "<=16M", ">16M"
+};
+
+static const double lat_pcts[] = { 50, 90, 99, 99.9, 99.99 };
+
+static size_t lat_hist_index(uint64_t ns)
+{
+	int msb, shift;
+
+	if (ns < 2 * LAT_SUB_BUCKETS)
+		return ns;
+
+	msb = 63 - __builtin_clzll(ns);
+	if (msb >= LAT_MAX_BITS)
+		return LAT_BUCKETS - 1;
+
+	shift = msb - LAT_SUB_BITS;
+	return ((shift + 1) << LAT_SUB_BITS) + (ns >> shift) - LAT_SUB_BUCKETS;
+}
+
+/* Largest value counted in the bucket */
+static uint64_t lat_hist_bound(size_t index)
+{
+	int shift;
+
+	if (index < 2 * LAT_SUB_BUCKETS)
+		return index;
+
+	shift = (index >> LAT_SUB_BITS) - 1;
+	return ((((index & (LAT_SUB_BUCKETS - 1)) + LAT_SUB_BUCKETS + 1) <<
+		 shift) - 1);
+}
+
+void lat_hist_add(struct lat_hist *hist, uint64_t ns)
+{
+	if (!hist->count || ns < hist->min)
+		hist->min = ns;
+	if (ns > hist->max)
+		hist->max = ns;
+	hist->count++;
+	hist->sum += ns;
+	hist->bucket[lat_hist_index(ns)]++;
+}
+
+uint64_t lat_hist_percentile(const struct lat_hist *hist, double pct)
+{
+	uint64_t target, seen = 0;
+	size_t i;
+
+	target = (uint64_t) (pct * hist->count / 100);
+	if (target < pct * hist->count / 100 || !target)
+		target++;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen >= target)
+			break;
+	}
+
+	return MAX(MIN(lat_hist_bound(i), hist->max), hist->min);
+}
+
+static void lat_print(FILE *file, const char *line)
+{
+	if (file)
+		fputs(line, file);
+	else
+		FI_INFO(lat_prov, FI_LOG_CQ, "%s", line);
+}
+
+static void lat_report_cq(struct lat_cq *cq, FILE *file)
+{
+	struct lat_hist *hist;
+	char line[256], pct[16];
+	size_t i, len;
+	int op, size;
+
+	snprintf(line, sizeof(line), "latency (ns) of CQ %p, pid %d\n",
+		 (void *) cq->hook_cq.hcq, getpid());
+	lat_print(file, line);
+
+	len = snprintf(line, sizeof(line), "%-8s %-7s %10s %10s", "op", "size",
+		       "count", "min");
+	for (i = 0; i < ARRAY_SIZE(lat_pcts); i++) {
+		snprintf(pct, sizeof(pct), "p%g", lat_pcts[i]);
+		len += snprintf(line + len, sizeof(line) - len, " %10s", pct);
+	}
+	snprintf(line + len, sizeof(line) - len, " %10s %10s\n", "max", "mean");
+	lat_print(file, line);
+
+	for (op = 0; op < lat_op_max; op++) {
+		for (size = 0; size < LAT_SIZE_MAX; size++) {
+			hist = cq->hist[op][size];
+			if (!hist || !hist->count)
+				continue;
+
+			/* Skip the "lat_" prefix */
+			len = snprintf(line, sizeof(line),
+				       "%-8s %-7s %10" PRIu64 " %10" PRIu64,
+				       lat_op_names[op] + 4,
+				       lat_size_names[size], hist->count,
+				       hist->min);
+			for (i = 0; i < ARRAY_SIZE(lat_pcts); i++)
+				len += snprintf(line + len, sizeof(line) - len,
+						" %10" PRIu64,
+						lat_hist_percentile(hist,
+							lat_pcts[i]));
+			snprintf(line + len, sizeof(line) - len,
+				 " %10" PRIu64 " %10" PRIu64 "\n", hist->max,
+				 hist->sum / hist->count);
+			lat_print(file, line);
+		}
+		if (cq->errors[op]) {
+			snprintf(line, sizeof(line), "%-8s errors %" PRIu64 "\n",
+				 lat_op_names[op] + 4, cq->errors[op]);
+			lat_print(file, line);
+		}
+	}
+
+	if (cq->lost) {
+		snprintf(line, sizeof(line), "untracked (reused context) %"
+			 PRIu64 "\n", cq->lost);
+		lat_print(file, line);
+	}
+}
+
+void lat_report(struct lat_cq *cq)
+{
+	char path[PATH_MAX];
+	FILE *file;
+
+	if (!lat_file) {
+		lat_report_cq(cq, NULL);
+		return;
+	}
+
+	snprintf(path, sizeof(path), "%s.%d", lat_file, getpid());
+	pthread_mutex_lock(&lat_file_lock);
+	file = fopen(path, "a");
+	if (file) {
+		lat_report_cq(cq, file);
+		fclose(file);
+	} else {
+		FI_WARN(lat_prov, FI_LOG_CQ, "unable to open %s\n", path);
+	}
+	pthread_mutex_unlock(&lat_file_lock);
+}
+
+void lat_report_init(struct fi_provider *prov)
+{
+	lat_prov = prov;
+	fi_param_get_str(prov, "file", &lat_file);
+}
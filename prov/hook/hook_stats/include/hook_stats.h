@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL); Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _HOOK_STATS_H_
+#define _HOOK_STATS_H_
+
+#include <stdint.h>
+
+/*
+ * Layout of the stats segment, shared with the fi_stat reader.
+ *
+ * The segment starts with a header page, followed by an array of slots,
+ * one per endpoint or CQ.  A slot is protected by a sequence lock: the
+ * publisher makes the sequence odd while updating the slot and even
+ * again afterward.  Readers copy the slot and retry if the sequence was
+ * odd or changed meanwhile.
+ */
+#define ST_MAGIC		0x7374617473696662ULL	/* "bfistats" */
+#define ST_VERSION		1
+#define ST_HDR_SIZE		4096
+#define ST_NAME_LEN		32
+#define ST_VAR_MAX		32
+
+enum st_kind {
+	ST_FREE,
+	ST_EP,
+	ST_CQ,
+};
+
+struct st_hdr {
+	uint64_t	magic;
+	uint32_t	version;
+	uint32_t	slot_cnt;
+	uint32_t	slot_size;
+	int32_t		pid;
+	uint64_t	interval_ms;
+	/* CLOCK_MONOTONIC time of the last update, in ns */
+	uint64_t	update_ns;
+	char		comm[ST_NAME_LEN];
+};
+
+struct st_var {
+	char		name[ST_NAME_LEN];
+	uint64_t	value;
+};
+
+struct st_slot {
+	uint64_t	seq;
+	uint32_t	kind;
+	uint32_t	var_cnt;
+	uint64_t	fid;
+	char		prov[ST_NAME_LEN];
+	char		domain[ST_NAME_LEN];
+	struct st_var	vars[ST_VAR_MAX];
+};
+
+static inline struct st_slot *st_slot(const struct st_hdr *hdr, uint32_t i)
+{
+	return (struct st_slot *) ((char *) hdr + ST_HDR_SIZE +
+				   (uint64_t) i * hdr->slot_size);
+}
+
+#endif /* _HOOK_STATS_H_ */
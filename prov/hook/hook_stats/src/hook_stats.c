@@ -0,0 +1,1076 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL); Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "ofi_hook.h"
+#include "ofi_prov.h"
+#include "ofi_iov.h"
+#include "ofi_atomic.h"
+#include "ofi_profile.h"
+#include "hook_prov.h"
+
+#include "hook_stats.h"
+
+/* Each transfer type has an operation and a byte counter */
+enum {
+	ST_TX_OPS,
+	ST_TX_BYTES,
+	ST_RX_OPS,
+	ST_RX_BYTES,
+	ST_RMA_OPS,
+	ST_RMA_BYTES,
+	ST_ATOMIC_OPS,
+	ST_ATOMIC_BYTES,
+	ST_EAGAIN,
+	ST_EP_CNT
+};
+
+static const char * const st_ep_names[] = {
+	"tx_ops", "tx_bytes", "rx_ops", "rx_bytes", "rma_ops", "rma_bytes",
+	"atomic_ops", "atomic_bytes", "eagain"
+};
+
+enum {
+	ST_COMPS,
+	ST_ERRORS,
+	ST_EMPTY_READS,
+	ST_CQ_CNT
+};
+
+static const char * const st_cq_names[] = {
+	"comps", "errors", "empty_reads"
+};
+
+struct st_ep {
+	struct hook_ep		hook_ep;
+	struct dlist_entry	entry;
+	struct st_slot		*slot;
+	struct fid_profile	*prof;
+	size_t			prof_cnt;
+	uint32_t		prof_ids[ST_VAR_MAX - ST_EP_CNT];
+	char			prof_names[ST_VAR_MAX - ST_EP_CNT][ST_NAME_LEN];
+	uint64_t		cnt[ST_EP_CNT];
+};
+
+struct st_cq {
+	struct hook_cq		hook_cq;
+	struct dlist_entry	entry;
+	struct st_slot		*slot;
+	uint64_t		cnt[ST_CQ_CNT];
+};
+
+struct hook_prov_ctx hook_stats_prov_ctx;
+
+static char *st_name = "fi_stats";
+static int st_interval = 1000;
+static size_t st_slots = 64;
+
+static pthread_mutex_t st_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t st_cond = PTHREAD_COND_INITIALIZER;
+static struct dlist_entry st_ep_list = { &st_ep_list, &st_ep_list };
+static struct dlist_entry st_cq_list = { &st_cq_list, &st_cq_list };
+static struct st_hdr *st_hdr;
+static size_t st_map_size;
+static char st_path[NAME_MAX];
+static pthread_t st_thread;
+static bool st_started, st_stop;
+
+static inline void st_add(uint64_t *cnt, uint64_t val)
+{
+	__atomic_fetch_add(cnt, val, __ATOMIC_RELAXED);
+}
+
+static inline ssize_t
+st_xfer(struct fid_ep *ep, int type, size_t len, ssize_t ret)
+{
+	struct st_ep *myep = container_of(ep, struct st_ep, hook_ep.ep);
+
+	if (!ret) {
+		st_add(&myep->cnt[type], 1);
+		st_add(&myep->cnt[type + 1], len);
+	} else if (ret == -FI_EAGAIN) {
+		st_add(&myep->cnt[ST_EAGAIN], 1);
+	}
+	return ret;
+}
+
+static inline struct fid_ep *st_hep(struct fid_ep *ep)
+{
+	return container_of(ep, struct hook_ep, ep)->hep;
+}
+
+static void st_slot_begin(struct st_slot *slot)
+{
+	__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void st_slot_end(struct st_slot *slot)
+{
+	__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Called with st_lock held */
+static struct st_slot *
+st_claim_slot(enum st_kind kind, const void *fid, const struct fi_info *info)
+{
+	struct st_slot *slot;
+	uint32_t i;
+
+	if (!st_hdr)
+		return NULL;
+
+	for (i = 0; i < st_hdr->slot_cnt; i++) {
+		slot = st_slot(st_hdr, i);
+		if (slot->kind != ST_FREE)
+			continue;
+
+		st_slot_begin(slot);
+		slot->kind = kind;
+		slot->fid = (uintptr_t) fid;
+		slot->var_cnt = 0;
+		snprintf(slot->prov, sizeof(slot->prov), "%s",
+			 info ? info->fabric_attr->prov_name : "");
+		snprintf(slot->domain, sizeof(slot->domain), "%s",
+			 info ? info->domain_attr->name : "");
+		st_slot_end(slot);
+		return slot;
+	}
+
+	FI_WARN(&hook_stats_prov_ctx.prov, FI_LOG_DOMAIN,
+		"no free stats slot, increase FI_OFI_HOOK_STATS_SLOTS\n");
+	return NULL;
+}
+
+static void st_release_slot(struct st_slot *slot)
+{
+	if (!slot)
+		return;
+
+	st_slot_begin(slot);
+	slot->kind = ST_FREE;
+	slot->var_cnt = 0;
+	st_slot_end(slot);
+}
+
+static void st_set_var(struct st_slot *slot, const char *name, uint64_t value)
+{
+	snprintf(slot->vars[slot->var_cnt].name,
+		 sizeof(slot->vars[slot->var_cnt].name), "%s", name);
+	slot->vars[slot->var_cnt++].value = value;
+}
+
+static void st_publish_ep(struct st_ep *ep)
+{
+	uint64_t value;
+	size_t i;
+
+	st_slot_begin(ep->slot);
+	ep->slot->var_cnt = 0;
+	for (i = 0; i < ST_EP_CNT; i++)
+		st_set_var(ep->slot, st_ep_names[i],
+			   __atomic_load_n(&ep->cnt[i], __ATOMIC_RELAXED));
+
+	for (i = 0; i < ep->prof_cnt; i++) {
+		if (!fi_profile_read_u64(ep->prof, ep->prof_ids[i], &value))
+			st_set_var(ep->slot, ep->prof_names[i], value);
+	}
+	st_slot_end(ep->slot);
+}
+
+static void st_publish(void)
+{
+	struct st_ep *ep;
+	struct st_cq *cq;
+	size_t i;
+
+	dlist_foreach_container(&st_ep_list, struct st_ep, ep, entry) {
+		if (ep->slot)
+			st_publish_ep(ep);
+	}
+
+	dlist_foreach_container(&st_cq_list, struct st_cq, cq, entry) {
+		if (!cq->slot)
+			continue;
+
+		st_slot_begin(cq->slot);
+		cq->slot->var_cnt = 0;
+		for (i = 0; i < ST_CQ_CNT; i++)
+			st_set_var(cq->slot, st_cq_names[i],
+				   __atomic_load_n(&cq->cnt[i],
+						   __ATOMIC_RELAXED));
+		st_slot_end(cq->slot);
+	}
+
+	__atomic_store_n(&st_hdr->update_ns, ofi_gettime_ns(),
+			 __ATOMIC_RELEASE);
+}
+
+static void *st_publish_thread(void *arg)
+{
+	struct timespec ts;
+
+	pthread_mutex_lock(&st_lock);
+	while (!st_stop) {
+		st_publish();
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += st_interval / 1000;
+		ts.tv_nsec += (st_interval % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&st_cond, &st_lock, &ts);
+	}
+	pthread_mutex_unlock(&st_lock);
+	return NULL;
+}
+
+static void st_read_comm(char *comm, size_t len)
+{
+	FILE *file;
+
+	file = fopen("/proc/self/comm", "r");
+	if (!file)
+		return;
+
+	if (fgets(comm, len, file))
+		comm[strcspn(comm, "\n")] = '\0';
+	fclose(file);
+}
+
+/* Called with st_lock held */
+static void st_open(struct fi_provider *hprov)
+{
+	int fd, ret;
+
+	st_map_size = ST_HDR_SIZE + st_slots * sizeof(struct st_slot);
+	snprintf(st_path, sizeof(st_path), "/%s.%d", st_name, getpid());
+
+	/* A segment of an earlier process with our pid may still be mapped
+	 * by a reader, or may have been created by another user.  Replace it
+	 * rather than reuse it, and fail if the name is taken again before
+	 * we create it.
+	 */
+	shm_unlink(st_path);
+	fd = shm_open(st_path, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		ret = -errno;
+		goto err;
+	}
+
+	if (ftruncate(fd, st_map_size)) {
+		ret = -errno;
+		close(fd);
+		goto unlink;
+	}
+
+	st_hdr = mmap(NULL, st_map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		      fd, 0);
+	close(fd);
+	if (st_hdr == MAP_FAILED) {
+		st_hdr = NULL;
+		ret = -errno;
+		goto unlink;
+	}
+
+	st_hdr->version = ST_VERSION;
+	st_hdr->slot_cnt = st_slots;
+	st_hdr->slot_size = sizeof(struct st_slot);
+	st_hdr->pid = getpid();
+	st_hdr->interval_ms = st_interval;
+	st_read_comm(st_hdr->comm, sizeof(st_hdr->comm));
+
+	ret = -pthread_create(&st_thread, NULL, st_publish_thread, NULL);
+	if (ret) {
+		munmap(st_hdr, st_map_size);
+		st_hdr = NULL;
+		goto unlink;
+	}
+
+	__atomic_store_n(&st_hdr->magic, ST_MAGIC, __ATOMIC_RELEASE);
+	FI_INFO(hprov, FI_LOG_FABRIC, "publishing stats to %s\n", st_path);
+	return;
+
+unlink:
+	shm_unlink(st_path);
+err:
+	FI_WARN(hprov, FI_LOG_FABRIC, "unable to create stats segment %s: %s\n",
+		st_path, fi_strerror(-ret));
+}
+
+/*
+ * Messages
+ */
+static ssize_t
+st_msg_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
+	    fi_addr_t src_addr, void *context)
+{
+	return st_xfer(ep, ST_RX_OPS, len,
+		       fi_recv(st_hep(ep), buf, len, desc, src_addr, context));
+}
+
+static ssize_t
+st_msg_recvv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+	     size_t count, fi_addr_t src_addr, void *context)
+{
+	return st_xfer(ep, ST_RX_OPS, ofi_total_iov_len(iov, count),
+		       fi_recvv(st_hep(ep), iov, desc, count, src_addr,
+				context));
+}
+
+static ssize_t
+st_msg_recvmsg(struct fid_ep *ep, const struct fi_msg *msg, uint64_t flags)
+{
+	return st_xfer(ep, ST_RX_OPS,
+		       ofi_total_iov_len(msg->msg_iov, msg->iov_count),
+		       fi_recvmsg(st_hep(ep), msg, flags));
+}
+
+static ssize_t
+st_msg_send(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+	    fi_addr_t dest_addr, void *context)
+{
+	return st_xfer(ep, ST_TX_OPS, len,
+		       fi_send(st_hep(ep), buf, len, desc, dest_addr, context));
+}
+
+static ssize_t
+st_msg_sendv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+	     size_t count, fi_addr_t dest_addr, void *context)
+{
+	return st_xfer(ep, ST_TX_OPS, ofi_total_iov_len(iov, count),
+		       fi_sendv(st_hep(ep), iov, desc, count, dest_addr,
+				context));
+}
+
+static ssize_t
+st_msg_sendmsg(struct fid_ep *ep, const struct fi_msg *msg, uint64_t flags)
+{
+	return st_xfer(ep, ST_TX_OPS,
+		       ofi_total_iov_len(msg->msg_iov, msg->iov_count),
+		       fi_sendmsg(st_hep(ep), msg, flags));
+}
+
+static ssize_t
+st_msg_inject(struct fid_ep *ep, const void *buf, size_t len,
+	      fi_addr_t dest_addr)
+{
+	return st_xfer(ep, ST_TX_OPS, len,
+		       fi_inject(st_hep(ep), buf, len, dest_addr));
+}
+
+static ssize_t
+st_msg_senddata(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+		uint64_t data, fi_addr_t dest_addr, void *context)
+{
+	return st_xfer(ep, ST_TX_OPS, len,
+		       fi_senddata(st_hep(ep), buf, len, desc, data,
+				   dest_addr, context));
+}
+
+static ssize_t
+st_msg_injectdata(struct fid_ep *ep, const void *buf, size_t len,
+		  uint64_t data, fi_addr_t dest_addr)
+{
+	return st_xfer(ep, ST_TX_OPS, len,
+		       fi_injectdata(st_hep(ep), buf, len, data, dest_addr));
+}
+
+static struct fi_ops_msg st_msg_ops = {
+	.size = sizeof(struct fi_ops_msg),
+	.recv = st_msg_recv,
+	.recvv = st_msg_recvv,
+	.recvmsg = st_msg_recvmsg,
+	.send = st_msg_send,
+	.sendv = st_msg_sendv,
+	.sendmsg = st_msg_sendmsg,
+	.inject = st_msg_inject,
+	.senddata = st_msg_senddata,
+	.injectdata = st_msg_injectdata,
+};
+
+/*
+ * Tagged messages
+ */
+static ssize_t
+st_tagged_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
+	       fi_addr_t src_addr, uint64_t tag, uint64_t ignore,
+	       void *context)
+{
+	return st_xfer(ep, ST_RX_OPS, len,
+		       fi_trecv(st_hep(ep), buf, len, desc, src_addr, tag,
+				ignore, context));
+}
+
+static ssize_t
+st_tagged_recvv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+		size_t count, fi_addr_t src_addr, uint64_t tag,
+		uint64_t ignore, void *context)
+{
+	return st_xfer(ep, ST_RX_OPS, ofi_total_iov_len(iov, count),
+		       fi_trecvv(st_hep(ep), iov, desc, count, src_addr, tag,
+				 ignore, context));
+}
+
+static ssize_t
+st_tagged_recvmsg(struct fid_ep *ep, const struct fi_msg_tagged *msg,
+		  uint64_t flags)
+{
+	return st_xfer(ep, ST_RX_OPS,
+		       ofi_total_iov_len(msg->msg_iov, msg->iov_count),
+		       fi_trecvmsg(st_hep(ep), msg, flags));
+}
+
+static ssize_t
+st_tagged_send(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+	       fi_addr_t dest_addr, uint64_t tag, void *context)
+{
+	return st_xfer(ep, ST_TX_OPS, len,
+		       fi_tsend(st_hep(ep), buf, len, desc, dest_addr, tag,
+				context));
+}
+
+static ssize_t
+st_tagged_sendv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+		size_t count, fi_addr_t dest_addr, uint64_t tag,
+		void *context)
+{
+	return st_xfer(ep, ST_TX_OPS, ofi_total_iov_len(iov, count),
+		       fi_tsendv(st_hep(ep), iov, desc, count, dest_addr, tag,
+				 context));
+}
+
+static ssize_t
+st_tagged_sendmsg(struct fid_ep *ep, const struct fi_msg_tagged *msg,
+		  uint64_t flags)
+{
+	return st_xfer(ep, ST_TX_OPS,
+		       ofi_total_iov_len(msg->msg_iov, msg->iov_count),
+		       fi_tsendmsg(st_hep(ep), msg, flags));
+}
+
+static ssize_t
+st_tagged_inject(struct fid_ep *ep, const void *buf, size_t len,
+		 fi_addr_t dest_addr, uint64_t tag)
+{
+	return st_xfer(ep, ST_TX_OPS, len,
+		       fi_tinject(st_hep(ep), buf, len, dest_addr, tag));
+}
+
+static ssize_t
+st_tagged_senddata(struct fid_ep *ep, const void *buf, size_t len,
+		   void *desc, uint64_t data, fi_addr_t dest_addr,
+		   uint64_t tag, void *context)
+{
+	return st_xfer(ep, ST_TX_OPS, len,
+		       fi_tsenddata(st_hep(ep), buf, len, desc, data,
+				    dest_addr, tag, context));
+}
+
+static ssize_t
+st_tagged_injectdata(struct fid_ep *ep, const void *buf, size_t len,
+		     uint64_t data, fi_addr_t dest_addr, uint64_t tag)
+{
+	return st_xfer(ep, ST_TX_OPS, len,
+		       fi_tinjectdata(st_hep(ep), buf, len, data, dest_addr,
+				      tag));
+}
+
+static struct fi_ops_tagged st_tagged_ops = {
+	.size = sizeof(struct fi_ops_tagged),
+	.recv = st_tagged_recv,
+	.recvv = st_tagged_recvv,
+	.recvmsg = st_tagged_recvmsg,
+	.send = st_tagged_send,
+	.sendv = st_tagged_sendv,
+	.sendmsg = st_tagged_sendmsg,
+	.inject = st_tagged_inject,
+	.senddata = st_tagged_senddata,
+	.injectdata = st_tagged_injectdata,
+};
+
+/*
+ * RMA
+ */
+static ssize_t
+st_rma_read(struct fid_ep *ep, void *buf, size_t len, void *desc,
+	    fi_addr_t src_addr, uint64_t addr, uint64_t key, void *context)
+{
+	return st_xfer(ep, ST_RMA_OPS, len,
+		       fi_read(st_hep(ep), buf, len, desc, src_addr, addr,
+			       key, context));
+}
+
+static ssize_t
+st_rma_readv(struct fid_ep *ep, const struct iovec *iov, void **desc,
+	     size_t count, fi_addr_t src_addr, uint64_t addr, uint64_t key,
+	     void *context)
+{
+	return st_xfer(ep, ST_RMA_OPS, ofi_total_iov_len(iov, count),
+		       fi_readv(st_hep(ep), iov, desc, count, src_addr, addr,
+				key, context));
+}
+
+static ssize_t
+st_rma_readmsg(struct fid_ep *ep, const struct fi_msg_rma *msg,
+	       uint64_t flags)
+{
+	return st_xfer(ep, ST_RMA_OPS,
+		       ofi_total_iov_len(msg->msg_iov, msg->iov_count),
+		       fi_readmsg(st_hep(ep), msg, flags));
+}
+
+static ssize_t
+st_rma_write(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+	     fi_addr_t dest_addr, uint64_t addr, uint64_t key, void *context)
+{
+	return st_xfer(ep, ST_RMA_OPS, len,
+		       fi_write(st_hep(ep), buf, len, desc, dest_addr, addr,
+				key, context));
+}
+
+static ssize_t
+st_rma_writev(struct fid_ep *ep, const struct iovec *iov, void **desc,
+	      size_t count, fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+	      void *context)
+{
+	return st_xfer(ep, ST_RMA_OPS, ofi_total_iov_len(iov, count),
+		       fi_writev(st_hep(ep), iov, desc, count, dest_addr,
+				 addr, key, context));
+}
+
+static ssize_t
+st_rma_writemsg(struct fid_ep *ep, const struct fi_msg_rma *msg,
+		uint64_t flags)
+{
+	return st_xfer(ep, ST_RMA_OPS,
+		       ofi_total_iov_len(msg->msg_iov, msg->iov_count),
+		       fi_writemsg(st_hep(ep), msg, flags));
+}
+
+static ssize_t
+st_rma_inject(struct fid_ep *ep, const void *buf, size_t len,
+	      fi_addr_t dest_addr, uint64_t addr, uint64_t key)
+{
+	return st_xfer(ep, ST_RMA_OPS, len,
+		       fi_inject_write(st_hep(ep), buf, len, dest_addr, addr,
+				       key));
+}
+
+static ssize_t
+st_rma_writedata(struct fid_ep *ep, const void *buf, size_t len, void *desc,
+		 uint64_t data, fi_addr_t dest_addr, uint64_t addr,
+		 uint64_t key, void *context)
+{
+	return st_xfer(ep, ST_RMA_OPS, len,
+		       fi_writedata(st_hep(ep), buf, len, desc, data,
+				    dest_addr, addr, key, context));
+}
+
+static ssize_t
+st_rma_injectdata(struct fid_ep *ep, const void *buf, size_t len,
+		  uint64_t data, fi_addr_t dest_addr, uint64_t addr,
+		  uint64_t key)
+{
+	return st_xfer(ep, ST_RMA_OPS, len,
+		       fi_inject_writedata(st_hep(ep), buf, len, data,
+					   dest_addr, addr, key));
+}
+
+static struct fi_ops_rma st_rma_ops = {
+	.size = sizeof(struct fi_ops_rma),
+	.read = st_rma_read,
+	.readv = st_rma_readv,
+	.readmsg = st_rma_readmsg,
+	.write = st_rma_write,
+	.writev = st_rma_writev,
+	.writemsg = st_rma_writemsg,
+	.inject = st_rma_inject,
+	.writedata = st_rma_writedata,
+	.injectdata = st_rma_injectdata,
+};
+
+/*
+ * Atomics
+ */
+static ssize_t
+st_atomic_write(struct fid_ep *ep, const void *buf, size_t count,
+		void *desc, fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+		enum fi_datatype datatype, enum fi_op op, void *context)
+{
+	return st_xfer(ep, ST_ATOMIC_OPS, count * ofi_datatype_size(datatype),
+		       fi_atomic(st_hep(ep), buf, count, desc, dest_addr,
+				 addr, key, datatype, op, context));
+}
+
+static ssize_t
+st_atomic_writev(struct fid_ep *ep, const struct fi_ioc *iov, void **desc,
+		 size_t count, fi_addr_t dest_addr, uint64_t addr,
+		 uint64_t key, enum fi_datatype datatype, enum fi_op op,
+		 void *context)
+{
+	return st_xfer(ep, ST_ATOMIC_OPS, ofi_total_ioc_cnt(iov, count) *
+		       ofi_datatype_size(datatype),
+		       fi_atomicv(st_hep(ep), iov, desc, count, dest_addr,
+				  addr, key, datatype, op, context));
+}
+
+static ssize_t
+st_atomic_writemsg(struct fid_ep *ep, const struct fi_msg_atomic *msg,
+		   uint64_t flags)
+{
+	return st_xfer(ep, ST_ATOMIC_OPS,
+		       ofi_total_ioc_cnt(msg->msg_iov, msg->iov_count) *
+		       ofi_datatype_size(msg->datatype),
+		       fi_atomicmsg(st_hep(ep), msg, flags));
+}
+
+static ssize_t
+st_atomic_inject(struct fid_ep *ep, const void *buf, size_t count,
+		 fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+		 enum fi_datatype datatype, enum fi_op op)
+{
+	return st_xfer(ep, ST_ATOMIC_OPS, count * ofi_datatype_size(datatype),
+		       fi_inject_atomic(st_hep(ep), buf, count, dest_addr,
+					addr, key, datatype, op));
+}
+
+static ssize_t
+st_atomic_readwrite(struct fid_ep *ep, const void *buf, size_t count,
+		    void *desc, void *result, void *result_desc,
+		    fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+		    enum fi_datatype datatype, enum fi_op op, void *context)
+{
+	return st_xfer(ep, ST_ATOMIC_OPS, count * ofi_datatype_size(datatype),
+		       fi_fetch_atomic(st_hep(ep), buf, count, desc, result,
+				       result_desc, dest_addr, addr, key,
+				       datatype, op, context));
+}
+
+static ssize_t
+st_atomic_readwritev(struct fid_ep *ep, const struct fi_ioc *iov,
+		     void **desc, size_t count, struct fi_ioc *resultv,
+		     void **result_desc, size_t result_count,
+		     fi_addr_t dest_addr, uint64_t addr, uint64_t key,
+		     enum fi_datatype datatype, enum fi_op op, void *context)
+{
+	return st_xfer(ep, ST_ATOMIC_OPS,
+		       ofi_total_ioc_cnt(resultv, result_count) *
+		       ofi_datatype_size(datatype),
+		       fi_fetch_atomicv(st_hep(ep), iov, desc, count, resultv,
+					result_desc, result_count, dest_addr,
+					addr, key, datatype, op, context));
+}
+
+static ssize_t
+st_atomic_readwritemsg(struct fid_ep *ep, const struct fi_msg_atomic *msg,
+		       struct fi_ioc *resultv, void **result_desc,
+		       size_t result_count, uint64_t flags)
+{
+	return st_xfer(ep, ST_ATOMIC_OPS,
+		       ofi_total_ioc_cnt(resultv, result_count) *
+		       ofi_datatype_size(msg->datatype),
+		       fi_fetch_atomicmsg(st_hep(ep), msg, resultv,
+					  result_desc, result_count, flags));
+}
+
+static ssize_t
+st_atomic_compwrite(struct fid_ep *ep, const void *buf, size_t count,
+		    void *desc, const void *compare, void *compare_desc,
+		    void *result, void *result_desc, fi_addr_t dest_addr,
+		    uint64_t addr, uint64_t key, enum fi_datatype datatype,
+		    enum fi_op op, void *context)
+{
+	return st_xfer(ep, ST_ATOMIC_OPS, count * ofi_datatype_size(datatype),
+		       fi_compare_atomic(st_hep(ep), buf, count, desc, compare,
+					 compare_desc, result, result_desc,
+					 dest_addr, addr, key, datatype, op,
+					 context));
+}
+
+static ssize_t
+st_atomic_compwritev(struct fid_ep *ep, const struct fi_ioc *iov,
+		     void **desc, size_t count, const struct fi_ioc *comparev,
+		     void **compare_desc, size_t compare_count,
+		     struct fi_ioc *resultv, void **result_desc,
+		     size_t result_count, fi_addr_t dest_addr, uint64_t addr,
+		     uint64_t key, enum fi_datatype datatype, enum fi_op op,
+		     void *context)
+{
+	return st_xfer(ep, ST_ATOMIC_OPS, ofi_total_ioc_cnt(iov, count) *
+		       ofi_datatype_size(datatype),
+		       fi_compare_atomicv(st_hep(ep), iov, desc, count,
+					  comparev, compare_desc,
+					  compare_count, resultv, result_desc,
+					  result_count, dest_addr, addr, key,
+					  datatype, op, context));
+}
+
+static ssize_t
+st_atomic_compwritemsg(struct fid_ep *ep, const struct fi_msg_atomic *msg,
+		       const struct fi_ioc *comparev, void **compare_desc,
+		       size_t compare_count, struct fi_ioc *resultv,
+		       void **result_desc, size_t result_count,
+		       uint64_t flags)
+{
+	return st_xfer(ep, ST_ATOMIC_OPS,
+		       ofi_total_ioc_cnt(msg->msg_iov, msg->iov_count) *
+		       ofi_datatype_size(msg->datatype),
+		       fi_compare_atomicmsg(st_hep(ep), msg, comparev,
+					    compare_desc, compare_count,
+					    resultv, result_desc, result_count,
+					    flags));
+}
+
+static struct fi_ops_atomic st_atomic_ops;
+
+/*
+ * CQ
+ */
+static inline ssize_t st_cq_comps(struct fid_cq *cq, ssize_t ret)
+{
+	struct st_cq *mycq = container_of(cq, struct st_cq, hook_cq.cq);
+
+	if (ret > 0)
+		st_add(&mycq->cnt[ST_COMPS], ret);
+	else if (ret == -FI_EAGAIN)
+		st_add(&mycq->cnt[ST_EMPTY_READS], 1);
+	return ret;
+}
+
+static inline struct fid_cq *st_hcq(struct fid_cq *cq)
+{
+	return container_of(cq, struct hook_cq, cq)->hcq;
+}
+
+static ssize_t st_cq_read(struct fid_cq *cq, void *buf, size_t count)
+{
+	return st_cq_comps(cq, fi_cq_read(st_hcq(cq), buf, count));
+}
+
+static ssize_t
+st_cq_readfrom(struct fid_cq *cq, void *buf, size_t count,
+	       fi_addr_t *src_addr)
+{
+	return st_cq_comps(cq, fi_cq_readfrom(st_hcq(cq), buf, count,
+					      src_addr));
+}
+
+static ssize_t
+st_cq_readerr(struct fid_cq *cq, struct fi_cq_err_entry *buf,
+	      uint64_t flags)
+{
+	struct st_cq *mycq = container_of(cq, struct st_cq, hook_cq.cq);
+	ssize_t ret;
+
+	ret = fi_cq_readerr(mycq->hook_cq.hcq, buf, flags);
+	if (ret > 0)
+		st_add(&mycq->cnt[ST_ERRORS], ret);
+	return ret;
+}
+
+static ssize_t
+st_cq_sread(struct fid_cq *cq, void *buf, size_t count, const void *cond,
+	    int timeout)
+{
+	return st_cq_comps(cq, fi_cq_sread(st_hcq(cq), buf, count, cond,
+					   timeout));
+}
+
+static ssize_t
+st_cq_sreadfrom(struct fid_cq *cq, void *buf, size_t count,
+		fi_addr_t *src_addr, const void *cond, int timeout)
+{
+	return st_cq_comps(cq, fi_cq_sreadfrom(st_hcq(cq), buf, count,
+					       src_addr, cond, timeout));
+}
+
+static struct fi_ops_cq st_cq_ops;
+
+static int st_cq_close(struct fid *fid)
+{
+	struct st_cq *mycq = container_of(fid, struct st_cq, hook_cq.cq.fid);
+	int ret;
+
+	ret = fi_close(&mycq->hook_cq.hcq->fid);
+	if (ret)
+		return ret;
+
+	pthread_mutex_lock(&st_lock);
+	dlist_remove(&mycq->entry);
+	st_release_slot(mycq->slot);
+	pthread_mutex_unlock(&st_lock);
+	free(mycq);
+	return 0;
+}
+
+static struct fi_ops st_cq_fid_ops;
+
+static int
+st_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
+	   struct fid_cq **cq, void *context)
+{
+	struct st_cq *mycq;
+	int ret;
+
+	mycq = calloc(1, sizeof(*mycq));
+	if (!mycq)
+		return -FI_ENOMEM;
+
+	ret = hook_cq_init(domain, attr, cq, context, &mycq->hook_cq);
+	if (ret) {
+		free(mycq);
+		return ret;
+	}
+
+	mycq->hook_cq.cq.fid.ops = &st_cq_fid_ops;
+	mycq->hook_cq.cq.ops = &st_cq_ops;
+
+	pthread_mutex_lock(&st_lock);
+	mycq->slot = st_claim_slot(ST_CQ, *cq, NULL);
+	dlist_insert_tail(&mycq->entry, &st_cq_list);
+	pthread_mutex_unlock(&st_lock);
+	return 0;
+}
+
+/*
+ * Endpoint
+ */
+static void st_prof_open(struct st_ep *ep)
+{
+	struct fi_profile_desc *desc;
+	size_t i, count = 0;
+	ssize_t cnt;
+
+	if (fi_profile_open(&ep->hook_ep.hep->fid, 0, &ep->prof, NULL)) {
+		ep->prof = NULL;
+		return;
+	}
+
+	fi_profile_query_vars(ep->prof, NULL, &count);
+	desc = calloc(count, sizeof(*desc));
+	if (!desc)
+		return;
+
+	cnt = fi_profile_query_vars(ep->prof, desc, &count);
+	for (i = 0; i < cnt && ep->prof_cnt < ARRAY_SIZE(ep->prof_ids); i++) {
+		if (OFI_VAR_ENABLED(&desc[i]) &&
+		    (OFI_VAR_DATATYPE_U64(&desc[i]) ||
+		     (desc[i].datatype_sel == fi_defined_type &&
+		      desc[i].datatype.defined == FI_TYPE_ATOMIC_TYPE))) {
+			snprintf(ep->prof_names[ep->prof_cnt], ST_NAME_LEN,
+				 "%s", desc[i].name);
+			ep->prof_ids[ep->prof_cnt++] = desc[i].id;
+		}
+	}
+	free(desc);
+}
+
+static int st_ep_close(struct fid *fid)
+{
+	struct st_ep *myep = container_of(fid, struct st_ep, hook_ep.ep.fid);
+	struct fid_profile *prof;
+	int ret;
+
+	/* The profile references the provider ep, so is closed first. */
+	pthread_mutex_lock(&st_lock);
+	prof = myep->prof;
+	myep->prof = NULL;
+	myep->prof_cnt = 0;
+	pthread_mutex_unlock(&st_lock);
+
+	if (prof)
+		fi_profile_close(prof);
+
+	ret = fi_close(&myep->hook_ep.hep->fid);
+	if (ret)
+		return ret;
+
+	pthread_mutex_lock(&st_lock);
+	dlist_remove(&myep->entry);
+	st_release_slot(myep->slot);
+	pthread_mutex_unlock(&st_lock);
+	free(myep);
+	return 0;
+}
+
+static struct fi_ops st_ep_fid_ops;
+
+static int
+st_endpoint(struct fid_domain *domain, struct fi_info *info,
+	    struct fid_ep **ep, void *context)
+{
+	struct st_ep *myep;
+	int ret;
+
+	myep = calloc(1, sizeof(*myep));
+	if (!myep)
+		return -FI_ENOMEM;
+
+	ret = hook_endpoint_init(domain, info, ep, context, &myep->hook_ep);
+	if (ret) {
+		free(myep);
+		return ret;
+	}
+
+	myep->hook_ep.ep.fid.ops = &st_ep_fid_ops;
+	myep->hook_ep.ep.msg = &st_msg_ops;
+	myep->hook_ep.ep.tagged = &st_tagged_ops;
+	myep->hook_ep.ep.rma = &st_rma_ops;
+	myep->hook_ep.ep.atomic = &st_atomic_ops;
+	st_prof_open(myep);
+
+	pthread_mutex_lock(&st_lock);
+	myep->slot = st_claim_slot(ST_EP, *ep, info);
+	dlist_insert_tail(&myep->entry, &st_ep_list);
+	pthread_mutex_unlock(&st_lock);
+	return 0;
+}
+
+static struct fi_ops_domain st_domain_ops;
+
+static int st_domain_init(struct fid *fid)
+{
+	struct fid_domain *domain = container_of(fid, struct fid_domain, fid);
+
+	domain->ops = &st_domain_ops;
+	return 0;
+}
+
+static int st_fabric(struct fi_fabric_attr *attr,
+		     struct fid_fabric **fabric, void *context)
+{
+	struct fi_provider *hprov = context;
+	struct hook_fabric *fab;
+
+	FI_TRACE(hprov, FI_LOG_FABRIC, "Installing stats hook\n");
+	fab = calloc(1, sizeof *fab);
+	if (!fab)
+		return -FI_ENOMEM;
+
+	/* All fabrics of the process publish to the same segment */
+	pthread_mutex_lock(&st_lock);
+	if (!st_started) {
+		st_open(hprov);
+		st_started = true;
+	}
+	pthread_mutex_unlock(&st_lock);
+
+	hook_fabric_init(fab, HOOK_STATS, attr->fabric, hprov,
+			 &hook_fid_ops, &hook_stats_prov_ctx);
+	*fabric = &fab->fabric;
+	return 0;
+}
+
+static void st_cleanup(void)
+{
+	if (!st_hdr)
+		return;
+
+	pthread_mutex_lock(&st_lock);
+	st_stop = true;
+	pthread_cond_signal(&st_cond);
+	pthread_mutex_unlock(&st_lock);
+	pthread_join(st_thread, NULL);
+
+	munmap(st_hdr, st_map_size);
+	st_hdr = NULL;
+	shm_unlink(st_path);
+}
+
+struct hook_prov_ctx hook_stats_prov_ctx = {
+	.prov = {
+		.version = OFI_VERSION_DEF_PROV,
+		/* We're a pass-through provider, so the fi_version is always the latest */
+		.fi_version = OFI_VERSION_LATEST,
+		.name = "ofi_hook_stats",
+		.getinfo = NULL,
+		.fabric = st_fabric,
+		.cleanup = st_cleanup,
+	},
+};
+
+HOOK_STATS_INI
+{
+	fi_param_define(&hook_stats_prov_ctx.prov, "name", FI_PARAM_STRING,
+			"Name of the shared memory segment, with the process "
+			"id added as suffix (default: fi_stats)");
+	fi_param_define(&hook_stats_prov_ctx.prov, "interval", FI_PARAM_INT,
+			"Milliseconds between updates of the segment "
+			"(default: 1000)");
+	fi_param_define(&hook_stats_prov_ctx.prov, "slots", FI_PARAM_SIZE_T,
+			"Maximum number of endpoints and CQs published "
+			"(default: 64)");
+	fi_param_get_str(&hook_stats_prov_ctx.prov, "name", &st_name);
+	fi_param_get_int(&hook_stats_prov_ctx.prov, "interval", &st_interval);
+	fi_param_get_size_t(&hook_stats_prov_ctx.prov, "slots", &st_slots);
+	if (st_interval <= 0)
+		st_interval = 1000;
+
+	st_domain_ops = hook_domain_ops;
+	st_domain_ops.cq_open = st_cq_open;
+	st_domain_ops.endpoint = st_endpoint;
+
+	st_cq_fid_ops = hook_fid_ops;
+	st_cq_fid_ops.close = st_cq_close;
+	st_cq_ops = hook_cq_ops;
+	st_cq_ops.read = st_cq_read;
+	st_cq_ops.readfrom = st_cq_readfrom;
+	st_cq_ops.readerr = st_cq_readerr;
+	st_cq_ops.sread = st_cq_sread;
+	st_cq_ops.sreadfrom = st_cq_sreadfrom;
+
+	st_ep_fid_ops = hook_fid_ops;
+	st_ep_fid_ops.close = st_ep_close;
+
+	st_atomic_ops = hook_atomic_ops;
+	st_atomic_ops.write = st_atomic_write;
+	st_atomic_ops.writev = st_atomic_writev;
+	st_atomic_ops.writemsg = st_atomic_writemsg;
+	st_atomic_ops.inject = st_atomic_inject;
+	st_atomic_ops.readwrite = st_atomic_readwrite;
+	st_atomic_ops.readwritev = st_atomic_readwritev;
+	st_atomic_ops.readwritemsg = st_atomic_readwritemsg;
+	st_atomic_ops.compwrite = st_atomic_compwrite;
+	st_atomic_ops.compwritev = st_atomic_compwritev;
+	st_atomic_ops.compwritemsg = st_atomic_compwritemsg;
+
+	hook_stats_prov_ctx.ini_fid[FI_CLASS_DOMAIN] = st_domain_init;
+
+	return &hook_stats_prov_ctx.prov;
+}
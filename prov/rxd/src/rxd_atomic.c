@@ -131,7 +131,7 @@ static ssize_t rxd_generic_atomic(struct rxd_ep *rxd_ep,
 
 	ofi_genlock_lock(&rxd_ep->util_ep.lock);
 
-	if (ofi_cirque_isfull(rxd_ep->util_ep.tx_cq->cirq))
+	if (ofi_cq_isfull(rxd_ep->util_ep.tx_cq))
 		goto out;
 
 	rxd_addr = (intptr_t) ofi_idx_lookup(&(rxd_ep_av(rxd_ep)->fi_addr_idx),
@@ -235,7 +235,7 @@ static ssize_t rxd_atomic_inject(struct fid_ep *ep_fid, const void *buf,
 
 	ofi_genlock_lock(&rxd_ep->util_ep.lock);
 
-	if (ofi_cirque_isfull(rxd_ep->util_ep.tx_cq->cirq))
+	if (ofi_cq_isfull(rxd_ep->util_ep.tx_cq))
 		goto out;
 	rxd_addr = (intptr_t) ofi_idx_lookup(&(rxd_ep_av(rxd_ep)->fi_addr_idx),
 					     RXD_IDX_OFFSET((int) addr));
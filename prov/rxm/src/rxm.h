@@ -47,6 +47,7 @@
 #include <rdma/fi_domain.h>
 #include <rdma/fi_endpoint.h>
 #include <rdma/fi_eq.h>
+#include <rdma/fi_ext.h>
 
 #include <ofi.h>
 #include <ofi_enosys.h>
@@ -77,6 +78,10 @@ enum {
 	RXM_CM_FLOW_CTRL_PEER_OFF,
 };
 
+/* rxm_cm_data connect and accept flags */
+#define RXM_CM_IDLE_CLOSE	BIT(0)	/* handles rxm_ctrl_close_req */
+#define RXM_CM_RNDV_TIME	BIT(1)	/* reports read time in rndv_rd_done */
+
 union rxm_cm_data {
 	struct _connect {
 		uint8_t version;
@@ -85,7 +90,7 @@ union rxm_cm_data {
 		uint8_t op_version;
 		uint16_t port;
 		uint8_t flow_ctrl;
-		uint8_t padding;
+		uint8_t flags;
 		uint32_t eager_limit;
 		uint32_t rx_size; /* used? */
 		uint64_t client_conn_id;
@@ -95,7 +100,8 @@ union rxm_cm_data {
 		uint64_t server_conn_id;
 		uint32_t rx_size; /* used? */
 		uint8_t flow_ctrl;
-		uint8_t align_pad[3];
+		uint8_t flags;
+		uint8_t align_pad[2];
 	} accept;
 
 	struct _reject {
@@ -198,6 +204,8 @@ enum {
 	RXM_TX_SIZE = 16384,
 };
 
+#define RXM_NUMA_NODE_NONE	INT_MIN
+
 extern size_t rxm_msg_tx_size;
 extern size_t rxm_msg_rx_size;
 extern size_t rxm_cm_progress_interval;
@@ -206,11 +214,73 @@ extern int rxm_passthru;
 extern int force_auto_progress;
 extern int rxm_use_write_rndv;
 extern int rxm_detect_hmem_iface;
+extern int rxm_buffer_numa_node;
+extern int rxm_prewarm;
+extern int rxm_prewarm_window;
+extern int rxm_conn_idle_timeout;
+extern int rxm_sar_tune;
 extern enum fi_wait_obj def_wait_obj, def_tcp_wait_obj;
 
 struct rxm_ep;
 struct rxm_av;
 
+#ifdef HAVE_FABRIC_PROFILE
+
+#include <ofi_profile.h>
+
+enum {
+	RXM_VAR_CONN_WARMUP = -FI_PROV_SPECIFIC_RXM,
+	RXM_VAR_CONN_WARMUP_DONE,
+	RXM_VAR_CONN_REAPED,
+	RXM_VAR_CONN_ACTIVE,
+	RXM_VAR_CONN_MEM,
+	RXM_VAR_SAR_LIMIT_MIN,
+	RXM_VAR_SAR_LIMIT_MAX,
+	RXM_VAR_SAR_SHIFTS,
+};
+
+/* Counters are only updated while a profile is open on the endpoint. */
+struct rxm_prof {
+	struct util_profile	util_prof;
+	struct rxm_ep		*ep;
+	uint64_t		conn_cnt;
+	uint64_t		conn_request;
+	uint64_t		conn_accept;
+	uint64_t		conn_reject;
+	uint64_t		conn_warmup;
+	uint64_t		conn_warmup_done;
+	uint64_t		conn_reaped;
+	uint64_t		conn_active;
+	uint64_t		conn_mem;
+	uint64_t		sar_limit_min;
+	uint64_t		sar_limit_max;
+	uint64_t		sar_shifts;
+};
+
+void rxm_prof_sar_limit(struct rxm_ep *ep);
+void rxm_prof_unlink(struct rxm_ep *ep);
+
+#define rxm_prof_inc(ep, field)			\
+	do {					\
+		if ((ep)->prof)			\
+			(ep)->prof->field++;	\
+	} while (0)
+
+#define rxm_prof_set(ep, field, val)		\
+	do {					\
+		if ((ep)->prof)			\
+			(ep)->prof->field = (val);	\
+	} while (0)
+
+#else
+
+#define rxm_prof_inc(ep, field)		do {} while (0)
+#define rxm_prof_set(ep, field, val)	do {} while (0)
+#define rxm_prof_sar_limit(ep)		do {} while (0)
+#define rxm_prof_unlink(ep)		do {} while (0)
+
+#endif
+
 
 enum rxm_cm_state {
 	RXM_CM_IDLE,
@@ -221,6 +291,45 @@ enum rxm_cm_state {
 
 enum {
 	RXM_CONN_INDEXED = BIT(0),
+	RXM_CONN_WARMUP = BIT(1),
+	RXM_CONN_ACTIVE = BIT(2),	/* used since the last reaper pass */
+	RXM_CONN_IDLE_CLOSE = BIT(3),	/* peer handles close requests */
+	RXM_CONN_CLOSING = BIT(4),	/* no new transfers until closed */
+	RXM_CONN_CLOSE_REQ = BIT(5),	/* close request sent to peer */
+	RXM_CONN_CLOSE_RESP = BIT(6),	/* close response owed to peer */
+	RXM_CONN_CLOSE_READY = BIT(7),	/* peer agreed to close */
+	RXM_CONN_RNDV_TIME = BIT(8),	/* peer reports its rndv read time */
+};
+
+/* With FI_OFI_RXM_SAR_TUNE, the crossover between SAR and rendezvous is
+ * chosen per connection.  Messages above the eager limit fall into size
+ * classes (eager_limit << c, eager_limit << (c + 1)], c < RXM_TUNE_CLASSES,
+ * and every RXM_TUNE_PROBE'th message of a class is sent with the protocol
+ * that is not currently selected, so both estimates stay current.  The
+ * crossover is always eager_limit << c, for c <= RXM_TUNE_CLASSES.
+ *
+ * Only the time spent moving data is compared.  For SAR this is from the
+ * first segment to the local completion of the last one.  For rendezvous
+ * it is the time to send the request, plus the time of the RMA transfer.
+ * The time the request waits for a matching receive at the peer depends
+ * on the peer application and is left out.  With the read protocol the
+ * peer reports its read time in the rd_done ack, so rendezvous is only
+ * measured on connections that negotiated RXM_CM_RNDV_TIME.
+ */
+#define RXM_TUNE_CLASSES	8
+#define RXM_TUNE_PROBE		32
+
+enum rxm_tune_proto {
+	RXM_TUNE_SAR,
+	RXM_TUNE_RNDV,
+	RXM_TUNE_PROTOS,
+};
+
+struct rxm_tune {
+	size_t sar_limit;
+	/* Average transfer time in ns per KiB, 0 until measured */
+	uint32_t ns_per_kb[RXM_TUNE_PROTOS][RXM_TUNE_CLASSES];
+	uint16_t sends[RXM_TUNE_CLASSES];
 };
 
 /* Each local rxm ep will have at most 1 connection to a single
@@ -240,7 +349,8 @@ struct rxm_conn {
 	 */
 	int remote_index;
 	uint32_t remote_pid;
-	uint8_t flags;
+	int tx_pending;
+	uint16_t flags;
 	uint8_t flow_ctrl;
 	uint8_t peer_flow_ctrl;
 
@@ -249,6 +359,9 @@ struct rxm_conn {
 	struct dlist_entry deferred_sar_msgs;
 	struct dlist_entry deferred_sar_segments;
 	struct dlist_entry loopback_entry;
+	struct dlist_entry conn_entry;
+
+	struct rxm_tune tune;
 };
 
 void rxm_freeall_conns(struct rxm_ep *ep);
@@ -408,7 +521,10 @@ enum {
 	rxm_ctrl_atomic_resp,
 	rxm_ctrl_credit,
 	rxm_ctrl_rndv_wr_data,
-	rxm_ctrl_rndv_wr_done
+	rxm_ctrl_rndv_wr_done,
+	/* only sent to peers that set RXM_CM_IDLE_CLOSE */
+	rxm_ctrl_close_req,
+	rxm_ctrl_close_resp,
 };
 
 struct rxm_pkt {
@@ -487,6 +603,7 @@ struct rxm_rx_buf {
 	struct dlist_entry rndv_wait_entry;
 	struct rxm_rndv_hdr *remote_rndv_hdr;
 	size_t rndv_rma_index;
+	uint64_t rndv_read_start;
 	struct fid_mr *mr[RXM_IOV_LIMIT];
 
 	/* Only differs from pkt.data for unexpected messages */
@@ -500,8 +617,15 @@ struct rxm_tx_buf {
 	struct rxm_buf hdr;
 
 	OFI_DBG_VAR(bool, user_tx)
+	struct rxm_conn *conn;
 	void *app_context;
 	uint64_t flags;
+	/* Transfer time of a tuned SAR or rendezvous send.  tune_start is
+	 * set while a timed span is running, tune_ns holds the completed
+	 * spans.  Both are 0 if the send is not measured.
+	 */
+	uint64_t tune_start;
+	uint64_t tune_ns;
 
 	union {
 		struct {
@@ -535,7 +659,7 @@ struct rxm_coll_buf {
 };
 
 /* Used for application transmits, provides credit check */
-struct rxm_tx_buf *rxm_get_tx_buf(struct rxm_ep *ep);
+struct rxm_tx_buf *rxm_get_tx_buf(struct rxm_ep *ep, struct rxm_conn *conn);
 void rxm_free_tx_buf(struct rxm_ep *ep, struct rxm_tx_buf *buf);
 
 /* Context for collective operations */
@@ -674,7 +798,9 @@ struct rxm_ep {
 	struct fi_info 		*msg_info;
 
 	int			connecting_cnt;
+	int			connected_cnt;
 	struct index_map	conn_idx_map;
+	struct dlist_entry	conn_list;
 	struct dlist_entry	loopback_list;
 	union ofi_sock_ip	addr;
 
@@ -700,6 +826,9 @@ struct rxm_ep {
 	bool			rdm_mr_local;
 	bool			do_progress;
 	bool			enable_direct_send;
+	bool			sar_tune;
+	/* Established connections per crossover, with sar_tune */
+	uint32_t		sar_limit_cnt[RXM_TUNE_CLASSES + 1];
 
 	size_t			min_multi_recv_size;
 	size_t			buffered_min;
@@ -724,11 +853,34 @@ struct rxm_ep {
 
 	struct rxm_eager_ops	*eager_ops;
 	struct rxm_rndv_ops	*rndv_ops;
+
+	/* Peers queued by FI_OPT_RXM_PREWARM, connected from prewarm_head */
+	fi_addr_t		*prewarm_addrs;
+	size_t			prewarm_head;
+	size_t			prewarm_cnt;
+	size_t			prewarm_size;
+
+	/* Next idle connection scan, and pending close handshake steps */
+	uint64_t		reap_time;
+	bool			close_pending;
+
+	struct rxm_prof		*prof;
 };
 
 int rxm_start_listen(struct rxm_ep *ep);
 void rxm_stop_listen(struct rxm_ep *ep);
 void rxm_conn_progress(struct rxm_ep *ep);
+int rxm_prewarm_addrs(struct rxm_ep *ep, const fi_addr_t *fi_addr,
+		      size_t count);
+void rxm_prewarm_progress(struct rxm_ep *ep);
+size_t rxm_conn_mem_size(struct rxm_ep *ep);
+ssize_t rxm_handle_close_req(struct rxm_rx_buf *rx_buf);
+ssize_t rxm_handle_close_resp(struct rxm_rx_buf *rx_buf);
+void rxm_tune_comp(struct rxm_ep *ep, struct rxm_tx_buf *tx_buf,
+		   enum rxm_tune_proto proto);
+void rxm_tune_track(struct rxm_ep *ep, struct rxm_conn *conn, int delta);
+int rxm_ep_ops_open(struct fid *fid, const char *name, uint64_t flags,
+		    void **ops, void *context);
 
 
 extern struct fi_provider rxm_prov;
@@ -925,6 +1077,40 @@ rxm_cq_write_src(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 ssize_t rxm_get_conn(struct rxm_ep *rxm_ep, fi_addr_t addr,
 		     struct rxm_conn **rxm_conn);
 
+static inline void
+rxm_tune_start(struct rxm_ep *ep, struct rxm_tx_buf *tx_buf)
+{
+	tx_buf->tune_start = ep->sar_tune ? ofi_gettime_ns() : 0;
+	tx_buf->tune_ns = 0;
+}
+
+/* Initial crossover of a tuned connection, the largest class boundary
+ * that does not exceed the configured sar_limit.
+ */
+static inline size_t rxm_tune_init_limit(struct rxm_ep *ep)
+{
+	size_t c = 0;
+
+	while (c < RXM_TUNE_CLASSES &&
+	       (ep->eager_limit << (c + 1)) <= ep->sar_limit)
+		c++;
+	return ep->eager_limit << c;
+}
+
+static inline void rxm_tune_stop(struct rxm_tx_buf *tx_buf)
+{
+	if (tx_buf->tune_start) {
+		tx_buf->tune_ns += MAX(ofi_gettime_ns() - tx_buf->tune_start, 1);
+		tx_buf->tune_start = 0;
+	}
+}
+
+static inline void rxm_tune_resume(struct rxm_tx_buf *tx_buf)
+{
+	if (tx_buf->tune_ns && !tx_buf->tune_start)
+		tx_buf->tune_start = ofi_gettime_ns();
+}
+
 static inline void
 rxm_ep_format_tx_buf_pkt(struct rxm_conn *rxm_conn, size_t len, uint8_t op,
 			 uint64_t data, uint64_t tag, uint64_t flags,
@@ -970,6 +1156,7 @@ ssize_t rxm_handle_unexp_sar(struct rxm_recv_queue *recv_queue,
 int rxm_post_recv(struct rxm_rx_buf *rx_buf);
 void rxm_av_remove_handler(struct util_ep *util_ep,
 			   struct util_peer_addr *peer);
+void rxm_av_insert_handler(struct util_ep *util_ep, fi_addr_t fi_addr);
 
 static inline void
 rxm_free_rx_buf(struct rxm_rx_buf *rx_buf)
@@ -152,7 +152,7 @@ rxm_ep_atomic_common(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 		return -FI_EINVAL;
 	}
 
-	tx_buf = rxm_get_tx_buf(rxm_ep);
+	tx_buf = rxm_get_tx_buf(rxm_ep, rxm_conn);
 	if (!tx_buf)
 		return -FI_EAGAIN;
 
@@ -43,6 +43,7 @@
 static void *rxm_cm_progress(void *arg);
 static void *rxm_cm_atomic_progress(void *arg);
 static void rxm_flush_msg_cq(struct rxm_ep *rxm_ep);
+static void rxm_conn_reap(struct rxm_ep *ep);
 
 
 /* castable to fi_eq_cm_entry - we can't use fi_eq_cm_entry directly
@@ -55,6 +56,27 @@ struct rxm_eq_cm_entry {
 };
 
 
+/* Buffers owned by an established connection, not counting the memory
+ * used by the msg provider for the msg ep itself.
+ */
+size_t rxm_conn_mem_size(struct rxm_ep *ep)
+{
+	size_t size = sizeof(struct rxm_conn);
+
+	if (!ep->msg_srx)
+		size += ep->msg_info->rx_attr->size *
+			(rxm_buffer_size + sizeof(struct rxm_rx_buf));
+	return size;
+}
+
+static void rxm_update_connected(struct rxm_ep *ep, int delta)
+{
+	ep->connected_cnt += delta;
+	assert(ep->connected_cnt >= 0);
+	rxm_prof_set(ep, conn_active, ep->connected_cnt);
+	rxm_prof_set(ep, conn_mem, ep->connected_cnt * rxm_conn_mem_size(ep));
+}
+
 static void rxm_close_conn(struct rxm_conn *conn)
 {
 	struct rxm_deferred_tx_entry *tx_entry;
@@ -89,10 +111,17 @@ static void rxm_close_conn(struct rxm_conn *conn)
 	rxm_flush_msg_cq(conn->ep);
 	dlist_remove_init(&conn->loopback_entry);
 	conn->msg_ep = NULL;
+	/* Everything else is negotiated again by the next connection. */
+	conn->flags &= RXM_CONN_INDEXED;
 
 	if (conn->state == RXM_CM_CONNECTING || conn->state == RXM_CM_ACCEPTING)
 		conn->ep->connecting_cnt--;
 	assert(conn->ep->connecting_cnt >= 0);
+	if (conn->state == RXM_CM_CONNECTED) {
+		dlist_remove_init(&conn->conn_entry);
+		rxm_update_connected(conn->ep, -1);
+		rxm_tune_track(conn->ep, conn, -1);
+	}
 	conn->state = RXM_CM_IDLE;
 }
 
@@ -251,6 +280,8 @@ static int rxm_init_connect_data(struct rxm_conn *conn,
 	cm_data->connect.flow_ctrl = conn->flow_ctrl ?
 						RXM_CM_FLOW_CTRL_PEER_ON :
 						RXM_CM_FLOW_CTRL_PEER_OFF;
+	cm_data->connect.flags = rxm_passthru_info(conn->ep->rxm_info) ?
+				 0 : RXM_CM_IDLE_CLOSE | RXM_CM_RNDV_TIME;
 
 	ret = fi_getopt(&conn->ep->msg_pep->fid, FI_OPT_ENDPOINT,
 			FI_OPT_CM_DATA_SIZE, &cm_data_size, &opt_size);
@@ -302,6 +333,7 @@ static int rxm_send_connect(struct rxm_conn *conn)
 	}
 	conn->state = RXM_CM_CONNECTING;
 	conn->ep->connecting_cnt++;
+	rxm_prof_inc(conn->ep, conn_request);
 	return 0;
 
 err:
@@ -410,6 +442,11 @@ rxm_alloc_conn(struct rxm_ep *ep, struct util_peer_addr *peer)
 	dlist_init(&conn->deferred_sar_msgs);
 	dlist_init(&conn->deferred_sar_segments);
 	dlist_init(&conn->loopback_entry);
+	dlist_init(&conn->conn_entry);
+	conn->tx_pending = 0;
+	memset(&conn->tune, 0, sizeof(conn->tune));
+	conn->tune.sar_limit = ep->sar_tune ?
+		rxm_tune_init_limit(ep) : ep->sar_limit;
 
 	conn->peer = peer;
 	rxm_ref_peer(peer);
@@ -455,6 +492,12 @@ ssize_t rxm_get_conn(struct rxm_ep *ep, fi_addr_t addr, struct rxm_conn **conn)
 		return -FI_ENOMEM;
 
 	if ((*conn)->state == RXM_CM_CONNECTED) {
+		if ((*conn)->flags & RXM_CONN_CLOSING) {
+			rxm_ep_do_progress(&ep->util_ep);
+			rxm_conn_progress(ep);
+			return -FI_EAGAIN;
+		}
+		(*conn)->flags |= RXM_CONN_ACTIVE;
 		if (!dlist_empty(&(*conn)->deferred_tx_queue)) {
 			rxm_ep_do_progress(&ep->util_ep);
 			if (!dlist_empty(&(*conn)->deferred_tx_queue))
@@ -512,6 +555,13 @@ void rxm_process_connect(struct rxm_eq_cm_entry *cm_entry)
 		conn->remote_pid = rxm_peer_pid(cm_entry->data.accept.
 						server_conn_id);
 		rxm_set_peer_flow_ctrl(conn, cm_entry->data.accept.flow_ctrl);
+		if ((cm_entry->data.accept.flags & RXM_CM_IDLE_CLOSE) &&
+		    !rxm_passthru_info(conn->ep->rxm_info) &&
+		    ofi_addr_cmp(&rxm_prov, &conn->peer->addr.sa,
+				 &conn->ep->addr.sa))
+			conn->flags |= RXM_CONN_IDLE_CLOSE;
+		if (cm_entry->data.accept.flags & RXM_CM_RNDV_TIME)
+			conn->flags |= RXM_CONN_RNDV_TIME;
 	}
 
 	if (conn->flow_ctrl & conn->peer_flow_ctrl) {
@@ -524,6 +574,15 @@ void rxm_process_connect(struct rxm_eq_cm_entry *cm_entry)
 	conn->ep->connecting_cnt--;
 	assert(conn->ep->connecting_cnt >= 0);
 	conn->state = RXM_CM_CONNECTED;
+	conn->flags |= RXM_CONN_ACTIVE;
+	dlist_insert_tail(&conn->conn_entry, &conn->ep->conn_list);
+	rxm_update_connected(conn->ep, 1);
+	rxm_tune_track(conn->ep, conn, 1);
+	rxm_prof_inc(conn->ep, conn_cnt);
+	if (conn->flags & RXM_CONN_WARMUP) {
+		rxm_prof_inc(conn->ep, conn_warmup_done);
+		conn->flags &= ~RXM_CONN_WARMUP;
+	}
 }
 
 /* For simultaneous connection requests, if the peer won the coin
@@ -619,6 +678,8 @@ rxm_reject_connreq(struct rxm_ep *ep, struct rxm_eq_cm_entry *cm_entry,
 			&cm_data.reject, sizeof(cm_data.reject));
 	if (ret)
 		RXM_WARN_ERR(FI_LOG_EP_CTRL, "fi_reject", ret);
+	else
+		rxm_prof_inc(ep, conn_reject);
 }
 
 static int
@@ -631,9 +692,10 @@ rxm_accept_connreq(struct rxm_conn *conn, struct rxm_eq_cm_entry *cm_entry)
 	cm_data.accept.rx_size = (uint32_t) cm_entry->info->rx_attr->size;
 	cm_data.accept.flow_ctrl = conn->flow_ctrl ? RXM_CM_FLOW_CTRL_PEER_ON :
 						     RXM_CM_FLOW_CTRL_PEER_OFF;
+	cm_data.accept.flags = rxm_passthru_info(conn->ep->rxm_info) ?
+			       0 : RXM_CM_IDLE_CLOSE | RXM_CM_RNDV_TIME;
 	cm_data.accept.align_pad[0] = 0;
 	cm_data.accept.align_pad[1] = 0;
-	cm_data.accept.align_pad[2] = 0;
 
 	ret = fi_accept(conn->msg_ep, &cm_data.accept, sizeof(cm_data.accept));
 	if (ret)
@@ -729,6 +791,12 @@ rxm_process_connreq(struct rxm_ep *ep, struct rxm_eq_cm_entry *cm_entry)
 		goto free;
 
 	rxm_set_peer_flow_ctrl(conn, cm_entry->data.connect.flow_ctrl);
+	if ((cm_entry->data.connect.flags & RXM_CM_IDLE_CLOSE) &&
+	    !rxm_passthru_info(ep->rxm_info) &&
+	    dlist_empty(&conn->loopback_entry))
+		conn->flags |= RXM_CONN_IDLE_CLOSE;
+	if (cm_entry->data.connect.flags & RXM_CM_RNDV_TIME)
+		conn->flags |= RXM_CONN_RNDV_TIME;
 
 	ret = rxm_accept_connreq(conn, cm_entry);
 	if (ret)
@@ -736,6 +804,7 @@ rxm_process_connreq(struct rxm_ep *ep, struct rxm_eq_cm_entry *cm_entry)
 
 	conn->state = RXM_CM_ACCEPTING;
 	conn->ep->connecting_cnt++;
+	rxm_prof_inc(ep, conn_accept);
 put:
 	util_put_peer(peer);
 	fi_freeinfo(cm_entry->info);
@@ -754,6 +823,8 @@ reject:
 
 void rxm_process_shutdown(struct rxm_conn *conn)
 {
+	bool reaped;
+
 	assert(ofi_genlock_held(&conn->ep->util_ep.lock));
 
 	FI_INFO(&rxm_prov, FI_LOG_EP_CTRL, "shutdown conn %p (state %d)\n",
@@ -765,8 +836,13 @@ void rxm_process_shutdown(struct rxm_conn *conn)
 	case RXM_CM_CONNECTING:
 	case RXM_CM_ACCEPTING:
 	case RXM_CM_CONNECTED:
+		reaped = conn->flags & RXM_CONN_CLOSING;
 		rxm_close_conn(conn);
-		rxm_free_conn(conn);
+		/* Connections closed for idleness, or still referenced by
+		 * transmits, are kept to reconnect on the next transfer.
+		 */
+		if (!reaped && !conn->tx_pending)
+			rxm_free_conn(conn);
 		break;
 	default:
 		break;
@@ -853,6 +929,255 @@ void rxm_conn_progress(struct rxm_ep *ep)
 			ret = 1;
 		}
 	} while (ret > 0);
+
+	rxm_prewarm_progress(ep);
+	rxm_conn_reap(ep);
+}
+
+/* Connect to queued peers, keeping at most rxm_prewarm_window handshakes
+ * in flight.  Further connections are started as earlier ones complete,
+ * so that prewarming thousands of peers does not flood their listeners.
+ */
+void rxm_prewarm_progress(struct rxm_ep *ep)
+{
+	struct util_peer_addr **peer;
+	struct rxm_conn *conn;
+	fi_addr_t fi_addr;
+	int ret;
+
+	assert(ofi_genlock_held(&ep->util_ep.lock));
+	while (ep->prewarm_head < ep->prewarm_cnt &&
+	       ep->connecting_cnt < rxm_prewarm_window) {
+		fi_addr = ep->prewarm_addrs[ep->prewarm_head];
+
+		/* The address may have been removed after it was queued. */
+		if (!ofi_ip_av_is_valid(&ep->util_ep.av->av_fid, fi_addr)) {
+			ep->prewarm_head++;
+			continue;
+		}
+
+		peer = ofi_av_addr_context(ep->util_ep.av, fi_addr);
+		if (!*peer) {
+			ep->prewarm_head++;
+			continue;
+		}
+
+		conn = rxm_add_conn(ep, *peer);
+		if (!conn)
+			break;
+
+		ep->prewarm_head++;
+		if (conn->state != RXM_CM_IDLE)
+			continue;
+
+		ret = rxm_send_connect(conn);
+		if (ret) {
+			RXM_WARN_ERR(FI_LOG_EP_CTRL, "rxm_send_connect", ret);
+			continue;
+		}
+		conn->flags |= RXM_CONN_WARMUP;
+		rxm_prof_inc(ep, conn_warmup);
+	}
+
+	if (ep->prewarm_head == ep->prewarm_cnt)
+		ep->prewarm_head = ep->prewarm_cnt = 0;
+}
+
+int rxm_prewarm_addrs(struct rxm_ep *ep, const fi_addr_t *fi_addr,
+		      size_t count)
+{
+	fi_addr_t *addrs;
+	size_t size;
+
+	assert(ofi_genlock_held(&ep->util_ep.lock));
+	if (ep->prewarm_cnt + count > ep->prewarm_size) {
+		size = MAX(ep->prewarm_cnt + count, ep->prewarm_size * 2);
+		addrs = realloc(ep->prewarm_addrs, size * sizeof(*addrs));
+		if (!addrs)
+			return -FI_ENOMEM;
+
+		ep->prewarm_addrs = addrs;
+		ep->prewarm_size = size;
+	}
+
+	memcpy(&ep->prewarm_addrs[ep->prewarm_cnt], fi_addr,
+	       count * sizeof(*fi_addr));
+	ep->prewarm_cnt += count;
+
+	/* Before the endpoint is enabled, connections start from fi_enable. */
+	if (ep->msg_cq)
+		rxm_prewarm_progress(ep);
+	return 0;
+}
+
+/* Idle connections are closed with a handshake over the connection itself,
+ * so that nothing is in flight when it goes away.  The side that found the
+ * connection idle sends a close request and stops issuing transfers on it.
+ * The peer agrees if it has nothing outstanding on the connection either,
+ * and stops issuing transfers as well, or refuses.  Both messages follow
+ * any earlier data on the connection, so the requester may close it as soon
+ * as the peer agrees.  Transfers posted meanwhile return -FI_EAGAIN, and
+ * reconnect once the connection is closed.
+ */
+static bool rxm_conn_quiesced(struct rxm_conn *conn)
+{
+	return !conn->tx_pending && dlist_empty(&conn->deferred_tx_queue) &&
+	       dlist_empty(&conn->deferred_sar_msgs) &&
+	       dlist_empty(&conn->deferred_sar_segments);
+}
+
+static int rxm_send_close_ctrl(struct rxm_conn *conn, uint8_t type,
+			       uint64_t ctrl_data)
+{
+	struct rxm_tx_buf *tx_buf;
+	struct iovec iov;
+	struct fi_msg msg;
+	ssize_t ret;
+
+	tx_buf = ofi_buf_alloc(conn->ep->tx_pool);
+	if (!tx_buf)
+		return -FI_ENOMEM;
+
+	/* Completes like a credit message, by releasing the buffer. */
+	tx_buf->hdr.state = RXM_CREDIT_TX;
+	rxm_ep_format_tx_buf_pkt(conn, 0, type, 0, 0, 0, &tx_buf->pkt);
+	tx_buf->pkt.ctrl_hdr.type = type;
+	tx_buf->pkt.ctrl_hdr.msg_id = ofi_buf_index(tx_buf);
+	tx_buf->pkt.ctrl_hdr.ctrl_data = ctrl_data;
+
+	iov.iov_base = &tx_buf->pkt;
+	iov.iov_len = sizeof(struct rxm_pkt);
+	msg.msg_iov = &iov;
+	msg.iov_count = 1;
+	msg.context = tx_buf;
+	msg.desc = &tx_buf->hdr.desc;
+
+	/* Not OFI_PRIORITY: the message must not overtake earlier data. */
+	ret = fi_sendmsg(conn->msg_ep, &msg, 0);
+	if (ret)
+		ofi_buf_free(tx_buf);
+	return (int) ret;
+}
+
+static void rxm_send_close_resp(struct rxm_conn *conn)
+{
+	if (rxm_send_close_ctrl(conn, rxm_ctrl_close_resp,
+				conn->flags & RXM_CONN_CLOSING ? 1 : 0)) {
+		conn->ep->close_pending = true;
+		return;
+	}
+	conn->flags &= ~RXM_CONN_CLOSE_RESP;
+}
+
+static struct rxm_conn *rxm_rx_buf_conn(struct rxm_rx_buf *rx_buf)
+{
+	struct rxm_conn *conn;
+
+	if (!rx_buf->ep->msg_srx)
+		return rx_buf->conn;
+
+	conn = ofi_idm_lookup(&rx_buf->ep->conn_idx_map,
+			      (int) rx_buf->pkt.ctrl_hdr.conn_id);
+	return conn && conn->state == RXM_CM_CONNECTED ? conn : NULL;
+}
+
+ssize_t rxm_handle_close_req(struct rxm_rx_buf *rx_buf)
+{
+	struct rxm_conn *conn;
+
+	assert(ofi_genlock_held(&rx_buf->ep->util_ep.lock));
+	conn = rxm_rx_buf_conn(rx_buf);
+	if (!conn)
+		goto out;
+
+	FI_DBG(&rxm_prov, FI_LOG_EP_CTRL, "close request for conn %p\n", conn);
+	/* If both sides asked at once, ours already stopped all transfers. */
+	if (!(conn->flags & RXM_CONN_CLOSING) && rxm_conn_quiesced(conn))
+		conn->flags |= RXM_CONN_CLOSING;
+
+	conn->flags |= RXM_CONN_CLOSE_RESP;
+	rxm_send_close_resp(conn);
+out:
+	rxm_free_rx_buf(rx_buf);
+	return FI_SUCCESS;
+}
+
+ssize_t rxm_handle_close_resp(struct rxm_rx_buf *rx_buf)
+{
+	struct rxm_conn *conn;
+
+	assert(ofi_genlock_held(&rx_buf->ep->util_ep.lock));
+	conn = rxm_rx_buf_conn(rx_buf);
+	if (!conn || !(conn->flags & RXM_CONN_CLOSE_REQ))
+		goto out;
+
+	FI_DBG(&rxm_prov, FI_LOG_EP_CTRL, "close %s for conn %p\n",
+	       rx_buf->pkt.ctrl_hdr.ctrl_data ? "accepted" : "refused", conn);
+	if (rx_buf->pkt.ctrl_hdr.ctrl_data) {
+		/* Closing the msg ep here would flush the msg CQ from
+		 * within its own completion handling.
+		 */
+		conn->flags |= RXM_CONN_CLOSE_READY;
+		conn->ep->close_pending = true;
+	} else {
+		conn->flags &= ~(RXM_CONN_CLOSING | RXM_CONN_CLOSE_REQ);
+		conn->flags |= RXM_CONN_ACTIVE;
+	}
+out:
+	rxm_free_rx_buf(rx_buf);
+	return FI_SUCCESS;
+}
+
+/* Runs the close handshake steps left pending, then, once per
+ * rxm_conn_idle_timeout, asks the peers of connections that were not used
+ * since the previous pass to close them.  Connections are thus closed
+ * after being idle for one to two timeouts.
+ */
+static void rxm_conn_reap(struct rxm_ep *ep)
+{
+	struct rxm_conn *conn;
+	struct dlist_entry *tmp;
+	uint64_t now;
+
+	assert(ofi_genlock_held(&ep->util_ep.lock));
+	if (ep->close_pending) {
+		ep->close_pending = false;
+		dlist_foreach_container_safe(&ep->conn_list, struct rxm_conn,
+					     conn, conn_entry, tmp) {
+			if (conn->flags & RXM_CONN_CLOSE_READY) {
+				FI_INFO(&rxm_prov, FI_LOG_EP_CTRL,
+					"closing idle conn %p\n", conn);
+				rxm_close_conn(conn);
+				rxm_prof_inc(ep, conn_reaped);
+			} else if (conn->flags & RXM_CONN_CLOSE_RESP) {
+				rxm_send_close_resp(conn);
+			}
+		}
+	}
+
+	if (!rxm_conn_idle_timeout)
+		return;
+
+	now = ofi_gettime_ms();
+	if (now < ep->reap_time)
+		return;
+
+	ep->reap_time = now + rxm_conn_idle_timeout;
+	dlist_foreach_container(&ep->conn_list, struct rxm_conn, conn,
+				conn_entry) {
+		if (!(conn->flags & RXM_CONN_IDLE_CLOSE) ||
+		    (conn->flags & RXM_CONN_CLOSING))
+			continue;
+
+		if ((conn->flags & RXM_CONN_ACTIVE) ||
+		    !rxm_conn_quiesced(conn)) {
+			conn->flags &= ~RXM_CONN_ACTIVE;
+			continue;
+		}
+
+		if (!rxm_send_close_ctrl(conn, rxm_ctrl_close_req, 0))
+			conn->flags |= RXM_CONN_CLOSING | RXM_CONN_CLOSE_REQ;
+	}
 }
 
 void rxm_stop_listen(struct rxm_ep *ep)
@@ -944,6 +1269,7 @@ static void *rxm_cm_progress(void *arg)
 			RXM_WARN_ERR(FI_LOG_EP_CTRL, "fi_eq_read", ret);
 			break;
 		}
+		rxm_prewarm_progress(ep);
 	}
 	ofi_genlock_unlock(&ep->util_ep.lock);
 
@@ -1066,3 +1392,19 @@ void rxm_av_remove_handler(struct util_ep *util_ep, struct util_peer_addr *peer)
 	}
 	ofi_genlock_unlock(&ep->util_ep.lock);
 }
+
+void rxm_av_insert_handler(struct util_ep *util_ep, fi_addr_t fi_addr)
+{
+	struct rxm_ep *ep;
+	int ret;
+
+	ep = container_of(util_ep, struct rxm_ep, util_ep);
+	if (rxm_passthru_info(ep->rxm_info))
+		return;
+
+	ofi_genlock_lock(&ep->util_ep.lock);
+	ret = rxm_prewarm_addrs(ep, &fi_addr, 1);
+	ofi_genlock_unlock(&ep->util_ep.lock);
+	if (ret)
+		RXM_WARN_ERR(FI_LOG_EP_CTRL, "rxm_prewarm_addrs", ret);
+}
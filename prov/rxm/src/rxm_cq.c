@@ -237,6 +237,7 @@ static bool rxm_complete_sar(struct rxm_ep *rxm_ep,
 	case RXM_SAR_SEG_LAST:
 		first_tx_buf = ofi_bufpool_get_ibuf(rxm_ep->tx_pool,
 						tx_buf->pkt.ctrl_hdr.msg_id);
+		rxm_tune_comp(rxm_ep, first_tx_buf, RXM_TUNE_SAR);
 		rxm_free_tx_buf(rxm_ep, first_tx_buf);
 		rxm_free_tx_buf(rxm_ep, tx_buf);
 		return true;
@@ -284,6 +285,7 @@ static void rxm_rndv_tx_finish(struct rxm_ep *rxm_ep,
 	assert(ofi_tx_cq_flags(tx_buf->pkt.hdr.op) & FI_SEND);
 
 	RXM_UPDATE_STATE(FI_LOG_CQ, tx_buf, RXM_RNDV_FINISH);
+	rxm_tune_comp(rxm_ep, tx_buf, RXM_TUNE_RNDV);
 	if (!rxm_ep->rdm_mr_local)
 		rxm_msg_mr_closev(tx_buf->rma.mr, tx_buf->rma.count);
 
@@ -311,6 +313,15 @@ static void rxm_rndv_handle_rd_done(struct rxm_ep *rxm_ep,
 				      rx_buf->pkt.ctrl_hdr.msg_id);
 	assert(tx_buf->pkt.ctrl_hdr.msg_id == rx_buf->pkt.ctrl_hdr.msg_id);
 
+	/* Add the peer's read time to the time spent sending the request.
+	 * If the request has not completed locally yet, its span includes
+	 * the read, so the send is not measured.
+	 */
+	if (tx_buf->tune_start || !(tx_buf->conn->flags & RXM_CONN_RNDV_TIME))
+		tx_buf->tune_start = tx_buf->tune_ns = 0;
+	else if (tx_buf->tune_ns)
+		tx_buf->tune_ns += rx_buf->pkt.ctrl_hdr.ctrl_data;
+
 	rxm_free_rx_buf(rx_buf);
 
 	if (tx_buf->hdr.state == RXM_RNDV_READ_DONE_WAIT) {
@@ -510,6 +521,7 @@ ssize_t rxm_rndv_read(struct rxm_rx_buf *rx_buf)
 
 	total_len = MIN(rx_buf->recv_entry->total_len, rx_buf->pkt.hdr.size);
 	RXM_UPDATE_STATE(FI_LOG_CQ, rx_buf, RXM_RNDV_READ);
+	rx_buf->rndv_read_start = ofi_gettime_ns();
 
 	ret = rxm_rndv_xfer(rx_buf->ep, rx_buf->conn->msg_ep,
 			    rx_buf->remote_rndv_hdr,
@@ -555,6 +567,7 @@ static ssize_t rxm_rndv_handle_wr_data(struct rxm_rx_buf *rx_buf)
 	 * RXM_RNDV_TX or RXM_RNDV_WRITE_DATA_WAIT.
 	 */
 	RXM_UPDATE_STATE(FI_LOG_CQ, tx_buf, RXM_RNDV_WRITE);
+	rxm_tune_resume(tx_buf);
 
 	ret = rxm_rndv_xfer(rx_buf->ep, tx_buf->write_rndv.conn->msg_ep, rx_hdr,
 			    tx_buf->write_rndv.iov, tx_buf->write_rndv.desc,
@@ -837,6 +850,9 @@ static void rxm_rndv_send_rd_done(struct rxm_rx_buf *rx_buf)
 	buf->pkt.ctrl_hdr.type = rxm_ctrl_rndv_rd_done;
 	buf->pkt.ctrl_hdr.conn_id = rx_buf->conn->remote_index;
 	buf->pkt.ctrl_hdr.msg_id = rx_buf->pkt.ctrl_hdr.msg_id;
+	/* Read time, for the sender's SAR tuning (RXM_CM_RNDV_TIME) */
+	buf->pkt.ctrl_hdr.ctrl_data = ofi_gettime_ns() -
+				      rx_buf->rndv_read_start;
 
 	ret = fi_send(rx_buf->conn->msg_ep, &buf->pkt, sizeof(buf->pkt),
 		      buf->hdr.desc, 0, rx_buf);
@@ -1316,6 +1332,21 @@ write_err:
 	goto free;
 }
 
+/* Keeps the idle connection reaper away from connections we receive on */
+static void rxm_mark_conn_active(struct rxm_rx_buf *rx_buf)
+{
+	struct rxm_conn *conn;
+
+	if (rx_buf->ep->msg_srx)
+		conn = ofi_idm_lookup(&rx_buf->ep->conn_idx_map,
+				      (int) rx_buf->pkt.ctrl_hdr.conn_id);
+	else
+		conn = rx_buf->conn;
+
+	if (conn)
+		conn->flags |= RXM_CONN_ACTIVE;
+}
+
 static ssize_t rxm_handle_credit(struct rxm_ep *rxm_ep, struct rxm_rx_buf *rx_buf)
 {
 	struct rxm_domain *domain;
@@ -1380,6 +1411,8 @@ ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp)
 		assert(!(comp->flags & FI_REMOTE_READ));
 		assert((rx_buf->pkt.hdr.version == OFI_OP_VERSION) &&
 		       (rx_buf->pkt.ctrl_hdr.version == RXM_CTRL_VERSION));
+		if (rxm_conn_idle_timeout)
+			rxm_mark_conn_active(rx_buf);
 
 		switch (rx_buf->pkt.ctrl_hdr.type) {
 		case rxm_ctrl_eager:
@@ -1400,6 +1433,10 @@ ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp)
 			return rxm_handle_atomic_resp(rxm_ep, rx_buf);
 		case rxm_ctrl_credit:
 			return rxm_handle_credit(rxm_ep, rx_buf);
+		case rxm_ctrl_close_req:
+			return rxm_handle_close_req(rx_buf);
+		case rxm_ctrl_close_resp:
+			return rxm_handle_close_resp(rx_buf);
 		default:
 			FI_WARN(&rxm_prov, FI_LOG_CQ, "Unknown message type\n");
 			assert(0);
@@ -1413,6 +1450,8 @@ ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp)
 	case RXM_RNDV_TX:
 		tx_buf = comp->op_context;
 		assert(comp->flags & FI_SEND);
+		/* The wait for the peer to match the request is not timed */
+		rxm_tune_stop(tx_buf);
 		if (rxm_ep->rndv_ops == &rxm_rndv_ops_write)
 			RXM_UPDATE_STATE(FI_LOG_CQ, tx_buf,
 					 RXM_RNDV_WRITE_DATA_WAIT);
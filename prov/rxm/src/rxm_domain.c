@@ -241,6 +241,8 @@ rxm_av_open(struct fid_domain *domain_fid, struct fi_av_attr *attr,
 		return ret;
 
 	rxm_av = container_of(fid_av_new, struct rxm_av, util_av.av_fid);
+	if (rxm_prewarm)
+		rxm_av->insert_handler = rxm_av_insert_handler;
 	rxm_domain = container_of(domain_fid, struct rxm_domain,
 				  util_domain.domain_fid);
 
@@ -263,6 +263,18 @@ static int rxm_ep_create_pools(struct rxm_ep *rxm_ep)
 	attr.context = rxm_ep;
 	attr.flags = OFI_BUFPOOL_NO_TRACK;
 
+	if (rxm_buffer_numa_node != RXM_NUMA_NODE_NONE) {
+		attr.flags |= OFI_BUFPOOL_NUMA;
+		attr.numa_node = rxm_buffer_numa_node;
+		if (attr.numa_node < 0) {
+			ret = ofi_nic_numa_node(rxm_ep->msg_info->nic);
+			attr.numa_node = ret < 0 ? OFI_BUFPOOL_NUMA_LOCAL : ret;
+		}
+		FI_INFO(&rxm_prov, FI_LOG_EP_CTRL,
+			"binding buffer pools to NUMA node %d\n",
+			attr.numa_node);
+	}
+
 	ret = ofi_bufpool_create_attr(&attr, &rxm_ep->rx_pool);
 	if (ret) {
 		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
@@ -495,6 +507,37 @@ static int rxm_ep_getopt(fid_t fid, int level, int optname, void *optval,
 	return FI_SUCCESS;
 }
 
+static int rxm_ep_set_prewarm(struct rxm_ep *rxm_ep,
+			      const struct fi_rxm_prewarm *prewarm,
+			      size_t optlen)
+{
+	size_t i;
+	int ret;
+
+	if (optlen != sizeof(*prewarm))
+		return -FI_EINVAL;
+
+	if (rxm_passthru_info(rxm_ep->rxm_info))
+		return -FI_EOPNOTSUPP;
+
+	if (!rxm_ep->util_ep.av) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+			"FI_OPT_RXM_PREWARM requires a bound AV\n");
+		return -FI_EOPBADSTATE;
+	}
+
+	for (i = 0; i < prewarm->count; i++) {
+		if (!ofi_ip_av_is_valid(&rxm_ep->util_ep.av->av_fid,
+					prewarm->fi_addr[i]))
+			return -FI_EINVAL;
+	}
+
+	ofi_genlock_lock(&rxm_ep->util_ep.lock);
+	ret = rxm_prewarm_addrs(rxm_ep, prewarm->fi_addr, prewarm->count);
+	ofi_genlock_unlock(&rxm_ep->util_ep.lock);
+	return ret;
+}
+
 static int rxm_ep_setopt(fid_t fid, int level, int optname,
 			 const void *optval, size_t optlen)
 {
@@ -546,6 +589,9 @@ static int rxm_ep_setopt(fid_t fid, int level, int optname,
 		 */
 		ret = rxm_ep->enable_direct_send ? FI_SUCCESS : -FI_EOPNOTSUPP;
 		break;
+	case FI_OPT_RXM_PREWARM:
+		ret = rxm_ep_set_prewarm(rxm_ep, optval, optlen);
+		break;
 
 	default:
 		ret = -FI_ENOPROTOOPT;
@@ -657,7 +703,7 @@ rxm_multi_recv_entry_get(struct rxm_ep *rxm_ep, const struct iovec *iov,
 	return recv_entry;
 }
 
-struct rxm_tx_buf *rxm_get_tx_buf(struct rxm_ep *ep)
+struct rxm_tx_buf *rxm_get_tx_buf(struct rxm_ep *ep, struct rxm_conn *conn)
 {
 	struct rxm_tx_buf *buf;
 
@@ -669,6 +715,8 @@ struct rxm_tx_buf *rxm_get_tx_buf(struct rxm_ep *ep)
 	if (buf) {
 		OFI_DBG_SET(buf->user_tx, true);
 		ep->tx_credit--;
+		buf->conn = conn;
+		conn->tx_pending++;
 	}
 	return buf;
 }
@@ -679,6 +727,8 @@ void rxm_free_tx_buf(struct rxm_ep *ep, struct rxm_tx_buf *buf)
 	assert(buf->user_tx);
 	OFI_DBG_SET(buf->user_tx, false);
 	ep->tx_credit++;
+	buf->conn->tx_pending--;
+	assert(buf->conn->tx_pending >= 0);
 	ofi_buf_free(buf);
 }
 
@@ -1239,6 +1289,8 @@ static int rxm_ep_close(struct fid *fid)
 		ep->offload_coll_ep = NULL;
 	}
 
+	rxm_prof_unlink(ep);
+	free(ep->prewarm_addrs);
 	free(ep->inject_pkt);
 	ofi_endpoint_close(&ep->util_ep);
 	fi_freeinfo(ep->msg_info);
@@ -1403,6 +1455,8 @@ static void rxm_ep_init_proto(struct rxm_ep *ep)
 	} else {
 		ep->sar_limit = ep->eager_limit * 8;
 	}
+
+	ep->sar_tune = rxm_sar_tune;
 }
 
 /* Direct send works with verbs, provided that msg_mr_local == rdm_mr_local.
@@ -1572,6 +1626,9 @@ static int rxm_ep_ctrl(struct fid *fid, int command, void *arg)
 		if (ret)
 			goto err;
 
+		ofi_genlock_lock(&ep->util_ep.lock);
+		rxm_prewarm_progress(ep);
+		ofi_genlock_unlock(&ep->util_ep.lock);
 		break;
 	default:
 		return -FI_ENOSYS;
@@ -1662,7 +1719,7 @@ static struct fi_ops rxm_ep_fi_ops = {
 	.close = rxm_ep_close,
 	.bind = rxm_ep_bind,
 	.control = rxm_ep_ctrl,
-	.ops_open = fi_no_ops_open,
+	.ops_open = rxm_ep_ops_open,
 };
 
 static int rxm_listener_open(struct rxm_ep *rxm_ep)
@@ -1938,6 +1995,7 @@ int rxm_endpoint(struct fid_domain *domain, struct fi_info *info,
 	if (rxm_ep->rxm_info->caps & FI_ATOMIC)
 		(*ep_fid)->atomic = &rxm_ops_atomic;
 
+	dlist_init(&rxm_ep->conn_list);
 	dlist_init(&rxm_ep->loopback_list);
 
 	return 0;
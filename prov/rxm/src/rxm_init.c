@@ -59,6 +59,11 @@ int rxm_passthru = 0; /* disable by default, need to analyze performance */
 int force_auto_progress;
 int rxm_use_write_rndv;
 int rxm_detect_hmem_iface;
+int rxm_buffer_numa_node = RXM_NUMA_NODE_NONE;
+int rxm_prewarm;
+int rxm_prewarm_window = 64;
+int rxm_conn_idle_timeout;
+int rxm_sar_tune;
 enum fi_wait_obj def_wait_obj = FI_WAIT_FD, def_tcp_wait_obj = FI_WAIT_UNSPEC;
 
 char *rxm_proto_state_str[] = {
@@ -700,6 +705,34 @@ RXM_INI
 			"in. This allows such buffers be copied or registered "
 			"internally by RxM. (default: false).");
 
+	fi_param_define(&rxm_prov, "buffer_numa_node", FI_PARAM_INT,
+			"NUMA node to place the bounce buffer pools of each "
+			"endpoint on.  Set to -1 to use the node of the core "
+			"provider's NIC, or the node of the thread growing "
+			"the pool if that is unknown.  (default: not bound)");
+
+	fi_param_define(&rxm_prov, "prewarm", FI_PARAM_BOOL,
+			"Connect to every peer as soon as it is inserted into "
+			"the AV, rather than on the first transfer to it "
+			"(default: false).");
+
+	fi_param_define(&rxm_prov, "prewarm_window", FI_PARAM_INT,
+			"Maximum number of connection handshakes in flight "
+			"while connecting to peers ahead of use, either with "
+			"prewarm or FI_OPT_RXM_PREWARM (default: 64).");
+
+	fi_param_define(&rxm_prov, "conn_idle_timeout", FI_PARAM_INT,
+			"Close connections that carried no traffic for this "
+			"many milliseconds.  They are re-established on the "
+			"next transfer to the peer.  Only applies to peers "
+			"that support it.  (default: 0, disabled)");
+
+	fi_param_define(&rxm_prov, "sar_tune", FI_PARAM_BOOL,
+			"Measure the send completion time of the SAR and "
+			"rendezvous protocols per peer and move the crossover "
+			"between them to the faster one, between eager_limit "
+			"and 256 times eager_limit.  (default: false)");
+
 	/* passthru supported disabled - to re-enable would need to fix call to
 	 * fi_cq_read to pass in the correct data structure.  However, passthru
 	 * will not be needed at all with in-work tcp changes.
@@ -726,10 +759,20 @@ RXM_INI
 			"level would be set to FI_THREAD_SAFE\n");
 
 	fi_param_get_bool(&rxm_prov, "detect_hmem_iface", &rxm_detect_hmem_iface);
+	fi_param_get_int(&rxm_prov, "buffer_numa_node", &rxm_buffer_numa_node);
+	fi_param_get_bool(&rxm_prov, "prewarm", &rxm_prewarm);
+	fi_param_get_int(&rxm_prov, "prewarm_window", &rxm_prewarm_window);
+	if (rxm_prewarm_window < 1)
+		rxm_prewarm_window = 1;
+	fi_param_get_int(&rxm_prov, "conn_idle_timeout", &rxm_conn_idle_timeout);
+	if (rxm_conn_idle_timeout < 0)
+		rxm_conn_idle_timeout = 0;
+	fi_param_get_bool(&rxm_prov, "sar_tune", &rxm_sar_tune);
 
 #if HAVE_RXM_DL
 	ofi_mem_init();
 	ofi_hmem_init();
+	ofi_copy_init();
 #endif
 
 	return &rxm_prov;
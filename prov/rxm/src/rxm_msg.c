@@ -290,7 +290,7 @@ rxm_alloc_rndv_buf(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	size_t len, i;
 	ssize_t ret;
 
-	*rndv_buf = rxm_get_tx_buf(rxm_ep);
+	*rndv_buf = rxm_get_tx_buf(rxm_ep, rxm_conn);
 	if (!*rndv_buf)
 		return -FI_EAGAIN;
 
@@ -301,6 +301,7 @@ rxm_alloc_rndv_buf(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	(*rndv_buf)->app_context = context;
 	(*rndv_buf)->flags = flags;
 	(*rndv_buf)->rma.count = count;
+	rxm_tune_start(rxm_ep, *rndv_buf);
 
 	if (!rxm_ep->rdm_mr_local) {
 		ret = rxm_msg_mr_regv(rxm_ep, iov, (*rndv_buf)->rma.count, data_len,
@@ -395,7 +396,7 @@ rxm_init_segment(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 {
 	struct rxm_tx_buf *tx_buf;
 
-	tx_buf = rxm_get_tx_buf(rxm_ep);
+	tx_buf = rxm_get_tx_buf(rxm_ep, rxm_conn);
 	if (!tx_buf)
 		return NULL;
 
@@ -406,6 +407,7 @@ rxm_init_segment(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 				 &tx_buf->pkt);
 	if (seg_type == RXM_SAR_SEG_FIRST) {
 		*msg_id = tx_buf->pkt.ctrl_hdr.msg_id = ofi_buf_index(tx_buf);
+		rxm_tune_start(rxm_ep, tx_buf);
 	} else {
 		tx_buf->pkt.ctrl_hdr.msg_id = *msg_id;
 	}
@@ -556,7 +558,7 @@ rxm_emulate_inject(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	struct rxm_tx_buf *tx_buf;
 	ssize_t ret;
 
-	tx_buf = rxm_get_tx_buf(rxm_ep);
+	tx_buf = rxm_get_tx_buf(rxm_ep, rxm_conn);
 	if (!tx_buf)
 		return -FI_EAGAIN;
 
@@ -652,7 +654,7 @@ rxm_send_eager(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	struct rxm_tx_buf *eager_buf;
 	ssize_t ret;
 
-	eager_buf = rxm_get_tx_buf(rxm_ep);
+	eager_buf = rxm_get_tx_buf(rxm_ep, rxm_conn);
 	if (!eager_buf)
 		return -FI_EAGAIN;
 
@@ -686,6 +688,110 @@ rxm_send_eager(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	return ret;
 }
 
+/* Returns RXM_TUNE_CLASSES for sizes above the tuned range. */
+static size_t rxm_tune_class(struct rxm_ep *ep, size_t data_len)
+{
+	size_t c = 0;
+
+	assert(data_len > ep->eager_limit);
+	while (c < RXM_TUNE_CLASSES && data_len > (ep->eager_limit << (c + 1)))
+		c++;
+	return c;
+}
+
+/* Move the crossover to the first size class where rendezvous completes
+ * faster than SAR.  A class only changes protocol if the other one is
+ * faster by more than 1/8, so noise does not make the limit oscillate.
+ */
+static void rxm_tune_shift(struct rxm_ep *ep, struct rxm_conn *conn)
+{
+	struct rxm_tune *tune = &conn->tune;
+	size_t c, limit = ep->eager_limit;
+	uint32_t sar, rndv;
+
+	for (c = 0; c < RXM_TUNE_CLASSES; c++) {
+		sar = tune->ns_per_kb[RXM_TUNE_SAR][c];
+		rndv = tune->ns_per_kb[RXM_TUNE_RNDV][c];
+		if ((ep->eager_limit << c) < tune->sar_limit) {
+			if (sar && rndv && rndv < sar - sar / 8)
+				break;
+		} else if (!sar || !rndv || sar >= rndv - rndv / 8) {
+			break;
+		}
+		limit = ep->eager_limit << (c + 1);
+	}
+
+	if (limit == tune->sar_limit)
+		return;
+
+	FI_DBG(&rxm_prov, FI_LOG_EP_DATA, "conn %p sar_limit %zu -> %zu\n",
+	       conn, tune->sar_limit, limit);
+	rxm_tune_track(ep, conn, -1);
+	tune->sar_limit = limit;
+	rxm_tune_track(ep, conn, 1);
+	rxm_prof_inc(ep, sar_shifts);
+}
+
+/* Keep a count of established connections per crossover, from which the
+ * profile interface reports the smallest and largest one.
+ */
+void rxm_tune_track(struct rxm_ep *ep, struct rxm_conn *conn, int delta)
+{
+	size_t c = 0;
+
+	if (!ep->sar_tune || conn->state != RXM_CM_CONNECTED)
+		return;
+
+	while ((ep->eager_limit << c) < conn->tune.sar_limit)
+		c++;
+	assert(c <= RXM_TUNE_CLASSES);
+	ep->sar_limit_cnt[c] += delta;
+	rxm_prof_sar_limit(ep);
+}
+
+void rxm_tune_comp(struct rxm_ep *ep, struct rxm_tx_buf *tx_buf,
+		   enum rxm_tune_proto proto)
+{
+	size_t c, len = tx_buf->pkt.hdr.size;
+	uint32_t *avg;
+	uint64_t ns;
+
+	rxm_tune_stop(tx_buf);
+	if (!tx_buf->tune_ns || len <= ep->eager_limit)
+		return;
+
+	c = rxm_tune_class(ep, len);
+	if (c == RXM_TUNE_CLASSES)
+		return;
+
+	ns = tx_buf->tune_ns * 1024 / len;
+	ns = MAX(MIN(ns, UINT32_MAX), 1);
+	avg = &tx_buf->conn->tune.ns_per_kb[proto][c];
+	*avg = *avg ? *avg - *avg / 8 + (uint32_t) ns / 8 : (uint32_t) ns;
+	rxm_tune_shift(ep, tx_buf->conn);
+}
+
+static bool rxm_use_sar(struct rxm_ep *ep, struct rxm_conn *conn,
+			size_t data_len)
+{
+	bool sar;
+	size_t c;
+
+	if (!ep->sar_tune)
+		return data_len <= ep->sar_limit;
+
+	c = rxm_tune_class(ep, data_len);
+	if (c == RXM_TUNE_CLASSES)
+		return false;
+
+	sar = data_len <= conn->tune.sar_limit;
+	if (!(conn->tune.sends[c]++ % RXM_TUNE_PROBE) &&
+	    (ep->rndv_ops == &rxm_rndv_ops_write ||
+	     (conn->flags & RXM_CONN_RNDV_TIME)))
+		sar = !sar;
+	return sar;
+}
+
 ssize_t
 rxm_send_common(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 		const struct iovec *iov, void **desc, size_t count,
@@ -717,7 +823,7 @@ rxm_send_common(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 		ret = rxm_send_eager(rxm_ep, rxm_conn, iov, desc, count,
 				     context, data, flags, tag, op,
 				     data_len, total_len);
-	} else if (data_len <= rxm_ep->sar_limit) {
+	} else if (rxm_use_sar(rxm_ep, rxm_conn, data_len)) {
 		ret = rxm_send_sar(rxm_ep, rxm_conn, iov, desc, (uint8_t) count,
 				   context, data, flags, tag, op, data_len,
 				   rxm_ep_sar_calc_segs_cnt(rxm_ep, data_len));
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "rxm.h"
+
+#ifdef HAVE_FABRIC_PROFILE
+
+extern struct ofi_common_locks common_locks;
+
+#define RXM_VAR(_id, _field, _name, _desc)				\
+	{								\
+	 .desc = {							\
+		.id = (uint32_t) (_id),					\
+		.datatype_sel = fi_primitive_type,			\
+		.datatype.primitive = FI_UINT64,			\
+		.flags = 0,						\
+		.size = sizeof(uint64_t),				\
+		.name = _name,						\
+		.desc = _desc						\
+	 },								\
+	 .offset = offsetof(struct rxm_prof, _field)			\
+	}
+
+static const struct {
+	struct fi_profile_desc	desc;
+	size_t			offset;
+} rxm_prof_vars[] = {
+	RXM_VAR(RXM_VAR_CONN_WARMUP, conn_warmup, "rxm_conn_warmup",
+		"Number of connections started ahead of use"),
+	RXM_VAR(RXM_VAR_CONN_WARMUP_DONE, conn_warmup_done,
+		"rxm_conn_warmup_done",
+		"Number of connections started ahead of use and established"),
+	RXM_VAR(RXM_VAR_CONN_REAPED, conn_reaped, "rxm_conn_reaped",
+		"Number of connections closed after being idle"),
+	RXM_VAR(RXM_VAR_CONN_ACTIVE, conn_active, "rxm_conn_active",
+		"Number of connections currently established"),
+	RXM_VAR(RXM_VAR_CONN_MEM, conn_mem, "rxm_conn_mem",
+		"Bytes of buffers held by established connections"),
+	RXM_VAR(RXM_VAR_SAR_LIMIT_MIN, sar_limit_min, "rxm_sar_limit_min",
+		"Smallest SAR/rendezvous crossover of established connections"),
+	RXM_VAR(RXM_VAR_SAR_LIMIT_MAX, sar_limit_max, "rxm_sar_limit_max",
+		"Largest SAR/rendezvous crossover of established connections"),
+	RXM_VAR(RXM_VAR_SAR_SHIFTS, sar_shifts, "rxm_sar_shifts",
+		"Number of times a connection's crossover was moved"),
+};
+
+static const struct {
+	uint32_t	id;
+	size_t		offset;
+} rxm_prof_common_vars[] = {
+	{ FI_VAR_CONNECTION_CNT, offsetof(struct rxm_prof, conn_cnt) },
+	{ FI_VAR_CONN_REQUEST, offsetof(struct rxm_prof, conn_request) },
+	{ FI_VAR_CONN_ACCEPT, offsetof(struct rxm_prof, conn_accept) },
+	{ FI_VAR_CONN_REJECT, offsetof(struct rxm_prof, conn_reject) },
+};
+
+/* Without established connections, report the crossover new connections
+ * start with.
+ */
+void rxm_prof_sar_limit(struct rxm_ep *ep)
+{
+	size_t c, min = SIZE_MAX, max = 0;
+
+	if (!ep->prof)
+		return;
+
+	if (!ep->sar_tune) {
+		ep->prof->sar_limit_min = ep->sar_limit;
+		ep->prof->sar_limit_max = ep->sar_limit;
+		return;
+	}
+
+	for (c = 0; c <= RXM_TUNE_CLASSES; c++) {
+		if (!ep->sar_limit_cnt[c])
+			continue;
+		min = MIN(min, ep->eager_limit << c);
+		max = ep->eager_limit << c;
+	}
+	if (!max)
+		min = max = rxm_tune_init_limit(ep);
+
+	ep->prof->sar_limit_min = min;
+	ep->prof->sar_limit_max = max;
+}
+
+/* The profile and the endpoint may be closed in either order.  Both
+ * close paths unlink under prof_lock, taken before the endpoint lock, so
+ * neither side is freed while the other still points to it.
+ */
+void rxm_prof_unlink(struct rxm_ep *ep)
+{
+	pthread_mutex_lock(&common_locks.prof_lock);
+	ofi_genlock_lock(&ep->util_ep.lock);
+	if (ep->prof) {
+		ep->prof->ep = NULL;
+		ep->prof = NULL;
+	}
+	ofi_genlock_unlock(&ep->util_ep.lock);
+	pthread_mutex_unlock(&common_locks.prof_lock);
+}
+
+static int rxm_prof_close(struct fid *fid)
+{
+	struct rxm_prof *prof;
+
+	prof = container_of(fid, struct rxm_prof, util_prof.prof_fid.fid);
+	pthread_mutex_lock(&common_locks.prof_lock);
+	if (prof->ep) {
+		ofi_genlock_lock(&prof->ep->util_ep.lock);
+		prof->ep->prof = NULL;
+		ofi_genlock_unlock(&prof->ep->util_ep.lock);
+	}
+	pthread_mutex_unlock(&common_locks.prof_lock);
+
+	ofi_prof_fini(&prof->util_prof);
+	free(prof);
+	return FI_SUCCESS;
+}
+
+static struct fi_ops rxm_prof_fi_ops = {
+	.size = sizeof(struct fi_ops),
+	.close = rxm_prof_close,
+	.bind = fi_no_bind,
+	.control = fi_no_control,
+	.ops_open = fi_no_ops_open,
+};
+
+int rxm_ep_ops_open(struct fid *fid, const char *name, uint64_t flags,
+		    void **ops, void *context)
+{
+	struct rxm_prof *prof;
+	struct rxm_ep *ep;
+	size_t i;
+	int ret = 0;
+
+	if (strcmp(name, "fi_profile_ops"))
+		return -FI_ENOSYS;
+
+	ep = container_of(fid, struct rxm_ep, util_ep.ep_fid.fid);
+	prof = calloc(1, sizeof(*prof));
+	if (!prof)
+		return -FI_ENOMEM;
+
+	prof->util_prof.prov = &rxm_prov;
+	ret = ofi_prof_init(&prof->util_prof, fid, flags, context,
+			    &ofi_prof_ops, ARRAY_SIZE(rxm_prof_vars), 0);
+	if (ret) {
+		free(prof);
+		return ret;
+	}
+	prof->util_prof.prof_fid.fid.ops = &rxm_prof_fi_ops;
+
+	for (i = 0; !ret && i < ARRAY_SIZE(rxm_prof_common_vars); i++) {
+		ret = ofi_prof_add_var(&prof->util_prof,
+				       rxm_prof_common_vars[i].id, NULL,
+				       (char *) prof +
+				       rxm_prof_common_vars[i].offset);
+	}
+	for (i = 0; !ret && i < ARRAY_SIZE(rxm_prof_vars); i++) {
+		ret = ofi_prof_add_var(&prof->util_prof,
+				       rxm_prof_vars[i].desc.id,
+				       (struct fi_profile_desc *)
+				       &rxm_prof_vars[i].desc,
+				       (char *) prof + rxm_prof_vars[i].offset);
+	}
+	if (ret)
+		goto err;
+	ofi_prof_add_common_events(&prof->util_prof);
+
+	ofi_genlock_lock(&ep->util_ep.lock);
+	if (ep->prof) {
+		ofi_genlock_unlock(&ep->util_ep.lock);
+		ret = -FI_EALREADY;
+		goto err;
+	}
+	prof->ep = ep;
+	prof->conn_active = ep->connected_cnt;
+	prof->conn_mem = ep->connected_cnt * rxm_conn_mem_size(ep);
+	ep->prof = prof;
+	rxm_prof_sar_limit(ep);
+	ofi_genlock_unlock(&ep->util_ep.lock);
+
+	*ops = &prof->util_prof.prof_fid.ops;
+	return FI_SUCCESS;
+
+err:
+	ofi_prof_fini(&prof->util_prof);
+	free(prof);
+	return ret;
+}
+
+#else
+
+int rxm_ep_ops_open(struct fid *fid, const char *name, uint64_t flags,
+		    void **ops, void *context)
+{
+	return -FI_ENOSYS;
+}
+
+#endif
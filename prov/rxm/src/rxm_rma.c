@@ -81,7 +81,7 @@ rxm_ep_rma_common(struct rxm_ep *rxm_ep, const struct fi_msg_rma *msg,
 	if (ret)
 		goto unlock;
 
-	rma_buf = rxm_get_tx_buf(rxm_ep);
+	rma_buf = rxm_get_tx_buf(rxm_ep, rxm_conn);
 	if (!rma_buf) {
 		ret = -FI_EAGAIN;
 		goto unlock;
@@ -218,7 +218,7 @@ rxm_ep_rma_emulate_inject_msg(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 
 	assert(msg->rma_iov_count <= rxm_ep->rxm_info->tx_attr->rma_iov_limit);
 
-	rma_buf = rxm_get_tx_buf(rxm_ep);
+	rma_buf = rxm_get_tx_buf(rxm_ep, rxm_conn);
 	if (!rma_buf)
 		return -FI_EAGAIN;
 
@@ -78,9 +78,21 @@ struct smr_env {
 	int use_dsa_sar;
 	size_t max_gdrcopy_size;
 	int use_xpmem;
+	size_t peer_queue_size;
+	size_t sar_pipeline_depth;
+	int calibrate;
+	char *calib_dir;
+};
+
+/* Message sizes from which the iov (CMA) protocol is used instead of SAR,
+ * for peers on the same and on a different NUMA node */
+struct smr_calib {
+	size_t vma_local;
+	size_t vma_remote;
 };
 
 extern struct smr_env smr_env;
+extern struct smr_calib smr_calib;
 extern struct fi_provider smr_prov;
 extern struct fi_info smr_info;
 extern struct util_prov smr_util_prov;
@@ -231,6 +243,7 @@ struct smr_ep {
 	struct dlist_entry	ipc_cpy_pend_list;
 
 	int			ep_idx;
+	int			peer_queue_word;
 	enum ofi_shm_p2p_type	p2p_type;
 	struct smr_sock_info	*sock_info;
 	void			*dsa_context;
@@ -273,8 +286,8 @@ size_t smr_copy_from_sar(struct smr_freestack *sar_pool, struct smr_resp *resp,
 			 const struct iovec *iov, size_t count,
 			 size_t *bytes_done);
 int smr_select_proto(void **desc, size_t iov_count, bool cma_avail,
-		     bool ipc_valid, uint32_t op, uint64_t total_len,
-		     uint64_t op_flags);
+		     size_t vma_threshold, bool ipc_valid, uint32_t op,
+		     uint64_t total_len, uint64_t op_flags);
 typedef ssize_t (*smr_proto_func)(struct smr_ep *ep, struct smr_region *peer_smr,
 		int64_t id, int64_t peer_id, uint32_t op, uint64_t tag,
 		uint64_t data, uint64_t op_flags, struct ofi_mr **desc,
@@ -299,6 +312,8 @@ static inline uint64_t smr_rx_cq_flags(uint64_t rx_flags, uint16_t op_flags)
 
 void smr_ep_progress(struct util_ep *util_ep);
 
+void smr_calibrate(void);
+
 static inline bool smr_vma_enabled(struct smr_ep *ep,
 				   struct smr_region *peer_smr)
 {
@@ -310,6 +325,13 @@ static inline bool smr_vma_enabled(struct smr_ep *ep,
 			peer_smr->xpmem_cap_self == SMR_VMA_CAP_ON);
 }
 
+static inline size_t smr_vma_threshold(struct smr_ep *ep, int64_t id)
+{
+	if (smr_peer_data(ep->region)[id].xpmem.cap == SMR_VMA_CAP_ON)
+		return 0;
+	return ep->region->map->peers[id].vma_threshold;
+}
+
 static inline void smr_set_ipc_valid(struct smr_region *region, uint64_t id)
 {
 	if (ofi_hmem_is_initialized(FI_HMEM_ZE) &&
@@ -204,7 +204,8 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 	if (smr_peer_data(ep->region)[id].sar_status)
 		return -FI_EAGAIN;
 
-	ret = smr_cmd_queue_next(smr_cmd_queue(peer_smr), &ce, &pos);
+	ret = smr_cmd_queue_next(smr_tx_cmd_queue(peer_smr, peer_id), &ce,
+				 &pos);
 	if (ret == -FI_ENOENT)
 		return -FI_EAGAIN;
 
@@ -254,6 +255,7 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 				smr_flags, &ce->cmd);
 		if (ret) {
 			smr_cmd_queue_discard(ce, pos);
+			smr_tx_cmd_signal(peer_smr, peer_id);
 			goto unlock;
 		}
 	}
@@ -268,6 +270,7 @@ static ssize_t smr_generic_atomic(struct smr_ep *ep,
 
 	smr_format_rma_ioc(&ce->rma_cmd, rma_ioc, rma_count);
 	smr_cmd_queue_commit(ce, pos);
+	smr_tx_cmd_signal(peer_smr, peer_id);
 unlock:
 	ofi_genlock_unlock(&ep->util_ep.lock);
 	return ret;
@@ -357,7 +360,8 @@ static ssize_t smr_atomic_inject(struct fid_ep *ep_fid, const void *buf,
 		goto out;
 	}
 
-	ret = smr_cmd_queue_next(smr_cmd_queue(peer_smr), &ce, &pos);
+	ret = smr_cmd_queue_next(smr_tx_cmd_queue(peer_smr, peer_id), &ce,
+				 &pos);
 	if (ret == -FI_ENOENT)
 		return -FI_EAGAIN;
 
@@ -382,12 +386,14 @@ static ssize_t smr_atomic_inject(struct fid_ep *ep_fid, const void *buf,
 				0, &ce->cmd);
 		if (ret) {
 			smr_cmd_queue_discard(ce, pos);
+			smr_tx_cmd_signal(peer_smr, peer_id);
 			goto out;
 		}
 	}
 
 	smr_format_rma_ioc(&ce->rma_cmd, &rma_ioc, 1);
 	smr_cmd_queue_commit(ce, pos);
+	smr_tx_cmd_signal(peer_smr, peer_id);
 	ofi_ep_peer_tx_cntr_inc(&ep->util_ep, ofi_op_atomic);
 out:
 	return ret;
@@ -0,0 +1,423 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "smr.h"
+
+#define SMR_CALIB_MIN_SIZE	(SMR_INJECT_SIZE * 2)
+#define SMR_CALIB_MAX_SIZE	(1 << 20)
+#define SMR_CALIB_REPS		8
+#define SMR_CALIB_MAX_NODES	64
+#define SMR_CALIB_KEY_MAX	256
+
+struct smr_calib smr_calib = {
+	.vma_local = SMR_INJECT_SIZE,
+	.vma_remote = SMR_INJECT_SIZE,
+};
+
+static pthread_once_t smr_calib_once = PTHREAD_ONCE_INIT;
+
+struct smr_calib_run {
+	char		*src;
+	size_t		threshold;
+	int		ret;
+	char		cpulist[256];
+};
+
+int smr_numa_node(void)
+{
+	char path[64];
+	int cpu, node;
+
+	cpu = sched_getcpu();
+	if (cpu < 0)
+		return 0;
+
+	for (node = 0; node < SMR_CALIB_MAX_NODES; node++) {
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d",
+			 cpu, node);
+		if (!access(path, F_OK))
+			return node;
+	}
+	return 0;
+}
+
+/* Approximate SAR: the sender and receiver each copy through a bounce
+ * buffer one SAR segment at a time. */
+static uint64_t smr_calib_sar(char *dst, char *bounce, const char *src,
+			      size_t size)
+{
+	uint64_t start;
+	size_t off, len;
+
+	start = ofi_gettime_ns();
+	for (off = 0; off < size; off += len) {
+		len = MIN(size - off, SMR_SAR_SIZE);
+		memcpy(bounce, src + off, len);
+		memcpy(dst + off, bounce, len);
+	}
+	return ofi_gettime_ns() - start;
+}
+
+static uint64_t smr_calib_cma(char *dst, char *src, size_t size)
+{
+	struct iovec local_iov, remote_iov;
+	uint64_t start;
+	ssize_t ret;
+
+	local_iov.iov_base = dst;
+	local_iov.iov_len = size;
+	remote_iov.iov_base = src;
+	remote_iov.iov_len = size;
+
+	start = ofi_gettime_ns();
+	ret = ofi_process_vm_readv(getpid(), &local_iov, 1, &remote_iov, 1, 0);
+	if (ret != size)
+		return UINT64_MAX;
+	return ofi_gettime_ns() - start;
+}
+
+/*
+ * Return the smallest power of two size for which a single CMA copy is at
+ * least as fast as the SAR copies, or 0 if CMA is not usable.  The
+ * destination and bounce buffers are first touched by the calling thread,
+ * so they reside on the caller's NUMA node.
+ */
+static size_t smr_calib_crossover(char *src)
+{
+	uint64_t sar, cma;
+	char *dst, *bounce;
+	size_t size, threshold = SMR_CALIB_MAX_SIZE;
+	int i;
+
+	dst = malloc(SMR_CALIB_MAX_SIZE);
+	bounce = malloc(SMR_SAR_SIZE);
+	if (!dst || !bounce) {
+		threshold = 0;
+		goto out;
+	}
+	memset(dst, 0, SMR_CALIB_MAX_SIZE);
+	memset(bounce, 0, SMR_SAR_SIZE);
+
+	for (size = SMR_CALIB_MIN_SIZE; size <= SMR_CALIB_MAX_SIZE;
+	     size <<= 1) {
+		sar = cma = UINT64_MAX;
+		for (i = 0; i < SMR_CALIB_REPS; i++) {
+			sar = MIN(sar, smr_calib_sar(dst, bounce, src, size));
+			cma = MIN(cma, smr_calib_cma(dst, src, size));
+		}
+		if (cma == UINT64_MAX) {
+			threshold = 0;
+			break;
+		}
+		if (cma <= sar) {
+			threshold = size;
+			break;
+		}
+	}
+out:
+	free(bounce);
+	free(dst);
+	return threshold;
+}
+
+static void *smr_calib_remote_thread(void *arg)
+{
+	struct smr_calib_run *run = arg;
+
+	run->ret = ofi_set_thread_affinity(run->cpulist);
+	if (!run->ret)
+		run->threshold = smr_calib_crossover(run->src);
+	return NULL;
+}
+
+/* Find the CPUs of a NUMA node other than the one we are running on */
+static int smr_calib_remote_cpus(char *cpulist, size_t size)
+{
+	char dir[64];
+	int node, local;
+
+	local = smr_numa_node();
+	for (node = 0; node < SMR_CALIB_MAX_NODES; node++) {
+		if (node == local)
+			continue;
+		snprintf(dir, sizeof(dir), "/sys/devices/system/node/node%d",
+			 node);
+		if (fi_read_file(dir, "cpulist", cpulist, size) > 0)
+			return 0;
+	}
+	return -FI_ENODATA;
+}
+
+static void smr_calib_key(char *key, size_t size)
+{
+	char line[SMR_CALIB_KEY_MAX], model[SMR_CALIB_KEY_MAX] = "unknown";
+	char path[64];
+	char *val;
+	FILE *file;
+	int nodes = 0, node;
+
+	file = fopen("/proc/cpuinfo", "r");
+	if (file) {
+		while (fgets(line, sizeof(line), file)) {
+			if (strncmp(line, "model name", 10))
+				continue;
+			val = strchr(line, ':');
+			if (val) {
+				val += strspn(val, ": \t");
+				val[strcspn(val, "\n")] = '\0';
+				snprintf(model, sizeof(model), "%s", val);
+			}
+			break;
+		}
+		fclose(file);
+	}
+
+	for (node = 0; node < SMR_CALIB_MAX_NODES; node++) {
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d",
+			 node);
+		if (!access(path, F_OK))
+			nodes++;
+	}
+
+	snprintf(key, size, "%.192s;cpus=%ld;nodes=%d", model,
+		 ofi_sysconf(_SC_NPROCESSORS_ONLN), nodes);
+}
+
+/* FNV-1a */
+static uint64_t smr_calib_hash(const char *key)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (; *key; key++) {
+		hash ^= (uint8_t) *key;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/* The cache lives in a shared directory, so only trust files that no one
+ * else could have written.
+ */
+static int smr_calib_load(const char *path, const char *key)
+{
+	char line[SMR_CALIB_KEY_MAX];
+	size_t local, remote;
+	struct stat st;
+	FILE *file;
+	int fd, ret = -FI_ENODATA;
+
+	fd = open(path, O_RDONLY | O_NOFOLLOW);
+	if (fd < 0)
+		return -FI_ENOENT;
+
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+	    st.st_uid != getuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+		FI_WARN(&smr_prov, FI_LOG_CORE,
+			"ignoring calibration file %s, not owned by user or "
+			"writable by others\n", path);
+		close(fd);
+		return -FI_EPERM;
+	}
+
+	file = fdopen(fd, "r");
+	if (!file) {
+		close(fd);
+		return -FI_ENOMEM;
+	}
+
+	if (fgets(line, sizeof(line), file)) {
+		line[strcspn(line, "\n")] = '\0';
+		if (!strcmp(line, key) &&
+		    fscanf(file, "%zu %zu", &local, &remote) == 2) {
+			smr_calib.vma_local = local;
+			smr_calib.vma_remote = remote;
+			ret = 0;
+		}
+	}
+	fclose(file);
+	return ret;
+}
+
+/* Write to a private temporary file and rename it into place, so readers
+ * never see a partial file.
+ */
+static void smr_calib_store(const char *path, const char *key)
+{
+	char tmp[PATH_MAX];
+	FILE *file;
+	int fd, ret;
+
+	ret = snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+	if (ret < 0 || ret >= sizeof(tmp))
+		return;
+
+	fd = mkstemp(tmp);
+	if (fd < 0)
+		goto err;
+
+	file = fdopen(fd, "w");
+	if (!file) {
+		close(fd);
+		goto err_unlink;
+	}
+	ret = fprintf(file, "%s\n%zu %zu\n", key, smr_calib.vma_local,
+		      smr_calib.vma_remote);
+	if (fclose(file) || ret < 0 || rename(tmp, path))
+		goto err_unlink;
+	return;
+
+err_unlink:
+	unlink(tmp);
+err:
+	FI_INFO(&smr_prov, FI_LOG_CORE,
+		"unable to save calibration to %s\n", path);
+}
+
+/* Serializes calibration between processes of the same user, so that one
+ * process measures while the others wait for its result.  Returns -1 if
+ * the lock could not be taken; calibration then proceeds unserialized.
+ */
+static int smr_calib_lock(const char *path)
+{
+	char lock_path[PATH_MAX];
+	struct stat st;
+	int fd, ret;
+
+	ret = snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+	if (ret < 0 || ret >= sizeof(lock_path))
+		return -1;
+
+	fd = open(lock_path, O_RDWR | O_CREAT | O_NOFOLLOW, S_IRUSR | S_IWUSR);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) || st.st_uid != getuid())
+		goto err;
+
+	while (flock(fd, LOCK_EX)) {
+		if (errno != EINTR)
+			goto err;
+	}
+	return fd;
+err:
+	close(fd);
+	return -1;
+}
+
+static void smr_calib_unlock(int fd)
+{
+	if (fd < 0)
+		return;
+
+	(void) flock(fd, LOCK_UN);
+	close(fd);
+}
+
+static void smr_calib_measure(void)
+{
+	struct smr_calib_run run = { 0 };
+	pthread_t thread;
+	size_t local;
+
+	run.src = malloc(SMR_CALIB_MAX_SIZE);
+	if (!run.src)
+		return;
+	memset(run.src, 0, SMR_CALIB_MAX_SIZE);
+
+	local = smr_calib_crossover(run.src);
+	if (!local) {
+		FI_INFO(&smr_prov, FI_LOG_CORE,
+			"CMA unavailable, skipping protocol calibration\n");
+		goto out;
+	}
+	smr_calib.vma_local = local;
+	smr_calib.vma_remote = local;
+
+	if (smr_calib_remote_cpus(run.cpulist, sizeof(run.cpulist)))
+		goto out;
+
+	if (pthread_create(&thread, NULL, smr_calib_remote_thread, &run))
+		goto out;
+	pthread_join(thread, NULL);
+	if (!run.ret && run.threshold)
+		smr_calib.vma_remote = run.threshold;
+out:
+	free(run.src);
+}
+
+static void smr_calib_init(void)
+{
+	char key[SMR_CALIB_KEY_MAX], path[PATH_MAX];
+	int lock_fd, ret;
+
+	smr_calib_key(key, sizeof(key));
+	snprintf(path, sizeof(path), "%s/fi_shm_calib_%u_%016" PRIx64,
+		 smr_env.calib_dir, (unsigned) getuid(), smr_calib_hash(key));
+
+	ret = smr_calib_load(path, key);
+	if (ret) {
+		lock_fd = smr_calib_lock(path);
+		/* Another process may have stored a result while we waited */
+		ret = smr_calib_load(path, key);
+		if (ret) {
+			smr_calib_measure();
+			smr_calib_store(path, key);
+		}
+		smr_calib_unlock(lock_fd);
+	}
+	if (!ret)
+		FI_INFO(&smr_prov, FI_LOG_CORE,
+			"loaded protocol calibration from %s\n", path);
+
+	FI_INFO(&smr_prov, FI_LOG_CORE,
+		"using CMA from %zu bytes (same node), %zu bytes (remote node)\n",
+		smr_calib.vma_local, smr_calib.vma_remote);
+}
+
+void smr_calibrate(void)
+{
+	if (smr_env.calibrate)
+		pthread_once(&smr_calib_once, smr_calib_init);
+}
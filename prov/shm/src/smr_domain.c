@@ -182,6 +182,8 @@ int smr_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 						    info->tx_attr->msg_order);
 	ofi_mutex_unlock(&smr_fabric->util_fabric.lock);
 
+	smr_calibrate();
+
 	ret = ofi_ipc_cache_open(&smr_domain->ipc_cache, &smr_domain->util_domain);
 	if (ret) {
 		free(smr_domain);
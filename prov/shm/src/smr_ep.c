@@ -414,6 +414,59 @@ remove_entry:
 	return ret;
 }
 
+static size_t smr_copy_to_sar_pipe(struct smr_freestack *sar_pool,
+				   struct smr_resp *resp, struct smr_cmd *cmd,
+				   struct ofi_mr **mr, const struct iovec *iov,
+				   size_t count, size_t *bytes_done,
+				   uint32_t max_bufs)
+{
+	struct smr_sar_buf *sar_buf;
+	size_t start = *bytes_done;
+	uint32_t batch = cmd->msg.data.buf_batch_size;
+
+	while (*bytes_done < cmd->msg.hdr.size && max_bufs &&
+	       resp->sar_filled - resp->sar_drained < batch) {
+		sar_buf = smr_freestack_get_entry_from_index(sar_pool,
+				cmd->msg.data.sar[resp->sar_filled % batch]);
+
+		*bytes_done += ofi_copy_from_mr_iov(
+				sar_buf->buf, SMR_SAR_SIZE, mr, iov, count,
+				*bytes_done);
+
+		/* publish each buffer as soon as it is filled */
+		ofi_wmb();
+		resp->sar_filled++;
+		max_bufs--;
+	}
+
+	return *bytes_done - start;
+}
+
+static size_t smr_copy_from_sar_pipe(struct smr_freestack *sar_pool,
+				     struct smr_resp *resp,
+				     struct smr_cmd *cmd, struct ofi_mr **mr,
+				     const struct iovec *iov, size_t count,
+				     size_t *bytes_done)
+{
+	struct smr_sar_buf *sar_buf;
+	size_t start = *bytes_done;
+	uint32_t batch = cmd->msg.data.buf_batch_size;
+
+	while (*bytes_done < cmd->msg.hdr.size &&
+	       resp->sar_drained != resp->sar_filled) {
+		sar_buf = smr_freestack_get_entry_from_index(sar_pool,
+				cmd->msg.data.sar[resp->sar_drained % batch]);
+
+		*bytes_done += ofi_copy_to_mr_iov(mr, iov, count, *bytes_done,
+				sar_buf->buf, SMR_SAR_SIZE);
+
+		ofi_wmb();
+		resp->sar_drained++;
+	}
+
+	return *bytes_done - start;
+}
+
 size_t smr_copy_to_sar(struct smr_freestack *sar_pool, struct smr_resp *resp,
 		       struct smr_cmd *cmd, struct ofi_mr **mr,
 		       const struct iovec *iov, size_t count,
@@ -423,6 +476,11 @@ size_t smr_copy_to_sar(struct smr_freestack *sar_pool, struct smr_resp *resp,
 	size_t start = *bytes_done;
 	int next_sar_buf = 0;
 
+	if (cmd->msg.hdr.op_flags & SMR_SAR_PIPELINE)
+		return smr_copy_to_sar_pipe(sar_pool, resp, cmd, mr, iov,
+					    count, bytes_done,
+					    cmd->msg.data.buf_batch_size);
+
 	if (resp->status != SMR_STATUS_SAR_EMPTY)
 		return 0;
 
@@ -454,6 +512,10 @@ size_t smr_copy_from_sar(struct smr_freestack *sar_pool, struct smr_resp *resp,
 	size_t start = *bytes_done;
 	int next_sar_buf = 0;
 
+	if (cmd->msg.hdr.op_flags & SMR_SAR_PIPELINE)
+		return smr_copy_from_sar_pipe(sar_pool, resp, cmd, mr, iov,
+					      count, bytes_done);
+
 	if (resp->status != SMR_STATUS_SAR_FULL)
 		return 0;
 
@@ -482,6 +544,7 @@ static int smr_format_sar(struct smr_ep *ep, struct smr_cmd *cmd,
 {
 	int i, ret;
 	uint32_t sar_needed;
+	bool pipeline;
 
 	if (peer_smr->max_sar_buf_per_peer == 0)
 		return -FI_EAGAIN;
@@ -494,6 +557,11 @@ static int smr_format_sar(struct smr_ep *ep, struct smr_cmd *cmd,
 	cmd->msg.data.buf_batch_size = MIN(SMR_BUF_BATCH_MAX,
 			MIN(peer_smr->max_sar_buf_per_peer, sar_needed));
 
+	pipeline = smr_env.sar_pipeline_depth && !smr_env.use_dsa_sar;
+	if (pipeline)
+		cmd->msg.data.buf_batch_size = MIN(cmd->msg.data.buf_batch_size,
+						   smr_env.sar_pipeline_depth);
+
 	pthread_spin_lock(&peer_smr->lock);
 	for (i = 0; i < cmd->msg.data.buf_batch_size; i++) {
 		if (smr_freestack_isempty(smr_sar_pool(peer_smr))) {
@@ -511,6 +579,8 @@ static int smr_format_sar(struct smr_ep *ep, struct smr_cmd *cmd,
 	pthread_spin_unlock(&peer_smr->lock);
 
 	resp->status = SMR_STATUS_SAR_EMPTY;
+	resp->sar_filled = 0;
+	resp->sar_drained = 0;
 	cmd->msg.hdr.op_src = smr_src_sar;
 	cmd->msg.hdr.src_data = smr_get_offset(smr, resp);
 	cmd->msg.hdr.size = total_len;
@@ -520,7 +590,15 @@ static int smr_format_sar(struct smr_ep *ep, struct smr_cmd *cmd,
 	if (!cmd->msg.hdr.size)
 		goto out;
 
-	if (cmd->msg.hdr.op != ofi_op_read_req) {
+	if (pipeline) {
+		cmd->msg.hdr.op_flags |= SMR_SAR_PIPELINE;
+		/* Only prime the first buffer so the receiver can start
+		 * draining while the rest is filled from progress. */
+		if (cmd->msg.hdr.op != ofi_op_read_req)
+			smr_copy_to_sar_pipe(smr_sar_pool(peer_smr), resp, cmd,
+					     mr, iov, count,
+					     &pending->bytes_done, 1);
+	} else if (cmd->msg.hdr.op != ofi_op_read_req) {
 		if (smr_env.use_dsa_sar && ofi_mr_all_host(mr, count)) {
 			ret = smr_dsa_copy_to_sar(ep, smr_sar_pool(peer_smr),
 					resp, cmd, iov,	count,
@@ -545,8 +623,8 @@ out:
 }
 
 int smr_select_proto(void **desc, size_t iov_count, bool vma_avail,
-		     bool ipc_valid, uint32_t op, uint64_t total_len,
-		     uint64_t op_flags)
+		     size_t vma_threshold, bool ipc_valid, uint32_t op,
+		     uint64_t total_len, uint64_t op_flags)
 {
 	struct ofi_mr *smr_desc;
 	enum fi_hmem_iface iface = FI_HMEM_SYSTEM;
@@ -589,7 +667,8 @@ int smr_select_proto(void **desc, size_t iov_count, bool vma_avail,
 	if (use_ipc)
 		return smr_src_ipc;
 
-	if (total_len > SMR_INJECT_SIZE && vma_avail)
+	if (total_len > SMR_INJECT_SIZE && vma_avail &&
+	    (total_len >= vma_threshold || total_len > smr_env.sar_threshold))
 		return smr_src_iov;
 
 	if (op_flags & FI_DELIVERY_COMPLETE)
@@ -1123,6 +1202,7 @@ static int smr_ep_ctrl(struct fid *fid, int command, void *arg)
 		attr.name = smr_no_prefix(ep->name);
 		attr.rx_count = ep->rx_size;
 		attr.tx_count = ep->tx_size;
+		attr.peer_queue_size = smr_env.peer_queue_size;
 		attr.flags = ep->util_ep.caps & FI_HMEM ?
 				SMR_FLAG_HMEM_ENABLED : 0;
 
@@ -1183,12 +1263,25 @@ static int smr_ep_ctrl(struct fid *fid, int command, void *arg)
 	return ret;
 }
 
+static int smr_ep_ops_open(struct fid *fid, const char *name, uint64_t flags,
+			   void **ops, void *context)
+{
+	struct smr_ep *ep;
+
+	ep = container_of(fid, struct smr_ep, util_ep.ep_fid.fid);
+	if (!ep->srx)
+		return -FI_EOPBADSTATE;
+
+	return ep->srx->ep_fid.fid.ops->ops_open(&ep->srx->ep_fid.fid, name,
+						 flags, ops, context);
+}
+
 static struct fi_ops smr_ep_fi_ops = {
 	.size = sizeof(struct fi_ops),
 	.close = smr_ep_close,
 	.bind = smr_ep_bind,
 	.control = smr_ep_ctrl,
-	.ops_open = fi_no_ops_open,
+	.ops_open = smr_ep_ops_open,
 };
 
 static int smr_endpoint_name(struct smr_ep *ep, char *name, char *addr,
@@ -46,6 +46,10 @@ struct smr_env smr_env = {
 	.use_dsa_sar = false,
 	.max_gdrcopy_size = 3072,
 	.use_xpmem = false,
+	.peer_queue_size = 0,
+	.sar_pipeline_depth = 0,
+	.calibrate = false,
+	.calib_dir = "/tmp",
 };
 
 static void smr_init_env(void)
@@ -56,6 +60,12 @@ static void smr_init_env(void)
 	fi_param_get_bool(&smr_prov, "disable_cma", &smr_env.disable_cma);
 	fi_param_get_bool(&smr_prov, "use_dsa_sar", &smr_env.use_dsa_sar);
 	fi_param_get_bool(&smr_prov, "use_xpmem", &smr_env.use_xpmem);
+	fi_param_get_size_t(&smr_prov, "peer_queue_size",
+			    &smr_env.peer_queue_size);
+	fi_param_get_size_t(&smr_prov, "sar_pipeline_depth",
+			    &smr_env.sar_pipeline_depth);
+	fi_param_get_bool(&smr_prov, "calibrate", &smr_env.calibrate);
+	fi_param_get_str(&smr_prov, "calib_dir", &smr_env.calib_dir);
 }
 
 static void smr_resolve_addr(const char *node, const char *service,
@@ -107,9 +117,10 @@ static int smr_shm_space_check(size_t tx_count, size_t rx_count)
 	}
 	shm_size_needed = num_of_core *
 			  smr_calculate_size_offsets(tx_count, rx_count,
+						     smr_env.peer_queue_size,
 						     NULL, NULL, NULL,
 						     NULL, NULL, NULL,
-						     NULL);
+						     NULL, NULL);
 	err = statvfs(shm_fs, &stat);
 	if (err) {
 		FI_WARN(&smr_prov, FI_LOG_CORE,
@@ -204,6 +215,7 @@ SHM_INI
 {
 #if HAVE_SHM_DL
 	ofi_hmem_init();
+	ofi_copy_init();
 #endif
 	fi_param_define(&smr_prov, "sar_threshold", FI_PARAM_SIZE_T,
 			"Max size to use for alternate SAR protocol if CMA \
@@ -222,6 +234,25 @@ SHM_INI
 	fi_param_define(&smr_prov, "use_xpmem", FI_PARAM_BOOL,
 			"Enable XPMEM over CMA when possible "
 			"(default: false)");
+	fi_param_define(&smr_prov, "peer_queue_size", FI_PARAM_SIZE_T,
+			"Number of command queue entries reserved for each "
+			"connected peer. A non-zero value gives every peer "
+			"its own command queue instead of sharing a single "
+			"queue between all senders (default: 0)");
+	fi_param_define(&smr_prov, "sar_pipeline_depth", FI_PARAM_SIZE_T,
+			"Number of SAR buffers a sender may fill ahead of the "
+			"receiver. A non-zero value pipelines SAR transfers "
+			"buffer by buffer instead of exchanging the whole "
+			"batch of buffers at once. Not used with DSA "
+			"(default: 0)");
+	fi_param_define(&smr_prov, "calibrate", FI_PARAM_BOOL,
+			"Measure at domain open the message sizes from which "
+			"CMA outperforms SAR, for peers on the same and on a "
+			"different NUMA node, and select protocols per peer "
+			"accordingly (default: false)");
+	fi_param_define(&smr_prov, "calib_dir", FI_PARAM_STRING,
+			"Directory used to cache calibration results "
+			"(default: /tmp)");
 
 	smr_init_env();
 
@@ -102,7 +102,8 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 	if (smr_peer_data(ep->region)[id].sar_status)
 		return -FI_EAGAIN;
 
-	ret = smr_cmd_queue_next(smr_cmd_queue(peer_smr), &ce, &pos);
+	ret = smr_cmd_queue_next(smr_tx_cmd_queue(peer_smr, peer_id), &ce,
+				 &pos);
 	if (ret == -FI_ENOENT)
 		return -FI_EAGAIN;
 
@@ -112,6 +113,7 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 	assert(!(op_flags & FI_INJECT) || total_len <= SMR_INJECT_SIZE);
 
 	proto = smr_select_proto(desc, iov_count, smr_vma_enabled(ep, peer_smr),
+				 smr_vma_threshold(ep, id),
 	                         smr_ipc_valid(ep, peer_smr, id, peer_id), op,
 				 total_len, op_flags);
 
@@ -120,9 +122,11 @@ static ssize_t smr_generic_sendmsg(struct smr_ep *ep, const struct iovec *iov,
 				   context, &ce->cmd);
 	if (ret) {
 		smr_cmd_queue_discard(ce, pos);
+		smr_tx_cmd_signal(peer_smr, peer_id);
 		goto unlock;
 	}
 	smr_cmd_queue_commit(ce, pos);
+	smr_tx_cmd_signal(peer_smr, peer_id);
 
 	if (proto != smr_src_inline && proto != smr_src_inject)
 		goto unlock;
@@ -207,7 +211,8 @@ static ssize_t smr_generic_inject(struct fid_ep *ep_fid, const void *buf,
 	if (smr_peer_data(ep->region)[id].sar_status)
 		return -FI_EAGAIN;
 
-	ret = smr_cmd_queue_next(smr_cmd_queue(peer_smr), &ce, &pos);
+	ret = smr_cmd_queue_next(smr_tx_cmd_queue(peer_smr, peer_id), &ce,
+				 &pos);
 	if (ret == -FI_ENOENT)
 		return -FI_EAGAIN;
 
@@ -216,9 +221,11 @@ static ssize_t smr_generic_inject(struct fid_ep *ep_fid, const void *buf,
 			op_flags, NULL, &msg_iov, 1, len, NULL, &ce->cmd);
 	if (ret) {
 		smr_cmd_queue_discard(ce, pos);
+		smr_tx_cmd_signal(peer_smr, peer_id);
 		return -FI_EAGAIN;
 	}
 	smr_cmd_queue_commit(ce, pos);
+	smr_tx_cmd_signal(peer_smr, peer_id);
 	ofi_ep_peer_tx_cntr_inc(&ep->util_ep, op);
 
 	return FI_SUCCESS;
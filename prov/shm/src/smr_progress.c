@@ -51,7 +51,8 @@ smr_try_progress_to_sar(struct smr_ep *ep, struct smr_region *smr,
                         size_t *bytes_done, void *entry_ptr)
 {
 	if (*bytes_done < cmd->msg.hdr.size) {
-		if (smr_env.use_dsa_sar && ofi_mr_all_host(mr, iov_count)) {
+		if (smr_env.use_dsa_sar && ofi_mr_all_host(mr, iov_count) &&
+		    !(cmd->msg.hdr.op_flags & SMR_SAR_PIPELINE)) {
 			(void) smr_dsa_copy_to_sar(ep, sar_pool, resp, cmd, iov,
 					    iov_count, bytes_done, entry_ptr);
 			return;
@@ -70,7 +71,8 @@ smr_try_progress_from_sar(struct smr_ep *ep, struct smr_region *smr,
                           size_t *bytes_done, void *entry_ptr)
 {
 	if (*bytes_done < cmd->msg.hdr.size) {
-		if (smr_env.use_dsa_sar && ofi_mr_all_host(mr, iov_count)) {
+		if (smr_env.use_dsa_sar && ofi_mr_all_host(mr, iov_count) &&
+		    !(cmd->msg.hdr.op_flags & SMR_SAR_PIPELINE)) {
 			(void) smr_dsa_copy_from_sar(ep, sar_pool, resp, cmd,
 					iov, iov_count, bytes_done, entry_ptr);
 			return;
@@ -104,8 +106,8 @@ static int smr_progress_resp_entry(struct smr_ep *ep, struct smr_resp *resp,
 		sar_buf = smr_freestack_get_entry_from_index(
 		    smr_sar_pool(peer_smr), pending->cmd.msg.data.sar[0]);
 		if (pending->bytes_done == pending->cmd.msg.hdr.size &&
-		    (resp->status == SMR_STATUS_SAR_EMPTY ||
-		     resp->status == SMR_STATUS_SUCCESS)) {
+		    (resp->status == SMR_STATUS_SUCCESS ||
+		     smr_sar_empty(resp, &pending->cmd))) {
 			resp->status = SMR_STATUS_SUCCESS;
 			break;
 		}
@@ -123,7 +125,7 @@ static int smr_progress_resp_entry(struct smr_ep *ep, struct smr_resp *resp,
 					pending->iov_count, &pending->bytes_done,
 					pending);
 		if (pending->bytes_done != pending->cmd.msg.hdr.size ||
-		    resp->status != SMR_STATUS_SAR_EMPTY) {
+		    !smr_sar_empty(resp, &pending->cmd)) {
 			return -FI_EAGAIN;
 		}
 
@@ -1209,29 +1211,22 @@ out:
 	return err;
 }
 
-static void smr_progress_cmd(struct smr_ep *ep)
+/*
+ * Process up to budget commands from queue.  Returns -FI_ENOENT once the
+ * queue is empty, 0 if the budget ran out, or the error that stopped
+ * processing.
+ */
+static int smr_progress_cmd_queue(struct smr_ep *ep,
+				  struct smr_cmd_queue *queue, int budget)
 {
 	struct smr_cmd_entry *ce;
 	int ret = 0;
 	int64_t pos;
 
-	/* ep->util_ep.lock is used to serialize the message/tag matching.
-	 * We keep the lock until the matching is complete. This will
-	 * ensure that commands are matched in the order they are
-	 * received, if there are multiple progress threads.
-	 *
-	 * This lock should be low cost because it's only used by this
-	 * single process. It is also optimized to be a noop if
-	 * multi-threading is disabled.
-	 *
-	 * Other processes are free to post on the queue without the need
-	 * for locking the queue.
-	 */
-	ofi_genlock_lock(&ep->util_ep.lock);
-	while (1) {
-		ret = smr_cmd_queue_head(smr_cmd_queue(ep->region), &ce, &pos);
+	while (budget--) {
+		ret = smr_cmd_queue_head(queue, &ce, &pos);
 		if (ret == -FI_ENOENT)
-			break;
+			return ret;
 		switch (ce->cmd.msg.hdr.op) {
 		case ofi_op_msg:
 		case ofi_op_tagged:
@@ -1261,15 +1256,85 @@ static void smr_progress_cmd(struct smr_ep *ep)
 				"unidentified operation type\n");
 			ret = -FI_EINVAL;
 		}
-		smr_cmd_queue_release(smr_cmd_queue(ep->region), ce, pos);
+		smr_cmd_queue_release(queue, ce, pos);
 		if (ret) {
 			if (ret != -FI_EAGAIN) {
 				FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 					"error processing command\n");
 			}
-			break;
+			return ret;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Each pass claims the active bits one word (64 peers) at a time, starting
+ * from a rotating word, and drains at most one queue's worth of commands
+ * from each claimed peer.  Peers that still have work are marked active
+ * again so that they are revisited on the next pass.
+ */
+static void smr_progress_peer_queues(struct smr_ep *ep)
+{
+	struct smr_peer_queue_hdr *hdr = smr_peer_queue_hdr(ep->region);
+	struct smr_cmd_queue *queue;
+	uint64_t claimed, pending, bit;
+	int64_t active;
+	int i, word, ret = 0;
+
+	for (i = 0; i < SMR_PEER_QUEUE_WORDS && !ret; i++) {
+		word = (ep->peer_queue_word + i) % SMR_PEER_QUEUE_WORDS;
+		active = ofi_atomic_get64(&hdr->active[word]);
+		if (!active)
+			continue;
+
+		while (!ofi_atomic_compare_exchange_weak64(&hdr->active[word],
+							   &active, 0))
+			;
+
+		claimed = (uint64_t) active;
+		for (pending = 0; claimed; claimed &= ~bit) {
+			bit = claimed & (~claimed + 1);
+			if (ret) {
+				pending |= bit;
+				continue;
+			}
+
+			queue = smr_peer_cmd_queue(ep->region, word * 64 +
+					__builtin_ctzll(bit));
+			ret = smr_progress_cmd_queue(ep, queue, queue->size);
+			if (ret == -FI_ENOENT)
+				ret = 0;
+			else
+				pending |= bit;
 		}
+		if (pending)
+			smr_peer_queue_mark(ep->region, word,
+					    (int64_t) pending);
 	}
+	ep->peer_queue_word = (ep->peer_queue_word + 1) % SMR_PEER_QUEUE_WORDS;
+}
+
+static void smr_progress_cmd(struct smr_ep *ep)
+{
+	int ret;
+
+	/* ep->util_ep.lock is used to serialize the message/tag matching.
+	 * We keep the lock until the matching is complete. This will
+	 * ensure that commands are matched in the order they are
+	 * received, if there are multiple progress threads.
+	 *
+	 * This lock should be low cost because it's only used by this
+	 * single process. It is also optimized to be a noop if
+	 * multi-threading is disabled.
+	 *
+	 * Other processes are free to post on the queue without the need
+	 * for locking the queue.
+	 */
+	ofi_genlock_lock(&ep->util_ep.lock);
+	ret = smr_progress_cmd_queue(ep, smr_cmd_queue(ep->region), INT_MAX);
+	if (ret == -FI_ENOENT && ep->region->peer_queue_offset)
+		smr_progress_peer_queues(ep);
 	ofi_genlock_unlock(&ep->util_ep.lock);
 }
 
@@ -1344,10 +1409,20 @@ static void smr_buffer_sar(struct smr_ep *ep, struct smr_region *peer_smr,
 	struct smr_sar_buf *sar_buf;
 	struct smr_unexp_buf *buf;
 	size_t bytes;
-	int next_buf = 0;
+	int next_buf = 0, index;
+	bool pipeline = sar_entry->cmd.msg.hdr.op_flags & SMR_SAR_PIPELINE;
 
 	while (next_buf < sar_entry->cmd.msg.data.buf_batch_size &&
 	       sar_entry->bytes_done < sar_entry->cmd.msg.hdr.size) {
+		if (pipeline) {
+			if (resp->sar_drained == resp->sar_filled)
+				return;
+			index = resp->sar_drained %
+				sar_entry->cmd.msg.data.buf_batch_size;
+		} else {
+			index = next_buf;
+		}
+
 		buf = ofi_buf_alloc(ep->unexp_buf_pool);
 		if (!buf) {
 			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
@@ -1360,7 +1435,7 @@ static void smr_buffer_sar(struct smr_ep *ep, struct smr_region *peer_smr,
 
 		sar_buf = smr_freestack_get_entry_from_index(
 				smr_sar_pool(ep->region),
-				sar_entry->cmd.msg.data.sar[next_buf]);
+				sar_entry->cmd.msg.data.sar[index]);
 		bytes = MIN(sar_entry->cmd.msg.hdr.size -
 				sar_entry->bytes_done,
 				SMR_SAR_SIZE);
@@ -1369,7 +1444,15 @@ static void smr_buffer_sar(struct smr_ep *ep, struct smr_region *peer_smr,
 
 		sar_entry->bytes_done += bytes;
 		next_buf++;
+
+		if (pipeline) {
+			ofi_wmb();
+			resp->sar_drained++;
+		}
 	}
+	if (pipeline)
+		return;
+
 	ofi_wmb();
 	resp->status = SMR_STATUS_SAR_EMPTY;
 }
@@ -1396,7 +1479,7 @@ static void smr_progress_sar_list(struct smr_ep *ep)
 					&sar_entry->bytes_done, sar_entry);
 		} else {
 			if (sar_entry->cmd_ctx) {
-				if (resp->status != SMR_STATUS_SAR_FULL)
+				if (!smr_sar_ready(resp, &sar_entry->cmd))
 					continue;
 				smr_buffer_sar(ep, peer_smr, resp, sar_entry);
 			} else {
@@ -68,7 +68,8 @@ static ssize_t smr_rma_fast(struct smr_ep *ep, struct smr_region *peer_smr,
 	int ret, i;
 	int64_t pos;
 
-	ret = smr_cmd_queue_next(smr_cmd_queue(peer_smr), &ce, &pos);
+	ret = smr_cmd_queue_next(smr_tx_cmd_queue(peer_smr, peer_id), &ce,
+				 &pos);
 	if (ret == -FI_ENOENT)
 		return -FI_EAGAIN;
 
@@ -88,6 +89,7 @@ static ssize_t smr_rma_fast(struct smr_ep *ep, struct smr_region *peer_smr,
 
 	if (ret) {
 		smr_cmd_queue_discard(ce, pos);
+		smr_tx_cmd_signal(peer_smr, peer_id);
 		return -FI_EAGAIN;
 	}
 
@@ -95,6 +97,7 @@ static ssize_t smr_rma_fast(struct smr_ep *ep, struct smr_region *peer_smr,
 			    (op == ofi_op_write) ? ofi_op_write_async :
 			    ofi_op_read_async, op_flags);
 	smr_cmd_queue_commit(ce, pos);
+	smr_tx_cmd_signal(peer_smr, peer_id);
 	return FI_SUCCESS;
 }
 
@@ -160,7 +163,8 @@ static ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 		goto unlock;
 	}
 
-	ret = smr_cmd_queue_next(smr_cmd_queue(peer_smr), &ce, &pos);
+	ret = smr_cmd_queue_next(smr_tx_cmd_queue(peer_smr, peer_id), &ce,
+				 &pos);
 	if (ret == -FI_ENOENT) {
 		/* kick the peer to process any outstanding commands */
 		ret = -FI_EAGAIN;
@@ -171,6 +175,7 @@ static ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 	assert(!(op_flags & FI_INJECT) || total_len <= SMR_INJECT_SIZE);
 
 	proto = smr_select_proto(desc, iov_count, smr_vma_enabled(ep, peer_smr),
+				 smr_vma_threshold(ep, id),
 	                         smr_ipc_valid(ep, peer_smr, id, peer_id), op,
 				 total_len, op_flags);
 
@@ -179,11 +184,13 @@ static ssize_t smr_generic_rma(struct smr_ep *ep, const struct iovec *iov,
 				   iov_count, total_len, context, &ce->cmd);
 	if (ret) {
 		smr_cmd_queue_discard(ce, pos);
+		smr_tx_cmd_signal(peer_smr, peer_id);
 		goto unlock;
 	}
 
 	smr_add_rma_cmd(peer_smr, rma_iov, rma_count, ce);
 	smr_cmd_queue_commit(ce, pos);
+	smr_tx_cmd_signal(peer_smr, peer_id);
 
 	if (proto != smr_src_inline && proto != smr_src_inject)
 		goto unlock;
@@ -350,7 +357,8 @@ static ssize_t smr_generic_rma_inject(struct fid_ep *ep_fid, const void *buf,
 		goto out;
 	}
 
-	ret = smr_cmd_queue_next(smr_cmd_queue(peer_smr), &ce, &pos);
+	ret = smr_cmd_queue_next(smr_tx_cmd_queue(peer_smr, peer_id), &ce,
+				 &pos);
 	if (ret == -FI_ENOENT)
 		return -FI_EAGAIN;
 
@@ -359,10 +367,12 @@ static ssize_t smr_generic_rma_inject(struct fid_ep *ep_fid, const void *buf,
 			data, flags, NULL, &iov, 1, len, NULL, &ce->cmd);
 	if (ret) {
 		smr_cmd_queue_discard(ce, pos);
+		smr_tx_cmd_signal(peer_smr, peer_id);
 		return -FI_EAGAIN;
 	}
 	smr_add_rma_cmd(peer_smr, &rma_iov, 1, ce);
 	smr_cmd_queue_commit(ce, pos);
+	smr_tx_cmd_signal(peer_smr, peer_id);
 
 out:
 	if (!ret)
@@ -89,15 +89,23 @@ void smr_cma_check(struct smr_region *smr, struct smr_region *peer_smr)
 	}
 }
 
+static size_t smr_peer_queue_stride(size_t peer_queue_size)
+{
+	return sizeof(struct smr_cmd_queue) +
+	       sizeof(struct smr_cmd_queue_entry) * peer_queue_size;
+}
+
 size_t smr_calculate_size_offsets(size_t tx_count, size_t rx_count,
+				  size_t peer_queue_size,
 				  size_t *cmd_offset, size_t *resp_offset,
 				  size_t *inject_offset, size_t *sar_offset,
 				  size_t *peer_offset, size_t *name_offset,
-				  size_t *sock_offset)
+				  size_t *sock_offset, size_t *peer_queue_offset)
 {
 	size_t cmd_queue_offset, resp_queue_offset, inject_pool_offset;
 	size_t sar_pool_offset, peer_data_offset, ep_name_offset;
 	size_t tx_size, rx_size, total_size, sock_name_offset;
+	size_t peer_cmd_queue_offset = 0;
 
 	tx_size = roundup_power_of_two(tx_count);
 	rx_size = roundup_power_of_two(rx_count);
@@ -134,6 +142,17 @@ size_t smr_calculate_size_offsets(size_t tx_count, size_t rx_count,
 
 	total_size = sock_name_offset + SMR_SOCK_NAME_MAX;
 
+	if (peer_queue_size) {
+		peer_queue_size = roundup_power_of_two(peer_queue_size);
+		peer_cmd_queue_offset = ofi_get_aligned_size(total_size, 64);
+		total_size = peer_cmd_queue_offset +
+			     sizeof(struct smr_peer_queue_hdr) +
+			     smr_peer_queue_stride(peer_queue_size) *
+			     SMR_MAX_PEERS;
+	}
+	if (peer_queue_offset)
+		*peer_queue_offset = peer_cmd_queue_offset;
+
 	/*
  	 * Revisit later to see if we really need the size adjustment, or
  	 * at most align to a multiple of a page size.
@@ -194,17 +213,21 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 	struct smr_ep_name *ep_name;
 	size_t total_size, cmd_queue_offset, peer_data_offset;
 	size_t resp_queue_offset, inject_pool_offset, name_offset;
-	size_t sar_pool_offset, sock_name_offset;
+	size_t sar_pool_offset, sock_name_offset, peer_queue_offset;
 	int fd, ret, i;
 	void *mapped_addr;
-	size_t tx_size, rx_size;
+	size_t tx_size, rx_size, peer_queue_size;
 
 	tx_size = roundup_power_of_two(attr->tx_count);
 	rx_size = roundup_power_of_two(attr->rx_count);
-	total_size = smr_calculate_size_offsets(tx_size, rx_size, &cmd_queue_offset,
+	peer_queue_size = attr->peer_queue_size ?
+			  roundup_power_of_two(attr->peer_queue_size) : 0;
+	total_size = smr_calculate_size_offsets(tx_size, rx_size,
+					peer_queue_size, &cmd_queue_offset,
 					&resp_queue_offset, &inject_pool_offset,
 					&sar_pool_offset, &peer_data_offset,
-					&name_offset, &sock_name_offset);
+					&name_offset, &sock_name_offset,
+					&peer_queue_offset);
 
 	fd = shm_open(attr->name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
 	if (fd < 0) {
@@ -281,6 +304,8 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 	(*smr)->cma_cap_peer = SMR_VMA_CAP_NA;
 	(*smr)->cma_cap_self = SMR_VMA_CAP_NA;
 
+	(*smr)->numa_node = smr_numa_node();
+
 	(*smr)->xpmem_cap_self = SMR_VMA_CAP_OFF;
 	if (xpmem && smr_env.use_xpmem) {
 		(*smr)->xpmem_cap_self = SMR_VMA_CAP_ON;
@@ -297,6 +322,9 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 	(*smr)->peer_data_offset = peer_data_offset;
 	(*smr)->name_offset = name_offset;
 	(*smr)->sock_name_offset = sock_name_offset;
+	(*smr)->peer_queue_offset = peer_queue_offset;
+	(*smr)->peer_queue_stride = peer_queue_size ?
+				    smr_peer_queue_stride(peer_queue_size) : 0;
 	(*smr)->max_sar_buf_per_peer = SMR_BUF_BATCH_MAX;
 
 	smr_cmd_queue_init(smr_cmd_queue(*smr), rx_size);
@@ -312,7 +340,16 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 		smr_peer_data(*smr)[i].xpmem.cap = SMR_VMA_CAP_OFF;
 	}
 
-	strncpy((char *) smr_name(*smr), attr->name, total_size - name_offset);
+	if (peer_queue_offset) {
+		for (i = 0; i < SMR_PEER_QUEUE_WORDS; i++)
+			ofi_atomic_initialize64(
+				&smr_peer_queue_hdr(*smr)->active[i], 0);
+		for (i = 0; i < SMR_MAX_PEERS; i++)
+			smr_cmd_queue_init(smr_peer_cmd_queue(*smr, i),
+					   peer_queue_size);
+	}
+
+	strncpy((char *) smr_name(*smr), attr->name, SMR_NAME_MAX - 1);
 
 	/* Must be set last to signal full initialization to peers */
 	(*smr)->pid = getpid();
@@ -456,6 +493,10 @@ void smr_map_to_endpoint(struct smr_region *region, int64_t id)
 	    (region == peer_smr && region->cma_cap_self == SMR_VMA_CAP_NA))
 		smr_cma_check(region, peer_smr);
 
+	region->map->peers[id].vma_threshold =
+		peer_smr->numa_node == region->numa_node ?
+		smr_calib.vma_local : smr_calib.vma_remote;
+
 	/* enable xpmem locally if the peer also has it enabled */
 	if (peer_smr->xpmem_cap_self == SMR_VMA_CAP_ON &&
 	    region->xpmem_cap_self == SMR_VMA_CAP_ON) {
@@ -47,6 +47,7 @@
 #include <ofi_tree.h>
 #include <ofi_hmem.h>
 #include <ofi_atomic_queue.h>
+#include <ofi_mb.h>
 
 #include <rdma/providers/fi_prov.h>
 
@@ -54,7 +55,7 @@
 extern "C" {
 #endif
 
-#define SMR_VERSION	8
+#define SMR_VERSION	10
 
 #define SMR_FLAG_ATOMIC	(1 << 0)
 #define SMR_FLAG_DEBUG	(1 << 1)
@@ -83,6 +84,7 @@ enum {
 #define SMR_TX_COMPLETION	(1 << 2)
 #define SMR_RX_COMPLETION	(1 << 3)
 #define SMR_MULTI_RECV		(1 << 4)
+#define SMR_SAR_PIPELINE	(1 << 5)
 
 /* CMA/XPMEM capability. Generic acronym used:
  * VMA: Virtual Memory Address */
@@ -210,6 +212,7 @@ struct smr_peer {
 	fi_addr_t		fiaddr;
 	struct smr_region	*region;
 	int			pid_fd;
+	size_t			vma_threshold;
 };
 
 #define SMR_MAX_PEERS	256
@@ -234,6 +237,7 @@ struct smr_region {
 	uint8_t		resv2;
 
 	uint32_t	max_sar_buf_per_peer;
+	int		numa_node;
 	struct ofi_xpmem_pinfo	xpmem_self;
 	struct ofi_xpmem_pinfo	xpmem_peer;
 	void		*base_addr;
@@ -254,11 +258,18 @@ struct smr_region {
 	size_t		peer_data_offset;
 	size_t		name_offset;
 	size_t		sock_name_offset;
+
+	/* per-peer command queues, 0 if disabled */
+	size_t		peer_queue_offset;
+	size_t		peer_queue_stride;
 };
 
 struct smr_resp {
 	uint64_t	msg_id;
 	uint64_t	status;
+	/* SAR buffers filled and drained, for SMR_SAR_PIPELINE transfers */
+	uint32_t	sar_filled;
+	uint32_t	sar_drained;
 };
 
 struct smr_inject_buf {
@@ -284,6 +295,25 @@ struct smr_sar_buf {
 	uint8_t		buf[SMR_SAR_SIZE];
 };
 
+/*
+ * Lock-step SAR hands the whole batch of buffers back and forth through
+ * resp->status.  Pipelined SAR treats the batch as a ring: the producer
+ * may run up to buf_batch_size buffers ahead of the consumer.
+ */
+static inline bool smr_sar_empty(struct smr_resp *resp, struct smr_cmd *cmd)
+{
+	if (cmd->msg.hdr.op_flags & SMR_SAR_PIPELINE)
+		return resp->sar_filled == resp->sar_drained;
+	return resp->status == SMR_STATUS_SAR_EMPTY;
+}
+
+static inline bool smr_sar_ready(struct smr_resp *resp, struct smr_cmd *cmd)
+{
+	if (cmd->msg.hdr.op_flags & SMR_SAR_PIPELINE)
+		return resp->sar_filled != resp->sar_drained;
+	return resp->status == SMR_STATUS_SAR_FULL;
+}
+
 /* TODO it is expected that a future patch will expand the smr_cmd
  * structure to also include the rma information, thereby removing the
  * need to have two commands in the cmd_entry. We can also remove the
@@ -300,6 +330,13 @@ struct smr_cmd_entry {
 OFI_DECLARE_CIRQUE(struct smr_resp, smr_resp_queue);
 OFI_DECLARE_ATOMIC_Q(struct smr_cmd_entry, smr_cmd_queue);
 
+#define SMR_PEER_QUEUE_WORDS	(SMR_MAX_PEERS / 64)
+
+/* Bitmap of the per-peer command queues with posted entries */
+struct smr_peer_queue_hdr {
+	ofi_atomic64_t	active[SMR_PEER_QUEUE_WORDS];
+} __attribute__((__aligned__(64)));
+
 static inline struct smr_region *smr_peer_region(struct smr_region *smr, int i)
 {
 	return smr->map->peers[i].region;
@@ -308,6 +345,18 @@ static inline struct smr_cmd_queue *smr_cmd_queue(struct smr_region *smr)
 {
 	return (struct smr_cmd_queue *) ((char *) smr + smr->cmd_queue_offset);
 }
+static inline struct smr_peer_queue_hdr *
+smr_peer_queue_hdr(struct smr_region *smr)
+{
+	return (struct smr_peer_queue_hdr *) ((char *) smr +
+					      smr->peer_queue_offset);
+}
+static inline struct smr_cmd_queue *
+smr_peer_cmd_queue(struct smr_region *smr, int64_t id)
+{
+	return (struct smr_cmd_queue *) ((char *) smr + smr->peer_queue_offset +
+		sizeof(struct smr_peer_queue_hdr) + id * smr->peer_queue_stride);
+}
 static inline struct smr_resp_queue *smr_resp_queue(struct smr_region *smr)
 {
 	return (struct smr_resp_queue *) ((char *) smr + smr->resp_queue_offset);
@@ -339,19 +388,62 @@ static inline void smr_set_map(struct smr_region *smr, struct smr_map *map)
 	smr->map = map;
 }
 
+/*
+ * Command queue used to post to smr by the peer smr knows as id.  Commands
+ * go through the shared queue until the peer has been assigned an id (i.e.
+ * the connection request) or if smr has no per-peer queues.
+ */
+static inline struct smr_cmd_queue *
+smr_tx_cmd_queue(struct smr_region *smr, int64_t id)
+{
+	if (!smr->peer_queue_offset || id < 0)
+		return smr_cmd_queue(smr);
+	return smr_peer_cmd_queue(smr, id);
+}
+
+/*
+ * Mark the per-peer queue as active after committing or discarding an entry
+ * so the owner polls it.  The fence orders the entry ahead of the bitmap
+ * read against the owner clearing the bit before draining the queue.
+ */
+static inline void smr_peer_queue_mark(struct smr_region *smr, int word,
+				       int64_t bits)
+{
+	ofi_atomic64_t *active = &smr_peer_queue_hdr(smr)->active[word];
+	int64_t val;
+
+	val = ofi_atomic_get64(active);
+	while ((val & bits) != bits) {
+		if (ofi_atomic_compare_exchange_weak64(active, &val, val | bits))
+			break;
+	}
+}
+
+static inline void smr_tx_cmd_signal(struct smr_region *smr, int64_t id)
+{
+	if (!smr->peer_queue_offset || id < 0)
+		return;
+
+	ofi_mb();
+	smr_peer_queue_mark(smr, id / 64, (int64_t) (1ULL << (id % 64)));
+}
+
 struct smr_attr {
 	const char	*name;
 	size_t		rx_count;
 	size_t		tx_count;
+	size_t		peer_queue_size;
 	uint16_t	flags;
 };
 
 size_t smr_calculate_size_offsets(size_t tx_count, size_t rx_count,
+				  size_t peer_queue_size,
 				  size_t *cmd_offset, size_t *resp_offset,
 				  size_t *inject_offset, size_t *sar_offset,
 				  size_t *peer_offset, size_t *name_offset,
-				  size_t *sock_offset);
+				  size_t *sock_offset, size_t *peer_queue_offset);
 void	smr_cma_check(struct smr_region *region, struct smr_region *peer_region);
+int	smr_numa_node(void);
 void	smr_cleanup(void);
 int	smr_map_to_region(const struct fi_provider *prov, struct smr_map *map,
 			  int64_t id);
@@ -96,6 +96,7 @@ typedef void  xnet_profile_t;
 #define XNET_DEF_BUF_SIZE	16384
 #define XNET_MAX_EVENTS		128
 #define XNET_MIN_MULTI_RECV	16384
+#define XNET_MAX_MSHOT_BUFS	8
 #define XNET_PORT_MAX_RANGE	(USHRT_MAX)
 
 extern struct fi_provider	xnet_prov;
@@ -115,6 +116,10 @@ extern size_t xnet_zerocopy_size;
 extern int xnet_trace_msg;
 extern int xnet_disable_autoprog;
 extern int xnet_io_uring;
+extern int xnet_io_uring_mshot;
+extern size_t xnet_io_uring_rx_bufs;
+extern size_t xnet_comp_batch;
+extern size_t xnet_tx_coalesce_size;
 extern int xnet_max_saved;
 extern size_t xnet_max_saved_size;
 extern size_t xnet_max_inject;
@@ -265,6 +270,12 @@ struct xnet_ep {
 
 	short			pollflags;
 
+	/* provided buffers holding data not yet copied into bsock.rq */
+	struct slist		rx_bufs;
+	size_t			rx_bufs_cnt;
+	struct dlist_entry	mshot_entry;
+	struct ofi_sockctx	mshot_cancel_ctx;
+
 	xnet_profile_t *profile;
 };
 
@@ -315,6 +326,25 @@ struct xnet_uring {
 	struct ofi_sockapi_uring *sockapi;
 };
 
+/* A successful completion staged by the progress engine */
+struct xnet_comp {
+	struct util_cq		*cq;
+	void			*context;
+	uint64_t		flags;
+	size_t			len;
+	void			*buf;
+	uint64_t		data;
+	uint64_t		tag;
+	fi_addr_t		src;
+};
+
+struct xnet_rx_buf {
+	struct slist_entry	entry;
+	size_t			len;
+	size_t			offset;
+	uint16_t		bid;
+};
+
 /* Serialization is handled at the progress instance level, using the
  * progress locks.  A progress instance has 2 locks, only one of which is
  * enabled.  The other lock will be set to NONE, meaning it is fully disabled.
@@ -363,8 +393,26 @@ struct xnet_progress {
 	struct xnet_uring	rx_uring;
 	ofi_io_uring_cqe_t	**cqes;
 
+	/* Multishot receive: connected sockets share a ring of provided
+	 * buffers.  Endpoints whose multishot request could not be (re)armed,
+	 * because the ring ran dry or the uring was out of credits, wait on
+	 * mshot_list until buffers are returned.
+	 */
+	struct ofi_uring_buf_ring rx_buf_ring;
+	struct xnet_rx_buf	*rx_bufs;
+	size_t			rx_bufs_avail;
+	struct dlist_entry	mshot_list;
+
 	struct ofi_sockapi	sockapi;
 
+	/* While progress runs, successful completions are staged here and
+	 * written to their CQs with one lock acquisition and one signal per
+	 * CQ when the pass ends or the batch fills.
+	 */
+	struct xnet_comp	*comps;
+	size_t			comp_cnt;
+	bool			comp_batching;
+
 	struct ofi_dynpoll	epoll_fd;
 	struct ofi_epollfds_event events[XNET_MAX_EVENTS];
 
@@ -398,6 +446,9 @@ int xnet_uring_cancel(struct xnet_progress *progress,
 int xnet_uring_pollin_add(struct xnet_progress *progress,
 			  int fd, bool multishot,
 			  struct ofi_sockctx *pollin_ctx);
+int xnet_uring_monitor_ep(struct xnet_progress *progress, struct xnet_ep *ep);
+void xnet_uring_release_rx_bufs(struct xnet_progress *progress,
+				struct xnet_ep *ep);
 
 static inline int xnet_progress_locked(struct xnet_progress *progress)
 {
@@ -597,6 +648,7 @@ int xnet_av_open(struct fid_domain *domain_fid, struct fi_av_attr *attr,
 int xnet_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 		 struct fid_cq **cq_fid, void *context);
 void xnet_report_success(struct xnet_xfer_entry *xfer_entry);
+void xnet_flush_comps(struct xnet_progress *progress);
 void xnet_report_error(struct xnet_xfer_entry *xfer_entry, int err);
 int xnet_cntr_open(struct fid_domain *fid_domain, struct fi_cntr_attr *attr,
 		   struct fid_cntr **cntr_fid, void *context);
@@ -126,6 +126,8 @@ static void xnet_get_cq_info(struct xnet_xfer_entry *entry, uint64_t *flags,
 
 void xnet_report_success(struct xnet_xfer_entry *xfer_entry)
 {
+	struct xnet_progress *progress;
+	struct xnet_comp *comp;
 	struct util_cq *cq;
 	uint64_t flags, data, tag;
 	size_t len;
@@ -171,6 +173,22 @@ void xnet_report_success(struct xnet_xfer_entry *xfer_entry)
 		tag = 0;
 	}
 
+	progress = xnet_cq2_progress(xfer_entry->cq);
+	if (progress->comp_batching) {
+		comp = &progress->comps[progress->comp_cnt++];
+		comp->cq = cq;
+		comp->context = xfer_entry->context;
+		comp->flags = flags;
+		comp->len = len;
+		comp->buf = xfer_entry->user_buf;
+		comp->data = data;
+		comp->tag = tag;
+		comp->src = xfer_entry->src_addr;
+		if (progress->comp_cnt == xnet_comp_batch)
+			xnet_flush_comps(progress);
+		return;
+	}
+
 	if (cq->src) {
 		ofi_cq_write_src(cq, xfer_entry->context, flags, len,
 				 xfer_entry->user_buf, data, tag,
@@ -183,8 +201,57 @@ void xnet_report_success(struct xnet_xfer_entry *xfer_entry)
 		cq->wait->signal(cq->wait);
 }
 
+static void xnet_write_comp(struct util_cq *cq, struct xnet_comp *comp)
+{
+	if (ofi_cirque_freecnt(cq->cirq) <= 1) {
+		(void) ofi_cq_write_overflow(cq, comp->context, comp->flags,
+					     comp->len, comp->buf, comp->data,
+					     comp->tag, cq->src ? comp->src :
+					     FI_ADDR_NOTAVAIL);
+	} else if (cq->src) {
+		ofi_cq_write_src_entry(cq, comp->context, comp->flags,
+				       comp->len, comp->buf, comp->data,
+				       comp->tag, comp->src);
+	} else {
+		ofi_cq_write_entry(cq, comp->context, comp->flags, comp->len,
+				   comp->buf, comp->data, comp->tag);
+	}
+}
+
+/* Completions are written per CQ in the order they were staged, which
+ * preserves ordering within each CQ.
+ */
+void xnet_flush_comps(struct xnet_progress *progress)
+{
+	struct util_cq *cq;
+	size_t i, j;
+
+	assert(xnet_progress_locked(progress));
+	for (i = 0; i < progress->comp_cnt; i++) {
+		cq = progress->comps[i].cq;
+		if (!cq)
+			continue;
+
+		ofi_genlock_lock(&cq->cq_lock);
+		ofi_cq_drain(cq, true);
+		for (j = i; j < progress->comp_cnt; j++) {
+			if (progress->comps[j].cq != cq)
+				continue;
+
+			xnet_write_comp(cq, &progress->comps[j]);
+			progress->comps[j].cq = NULL;
+		}
+		ofi_genlock_unlock(&cq->cq_lock);
+
+		if (cq->wait)
+			cq->wait->signal(cq->wait);
+	}
+	progress->comp_cnt = 0;
+}
+
 void xnet_report_error(struct xnet_xfer_entry *xfer_entry, int err)
 {
+	struct xnet_progress *progress;
 	struct fi_cq_err_entry err_entry;
 
 	if (xfer_entry->ctrl_flags &
@@ -230,6 +297,11 @@ void xnet_report_error(struct xnet_xfer_entry *xfer_entry, int err)
 	err_entry.err_data = NULL;
 	err_entry.err_data_size = 0;
 
+	/* Keep the error behind any successful completions staged before it */
+	progress = xnet_cq2_progress(xfer_entry->cq);
+	if (progress->comp_cnt)
+		xnet_flush_comps(progress);
+
 	ofi_cq_write_error(&xfer_entry->cq->util_cq, &err_entry);
 }
 
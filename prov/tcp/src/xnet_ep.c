@@ -197,8 +197,7 @@ static int xnet_monitor_ep(struct xnet_progress *progress, struct xnet_ep *ep)
 {
 	if (xnet_io_uring) {
 		assert(!(ep->pollflags & POLLOUT));
-		return xnet_uring_pollin_add(progress, ep->bsock.sock,
-					     false, &ep->bsock.pollin_sockctx);
+		return xnet_uring_monitor_ep(progress, ep);
 	}
 
 	return xnet_monitor_sock(progress, ep->bsock.sock, ep->pollflags,
@@ -383,6 +382,13 @@ static void xnet_ep_flush_all_queues(struct xnet_ep *ep)
 				&ep->util_ep.ep_fid);
 	if (ret)
 		FI_WARN(&xnet_prov, FI_LOG_EP_DATA, "Failed to cancel RX uring\n");
+	xnet_uring_release_rx_bufs(progress, ep);
+
+	ret = xnet_uring_cancel(progress, &progress->rx_uring,
+				&ep->mshot_cancel_ctx,
+				&ep->util_ep.ep_fid);
+	if (ret)
+		FI_WARN(&xnet_prov, FI_LOG_EP_DATA, "Failed to cancel RX uring\n");
 
 	ret = xnet_uring_cancel(progress, &progress->rx_uring,
 				&ep->bsock.pollin_sockctx,
@@ -739,6 +745,7 @@ int xnet_endpoint(struct fid_domain *domain, struct fi_info *info,
 	ofi_bsock_init(&ep->bsock, &xnet_ep2_progress(ep)->sockapi,
 		       xnet_staging_sbuf_size, xnet_prefetch_rbuf_size,
 		       &ep->util_ep.ep_fid);
+	ofi_sockctx_init(&ep->mshot_cancel_ctx, &ep->util_ep.ep_fid);
 	if (info->handle) {
 		if (((fid_t) info->handle)->fclass == FI_CLASS_PEP) {
 			pep = container_of(info->handle, struct xnet_pep,
@@ -807,6 +814,8 @@ int xnet_endpoint(struct fid_domain *domain, struct fi_info *info,
 	}
 
 	dlist_init(&ep->unexp_entry);
+	dlist_init(&ep->mshot_entry);
+	slist_init(&ep->rx_bufs);
 	slist_init(&ep->rx_queue);
 	slist_init(&ep->tx_queue);
 	slist_init(&ep->priority_queue);
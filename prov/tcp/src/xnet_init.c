@@ -67,6 +67,10 @@ size_t xnet_zerocopy_size = SIZE_MAX;
 int xnet_trace_msg;
 int xnet_disable_autoprog;
 int xnet_io_uring;
+int xnet_io_uring_mshot;
+size_t xnet_io_uring_rx_bufs = 256;
+size_t xnet_comp_batch = 64;
+size_t xnet_tx_coalesce_size = 256;
 int xnet_max_saved = 64;
 size_t xnet_max_inject = XNET_DEF_INJECT;
 size_t xnet_buf_size = XNET_DEF_BUF_SIZE;
@@ -173,6 +177,20 @@ static void xnet_init_env(void)
 	fi_param_get_int(&xnet_prov, "prefetch_rbuf_size",
 			 &xnet_prefetch_rbuf_size);
 	fi_param_get_size_t(&xnet_prov, "zerocopy_size", &xnet_zerocopy_size);
+	fi_param_define(&xnet_prov, "tx_coalesce_size", FI_PARAM_SIZE_T,
+			"messages up to this size that are queued behind other "
+			"outbound data are copied into the staging buffer and "
+			"sent together with it, set to 0 to disable "
+			"(default: %zu)", xnet_tx_coalesce_size);
+	fi_param_get_size_t(&xnet_prov, "tx_coalesce_size",
+			    &xnet_tx_coalesce_size);
+
+	fi_param_define(&xnet_prov, "comp_batch", FI_PARAM_SIZE_T,
+			"maximum number of completions collected by a single "
+			"progress pass before they are written to the CQ, set "
+			"to 0 to write each completion as it occurs "
+			"(default: %zu)", xnet_comp_batch);
+	fi_param_get_size_t(&xnet_prov, "comp_batch", &xnet_comp_batch);
 
 	fi_param_define(&xnet_prov, "trace_msg", FI_PARAM_BOOL,
 			"Capture and display transport message information "
@@ -186,6 +204,19 @@ static void xnet_init_env(void)
 			"Enable io_uring support if available (default: %d)", xnet_io_uring);
 	fi_param_get_bool(&xnet_prov, "io_uring",
 			 &xnet_io_uring);
+	fi_param_define(&xnet_prov, "io_uring_multishot", FI_PARAM_BOOL,
+			"Receive using a single multishot request per socket "
+			"and a ring of provided buffers, requires io_uring "
+			"(default: %d)", xnet_io_uring_mshot);
+	fi_param_get_bool(&xnet_prov, "io_uring_multishot",
+			  &xnet_io_uring_mshot);
+	fi_param_define(&xnet_prov, "io_uring_rx_bufs", FI_PARAM_SIZE_T,
+			"Number of provided receive buffers per progress "
+			"thread when io_uring_multishot is enabled, rounded "
+			"up to a power of 2.  Each buffer is prefetch_rbuf_size "
+			"bytes (default: %zu)", xnet_io_uring_rx_bufs);
+	fi_param_get_size_t(&xnet_prov, "io_uring_rx_bufs",
+			    &xnet_io_uring_rx_bufs);
 }
 
 static void xnet_fini(void)
@@ -207,6 +238,7 @@ TCP_INI
 #if HAVE_TCP_DL
 	ofi_pmem_init();
 	ofi_mem_init();
+	ofi_copy_init();
 #endif
 	xnet_init_env();
 	xnet_init_infos();
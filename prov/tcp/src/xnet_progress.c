@@ -361,6 +361,166 @@ void xnet_recv_saved(struct xnet_rdm *rdm, struct xnet_xfer_entry *saved_entry,
 	xnet_free_xfer(progress, rx_entry);
 }
 
+static void xnet_uring_release_rx_buf(struct xnet_progress *progress,
+				      struct xnet_rx_buf *rx_buf)
+{
+	ofi_uring_buf_ring_recycle(&progress->rx_buf_ring, rx_buf->bid);
+	progress->rx_bufs_avail++;
+}
+
+void xnet_uring_release_rx_bufs(struct xnet_progress *progress,
+				struct xnet_ep *ep)
+{
+	struct xnet_rx_buf *rx_buf;
+
+	assert(xnet_progress_locked(progress));
+	dlist_remove_init(&ep->mshot_entry);
+	while (!slist_empty(&ep->rx_bufs)) {
+		rx_buf = container_of(slist_remove_head(&ep->rx_bufs),
+				      struct xnet_rx_buf, entry);
+		xnet_uring_release_rx_buf(progress, rx_buf);
+	}
+	ep->rx_bufs_cnt = 0;
+}
+
+/* Copy data that the kernel placed into provided buffers into the
+ * socket's prefetch buffer, where the normal receive path consumes it.
+ */
+static void xnet_uring_fill_rq(struct xnet_progress *progress,
+			       struct xnet_ep *ep)
+{
+	struct xnet_rx_buf *rx_buf;
+	char *buf;
+	size_t len;
+
+	while (!slist_empty(&ep->rx_bufs)) {
+		len = ofi_byteq_writeable(&ep->bsock.rq);
+		if (!len)
+			break;
+
+		rx_buf = container_of(ep->rx_bufs.head, struct xnet_rx_buf,
+				      entry);
+		buf = ofi_uring_buf_ring_buf(&progress->rx_buf_ring,
+					     rx_buf->bid);
+		len = MIN(len, rx_buf->len - rx_buf->offset);
+		ofi_byteq_write(&ep->bsock.rq, buf + rx_buf->offset, len);
+		rx_buf->offset += len;
+		if (rx_buf->offset == rx_buf->len) {
+			slist_remove_head(&ep->rx_bufs);
+			xnet_uring_release_rx_buf(progress, rx_buf);
+			ep->rx_bufs_cnt--;
+		}
+	}
+}
+
+static inline bool xnet_uring_rq_pending(struct xnet_ep *ep)
+{
+	return !slist_empty(&ep->rx_bufs) && ep->state == XNET_CONNECTED &&
+	       ofi_byteq_writeable(&ep->bsock.rq);
+}
+
+static int xnet_uring_mshot_arm(struct xnet_progress *progress,
+				struct xnet_ep *ep)
+{
+	int ret;
+
+	assert(xnet_progress_locked(progress));
+	assert(progress->rx_bufs);
+	ep->bsock.rx_sockctx.uring_mshot = true;
+	if (!progress->rx_bufs_avail) {
+		ret = -FI_EAGAIN;
+	} else {
+		ret = ofi_sockctx_uring_recv_multishot(progress->rx_uring.sockapi,
+						       ep->bsock.sock,
+						       &progress->rx_buf_ring,
+						       &ep->bsock.rx_sockctx);
+	}
+
+	if (ret == -FI_EAGAIN) {
+		if (dlist_empty(&ep->mshot_entry))
+			dlist_insert_tail(&ep->mshot_entry,
+					  &progress->mshot_list);
+		return 0;
+	}
+
+	return ret == -OFI_EINPROGRESS_URING ? 0 : ret;
+}
+
+/* An endpoint that is not consuming its data must stop taking buffers from
+ * the ring shared by all sockets of the progress instance.  Otherwise a
+ * single slow receiver starves the others.  Cancel its multishot request
+ * and leave further data in the socket, where TCP flow control pushes back
+ * on the peer.
+ */
+static int xnet_uring_mshot_pause(struct xnet_progress *progress,
+				  struct xnet_ep *ep)
+{
+	int ret;
+
+	assert(xnet_progress_locked(progress));
+	if (dlist_empty(&ep->unexp_entry) &&
+	    ep->rx_bufs_cnt < XNET_MAX_MSHOT_BUFS)
+		return 0;
+
+	dlist_remove_init(&ep->mshot_entry);
+	ret = ofi_sockctx_uring_cancel(progress->rx_uring.sockapi,
+				       &ep->bsock.rx_sockctx,
+				       &ep->mshot_cancel_ctx);
+	/* Without a credit, the next completion retries the cancel */
+	if (ret == -FI_EAGAIN || ret == -OFI_EINPROGRESS_URING)
+		return 0;
+	return ret;
+}
+
+/* Rearm a paused endpoint once it has drained most of its buffers.  Its
+ * previous request and any cancel of it must have completed first.
+ */
+static int xnet_uring_mshot_resume(struct xnet_progress *progress,
+				   struct xnet_ep *ep)
+{
+	assert(xnet_progress_locked(progress));
+	if (ep->bsock.rx_sockctx.uring_sqe_inuse ||
+	    ep->mshot_cancel_ctx.uring_sqe_inuse ||
+	    !dlist_empty(&ep->mshot_entry) ||
+	    !dlist_empty(&ep->unexp_entry) ||
+	    ep->rx_bufs_cnt > XNET_MAX_MSHOT_BUFS / 2)
+		return 0;
+
+	return xnet_uring_mshot_arm(progress, ep);
+}
+
+/* Rearm endpoints waiting on buffers or credits to become available */
+static void xnet_uring_mshot_rearm(struct xnet_progress *progress)
+{
+	struct xnet_ep *ep;
+	int ret;
+
+	while (!dlist_empty(&progress->mshot_list) && progress->rx_bufs_avail) {
+		dlist_pop_front(&progress->mshot_list, struct xnet_ep, ep,
+				mshot_entry);
+		dlist_init(&ep->mshot_entry);
+		if (ep->state != XNET_CONNECTED)
+			continue;
+
+		ret = xnet_uring_mshot_resume(progress, ep);
+		if (ret) {
+			xnet_ep_disable(ep, 0, NULL, 0);
+			continue;
+		}
+		if (!dlist_empty(&ep->mshot_entry))
+			break;
+	}
+}
+
+int xnet_uring_monitor_ep(struct xnet_progress *progress, struct xnet_ep *ep)
+{
+	if (progress->rx_bufs)
+		return xnet_uring_mshot_arm(progress, ep);
+
+	return xnet_uring_pollin_add(progress, ep->bsock.sock, false,
+				     &ep->bsock.pollin_sockctx);
+}
+
 int xnet_uring_pollin_add(struct xnet_progress *progress, int fd,
 			  bool multishot, struct ofi_sockctx *pollin_ctx)
 {
@@ -384,6 +544,11 @@ static int xnet_update_pollflag(struct xnet_ep *ep, short pollflag, bool set)
 
 	progress = xnet_ep2_progress(ep);
 	assert(xnet_progress_locked(progress));
+	if (pollflag == POLLIN && ep->bsock.rx_sockctx.uring_mshot) {
+		return set ? xnet_uring_mshot_resume(progress, ep) :
+			     xnet_uring_mshot_pause(progress, ep);
+	}
+
 	if (set) {
 		if (ep->pollflags & pollflag)
 			return 0;
@@ -567,12 +732,42 @@ static void xnet_complete_tx(struct xnet_ep *ep, int ret)
 	ep->hdr_bswap(ep, &ep->cur_tx.entry->hdr.base_hdr);
 }
 
+/* If other data is waiting to go out, append a small message to the
+ * staging buffer instead of sending it by itself.  Queued messages are
+ * then written to the socket with a single call when the staging buffer
+ * is flushed, at the latest before xnet_progress_tx returns.
+ */
+static bool xnet_coalesce_msg(struct xnet_ep *ep)
+{
+	struct xnet_xfer_entry *tx_entry;
+
+	if (xnet_io_uring || ep->cur_tx.data_left > xnet_tx_coalesce_size ||
+	    ep->cur_tx.data_left >= ofi_byteq_writeable(&ep->bsock.sq))
+		return false;
+
+	if (!ofi_bsock_tosend(&ep->bsock) && slist_empty(&ep->tx_queue) &&
+	    slist_empty(&ep->priority_queue))
+		return false;
+
+	tx_entry = ep->cur_tx.entry;
+	assert(ofi_total_iov_len(tx_entry->iov, tx_entry->iov_cnt) ==
+	       ep->cur_tx.data_left);
+	ofi_byteq_writev(&ep->bsock.sq, tx_entry->iov, tx_entry->iov_cnt);
+	ep->cur_tx.data_left = 0;
+	return true;
+}
+
 static void xnet_progress_tx(struct xnet_ep *ep)
 {
 	int ret;
 
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
 	while (ep->cur_tx.entry) {
+		if (xnet_coalesce_msg(ep)) {
+			xnet_complete_tx(ep, FI_SUCCESS);
+			continue;
+		}
+
 		ret = xnet_send_msg(ep);
 		if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret)) {
 			ret = xnet_update_pollflag(ep, POLLOUT, true);
@@ -1123,11 +1318,14 @@ cq_error:
 
 void xnet_progress_rx(struct xnet_ep *ep)
 {
+	struct xnet_progress *progress;
 	int ret;
 
-	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	progress = xnet_ep2_progress(ep);
+	assert(xnet_progress_locked(progress));
 	do {
 		assert(ep->state == XNET_CONNECTED);
+		xnet_uring_fill_rq(progress, ep);
 		if (ep->cur_rx.hdr_done < ep->cur_rx.hdr_len) {
 			ret = xnet_recv_hdr(ep);
 		} else {
@@ -1135,15 +1333,19 @@ void xnet_progress_rx(struct xnet_ep *ep)
 		}
 
 		if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret) ||
-		    ret == -OFI_EINPROGRESS_URING)
+		    ret == -OFI_EINPROGRESS_URING) {
+			if (xnet_uring_rq_pending(ep))
+				continue;
 			break;
+		}
 
 		if (ep->cur_rx.entry)
 			xnet_complete_rx(ep, ret);
 		else if (ret)
 			xnet_ep_disable(ep, 0, NULL, 0);
 
-	} while (!ret && ofi_bsock_readable(&ep->bsock));
+	} while ((!ret && ofi_bsock_readable(&ep->bsock)) ||
+		 xnet_uring_rq_pending(ep));
 
 	if (xnet_io_uring) {
 		if (ret == -OFI_EINPROGRESS_URING)
@@ -1276,6 +1478,53 @@ disable:
 	xnet_ep_disable(ep, -ret, NULL, 0);
 }
 
+static void xnet_uring_mshot_done(struct xnet_progress *progress,
+				  struct xnet_ep *ep, ofi_io_uring_cqe_t *cqe)
+{
+	struct xnet_rx_buf *rx_buf;
+	int ret;
+
+	if (cqe->flags & IORING_CQE_F_BUFFER) {
+		rx_buf = &progress->rx_bufs[ofi_uring_cqe_bid(cqe)];
+		assert(progress->rx_bufs_avail);
+		progress->rx_bufs_avail--;
+		if (ep->state == XNET_CONNECTED && cqe->res > 0) {
+			rx_buf->len = cqe->res;
+			rx_buf->offset = 0;
+			slist_insert_tail(&rx_buf->entry, &ep->rx_bufs);
+			ep->rx_bufs_cnt++;
+		} else {
+			xnet_uring_release_rx_buf(progress, rx_buf);
+		}
+	}
+
+	/* Canceled or disabled, the final CQE will clear the sockctx */
+	if (ep->state != XNET_CONNECTED)
+		return;
+
+	/* The request ends on ENOBUFS, or when paused with ECANCELED.
+	 * Anything else that ends it is EOF or a socket error.
+	 */
+	if (!(cqe->flags & IORING_CQE_F_MORE) && cqe->res <= 0 &&
+	    cqe->res != -ENOBUFS && cqe->res != -ECANCELED) {
+		xnet_ep_disable(ep, 0, NULL, 0);
+		return;
+	}
+
+	if (!slist_empty(&ep->rx_bufs)) {
+		xnet_progress_rx(ep);
+		if (ep->state != XNET_CONNECTED)
+			return;
+	}
+
+	if (cqe->flags & IORING_CQE_F_MORE)
+		ret = xnet_uring_mshot_pause(progress, ep);
+	else
+		ret = xnet_uring_mshot_resume(progress, ep);
+	if (ret)
+		xnet_ep_disable(ep, 0, NULL, 0);
+}
+
 static void xnet_uring_run_ep(struct xnet_ep *ep, struct ofi_sockctx *sockctx,
 			      int res)
 {
@@ -1292,6 +1541,9 @@ static void xnet_uring_run_ep(struct xnet_ep *ep, struct ofi_sockctx *sockctx,
 				assert(res & POLLIN);
 				xnet_progress_rx(ep);
 			}
+		} else if (sockctx == &ep->mshot_cancel_ctx) {
+			if (xnet_uring_mshot_resume(xnet_ep2_progress(ep), ep))
+				xnet_ep_disable(ep, 0, NULL, 0);
 		}
 		/* Must be a cancelation otherwise */
 		break;
@@ -1333,15 +1585,20 @@ static void xnet_progress_cqe(struct xnet_progress *progress,
 	sockctx = (struct ofi_sockctx *) cqe->user_data;
 	assert(sockctx);
 	assert(sockctx->uring_sqe_inuse);
-	if (!(cqe ->flags & IORING_CQE_F_MORE))
+	/* A multishot request holds its credit until the final CQE */
+	if (!(cqe->flags & IORING_CQE_F_MORE)) {
 		sockctx->uring_sqe_inuse = false;
-	uring->sockapi->credits++;
+		uring->sockapi->credits++;
+	}
 
 	fid = sockctx->context;
 	switch (fid->fclass) {
 	case FI_CLASS_EP:
 		ep = container_of(fid, struct xnet_ep, util_ep.ep_fid.fid);
-		xnet_uring_run_ep(ep, sockctx, cqe->res);
+		if (sockctx->uring_mshot)
+			xnet_uring_mshot_done(progress, ep, cqe);
+		else
+			xnet_uring_run_ep(ep, sockctx, cqe->res);
 		break;
 	case FI_CLASS_CONNREQ:
 		conn = container_of(fid, struct xnet_conn_handle, fid);
@@ -1379,6 +1636,8 @@ static void xnet_progress_uring(struct xnet_progress *progress,
 	}
 
 	ofi_uring_cq_advance(&uring->ring, nready);
+	if (uring == &progress->rx_uring)
+		xnet_uring_mshot_rearm(progress);
 }
 
 int xnet_uring_cancel(struct xnet_progress *progress,
@@ -1547,9 +1806,14 @@ void xnet_progress_unexp(struct xnet_progress *progress,
 
 void xnet_run_progress(struct xnet_progress *progress, bool clear_signal)
 {
+	bool batching;
 	int nfds;
 
 	assert(ofi_genlock_held(progress->active_lock));
+	/* progress may be driven recursively, e.g. while waiting on a
+	 * connection, only the outermost pass ends the batch */
+	batching = progress->comp_batching;
+	progress->comp_batching = progress->comps != NULL;
 	if (xnet_io_uring) {
 		xnet_progress_uring(progress, &progress->tx_uring);
 		xnet_progress_uring(progress, &progress->rx_uring);
@@ -1561,6 +1825,10 @@ void xnet_run_progress(struct xnet_progress *progress, bool clear_signal)
 					ARRAY_SIZE(progress->events), 0);
 		xnet_handle_events(progress, &progress->events[0], nfds, clear_signal);
 	}
+
+	if (progress->comp_cnt)
+		xnet_flush_comps(progress);
+	progress->comp_batching = batching;
 }
 
 void xnet_progress(struct xnet_progress *progress, bool clear_signal)
@@ -1626,7 +1894,7 @@ int xnet_trywait(struct fid_fabric *fabric_fid, struct fid **fid, int count)
 			cq = container_of(fid[i], struct xnet_cq,
 					  util_cq.cq_fid.fid);
 			ofi_genlock_lock(xnet_cq2_progress(cq)->active_lock);
-			if (ofi_cirque_isempty(cq->util_cq.cirq))
+			if (ofi_cq_isempty(&cq->util_cq))
 				xnet_reset_wait(cq->util_cq.wait);
 			else
 				ret = -FI_EAGAIN;
@@ -1849,6 +2117,52 @@ static void xnet_destroy_uring(struct xnet_uring *uring,
 	}
 }
 
+/* Multishot receive is an optimization, fall back to posting a receive
+ * per operation if the kernel or liburing lack support for it.
+ */
+static void xnet_init_rx_bufs(struct xnet_progress *progress)
+{
+	size_t cnt;
+	int ret;
+
+	if (xnet_prefetch_rbuf_size <= 0)
+		return;
+
+	cnt = roundup_power_of_two(xnet_io_uring_rx_bufs);
+	progress->rx_bufs = calloc(cnt, sizeof(*progress->rx_bufs));
+	if (!progress->rx_bufs)
+		return;
+
+	ret = ofi_uring_buf_ring_init(&progress->rx_uring.ring,
+				      &progress->rx_buf_ring, 0,
+				      (unsigned int) cnt,
+				      (size_t) xnet_prefetch_rbuf_size);
+	if (ret) {
+		FI_INFO(&xnet_prov, FI_LOG_EP_CTRL,
+			"io_uring multishot receive unavailable: %s\n",
+			fi_strerror(-ret));
+		free(progress->rx_bufs);
+		progress->rx_bufs = NULL;
+		return;
+	}
+
+	while (cnt--)
+		progress->rx_bufs[cnt].bid = (uint16_t) cnt;
+	progress->rx_bufs_avail = progress->rx_buf_ring.count;
+}
+
+static void xnet_close_rx_bufs(struct xnet_progress *progress)
+{
+	if (!progress->rx_bufs)
+		return;
+
+	assert(dlist_empty(&progress->mshot_list));
+	ofi_uring_buf_ring_destroy(&progress->rx_uring.ring,
+				   &progress->rx_buf_ring);
+	free(progress->rx_bufs);
+	progress->rx_bufs = NULL;
+}
+
 int xnet_init_progress(struct xnet_progress *progress, struct fi_info *info)
 {
 	int ret;
@@ -1858,6 +2172,7 @@ int xnet_init_progress(struct xnet_progress *progress, struct fi_info *info)
 	dlist_init(&progress->unexp_msg_list);
 	dlist_init(&progress->unexp_tag_list);
 	dlist_init(&progress->saved_tag_list);
+	dlist_init(&progress->mshot_list);
 	slist_init(&progress->event_list);
 
 	ret = fd_signal_init(&progress->signal);
@@ -1885,6 +2200,15 @@ int xnet_init_progress(struct xnet_progress *progress, struct fi_info *info)
 	if (ret)
 		goto err4;
 
+	if (xnet_comp_batch > 1) {
+		progress->comps = calloc(xnet_comp_batch,
+					 sizeof(*progress->comps));
+		if (!progress->comps) {
+			ret = -FI_ENOMEM;
+			goto err5;
+		}
+	}
+
 	if (xnet_io_uring) {
 		progress->cqes = calloc(XNET_MAX_EVENTS, sizeof(*progress->cqes));
 		if (!progress->cqes)
@@ -1907,6 +2231,9 @@ int xnet_init_progress(struct xnet_progress *progress, struct fi_info *info)
 				      &progress->epoll_fd);
 		if (ret)
 			goto err7;
+
+		if (xnet_io_uring_mshot)
+			xnet_init_rx_bufs(progress);
 	} else {
 		progress->sockapi = xnet_sockapi_socket;
 	}
@@ -1918,6 +2245,7 @@ err6:
 	ofi_dynpoll_del(&progress->epoll_fd, progress->signal.fd[FI_READ_FD]);
 err5:
 	free(progress->cqes);
+	free(progress->comps);
 err4:
 	ofi_bufpool_destroy(progress->xfer_pool);
 err3:
@@ -1939,9 +2267,12 @@ void xnet_close_progress(struct xnet_progress *progress)
 	xnet_stop_progress(progress);
 	if (xnet_io_uring) {
 		free(progress->cqes);
+		xnet_close_rx_bufs(progress);
 		xnet_destroy_uring(&progress->rx_uring, &progress->epoll_fd);
 		xnet_destroy_uring(&progress->tx_uring, &progress->epoll_fd);
 	}
+	assert(!progress->comp_cnt);
+	free(progress->comps);
 	ofi_dynpoll_close(&progress->epoll_fd);
 	ofi_bufpool_destroy(progress->xfer_pool);
 	ofi_genlock_destroy(&progress->ep_lock);
@@ -286,7 +286,8 @@ static void udpx_ep_progress(struct util_ep *util_ep)
 	hdr.msg_flags = 0;
 
 	ofi_genlock_lock(&ep->util_ep.rx_cq->cq_lock);
-	if (ofi_cirque_isempty(ep->rxq))
+	ofi_cq_drain(ep->util_ep.rx_cq, false);
+	if (ofi_cirque_isempty(ep->rxq) || ofi_cq_isfull(ep->util_ep.rx_cq))
 		goto out;
 
 	entry = ofi_cirque_head(ep->rxq);
@@ -393,7 +394,8 @@ static ssize_t udpx_sendto(struct udpx_ep *ep, const void *buf, size_t len,
 	ssize_t ret;
 
 	ofi_genlock_lock(&ep->util_ep.tx_cq->cq_lock);
-	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
+	ofi_cq_drain(ep->util_ep.tx_cq, false);
+	if (ofi_cq_isfull(ep->util_ep.tx_cq)) {
 		ret = -FI_EAGAIN;
 		goto out;
 	}
@@ -449,7 +451,8 @@ static ssize_t udpx_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 	hdr.msg_flags = 0;
 
 	ofi_genlock_lock(&ep->util_ep.tx_cq->cq_lock);
-	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
+	ofi_cq_drain(ep->util_ep.tx_cq, false);
+	if (ofi_cq_isfull(ep->util_ep.tx_cq)) {
 		ret = -FI_EAGAIN;
 		goto out;
 	}
@@ -263,7 +263,7 @@ static int rxm_av_remove(struct fid_av *av_fid, fi_addr_t *fi_addr,
 
 		if (!ofi_atomic_dec32(&av_entry->use_cnt)) {
 			rxm_put_peer_addr(av, fi_addr[i]);
-			HASH_DELETE(hh, av->util_av.hash, av_entry);
+			ofi_av_hash_remove(&av->util_av, av_entry);
 			ofi_ibuf_free(av_entry);
 		}
 	}
@@ -272,6 +272,34 @@ static int rxm_av_remove(struct fid_av *av_fid, fi_addr_t *fi_addr,
 	return 0;
 }
 
+/* Lets the endpoints bound to the AV act on newly inserted peers. */
+static void rxm_av_notify_insert(struct rxm_av *av, const void *addr,
+				 size_t count, fi_addr_t *fi_addr)
+{
+	struct util_ep *util_ep;
+	struct dlist_entry *item;
+	fi_addr_t cur_fi_addr;
+	size_t i;
+
+	if (!av->insert_handler)
+		return;
+
+	ofi_genlock_lock(&av->util_av.ep_list_lock);
+	for (i = 0; i < count; i++) {
+		cur_fi_addr = fi_addr ? fi_addr[i] :
+			      ofi_av_lookup_fi_addr(&av->util_av,
+				(char *) addr + i * av->util_av.addrlen);
+		if (cur_fi_addr == FI_ADDR_NOTAVAIL)
+			continue;
+
+		dlist_foreach(&av->util_av.ep_list, item) {
+			util_ep = container_of(item, struct util_ep, av_entry);
+			av->insert_handler(util_ep, cur_fi_addr);
+		}
+	}
+	ofi_genlock_unlock(&av->util_av.ep_list_lock);
+}
+
 static int rxm_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 			 fi_addr_t *fi_addr, uint64_t flags, void *context)
 {
@@ -291,6 +319,7 @@ static int rxm_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 		return ret;
 	}
 
+	rxm_av_notify_insert(av, addr, count, fi_addr);
 	return (int) count;
 }
 
@@ -325,6 +354,7 @@ static int rxm_av_insertsym(struct fid_av *av_fid, const char *node,
 		return ret;
 	}
 
+	rxm_av_notify_insert(av, addr, count, fi_addr);
 	free(addr);
 	return (int) count;
 }
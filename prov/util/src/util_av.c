@@ -49,6 +49,11 @@
 #endif
 
 #include <ofi_util.h>
+#include <fasthash.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 enum {
@@ -271,15 +276,227 @@ int ofi_verify_av_insert(struct util_av *av, uint64_t flags, void *context)
 	return 0;
 }
 
+#define UTIL_AV_HASH_EMPTY	((int8_t) -128)
+#define UTIL_AV_HASH_DELETED	((int8_t) -2)
+
+/* Bit i of the result is set if control byte i of the group equals val. */
+static inline unsigned util_av_hash_match(const int8_t *ctrl, int8_t val)
+{
+#ifdef __SSE2__
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i *) ctrl),
+			_mm_set1_epi8(val)));
+#else
+	unsigned mask = 0;
+	int i;
+
+	for (i = 0; i < UTIL_AV_HASH_GROUP; i++)
+		mask |= (unsigned) (ctrl[i] == val) << i;
+	return mask;
+#endif
+}
+
+static inline uint64_t util_av_hash_key(struct util_av *av, const void *addr)
+{
+	return fasthash64(addr, av->addrlen, 0);
+}
+
+static inline int8_t util_av_hash_h2(uint64_t hash)
+{
+	return (int8_t) (hash & 0x7f);
+}
+
+static inline bool util_av_hash_equal(struct util_av *av, size_t slot,
+				      const void *addr)
+{
+	struct util_av_hash *hash = &av->hash;
+
+	if (hash->key_size)
+		return !memcmp(&hash->keys[slot * hash->key_size], addr,
+			       av->addrlen);
+
+	return !memcmp(ofi_av_get_addr(av, hash->fi_addr[slot]), addr,
+		       av->addrlen);
+}
+
+/*
+ * Groups are probed in triangular order, which visits every group of a
+ * power of two sized table.  The search ends at the first group with an
+ * empty slot, because an insert would have used that slot.
+ */
+static ssize_t util_av_hash_find(struct util_av *av, const void *addr,
+				 uint64_t key)
+{
+	struct util_av_hash *hash = &av->hash;
+	size_t group_mask, group, slot, i;
+	unsigned match;
+	int8_t *ctrl;
+
+	if (!hash->size)
+		return -1;
+
+	group_mask = hash->size / UTIL_AV_HASH_GROUP - 1;
+	group = (key >> 7) & group_mask;
+	for (i = 1; ; i++) {
+		ctrl = &hash->ctrl[group * UTIL_AV_HASH_GROUP];
+		for (match = util_av_hash_match(ctrl, util_av_hash_h2(key));
+		     match; match &= match - 1) {
+			slot = group * UTIL_AV_HASH_GROUP + ffsl(match) - 1;
+			if (util_av_hash_equal(av, slot, addr))
+				return slot;
+		}
+
+		if (util_av_hash_match(ctrl, UTIL_AV_HASH_EMPTY))
+			return -1;
+
+		group = (group + i) & group_mask;
+	}
+}
+
+static void util_av_hash_set(struct util_av *av, const void *addr,
+			     uint64_t key, fi_addr_t fi_addr)
+{
+	struct util_av_hash *hash = &av->hash;
+	size_t group_mask, group, slot, i;
+	unsigned match;
+	int8_t *ctrl;
+
+	group_mask = hash->size / UTIL_AV_HASH_GROUP - 1;
+	group = (key >> 7) & group_mask;
+	for (i = 1; ; i++) {
+		ctrl = &hash->ctrl[group * UTIL_AV_HASH_GROUP];
+		match = util_av_hash_match(ctrl, UTIL_AV_HASH_EMPTY) |
+			util_av_hash_match(ctrl, UTIL_AV_HASH_DELETED);
+		if (match)
+			break;
+		group = (group + i) & group_mask;
+	}
+
+	slot = group * UTIL_AV_HASH_GROUP + ffsl(match) - 1;
+	if (hash->ctrl[slot] == UTIL_AV_HASH_EMPTY)
+		hash->used++;
+	hash->cnt++;
+	hash->ctrl[slot] = util_av_hash_h2(key);
+	hash->fi_addr[slot] = fi_addr;
+	if (hash->key_size)
+		memcpy(&hash->keys[slot * hash->key_size], addr, av->addrlen);
+}
+
+/* Rebuild the table with room for cnt addresses, dropping tombstones. */
+static int util_av_hash_resize(struct util_av *av, size_t cnt)
+{
+	struct util_av_hash *hash = &av->hash;
+	struct util_av_hash old = *hash;
+	size_t size, slot;
+	void *addr;
+
+	size = roundup_power_of_two(MAX(cnt + cnt / 7, UTIL_AV_HASH_GROUP));
+	while (cnt >= size / 8 * 7)
+		size *= 2;
+
+	hash->ctrl = malloc(size);
+	hash->fi_addr = malloc(size * sizeof(*hash->fi_addr));
+	hash->keys = hash->key_size ? malloc(size * hash->key_size) : NULL;
+	if (!hash->ctrl || !hash->fi_addr || (hash->key_size && !hash->keys)) {
+		free(hash->ctrl);
+		free(hash->fi_addr);
+		free(hash->keys);
+		*hash = old;
+		return -FI_ENOMEM;
+	}
+
+	memset(hash->ctrl, UTIL_AV_HASH_EMPTY, size);
+	hash->size = size;
+	hash->cnt = 0;
+	hash->used = 0;
+
+	for (slot = 0; slot < old.size; slot++) {
+		if (old.ctrl[slot] < 0)
+			continue;
+
+		addr = old.key_size ? &old.keys[slot * old.key_size] :
+		       ofi_av_get_addr(av, old.fi_addr[slot]);
+		util_av_hash_set(av, addr, util_av_hash_key(av, addr),
+				 old.fi_addr[slot]);
+	}
+
+	free(old.ctrl);
+	free(old.fi_addr);
+	free(old.keys);
+	return 0;
+}
+
+/*
+ * Size the table for cnt addresses in total, so that inserting many
+ * addresses at once does not rebuild it repeatedly.
+ */
+int ofi_av_hash_reserve(struct util_av *av, size_t cnt)
+{
+	assert(ofi_mutex_held(&av->lock));
+	if (cnt < av->hash.size / 8 * 7)
+		return 0;
+
+	return util_av_hash_resize(av, cnt);
+}
+
+static int util_av_hash_insert(struct util_av *av, const void *addr,
+			       fi_addr_t fi_addr)
+{
+	struct util_av_hash *hash = &av->hash;
+	int ret;
+
+	if (hash->used + 1 >= hash->size / 8 * 7) {
+		ret = util_av_hash_resize(av, MAX(hash->cnt * 2,
+						  hash->cnt + 1));
+		if (ret)
+			return ret;
+	}
+
+	util_av_hash_set(av, addr, util_av_hash_key(av, addr), fi_addr);
+	return 0;
+}
+
+void ofi_av_hash_remove(struct util_av *av, struct util_av_entry *entry)
+{
+	struct util_av_hash *hash = &av->hash;
+	ssize_t slot;
+	int8_t *ctrl;
+
+	slot = util_av_hash_find(av, entry->data,
+				 util_av_hash_key(av, entry->data));
+	assert(slot >= 0 && hash->fi_addr[slot] == ofi_buf_index(entry));
+
+	/* Probes stop at a group with an empty slot, so the slot may be
+	 * emptied rather than marked deleted if its group has one. */
+	ctrl = &hash->ctrl[slot - slot % UTIL_AV_HASH_GROUP];
+	if (util_av_hash_match(ctrl, UTIL_AV_HASH_EMPTY)) {
+		hash->ctrl[slot] = UTIL_AV_HASH_EMPTY;
+		hash->used--;
+	} else {
+		hash->ctrl[slot] = UTIL_AV_HASH_DELETED;
+	}
+	hash->cnt--;
+}
+
+static void util_av_hash_cleanup(struct util_av *av)
+{
+	free(av->hash.ctrl);
+	free(av->hash.fi_addr);
+	free(av->hash.keys);
+	memset(&av->hash, 0, sizeof(av->hash));
+}
+
 int ofi_av_insert_addr_at(struct util_av *av, const void *addr, fi_addr_t fi_addr)
 {
 	struct util_av_entry *entry = NULL;
+	ssize_t slot;
+	int ret;
 
 	assert(ofi_mutex_held(&av->lock));
 	ofi_av_straddr_log(av, FI_LOG_INFO, "inserting addr", addr);
-	HASH_FIND(hh, av->hash, addr, av->addrlen, entry);
-	if (entry) {
-		if (fi_addr == ofi_buf_index(entry))
+	slot = util_av_hash_find(av, addr, util_av_hash_key(av, addr));
+	if (slot >= 0) {
+		if (fi_addr == av->hash.fi_addr[slot])
 			return FI_SUCCESS;
 
 		ofi_av_straddr_log(av, FI_LOG_WARN, "addr already in AV", addr);
@@ -292,7 +509,11 @@ int ofi_av_insert_addr_at(struct util_av *av, const void *addr, fi_addr_t fi_add
 
 	memcpy(entry->data, addr, av->addrlen);
 	ofi_atomic_initialize32(&entry->use_cnt, 1);
-	HASH_ADD(hh, av->hash, data, av->addrlen, entry);
+	ret = util_av_hash_insert(av, addr, fi_addr);
+	if (ret) {
+		ofi_ibuf_free(entry);
+		return ret;
+	}
 	FI_INFO(av->prov, FI_LOG_AV, "fi_addr: %" PRIu64 "\n",
 		ofi_buf_index(entry));
 	return 0;
@@ -301,11 +522,15 @@ int ofi_av_insert_addr_at(struct util_av *av, const void *addr, fi_addr_t fi_add
 int ofi_av_insert_addr(struct util_av *av, const void *addr, fi_addr_t *fi_addr)
 {
 	struct util_av_entry *entry = NULL;
+	ssize_t slot;
+	int ret;
 
 	assert(ofi_mutex_held(&av->lock));
 	ofi_av_straddr_log(av, FI_LOG_INFO, "inserting addr", addr);
-	HASH_FIND(hh, av->hash, addr, av->addrlen, entry);
-	if (entry) {
+	slot = util_av_hash_find(av, addr, util_av_hash_key(av, addr));
+	if (slot >= 0) {
+		entry = ofi_bufpool_get_ibuf(av->av_entry_pool,
+					     av->hash.fi_addr[slot]);
 		if (fi_addr)
 			*fi_addr = ofi_buf_index(entry);
 		if (ofi_atomic_inc32(&entry->use_cnt) > 1) {
@@ -319,11 +544,17 @@ int ofi_av_insert_addr(struct util_av *av, const void *addr, fi_addr_t *fi_addr)
 			return -FI_ENOMEM;
 		}
 
-		if (fi_addr)
-			*fi_addr = ofi_buf_index(entry);
 		memcpy(entry->data, addr, av->addrlen);
 		ofi_atomic_initialize32(&entry->use_cnt, 1);
-		HASH_ADD(hh, av->hash, data, av->addrlen, entry);
+		ret = util_av_hash_insert(av, addr, ofi_buf_index(entry));
+		if (ret) {
+			ofi_ibuf_free(entry);
+			if (fi_addr)
+				*fi_addr = FI_ADDR_NOTAVAIL;
+			return ret;
+		}
+		if (fi_addr)
+			*fi_addr = ofi_buf_index(entry);
 		FI_INFO(av->prov, FI_LOG_AV, "fi_addr: %" PRIu64 "\n",
 			ofi_buf_index(entry));
 	}
@@ -342,7 +573,7 @@ int ofi_av_remove_addr(struct util_av *av, fi_addr_t fi_addr)
 	if (ofi_atomic_dec32(&av_entry->use_cnt))
 		return FI_SUCCESS;
 
-	HASH_DELETE(hh, av->hash, av_entry);
+	ofi_av_hash_remove(av, av_entry);
 	FI_DBG(av->prov, FI_LOG_AV, "av_remove fi_addr: %" PRIu64 "\n", fi_addr);
 	ofi_ibuf_free(av_entry);
 	return 0;
@@ -350,10 +581,10 @@ int ofi_av_remove_addr(struct util_av *av, fi_addr_t fi_addr)
 
 fi_addr_t ofi_av_lookup_fi_addr_unsafe(struct util_av *av, const void *addr)
 {
-	struct util_av_entry *entry = NULL;
+	ssize_t slot;
 
-	HASH_FIND(hh, av->hash, addr, av->addrlen, entry);
-	return entry ? ofi_buf_index(entry) : FI_ADDR_NOTAVAIL;
+	slot = util_av_hash_find(av, addr, util_av_hash_key(av, addr));
+	return slot >= 0 ? av->hash.fi_addr[slot] : FI_ADDR_NOTAVAIL;
 }
 
 fi_addr_t ofi_av_lookup_fi_addr(struct util_av *av, const void *addr)
@@ -374,7 +605,7 @@ ofi_av_lookup_addr(struct util_av *av, fi_addr_t fi_addr, size_t *addrlen)
 
 static void util_av_close(struct util_av *av)
 {
-	HASH_CLEAR(hh, av->hash);
+	util_av_hash_cleanup(av);
 	ofi_bufpool_destroy(av->av_entry_pool);
 }
 
@@ -470,7 +701,9 @@ static int util_av_init(struct util_av *av, const struct fi_av_attr *attr,
 	av->addrlen = util_attr->addrlen;
 	av->context_offset = offset + av->addrlen;
 	av->flags = util_attr->flags | attr->flags;
-	av->hash = NULL;
+	memset(&av->hash, 0, sizeof(av->hash));
+	if (util_attr->addrlen <= UTIL_AV_HASH_KEY_MAX)
+		av->hash.key_size = util_attr->addrlen;
 
 	pool_attr.chunk_cnt = orig_size;
 	return ofi_bufpool_create_attr(&pool_attr, &av->av_entry_pool);
@@ -621,6 +854,12 @@ int ofi_ip_av_insertv(struct util_av *av, const void *addr, size_t addrlen,
 	assert(av->addrlen == addrlen);
 
 	FI_DBG(av->prov, FI_LOG_AV, "inserting %zu addresses\n", count);
+	ofi_mutex_lock(&av->lock);
+	ret = ofi_av_hash_reserve(av, av->hash.cnt + count);
+	ofi_mutex_unlock(&av->lock);
+	if (ret)
+		return ret;
+
 	if (flags & FI_SYNC_ERR) {
 		sync_err = context;
 		memset(sync_err, 0, sizeof(*sync_err) * count);
@@ -38,6 +38,7 @@
 #include <ofi_mem.h>
 #include <ofi.h>
 #include <ofi_osd.h>
+#include <ofi_util.h>
 
 #ifdef HAVE_FABRIC_PROFILE
 #include <ofi_profile.h>
@@ -54,11 +55,36 @@ ofi_bufpool_track_mem(size_t size)
 };
 #endif
 
+extern struct ofi_common_locks common_locks;
+
 enum {
-	OFI_BUFPOOL_REGION_CHUNK_CNT = 16
+	OFI_BUFPOOL_REGION_CHUNK_CNT = 16,
+	OFI_BUFPOOL_MAGAZINE_SIZE = 32,
 };
 
 
+static void ofi_bufpool_region_bind(struct ofi_bufpool_region *buf_region)
+{
+	struct ofi_bufpool *pool = buf_region->pool;
+	int ret;
+
+	if (!(pool->attr.flags & OFI_BUFPOOL_NUMA))
+		return;
+
+	buf_region->numa_node = pool->attr.numa_node >= 0 ?
+				pool->attr.numa_node : ofi_numa_node();
+	if (buf_region->numa_node < 0)
+		return;
+
+	ret = ofi_numa_bind(buf_region->alloc_region, pool->alloc_size,
+			    buf_region->numa_node);
+	if (ret) {
+		FI_DBG(&core_prov, FI_LOG_CORE,
+		       "unable to bind region to node %d: %s\n",
+		       buf_region->numa_node, fi_strerror(-ret));
+	}
+}
+
 static int ofi_bufpool_region_alloc(struct ofi_bufpool_region *buf_region)
 {
 	int ret;
@@ -76,6 +102,7 @@ static int ofi_bufpool_region_alloc(struct ofi_bufpool_region *buf_region)
 				buf_region->flags = OFI_BUFPOOL_HUGEPAGES | OFI_BUFPOOL_NONSHARED;
 				pool->alloc_size = alloc_size;
 				pool->region_size = pool->alloc_size - pool->entry_size;
+				ofi_bufpool_region_bind(buf_region);
 				return 0;
 			}
 		}
@@ -97,6 +124,7 @@ static int ofi_bufpool_region_alloc(struct ofi_bufpool_region *buf_region)
 		if (!ret) {
 			buf_region->flags = OFI_BUFPOOL_NONSHARED;
 			pool->region_size = pool->alloc_size - pool->entry_size;
+			ofi_bufpool_region_bind(buf_region);
 			return 0;
 		} else if (ret != -FI_ENOSYS) {
 			return ret;
@@ -131,6 +159,19 @@ static void ofi_bufpool_region_free(struct ofi_bufpool_region *buf_region)
 	}
 }
 
+/*
+ * Free list of a non-indexed pool that holds the buffers of the given
+ * node.  Only magazine pools created with OFI_BUFPOOL_NUMA_LOCAL keep
+ * per-node lists.
+ */
+static struct slist *ofi_bufpool_free_list(struct ofi_bufpool *pool, int node)
+{
+	if (!pool->node_list)
+		return &pool->free_list.entries;
+
+	return &pool->node_list[node < 0 ? 0 : node % OFI_BUFPOOL_MAX_NODES];
+}
+
 int ofi_bufpool_grow(struct ofi_bufpool *pool)
 {
 	struct ofi_bufpool_region *buf_region;
@@ -155,6 +196,7 @@ int ofi_bufpool_grow(struct ofi_bufpool *pool)
 		return -FI_ENOMEM;
 
 	buf_region->pool = pool;
+	buf_region->numa_node = -1;
 	OFI_DBG_CALL(ofi_atomic_initialize32(&buf_region->use_cnt, 0));
 	dlist_init(&buf_region->free_list);
 
@@ -215,7 +257,8 @@ int ofi_bufpool_grow(struct ofi_bufpool *pool)
 					  &buf_region->free_list);
 		} else {
 			slist_insert_tail(&buf_hdr->entry.slist,
-					  &pool->free_list.entries);
+					  ofi_bufpool_free_list(pool,
+						buf_region->numa_node));
 		}
 	}
 
@@ -237,6 +280,294 @@ err1:
 	return ret;
 }
 
+static struct slist *ofi_bufpool_any_list(struct ofi_bufpool *pool)
+{
+	int node;
+
+	for (node = 0; node < OFI_BUFPOOL_MAX_NODES; node++) {
+		if (!slist_empty(&pool->node_list[node]))
+			return &pool->node_list[node];
+	}
+	return NULL;
+}
+
+/* Caller must hold the pool's magazine lock. */
+static void ofi_bufpool_mag_drain(struct ofi_bufpool_mag *mag, size_t keep)
+{
+	struct ofi_bufpool_hdr *buf_hdr;
+
+	while (mag->cnt > keep) {
+		slist_remove_head_container(&mag->bufs, struct ofi_bufpool_hdr,
+					    buf_hdr, entry.slist);
+		slist_insert_head(&buf_hdr->entry.slist,
+				  ofi_bufpool_free_list(mag->pool,
+						buf_hdr->region->numa_node));
+		mag->cnt--;
+	}
+}
+
+/*
+ * Magazine pools share one key, created with the first pool and deleted
+ * with the last, so that no destructor outlives the code it points to.
+ * ofi_bufpool_mag_ids tracks the mag_id values in use.  Both are guarded
+ * by bufpool_mag_lock, as are the arrays of all threads, on
+ * ofi_bufpool_mag_threads.
+ *
+ * Deleting the key does not wait for destructors that are already
+ * running, and it leaves the arrays of running threads unreachable.
+ * Those arrays are therefore kept on ofi_bufpool_mag_spare and reused
+ * rather than freed.  A destructor only acts on an array that is still
+ * active and owned by the calling thread.
+ */
+pthread_key_t ofi_bufpool_mag_key;
+static size_t ofi_bufpool_mag_pools;
+static bool *ofi_bufpool_mag_ids;
+static size_t ofi_bufpool_mag_id_cnt;
+static DEFINE_LIST(ofi_bufpool_mag_threads);
+static DEFINE_LIST(ofi_bufpool_mag_spare);
+
+/* Runs on thread exit */
+static void ofi_bufpool_mags_free(void *arg)
+{
+	struct ofi_bufpool_mags *mags = arg;
+	struct ofi_bufpool_mag *mag;
+	size_t i;
+
+	pthread_mutex_lock(&common_locks.bufpool_mag_lock);
+	if (!mags->active || !pthread_equal(mags->owner, pthread_self())) {
+		pthread_mutex_unlock(&common_locks.bufpool_mag_lock);
+		return;
+	}
+
+	for (i = 0; i < mags->cnt; i++) {
+		mag = mags->mag[i];
+		if (!mag)
+			continue;
+
+		pthread_mutex_lock(&mag->pool->mag_lock);
+		ofi_bufpool_mag_drain(mag, 0);
+		dlist_remove(&mag->entry);
+		pthread_mutex_unlock(&mag->pool->mag_lock);
+		free(mag);
+	}
+	dlist_remove(&mags->entry);
+	pthread_mutex_unlock(&common_locks.bufpool_mag_lock);
+
+	free(mags->mag);
+	free(mags);
+}
+
+/* Caller must hold bufpool_mag_lock. */
+static struct ofi_bufpool_mags *ofi_bufpool_mags_open(void)
+{
+	struct ofi_bufpool_mags *mags;
+
+	mags = pthread_getspecific(ofi_bufpool_mag_key);
+	if (mags)
+		return mags;
+
+	if (!dlist_empty(&ofi_bufpool_mag_spare)) {
+		dlist_pop_front(&ofi_bufpool_mag_spare, struct ofi_bufpool_mags,
+				mags, entry);
+	} else {
+		mags = calloc(1, sizeof(*mags));
+		if (!mags)
+			return NULL;
+	}
+
+	if (pthread_setspecific(ofi_bufpool_mag_key, mags)) {
+		dlist_insert_tail(&mags->entry, &ofi_bufpool_mag_spare);
+		return NULL;
+	}
+
+	mags->owner = pthread_self();
+	mags->active = true;
+	dlist_insert_tail(&mags->entry, &ofi_bufpool_mag_threads);
+	return mags;
+}
+
+static struct ofi_bufpool_mag *ofi_bufpool_mag_open(struct ofi_bufpool *pool)
+{
+	struct ofi_bufpool_mags *mags;
+	struct ofi_bufpool_mag *mag, **array;
+	size_t cnt;
+
+	mag = ofi_bufpool_mag(pool);
+	if (mag)
+		return mag;
+
+	pthread_mutex_lock(&common_locks.bufpool_mag_lock);
+	mags = ofi_bufpool_mags_open();
+	if (!mags)
+		goto err;
+
+	if (pool->mag_id >= mags->cnt) {
+		cnt = MAX(ofi_bufpool_mag_id_cnt, pool->mag_id + 1);
+		array = realloc(mags->mag, cnt * sizeof(*array));
+		if (!array)
+			goto err;
+		memset(array + mags->cnt, 0,
+		       (cnt - mags->cnt) * sizeof(*array));
+		mags->mag = array;
+		mags->cnt = cnt;
+	}
+
+	mag = calloc(1, sizeof(*mag));
+	if (!mag)
+		goto err;
+
+	slist_init(&mag->bufs);
+	mag->pool = pool;
+	mag->mags = mags;
+	mags->mag[pool->mag_id] = mag;
+
+	pthread_mutex_lock(&pool->mag_lock);
+	dlist_insert_tail(&mag->entry, &pool->mag_list);
+	pthread_mutex_unlock(&pool->mag_lock);
+	pthread_mutex_unlock(&common_locks.bufpool_mag_lock);
+	return mag;
+
+err:
+	pthread_mutex_unlock(&common_locks.bufpool_mag_lock);
+	return NULL;
+}
+
+/* Reserves the key and a mag_id for a new magazine pool. */
+static int ofi_bufpool_mag_init(struct ofi_bufpool *pool)
+{
+	bool *ids;
+	size_t id;
+	int ret = 0;
+
+	pthread_mutex_lock(&common_locks.bufpool_mag_lock);
+	if (!ofi_bufpool_mag_pools &&
+	    pthread_key_create(&ofi_bufpool_mag_key, ofi_bufpool_mags_free)) {
+		ret = -FI_ENOMEM;
+		goto out;
+	}
+
+	for (id = 0; id < ofi_bufpool_mag_id_cnt; id++) {
+		if (!ofi_bufpool_mag_ids[id])
+			break;
+	}
+
+	if (id == ofi_bufpool_mag_id_cnt) {
+		ids = realloc(ofi_bufpool_mag_ids, (id + 1) * sizeof(*ids));
+		if (!ids) {
+			if (!ofi_bufpool_mag_pools)
+				pthread_key_delete(ofi_bufpool_mag_key);
+			ret = -FI_ENOMEM;
+			goto out;
+		}
+		ofi_bufpool_mag_ids = ids;
+		ofi_bufpool_mag_id_cnt++;
+	}
+
+	ofi_bufpool_mag_ids[id] = true;
+	pool->mag_id = id;
+	ofi_bufpool_mag_pools++;
+out:
+	pthread_mutex_unlock(&common_locks.bufpool_mag_lock);
+	return ret;
+}
+
+/*
+ * Frees the magazines of all threads, and deletes the key along with the
+ * last pool.  Magazines of threads that are still running are unlinked
+ * from their arrays, which is safe as the lock is held.
+ */
+static void ofi_bufpool_mag_fini(struct ofi_bufpool *pool)
+{
+	struct ofi_bufpool_mags *mags;
+	struct ofi_bufpool_mag *mag;
+
+	pthread_mutex_lock(&common_locks.bufpool_mag_lock);
+	pthread_mutex_lock(&pool->mag_lock);
+	while (!dlist_empty(&pool->mag_list)) {
+		dlist_pop_front(&pool->mag_list, struct ofi_bufpool_mag,
+				mag, entry);
+		mag->mags->mag[pool->mag_id] = NULL;
+		free(mag);
+	}
+	pthread_mutex_unlock(&pool->mag_lock);
+
+	ofi_bufpool_mag_ids[pool->mag_id] = false;
+	if (!--ofi_bufpool_mag_pools) {
+		pthread_key_delete(ofi_bufpool_mag_key);
+		while (!dlist_empty(&ofi_bufpool_mag_threads)) {
+			dlist_pop_front(&ofi_bufpool_mag_threads,
+					struct ofi_bufpool_mags, mags, entry);
+			mags->active = false;
+			dlist_insert_tail(&mags->entry, &ofi_bufpool_mag_spare);
+		}
+	}
+	pthread_mutex_unlock(&common_locks.bufpool_mag_lock);
+	pthread_mutex_destroy(&pool->mag_lock);
+}
+
+/*
+ * Slow paths of ofi_buf_alloc and ofi_buf_free for magazine pools.  The
+ * calling thread's magazine is created on first use, then refilled to
+ * half its size when empty, or flushed down to half when full, so that
+ * a thread alternating between allocating and freeing around either
+ * boundary does not return here on every call.
+ */
+struct ofi_bufpool_mag *ofi_bufpool_mag_fill(struct ofi_bufpool *pool)
+{
+	struct ofi_bufpool_mag *mag;
+	struct slist_entry *entry;
+	struct slist *list;
+	size_t half;
+
+	mag = ofi_bufpool_mag_open(pool);
+	if (!mag)
+		return NULL;
+
+	half = MAX(pool->attr.magazine_size / 2, 1);
+	pthread_mutex_lock(&pool->mag_lock);
+	list = ofi_bufpool_free_list(pool, pool->node_list ?
+				     ofi_numa_node() : 0);
+	while (mag->cnt < half) {
+		if (slist_empty(list)) {
+			if (!ofi_bufpool_grow(pool)) {
+				/* We may have moved to another node. */
+				list = ofi_bufpool_free_list(pool,
+					pool->region_table[pool->region_cnt - 1]->numa_node);
+			} else if (!pool->node_list ||
+				   !(list = ofi_bufpool_any_list(pool))) {
+				break;
+			}
+		}
+
+		entry = slist_remove_head(list);
+		slist_insert_head(entry, &mag->bufs);
+		mag->cnt++;
+	}
+	pthread_mutex_unlock(&pool->mag_lock);
+
+	return mag->cnt ? mag : NULL;
+}
+
+void ofi_bufpool_mag_put(struct ofi_bufpool *pool, void *buf)
+{
+	struct ofi_bufpool_hdr *buf_hdr = ofi_buf_hdr(buf);
+	struct ofi_bufpool_mag *mag;
+
+	mag = ofi_bufpool_mag_open(pool);
+
+	pthread_mutex_lock(&pool->mag_lock);
+	if (mag) {
+		ofi_bufpool_mag_drain(mag, pool->attr.magazine_size / 2);
+		slist_insert_head(&buf_hdr->entry.slist, &mag->bufs);
+		mag->cnt++;
+	} else {
+		slist_insert_head(&buf_hdr->entry.slist,
+				  ofi_bufpool_free_list(pool,
+						buf_hdr->region->numa_node));
+	}
+	pthread_mutex_unlock(&pool->mag_lock);
+}
+
 int ofi_bufpool_create_attr(struct ofi_bufpool_attr *attr,
 			      struct ofi_bufpool **buf_pool)
 {
@@ -265,6 +596,36 @@ int ofi_bufpool_create_attr(struct ofi_bufpool_attr *attr,
 	else
 		slist_init(&pool->free_list.entries);
 
+	if (pool->attr.flags & OFI_BUFPOOL_MAGAZINE) {
+		if (pool->attr.flags & OFI_BUFPOOL_INDEXED) {
+			free(pool);
+			return -FI_EINVAL;
+		}
+
+		if (!attr->magazine_size)
+			pool->attr.magazine_size = OFI_BUFPOOL_MAGAZINE_SIZE;
+		if (ofi_bufpool_mag_init(pool)) {
+			free(pool);
+			return -FI_ENOMEM;
+		}
+		pthread_mutex_init(&pool->mag_lock, NULL);
+		dlist_init(&pool->mag_list);
+	}
+
+	/* Binding requires page aligned regions, as allocated by mmap. */
+	if (pool->attr.flags & OFI_BUFPOOL_NUMA) {
+		pool->attr.flags |= OFI_BUFPOOL_NONSHARED;
+		if ((pool->attr.flags & OFI_BUFPOOL_MAGAZINE) &&
+		    pool->attr.numa_node == OFI_BUFPOOL_NUMA_LOCAL) {
+			pool->node_list = calloc(OFI_BUFPOOL_MAX_NODES,
+						 sizeof(*pool->node_list));
+			if (!pool->node_list) {
+				ofi_bufpool_destroy(pool);
+				return -FI_ENOMEM;
+			}
+		}
+	}
+
 	pool->alloc_size = (pool->attr.chunk_cnt + 1) * pool->entry_size;
 	pool->region_size = pool->alloc_size - pool->entry_size;
 
@@ -283,6 +644,10 @@ void ofi_bufpool_destroy(struct ofi_bufpool *pool)
 	struct ofi_bufpool_region *buf_region;
 	size_t i;
 
+	if (pool->attr.flags & OFI_BUFPOOL_MAGAZINE)
+		ofi_bufpool_mag_fini(pool);
+	free(pool->node_list);
+
 	for (i = 0; i < pool->region_cnt; i++) {
 		buf_region = pool->region_table[i];
 
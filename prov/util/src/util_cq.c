@@ -30,6 +30,7 @@
  * SOFTWARE.
  */
 
+#include <sched.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -81,6 +82,51 @@ int ofi_cq_write_overflow(struct util_cq *cq, void *context, uint64_t flags,
 	return 0;
 }
 
+/* A writer fills its slot right after claiming it, so a slot stays
+ * unfilled only if that writer was preempted.  Give up waiting on it
+ * after this many yields rather than spinning with cq_lock held.
+ */
+#define UTIL_CQ_MPSC_WAIT	64
+
+void ofi_cq_drain_mpsc(struct util_cq *cq, bool wait)
+{
+	struct util_cq_mpsc_comp *entry;
+	int64_t pos, end;
+	int yields = 0;
+
+	assert(ofi_genlock_held(&cq->cq_lock));
+	end = ofi_atomic_load_explicit64(&cq->mpsc->write_pos,
+					 memory_order_acquire);
+	while (ofi_atomic_load_explicit64(&cq->mpsc->read_pos,
+					  memory_order_relaxed) < end) {
+		if (util_cq_mpsc_head(cq->mpsc, &entry, &pos)) {
+			if (!wait || ++yields > UTIL_CQ_MPSC_WAIT)
+				break;
+			sched_yield();
+			continue;
+		}
+		yields = 0;
+
+		if (ofi_cirque_freecnt(cq->cirq) <= 1) {
+			(void) ofi_cq_write_overflow(cq, entry->comp.op_context,
+					entry->comp.flags, entry->comp.len,
+					entry->comp.buf, entry->comp.data,
+					entry->comp.tag, entry->src);
+		} else if (cq->src) {
+			ofi_cq_write_src_entry(cq, entry->comp.op_context,
+					entry->comp.flags, entry->comp.len,
+					entry->comp.buf, entry->comp.data,
+					entry->comp.tag, entry->src);
+		} else {
+			ofi_cq_write_entry(cq, entry->comp.op_context,
+					entry->comp.flags, entry->comp.len,
+					entry->comp.buf, entry->comp.data,
+					entry->comp.tag);
+		}
+		util_cq_mpsc_release(cq->mpsc, entry, pos);
+	}
+}
+
 static int util_cq_insert_error(struct util_cq *cq,
 				const struct fi_cq_err_entry *err_entry)
 {
@@ -89,6 +135,7 @@ static int util_cq_insert_error(struct util_cq *cq,
 
 	assert(ofi_genlock_held(&cq->cq_lock));
 	assert(err_entry->err);
+	ofi_cq_drain(cq, true);
 	entry = calloc(1, sizeof(*entry));
 	if (!entry)
 		return -FI_ENOMEM;
@@ -290,6 +337,7 @@ ssize_t ofi_cq_readerr(struct fid_cq *cq_fid, struct fi_cq_err_entry *buf,
 	api_version = cq->domain->fabric->fabric_fid.api_version;
 
 	ofi_genlock_lock(&cq->cq_lock);
+	ofi_cq_drain(cq, false);
 
 	if (cq->err_data) {
 		free(cq->err_data);
@@ -425,6 +473,8 @@ static void util_peer_cq_cleanup(struct util_cq *cq)
 
 	util_comp_cirq_free(cq->cirq);
 	free(cq->src);
+	if (cq->mpsc)
+		util_cq_mpsc_free(cq->mpsc);
 	fi_close(&cq->peer_cq->fid);
 }
 
@@ -536,18 +586,7 @@ static ssize_t util_peer_cq_write(struct fid_peer_cq *cq, void *context,
 	struct util_cq *util_cq = cq->fid.context;
 	int ret;
 
-	util_cq = cq->fid.context;
-
-	ofi_genlock_lock(&util_cq->cq_lock);
-	if (ofi_cirque_freecnt(util_cq->cirq) > 1) {
-		ofi_cq_write_entry(util_cq, context, flags, len, buf, data,
-				     tag);
-		ret = 0;
-	} else {
-		ret = ofi_cq_write_overflow(util_cq, context, flags, len, buf,
-					      data, tag, FI_ADDR_NOTAVAIL);
-	}
-	ofi_genlock_unlock(&util_cq->cq_lock);
+	ret = ofi_cq_write(util_cq, context, flags, len, buf, data, tag);
 
 	if (util_cq->wait)
 		util_cq->wait->signal(util_cq->wait);
@@ -562,16 +601,8 @@ static ssize_t util_peer_cq_write_src(struct fid_peer_cq *cq, void *context,
 	struct util_cq *util_cq = cq->fid.context;
 	int ret;
 
-	ofi_genlock_lock(&util_cq->cq_lock);
-	if (ofi_cirque_freecnt(util_cq->cirq) > 1) {
-		ofi_cq_write_src_entry(util_cq, context, flags, len, buf, data,
-				       tag, src);
-		ret = 0;
-	} else {
-		ret = ofi_cq_write_overflow(util_cq, context, flags, len, buf,
-					      data, tag, src);
-	}
-	ofi_genlock_unlock(&util_cq->cq_lock);
+	ret = ofi_cq_write_src(util_cq, context, flags, len, buf, data, tag,
+			       src);
 
 	if (util_cq->wait)
 		util_cq->wait->signal(util_cq->wait);
@@ -721,6 +752,7 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 	cq->cq_fid.ops = &util_cq_ops;
 	cq->progress = progress;
 	cq->err_data = NULL;
+	cq->mpsc = NULL;
 
 	cq->domain = container_of(domain, struct util_domain, domain_fid);
 	ofi_atomic_initialize32(&cq->ref, 0);
@@ -754,6 +786,16 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 		ret = util_init_peer_cq(cq, attr);
 		if (ret)
 			goto destroy2;
+
+		/* Writers only need the lock-free queue if they can race. */
+		if (ofi_cq_mpsc_size && (cq_lock_type == OFI_LOCK_MUTEX ||
+					 cq_lock_type == OFI_LOCK_SPINLOCK)) {
+			cq->mpsc = util_cq_mpsc_create(ofi_cq_mpsc_size);
+			if (!cq->mpsc) {
+				ret = -FI_ENOMEM;
+				goto cleanup;
+			}
+		}
 	}
 
 	switch (attr->wait_obj) {
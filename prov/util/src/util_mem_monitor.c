@@ -275,6 +275,29 @@ void ofi_monitors_init(void)
 			" reduce the number of registered regions, regardless"
 			" of their size, stored in the cache.  Setting this"
 			" to zero will disable MR caching.  (default: 1024)");
+	fi_param_define(NULL, "mr_cache_shards", FI_PARAM_SIZE_T,
+			"Number of shards the MR cache is split into.  Regions"
+			" are assigned to shards by address, and cache hits"
+			" in different shards do not contend on a lock."
+			" Setting this to zero uses a single, globally locked"
+			" cache.  (default: 0, max: 32)");
+	fi_param_define(NULL, "mr_cache_align", FI_PARAM_SIZE_T,
+			"Round host memory registrations made through the MR"
+			" cache out to this alignment, a power of two, so that"
+			" one registration covers neighbouring buffers."
+			" Registrations that fail once rounded are retried"
+			" unrounded.  (default: 0, disabled)");
+	fi_param_define(NULL, "mr_cache_merge", FI_PARAM_BOOL,
+			"Merge new host memory registrations with the cached"
+			" regions they overlap or adjoin into a single"
+			" registration.  (default: false)");
+	fi_param_define(NULL, "mr_cache_reap_backlog", FI_PARAM_SIZE_T,
+			"Maximum number of regions removed from the MR cache"
+			" that may be waiting for a background thread to"
+			" deregister them.  Regions beyond the backlog are"
+			" deregistered by the thread that removed them."
+			" Setting this to zero deregisters all regions inline."
+			" (default: 0)");
 	fi_param_define(NULL, "mr_cache_monitor", FI_PARAM_STRING,
 			"Define a default memory registration monitor."
 			" The monitor checks for virtual to physical memory"
@@ -302,6 +325,11 @@ void ofi_monitors_init(void)
 
 	fi_param_get_size_t(NULL, "mr_cache_max_size", &cache_params.max_size);
 	fi_param_get_size_t(NULL, "mr_cache_max_count", &cache_params.max_cnt);
+	fi_param_get_size_t(NULL, "mr_cache_shards", &cache_params.shard_cnt);
+	fi_param_get_size_t(NULL, "mr_cache_align", &cache_params.align);
+	fi_param_get_bool(NULL, "mr_cache_merge", &cache_params.merge);
+	fi_param_get_size_t(NULL, "mr_cache_reap_backlog",
+			    &cache_params.reap_max);
 	fi_param_get_str(NULL, "mr_cache_monitor", &cache_params.monitor);
 	fi_param_get_bool(NULL, "mr_cuda_cache_monitor_enabled",
 			  &cache_params.cuda_monitor_enabled);
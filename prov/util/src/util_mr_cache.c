@@ -87,10 +87,14 @@ static int util_mr_find_overlap(struct ofi_rbmap *map, void *key, void *data)
 	return 0;
 }
 
+/* A sharded cache allocates entries from per-thread magazines. */
 static struct ofi_mr_entry *util_mr_entry_alloc(struct ofi_mr_cache *cache)
 {
 	struct ofi_mr_entry *entry;
 
+	if (cache->shards)
+		return ofi_buf_alloc(cache->entry_pool);
+
 	pthread_mutex_lock(&cache->lock);
 	entry = ofi_buf_alloc(cache->entry_pool);
 	pthread_mutex_unlock(&cache->lock);
@@ -100,6 +104,11 @@ static struct ofi_mr_entry *util_mr_entry_alloc(struct ofi_mr_cache *cache)
 static void util_mr_entry_free(struct ofi_mr_cache *cache,
 			       struct ofi_mr_entry *entry)
 {
+	if (cache->shards) {
+		ofi_buf_free(entry);
+		return;
+	}
+
 	pthread_mutex_lock(&cache->lock);
 	ofi_buf_free(entry);
 	pthread_mutex_unlock(&cache->lock);
@@ -164,6 +173,18 @@ static struct ofi_mr_entry *ofi_mr_rbt_find(struct ofi_rbmap *tree,
 	return node->data;
 }
 
+/* Returns true if a cached region matching info extends beyond it.
+ * Regions within info are replaced when info is cached instead.
+ */
+static bool util_mr_covered(struct ofi_rbmap *tree,
+			     const struct ofi_mr_info *info)
+{
+	struct ofi_mr_entry *entry;
+
+	entry = ofi_mr_rbt_find(tree, info);
+	return entry && !ofi_iov_within(&entry->info.iov, &info->iov);
+}
+
 static struct ofi_mr_entry *ofi_mr_rbt_overlap(struct ofi_rbmap *tree,
 					       const struct iovec *key)
 {
@@ -180,6 +201,676 @@ static struct ofi_mr_entry *ofi_mr_rbt_overlap(struct ofi_rbmap *tree,
 	return node->data;
 }
 
+/* Finds a region holding the byte just before or just after info */
+static struct ofi_mr_entry *ofi_mr_rbt_neighbor(struct ofi_rbmap *tree,
+						const struct ofi_mr_info *key)
+{
+	struct ofi_rbnode *node;
+
+	node = ofi_rbmap_search(tree, (void *) key, util_mr_find_overlap);
+	if (!node)
+		return NULL;
+
+	return node->data;
+}
+
+/* Sets key to the byte before (left) or after info, if there is one */
+static bool util_mr_neighbor_key(const struct ofi_mr_info *info, bool left,
+				 struct ofi_mr_info *key)
+{
+	memset(key, 0, sizeof(*key));
+	key->peer_id = info->peer_id;
+	key->iov.iov_len = 1;
+
+	if (left) {
+		if (!info->iov.iov_base)
+			return false;
+		key->iov.iov_base = (char *) info->iov.iov_base - 1;
+	} else {
+		if ((uintptr_t) ofi_iov_end(&info->iov) == UINTPTR_MAX)
+			return false;
+		key->iov.iov_base = (char *) ofi_iov_end(&info->iov) + 1;
+	}
+	return true;
+}
+
+/* Returns true if info was rounded out to the cache alignment */
+static bool util_mr_round(struct ofi_mr_cache *cache, struct ofi_mr_info *info)
+{
+	char *start, *end;
+
+	if (!cache->align || info->iface != FI_HMEM_SYSTEM ||
+	    !info->iov.iov_len)
+		return false;
+
+	start = ofi_get_page_start(info->iov.iov_base, cache->align);
+	end = ofi_get_page_end(ofi_iov_end(&info->iov), cache->align);
+	if (start == info->iov.iov_base && end == ofi_iov_end(&info->iov))
+		return false;
+
+	info->iov.iov_base = start;
+	info->iov.iov_len = end - start + 1;
+	return true;
+}
+
+static void util_mr_merge_info(struct ofi_mr_info *info,
+			       const struct ofi_mr_entry *entry)
+{
+	char *start, *end;
+
+	start = MIN((char *) info->iov.iov_base,
+		    (char *) entry->info.iov.iov_base);
+	end = MAX((char *) ofi_iov_end(&info->iov),
+		  (char *) ofi_iov_end(&entry->info.iov));
+	info->iov.iov_base = start;
+	info->iov.iov_len = end - start + 1;
+}
+
+/* A merged registration never grows past a shard window, nor past what
+ * the cache may hold.
+ */
+static size_t util_mr_merge_max(struct ofi_mr_cache *cache)
+{
+	return MIN((size_t) 1 << OFI_MR_CACHE_WINDOW_SHIFT,
+		   cache->cached_max_size);
+}
+
+/* Extends info over entry, unless entry is in use, holds a different
+ * kind of memory, or the result would exceed the merge limit.  Entries
+ * are not removed here; creating the merged region replaces them.
+ */
+static bool util_mr_merge_entry(struct ofi_mr_cache *cache,
+				struct ofi_mr_info *info,
+				const struct ofi_mr_entry *entry)
+{
+	struct ofi_mr_info merged = *info;
+
+	if (!entry || entry->use_cnt || entry->info.iface != info->iface)
+		return false;
+
+	util_mr_merge_info(&merged, entry);
+	if (merged.iov.iov_len > util_mr_merge_max(cache))
+		return false;
+
+	*info = merged;
+	return true;
+}
+
+/* Caller must hold mm_lock.  Returns true if info was extended. */
+static bool util_mr_merge(struct ofi_mr_cache *cache, struct ofi_mr_info *info)
+{
+	struct ofi_mr_info key;
+	bool merged = false, progress;
+
+	if (!info->iov.iov_len)
+		return false;
+
+	do {
+		progress = util_mr_neighbor_key(info, true, &key) &&
+			   util_mr_merge_entry(cache, info,
+				ofi_mr_rbt_neighbor(&cache->tree, &key));
+		progress |= util_mr_neighbor_key(info, false, &key) &&
+			    util_mr_merge_entry(cache, info,
+				ofi_mr_rbt_neighbor(&cache->tree, &key));
+		merged |= progress;
+	} while (progress);
+
+	return merged;
+}
+
+static void util_mr_cache_reap(struct ofi_mr_cache *cache, bool flush_lru);
+
+/*
+ * Sharded cache.  Lock order is mm_lock, then shard locks in ascending
+ * order, then the count lock.  The cache lock is held while allocating
+ * entries, which may enter the memory monitor, so it must not be taken
+ * with any of the former held.  Regions are never freed with a lock held.
+ */
+static uint64_t util_mr_shard_hash(struct ofi_mr_cache *cache,
+				   uint64_t peer_id, uint64_t window)
+{
+	uint64_t key = (window ^ peer_id) * 0x9e3779b97f4a7c15ULL;
+
+	return (key >> 32) % cache->shard_cnt;
+}
+
+static void util_mr_shard_windows(const struct iovec *iov,
+				  uint64_t *first, uint64_t *last)
+{
+	*first = (uintptr_t) iov->iov_base >> OFI_MR_CACHE_WINDOW_SHIFT;
+	*last = iov->iov_len ?
+		(uintptr_t) ofi_iov_end(iov) >> OFI_MR_CACHE_WINDOW_SHIFT :
+		*first;
+}
+
+/* Shard that stores a region with the given info */
+static struct ofi_mr_cache_shard *
+util_mr_shard_home(struct ofi_mr_cache *cache, const struct ofi_mr_info *info)
+{
+	uint64_t first, last;
+
+	util_mr_shard_windows(&info->iov, &first, &last);
+	if (first != last)
+		return &cache->shards[cache->shard_cnt];
+
+	return &cache->shards[util_mr_shard_hash(cache, info->peer_id, first)];
+}
+
+/* Mask of the shards that may store regions overlapping the iov */
+static uint64_t util_mr_shard_mask(struct ofi_mr_cache *cache,
+				   uint64_t peer_id, const struct iovec *iov)
+{
+	uint64_t first, last, mask;
+
+	mask = 1ULL << cache->shard_cnt;
+	util_mr_shard_windows(iov, &first, &last);
+	if (last - first >= cache->shard_cnt)
+		return mask | (mask - 1);
+
+	for (; first <= last; first++)
+		mask |= 1ULL << util_mr_shard_hash(cache, peer_id, first);
+	return mask;
+}
+
+static void util_mr_shard_wrlock(struct ofi_mr_cache *cache, uint64_t mask)
+{
+	size_t i;
+
+	for (i = 0; i <= cache->shard_cnt; i++) {
+		if (mask & (1ULL << i))
+			pthread_rwlock_wrlock(&cache->shards[i].lock);
+	}
+}
+
+static void util_mr_shard_unlock(struct ofi_mr_cache *cache, uint64_t mask)
+{
+	size_t i;
+
+	for (i = 0; i <= cache->shard_cnt; i++) {
+		if (mask & (1ULL << i))
+			pthread_rwlock_unlock(&cache->shards[i].lock);
+	}
+}
+
+static void util_mr_shard_count(struct ofi_mr_cache *cache, size_t *cnt,
+				size_t *size, bool add, size_t len)
+{
+	ofi_spin_lock(&cache->count_lock);
+	if (add) {
+		(*cnt)++;
+		*size += len;
+	} else {
+		(*cnt)--;
+		*size -= len;
+	}
+	ofi_spin_unlock(&cache->count_lock);
+}
+
+/* Caller must hold the shard lock for writing */
+static void util_mr_shard_uncache_storage(struct ofi_mr_cache *cache,
+					  struct ofi_mr_cache_shard *shard,
+					  struct ofi_mr_entry *entry)
+{
+	ofi_rbmap_delete(&shard->tree, entry->node);
+	entry->node = NULL;
+	dlist_remove_init(&entry->list_entry);
+	shard->cached_cnt--;
+
+	util_mr_shard_count(cache, &cache->cached_cnt, &cache->cached_size,
+			    false, entry->info.iov.iov_len);
+}
+
+static void util_mr_shard_uncache(struct ofi_mr_cache *cache,
+				  struct ofi_mr_cache_shard *shard,
+				  struct ofi_mr_entry *entry)
+{
+	util_mr_shard_uncache_storage(cache, shard, entry);
+
+	if (entry->use_cnt == 0) {
+		dlist_insert_tail(&entry->list_entry,
+				  &shard->dead_region_list);
+		ofi_atomic_inc32(&cache->dead_cnt);
+	} else {
+		util_mr_shard_count(cache, &cache->uncached_cnt,
+				    &cache->uncached_size, true,
+				    entry->info.iov.iov_len);
+	}
+}
+
+/* Uncache all regions that a search for info would match */
+static void util_mr_shard_purge(struct ofi_mr_cache *cache,
+				const struct ofi_mr_info *info)
+{
+	struct ofi_mr_cache_shard *shard;
+	struct ofi_mr_entry *entry;
+	uint64_t mask;
+	size_t i;
+
+	mask = util_mr_shard_mask(cache, info->peer_id, &info->iov);
+	util_mr_shard_wrlock(cache, mask);
+	for (i = 0; i <= cache->shard_cnt; i++) {
+		if (!(mask & (1ULL << i)))
+			continue;
+
+		shard = &cache->shards[i];
+		while ((entry = ofi_mr_rbt_find(&shard->tree, info)))
+			util_mr_shard_uncache(cache, shard, entry);
+	}
+	util_mr_shard_unlock(cache, mask);
+}
+
+static bool util_mr_shard_merge_side(struct ofi_mr_cache *cache,
+				     struct ofi_mr_info *info, bool left)
+{
+	struct ofi_mr_entry *entry = NULL;
+	struct ofi_mr_info key;
+	uint64_t mask;
+	bool merged;
+	size_t i;
+
+	if (!util_mr_neighbor_key(info, left, &key))
+		return false;
+
+	mask = util_mr_shard_mask(cache, key.peer_id, &key.iov);
+	util_mr_shard_wrlock(cache, mask);
+	for (i = 0; !entry && i <= cache->shard_cnt; i++) {
+		if (mask & (1ULL << i))
+			entry = ofi_mr_rbt_neighbor(&cache->shards[i].tree,
+						    &key);
+	}
+	merged = util_mr_merge_entry(cache, info, entry);
+	util_mr_shard_unlock(cache, mask);
+	return merged;
+}
+
+static bool util_mr_shard_merge(struct ofi_mr_cache *cache,
+				struct ofi_mr_info *info)
+{
+	bool merged = false, progress;
+
+	if (!info->iov.iov_len)
+		return false;
+
+	do {
+		progress = util_mr_shard_merge_side(cache, info, true);
+		progress |= util_mr_shard_merge_side(cache, info, false);
+		merged |= progress;
+	} while (progress);
+
+	return merged;
+}
+
+static struct ofi_mr_entry *
+util_mr_shard_lookup(struct ofi_mr_cache_shard *shard,
+		     struct ofi_mem_monitor *monitor,
+		     const struct ofi_mr_info *info)
+{
+	struct ofi_mr_entry *entry;
+
+	pthread_rwlock_rdlock(&shard->lock);
+	entry = ofi_mr_rbt_find(&shard->tree, info);
+	if (entry && ofi_iov_within(&info->iov, &entry->info.iov) &&
+	    monitor->valid(monitor, info, entry)) {
+		ofi_atomic_add_and_fetch(32, &entry->use_cnt, 1);
+		entry->referenced = true;
+	} else {
+		entry = NULL;
+	}
+	pthread_rwlock_unlock(&shard->lock);
+	return entry;
+}
+
+/* A region containing info is either in its home or the spanning shard */
+static struct ofi_mr_entry *
+util_mr_shard_find(struct ofi_mr_cache *cache, struct ofi_mem_monitor *monitor,
+		   const struct ofi_mr_info *info)
+{
+	struct ofi_mr_cache_shard *shard, *spanning;
+	struct ofi_mr_entry *entry;
+
+	shard = util_mr_shard_home(cache, info);
+	ofi_atomic_inc64(&shard->search_cnt);
+	entry = util_mr_shard_lookup(shard, monitor, info);
+
+	spanning = &cache->shards[cache->shard_cnt];
+	if (!entry && shard != spanning && spanning->cached_cnt) {
+		shard = spanning;
+		entry = util_mr_shard_lookup(shard, monitor, info);
+	}
+
+	if (entry) {
+		ofi_atomic_inc64(&shard->hit_cnt);
+		if (entry->coalesced)
+			ofi_atomic_inc64(&shard->coalesce_hit_cnt);
+	}
+	return entry;
+}
+
+/* Hit regions get a second chance, regions in use are skipped.  Returns
+ * true if more regions need to be evicted.
+ */
+static bool util_mr_shard_evict(struct ofi_mr_cache *cache,
+				struct ofi_mr_cache_shard *shard,
+				struct dlist_entry *free_list, bool *evicted)
+{
+	struct ofi_mr_entry *entry;
+	size_t scan = 2 * shard->cached_cnt;
+
+	while (scan-- && !dlist_empty(&shard->lru_list) &&
+	       (!*evicted || ofi_mr_cache_full(cache))) {
+		dlist_pop_front(&shard->lru_list, struct ofi_mr_entry,
+				entry, list_entry);
+		dlist_init(&entry->list_entry);
+		if (entry->use_cnt || entry->referenced) {
+			entry->referenced = false;
+			dlist_insert_tail(&entry->list_entry, &shard->lru_list);
+			continue;
+		}
+
+		util_mr_shard_uncache_storage(cache, shard, entry);
+		dlist_insert_tail(&entry->list_entry, free_list);
+		*evicted = true;
+	}
+
+	return !*evicted || ofi_mr_cache_full(cache);
+}
+
+static void util_mr_shard_flush(struct ofi_mr_cache *cache, bool flush_lru,
+				struct dlist_entry *free_list)
+{
+	struct ofi_mr_cache_shard *shard;
+	struct dlist_entry *item;
+	bool evicted = false;
+	size_t i, start;
+	int dead = 0;
+
+	if (ofi_atomic_get32(&cache->dead_cnt)) {
+		for (i = 0; i <= cache->shard_cnt; i++) {
+			shard = &cache->shards[i];
+			pthread_rwlock_wrlock(&shard->lock);
+			dlist_splice_tail(free_list, &shard->dead_region_list);
+			pthread_rwlock_unlock(&shard->lock);
+		}
+		dlist_foreach(free_list, item)
+			dead++;
+		ofi_atomic_sub32(&cache->dead_cnt, dead);
+	}
+
+	start = ofi_atomic_inc32(&cache->evict_pos);
+	for (i = 0; flush_lru && i <= cache->shard_cnt; i++) {
+		shard = &cache->shards[(start + i) % (cache->shard_cnt + 1)];
+		pthread_rwlock_wrlock(&shard->lock);
+		flush_lru = util_mr_shard_evict(cache, shard, free_list,
+						&evicted);
+		pthread_rwlock_unlock(&shard->lock);
+	}
+}
+
+static void util_mr_shard_delete(struct ofi_mr_cache *cache,
+				 struct ofi_mr_entry *entry)
+{
+	struct ofi_mr_cache_shard *shard;
+	bool cached;
+
+	shard = util_mr_shard_home(cache, &entry->info);
+	ofi_atomic_inc64(&shard->delete_cnt);
+
+	/* Unused cached regions stay on the LRU list */
+	pthread_rwlock_rdlock(&shard->lock);
+	cached = ofi_atomic_sub_and_fetch(32, &entry->use_cnt, 1) ||
+		 entry->node;
+	pthread_rwlock_unlock(&shard->lock);
+	if (cached)
+		return;
+
+	util_mr_shard_count(cache, &cache->uncached_cnt, &cache->uncached_size,
+			    false, entry->info.iov.iov_len);
+	util_mr_free_entry(cache, entry);
+}
+
+static int util_mr_shard_create(struct ofi_mr_cache *cache,
+				struct ofi_mem_monitor *monitor,
+				struct ofi_mr_info *info, bool coalesced,
+				struct ofi_mr_entry **entry)
+{
+	struct ofi_mr_cache_shard *shard;
+	struct ofi_mr_entry *cur;
+	uint64_t mask;
+	size_t i;
+	int ret;
+
+	FI_DBG(cache->prov, FI_LOG_MR, "create %p (len: %zu)\n",
+	       info->iov.iov_base, info->iov.iov_len);
+
+	*entry = util_mr_entry_alloc(cache);
+	if (!*entry)
+		return -FI_ENOMEM;
+
+	(*entry)->node = NULL;
+	(*entry)->info = *info;
+	(*entry)->use_cnt = 1;
+	(*entry)->referenced = false;
+	(*entry)->coalesced = coalesced;
+	dlist_init(&(*entry)->list_entry);
+
+	ret = cache->add_region(cache, *entry);
+	if (ret)
+		goto free;
+
+	assert(ofi_iov_within(&(*info).iov, &(*entry)->info.iov));
+	*info = (*entry)->info;
+
+	mask = util_mr_shard_mask(cache, info->peer_id, &info->iov);
+	pthread_mutex_lock(&mm_lock);
+	util_mr_shard_wrlock(cache, mask);
+	for (i = 0; i <= cache->shard_cnt; i++) {
+		if ((mask & (1ULL << i)) &&
+		    util_mr_covered(&cache->shards[i].tree, info)) {
+			ret = -FI_EAGAIN;
+			goto unlock;
+		}
+	}
+
+	if (ofi_mr_cache_full(cache)) {
+		util_mr_shard_count(cache, &cache->uncached_cnt,
+				    &cache->uncached_size, true,
+				    info->iov.iov_len);
+	} else {
+		/* Replace the regions that the new one covers */
+		for (i = 0; i <= cache->shard_cnt; i++) {
+			if (!(mask & (1ULL << i)))
+				continue;
+
+			shard = &cache->shards[i];
+			while ((cur = ofi_mr_rbt_find(&shard->tree, info))) {
+				util_mr_shard_uncache(cache, shard, cur);
+				if (coalesced)
+					shard->coalesce_cnt++;
+			}
+		}
+
+		shard = util_mr_shard_home(cache, info);
+		if (ofi_rbmap_insert(&shard->tree, (void *) &(*entry)->info,
+				     (void *) *entry, &(*entry)->node)) {
+			ret = -FI_ENOMEM;
+			goto unlock;
+		}
+		dlist_insert_tail(&(*entry)->list_entry, &shard->lru_list);
+		shard->cached_cnt++;
+		util_mr_shard_count(cache, &cache->cached_cnt,
+				    &cache->cached_size, true,
+				    info->iov.iov_len);
+
+		ret = ofi_monitor_subscribe(monitor, info->iov.iov_base,
+					    info->iov.iov_len,
+					    &(*entry)->hmem_info);
+		if (ret) {
+			util_mr_shard_uncache_storage(cache, shard, *entry);
+			util_mr_shard_count(cache, &cache->uncached_cnt,
+					    &cache->uncached_size, true,
+					    info->iov.iov_len);
+		}
+	}
+	util_mr_shard_unlock(cache, mask);
+	pthread_mutex_unlock(&mm_lock);
+	return 0;
+
+unlock:
+	util_mr_shard_unlock(cache, mask);
+	pthread_mutex_unlock(&mm_lock);
+free:
+	util_mr_free_entry(cache, *entry);
+	return ret;
+}
+
+static int util_mr_shard_search(struct ofi_mr_cache *cache,
+				struct ofi_mem_monitor *monitor,
+				struct ofi_mr_info *info,
+				struct ofi_mr_entry **entry)
+{
+	struct ofi_mr_info orig;
+	bool flush_lru, expanded;
+	int ret;
+
+	do {
+		flush_lru = ofi_mr_cache_full(cache);
+		if (flush_lru || ofi_atomic_get32(&cache->dead_cnt))
+			util_mr_cache_reap(cache, flush_lru);
+
+		*entry = util_mr_shard_find(cache, monitor, info);
+		if (*entry)
+			return 0;
+
+		util_mr_shard_purge(cache, info);
+
+		orig = *info;
+		expanded = util_mr_round(cache, info);
+		if (cache->merge && info->iface == FI_HMEM_SYSTEM)
+			expanded |= util_mr_shard_merge(cache, info);
+
+		ret = util_mr_shard_create(cache, monitor, info, expanded,
+					   entry);
+		if (ret && ret != -FI_EAGAIN && expanded) {
+			*info = orig;
+			ret = util_mr_shard_create(cache, monitor, info, false,
+						   entry);
+		}
+		if (ret && ret != -FI_EAGAIN) {
+			if (ofi_mr_cache_flush(cache, true))
+				ret = -FI_EAGAIN;
+		}
+	} while (ret == -FI_EAGAIN);
+
+	return ret;
+}
+
+static void util_mr_shard_cleanup(struct ofi_mr_cache *cache)
+{
+	struct ofi_mr_cache_shard *shard;
+	size_t i;
+
+	for (i = 0; i <= cache->shard_cnt; i++) {
+		shard = &cache->shards[i];
+		ofi_rbmap_cleanup(&shard->tree);
+		pthread_rwlock_destroy(&shard->lock);
+	}
+	ofi_spin_destroy(&cache->count_lock);
+	free(cache->shards);
+	cache->shards = NULL;
+}
+
+static int util_mr_shard_init(struct ofi_mr_cache *cache)
+{
+	struct ofi_mr_cache_shard *shard;
+	size_t i;
+
+	cache->shard_cnt = MIN(cache_params.shard_cnt,
+			       OFI_MR_CACHE_MAX_SHARDS);
+	cache->shards = calloc(cache->shard_cnt + 1, sizeof(*cache->shards));
+	if (!cache->shards)
+		return -FI_ENOMEM;
+
+	for (i = 0; i <= cache->shard_cnt; i++) {
+		shard = &cache->shards[i];
+		pthread_rwlock_init(&shard->lock, NULL);
+		ofi_rbmap_init(&shard->tree, util_mr_find_within);
+		dlist_init(&shard->lru_list);
+		dlist_init(&shard->dead_region_list);
+		ofi_atomic_initialize64(&shard->search_cnt, 0);
+		ofi_atomic_initialize64(&shard->delete_cnt, 0);
+		ofi_atomic_initialize64(&shard->hit_cnt, 0);
+		ofi_atomic_initialize64(&shard->coalesce_hit_cnt, 0);
+	}
+	ofi_spin_init(&cache->count_lock);
+	ofi_atomic_initialize32(&cache->dead_cnt, 0);
+	ofi_atomic_initialize32(&cache->evict_pos, 0);
+	return 0;
+}
+
+static void util_mr_shard_notify(struct ofi_mr_cache *cache,
+				 const struct iovec *iov)
+{
+	struct ofi_mr_cache_shard *shard;
+	struct ofi_mr_entry *entry;
+	uint64_t mask;
+	size_t i;
+
+	mask = util_mr_shard_mask(cache, 0, iov);
+	util_mr_shard_wrlock(cache, mask);
+	for (i = 0; i <= cache->shard_cnt; i++) {
+		if (!(mask & (1ULL << i)))
+			continue;
+
+		shard = &cache->shards[i];
+		while ((entry = ofi_mr_rbt_overlap(&shard->tree, iov)))
+			util_mr_shard_uncache(cache, shard, entry);
+	}
+	util_mr_shard_unlock(cache, mask);
+}
+
+static struct ofi_mr_entry *
+util_mr_shard_find_attr(struct ofi_mr_cache *cache,
+			const struct fi_mr_attr *attr, uint64_t flags)
+{
+	struct ofi_mem_monitor *monitor;
+	struct ofi_mr_entry *entry;
+	struct ofi_mr_info info = {0};
+
+	monitor = cache->monitors[attr->iface];
+	if (!monitor)
+		return NULL;
+
+	if (ofi_atomic_get32(&cache->dead_cnt))
+		util_mr_cache_reap(cache, false);
+
+	info.iface = attr->iface;
+	ofi_mr_info_get_iov_from_mr_attr(&info, attr, flags);
+	entry = util_mr_shard_find(cache, monitor, &info);
+	if (!entry)
+		util_mr_shard_purge(cache, &info);
+	return entry;
+}
+
+static void util_mr_shard_stats(struct ofi_mr_cache *cache)
+{
+	struct ofi_mr_cache_shard *shard;
+	size_t i;
+
+	for (i = 0; i <= cache->shard_cnt; i++) {
+		shard = &cache->shards[i];
+		cache->search_cnt += ofi_atomic_get64(&shard->search_cnt);
+		cache->delete_cnt += ofi_atomic_get64(&shard->delete_cnt);
+		cache->hit_cnt += ofi_atomic_get64(&shard->hit_cnt);
+		cache->coalesce_cnt += shard->coalesce_cnt;
+		cache->coalesce_hit_cnt +=
+			ofi_atomic_get64(&shard->coalesce_hit_cnt);
+		FI_INFO(cache->prov, FI_LOG_MR, "MR cache shard %zu: "
+			"searches %" PRId64 ", hits %" PRId64 "\n", i,
+			ofi_atomic_get64(&shard->search_cnt),
+			ofi_atomic_get64(&shard->hit_cnt));
+	}
+}
+
 /* Caller must hold ofi_mem_monitor lock as well as unsubscribe from the region */
 void ofi_mr_cache_notify(struct ofi_mr_cache *cache, const void *addr, size_t len)
 {
@@ -190,47 +881,198 @@ void ofi_mr_cache_notify(struct ofi_mr_cache *cache, const void *addr, size_t le
 	iov.iov_base = (void *) addr;
 	iov.iov_len = len;
 
+	if (cache->shards) {
+		util_mr_shard_notify(cache, &iov);
+		return;
+	}
+
 	for (entry = ofi_mr_rbt_overlap(&cache->tree, &iov); entry;
 	     entry = ofi_mr_rbt_overlap(&cache->tree, &iov))
 		util_mr_uncache_entry(cache, entry);
 }
 
-/* Function to remove dead regions and prune MR cache size.
- * Returns true if any entries were flushed from the cache.
+/* Moves dead regions, and the least recently used ones if flush_lru is
+ * set, from the cache to the free list.
  */
-bool ofi_mr_cache_flush(struct ofi_mr_cache *cache, bool flush_lru)
+static void util_mr_cache_collect(struct ofi_mr_cache *cache, bool flush_lru,
+				  struct dlist_entry *free_list)
 {
-	struct dlist_entry free_list;
 	struct ofi_mr_entry *entry;
-	bool entries_freed;
 
-	dlist_init(&free_list);
+	if (cache->shards) {
+		util_mr_shard_flush(cache, flush_lru, free_list);
+		return;
+	}
 
 	pthread_mutex_lock(&mm_lock);
 
-	dlist_splice_tail(&free_list, &cache->dead_region_list);
+	dlist_splice_tail(free_list, &cache->dead_region_list);
 
 	while (flush_lru && !dlist_empty(&cache->lru_list)) {
 		dlist_pop_front(&cache->lru_list, struct ofi_mr_entry,
 				entry, list_entry);
 		dlist_init(&entry->list_entry);
 		util_mr_uncache_entry_storage(cache, entry);
-		dlist_insert_tail(&entry->list_entry, &free_list);
+		dlist_insert_tail(&entry->list_entry, free_list);
 
 		flush_lru = ofi_mr_cache_full(cache);
 	}
 
 	pthread_mutex_unlock(&mm_lock);
+}
 
-	entries_freed = !dlist_empty(&free_list);
+static size_t util_mr_free_list(struct ofi_mr_cache *cache,
+				struct dlist_entry *free_list)
+{
+	struct ofi_mr_entry *entry;
+	size_t cnt = 0;
 
-	while(!dlist_empty(&free_list)) {
-		dlist_pop_front(&free_list, struct ofi_mr_entry,
+	while(!dlist_empty(free_list)) {
+		dlist_pop_front(free_list, struct ofi_mr_entry,
 				entry, list_entry);
 		FI_DBG(cache->prov, FI_LOG_MR, "flush %p (len: %zu)\n",
 			entry->info.iov.iov_base, entry->info.iov.iov_len);
 		util_mr_free_entry(cache, entry);
+		cnt++;
+	}
+	return cnt;
+}
+
+/*
+ * Background deregistration.  Regions removed from the cache while
+ * searching it are queued to a reaper thread, which deregisters them in
+ * batches.  Once reap_max regions are queued, the searching thread
+ * deregisters the rest itself.  ofi_mr_cache_flush() waits for the queue
+ * to drain, so that all regions removed before the call are deregistered
+ * when it returns.
+ */
+static void *util_mr_reaper(void *arg)
+{
+	struct ofi_mr_cache *cache = arg;
+	struct dlist_entry batch;
+	size_t cnt;
+
+	pthread_mutex_lock(&cache->reap_lock);
+	while (!cache->reap_stop) {
+		if (dlist_empty(&cache->reap_list)) {
+			ofi_wait_cond(&cache->reap_cond, &cache->reap_lock, -1);
+			continue;
+		}
+
+		dlist_init(&batch);
+		dlist_splice_tail(&batch, &cache->reap_list);
+		pthread_mutex_unlock(&cache->reap_lock);
+
+		cnt = util_mr_free_list(cache, &batch);
+
+		pthread_mutex_lock(&cache->reap_lock);
+		cache->reap_cnt -= cnt;
+		if (!cache->reap_cnt)
+			pthread_cond_broadcast(&cache->reap_cond);
+	}
+	pthread_mutex_unlock(&cache->reap_lock);
+	return NULL;
+}
+
+/* Returns true if it had to wait for any region */
+static bool util_mr_reap_wait(struct ofi_mr_cache *cache)
+{
+	bool waited = false;
+
+	if (!cache->reap_max)
+		return false;
+
+	pthread_mutex_lock(&cache->reap_lock);
+	while (cache->reap_cnt) {
+		waited = true;
+		ofi_wait_cond(&cache->reap_cond, &cache->reap_lock, -1);
+	}
+	pthread_mutex_unlock(&cache->reap_lock);
+	return waited;
+}
+
+static void util_mr_cache_reap(struct ofi_mr_cache *cache, bool flush_lru)
+{
+	struct dlist_entry free_list;
+	struct dlist_entry *item;
+
+	if (!cache->reap_max) {
+		ofi_mr_cache_flush(cache, flush_lru);
+		return;
+	}
+
+	dlist_init(&free_list);
+	util_mr_cache_collect(cache, flush_lru, &free_list);
+	if (dlist_empty(&free_list))
+		return;
+
+	pthread_mutex_lock(&cache->reap_lock);
+	while (!dlist_empty(&free_list) && cache->reap_cnt < cache->reap_max) {
+		item = free_list.next;
+		dlist_remove(item);
+		dlist_insert_tail(item, &cache->reap_list);
+		cache->reap_cnt++;
+	}
+	pthread_cond_broadcast(&cache->reap_cond);
+	pthread_mutex_unlock(&cache->reap_lock);
+
+	util_mr_free_list(cache, &free_list);
+}
+
+static void util_mr_reap_init(struct ofi_mr_cache *cache)
+{
+	int ret;
+
+	dlist_init(&cache->reap_list);
+	cache->reap_cnt = 0;
+	cache->reap_stop = false;
+	cache->reap_max = cache_params.reap_max;
+	if (!cache->reap_max)
+		return;
+
+	pthread_mutex_init(&cache->reap_lock, NULL);
+	pthread_cond_init(&cache->reap_cond, NULL);
+	ret = pthread_create(&cache->reap_thread, NULL, util_mr_reaper, cache);
+	if (ret) {
+		FI_WARN(cache->prov, FI_LOG_MR,
+			"unable to start MR cache reaper: %s\n", strerror(ret));
+		pthread_cond_destroy(&cache->reap_cond);
+		pthread_mutex_destroy(&cache->reap_lock);
+		cache->reap_max = 0;
 	}
+}
+
+static void util_mr_reap_cleanup(struct ofi_mr_cache *cache)
+{
+	if (!cache->reap_max)
+		return;
+
+	pthread_mutex_lock(&cache->reap_lock);
+	cache->reap_stop = true;
+	pthread_cond_broadcast(&cache->reap_cond);
+	pthread_mutex_unlock(&cache->reap_lock);
+
+	pthread_join(cache->reap_thread, NULL);
+	assert(dlist_empty(&cache->reap_list));
+	pthread_cond_destroy(&cache->reap_cond);
+	pthread_mutex_destroy(&cache->reap_lock);
+	cache->reap_max = 0;
+}
+
+/* Function to remove dead regions and prune MR cache size.
+ * Returns true if any entries were flushed from the cache.
+ */
+bool ofi_mr_cache_flush(struct ofi_mr_cache *cache, bool flush_lru)
+{
+	struct dlist_entry free_list;
+	bool entries_freed;
+
+	dlist_init(&free_list);
+	util_mr_cache_collect(cache, flush_lru, &free_list);
+	entries_freed = util_mr_free_list(cache, &free_list) > 0;
+
+	if (util_mr_reap_wait(cache))
+		entries_freed = true;
 
 	return entries_freed;
 }
@@ -240,6 +1082,11 @@ void ofi_mr_cache_delete(struct ofi_mr_cache *cache, struct ofi_mr_entry *entry)
 	FI_DBG(cache->prov, FI_LOG_MR, "delete %p (len: %zu)\n",
 	       entry->info.iov.iov_base, entry->info.iov.iov_len);
 
+	if (cache->shards) {
+		util_mr_shard_delete(cache, entry);
+		return;
+	}
+
 	pthread_mutex_lock(&mm_lock);
 	cache->delete_cnt++;
 
@@ -268,7 +1115,7 @@ void ofi_mr_cache_delete(struct ofi_mr_cache *cache, struct ofi_mr_entry *entry)
  */
 static int
 util_mr_cache_create(struct ofi_mr_cache *cache, struct ofi_mr_info *info,
-		     struct ofi_mr_entry **entry)
+		     bool coalesced, struct ofi_mr_entry **entry)
 {
 	struct ofi_mr_entry *cur;
 	int ret;
@@ -286,6 +1133,7 @@ util_mr_cache_create(struct ofi_mr_cache *cache, struct ofi_mr_info *info,
 	(*entry)->node = NULL;
 	(*entry)->info = *info;
 	(*entry)->use_cnt = 1;
+	(*entry)->coalesced = coalesced;
 
 	ret = cache->add_region(cache, *entry);
 	if (ret)
@@ -298,8 +1146,7 @@ util_mr_cache_create(struct ofi_mr_cache *cache, struct ofi_mr_info *info,
 	*info = (*entry)->info;
 
 	pthread_mutex_lock(&mm_lock);
-	cur = ofi_mr_rbt_find(&cache->tree, info);
-	if (cur) {
+	if (util_mr_covered(&cache->tree, info)) {
 		ret = -FI_EAGAIN;
 		goto unlock;
 	}
@@ -308,6 +1155,13 @@ util_mr_cache_create(struct ofi_mr_cache *cache, struct ofi_mr_info *info,
 		cache->uncached_cnt++;
 		cache->uncached_size += info->iov.iov_len;
 	} else {
+		/* Replace the regions that the new one covers */
+		while ((cur = ofi_mr_rbt_find(&cache->tree, info))) {
+			util_mr_uncache_entry(cache, cur);
+			if (coalesced)
+				cache->coalesce_cnt++;
+		}
+
 		if (ofi_rbmap_insert(&cache->tree, (void *) &(*entry)->info,
 				     (void *) *entry, &(*entry)->node)) {
 			ret = -FI_ENOMEM;
@@ -339,7 +1193,8 @@ int ofi_mr_cache_search(struct ofi_mr_cache *cache, struct ofi_mr_info *info,
 			struct ofi_mr_entry **entry)
 {
 	struct ofi_mem_monitor *monitor;
-	bool flush_lru;
+	struct ofi_mr_info orig;
+	bool flush_lru, expanded;
 	int ret;
 
 	monitor = cache->monitors[info->iface];
@@ -353,12 +1208,15 @@ int ofi_mr_cache_search(struct ofi_mr_cache *cache, struct ofi_mr_info *info,
 	FI_DBG(cache->prov, FI_LOG_MR, "search %p (len: %zu)\n",
 	       info->iov.iov_base, info->iov.iov_len);
 
+	if (cache->shards)
+		return util_mr_shard_search(cache, monitor, info, entry);
+
 	do {
 		pthread_mutex_lock(&mm_lock);
 		flush_lru = ofi_mr_cache_full(cache);
 		if (flush_lru || !dlist_empty(&cache->dead_region_list)) {
 			pthread_mutex_unlock(&mm_lock);
-			ofi_mr_cache_flush(cache, flush_lru);
+			util_mr_cache_reap(cache, flush_lru);
 			pthread_mutex_lock(&mm_lock);
 		}
 
@@ -375,9 +1233,19 @@ int ofi_mr_cache_search(struct ofi_mr_cache *cache, struct ofi_mr_info *info,
 			util_mr_uncache_entry(cache, *entry);
 			*entry = ofi_mr_rbt_find(&cache->tree, info);
 		}
+
+		/* Let one registration serve neighbouring buffers */
+		orig = *info;
+		expanded = util_mr_round(cache, info);
+		if (cache->merge && info->iface == FI_HMEM_SYSTEM)
+			expanded |= util_mr_merge(cache, info);
 		pthread_mutex_unlock(&mm_lock);
 
-		ret = util_mr_cache_create(cache, info, entry);
+		ret = util_mr_cache_create(cache, info, expanded, entry);
+		if (ret && ret != -FI_EAGAIN && expanded) {
+			*info = orig;
+			ret = util_mr_cache_create(cache, info, false, entry);
+		}
 		if (ret && ret != -FI_EAGAIN) {
 			if (ofi_mr_cache_flush(cache, true))
 				ret = -FI_EAGAIN;
@@ -388,6 +1256,8 @@ int ofi_mr_cache_search(struct ofi_mr_cache *cache, struct ofi_mr_info *info,
 
 hit:
 	cache->hit_cnt++;
+	if ((*entry)->coalesced)
+		cache->coalesce_hit_cnt++;
 	if ((*entry)->use_cnt++ == 0)
 		dlist_remove_init(&(*entry)->list_entry);
 	pthread_mutex_unlock(&mm_lock);
@@ -406,11 +1276,14 @@ struct ofi_mr_entry *ofi_mr_cache_find(struct ofi_mr_cache *cache,
 	FI_DBG(cache->prov, FI_LOG_MR, "find %p (len: %zu)\n",
 	       attr->mr_iov->iov_base, attr->mr_iov->iov_len);
 
+	if (cache->shards)
+		return util_mr_shard_find_attr(cache, attr, flags);
+
 	pthread_mutex_lock(&mm_lock);
 
 	if (!dlist_empty(&cache->dead_region_list)) {
 		pthread_mutex_unlock(&mm_lock);
-		ofi_mr_cache_flush(cache, false);
+		util_mr_cache_reap(cache, false);
 		pthread_mutex_lock(&mm_lock);
 	}
 
@@ -455,10 +1328,16 @@ int ofi_mr_cache_reg(struct ofi_mr_cache *cache, const struct fi_mr_attr *attr,
 	if (!*entry)
 		return -FI_ENOMEM;
 
-	pthread_mutex_lock(&mm_lock);
-	cache->uncached_cnt++;
-	cache->uncached_size += attr->mr_iov->iov_len;
-	pthread_mutex_unlock(&mm_lock);
+	if (cache->shards) {
+		util_mr_shard_count(cache, &cache->uncached_cnt,
+				    &cache->uncached_size, true,
+				    attr->mr_iov->iov_len);
+	} else {
+		pthread_mutex_lock(&mm_lock);
+		cache->uncached_cnt++;
+		cache->uncached_size += attr->mr_iov->iov_len;
+		pthread_mutex_unlock(&mm_lock);
+	}
 
 	ofi_mr_info_get_iov_from_mr_attr(&(*entry)->info, attr, flags);
 	(*entry)->use_cnt = 1;
@@ -472,10 +1351,16 @@ int ofi_mr_cache_reg(struct ofi_mr_cache *cache, const struct fi_mr_attr *attr,
 
 buf_free:
 	util_mr_entry_free(cache, *entry);
-	pthread_mutex_lock(&mm_lock);
-	cache->uncached_cnt--;
-	cache->uncached_size -= attr->mr_iov->iov_len;
-	pthread_mutex_unlock(&mm_lock);
+	if (cache->shards) {
+		util_mr_shard_count(cache, &cache->uncached_cnt,
+				    &cache->uncached_size, false,
+				    attr->mr_iov->iov_len);
+	} else {
+		pthread_mutex_lock(&mm_lock);
+		cache->uncached_cnt--;
+		cache->uncached_size -= attr->mr_iov->iov_len;
+		pthread_mutex_unlock(&mm_lock);
+	}
 	return ret;
 }
 
@@ -485,17 +1370,25 @@ void ofi_mr_cache_cleanup(struct ofi_mr_cache *cache)
 	if (!cache->prov)
 		return;
 
+	if (cache->shards)
+		util_mr_shard_stats(cache);
+
 	FI_INFO(cache->prov, FI_LOG_MR, "MR cache stats: "
-		"searches %zu, deletes %zu, hits %zu notify %zu\n",
+		"searches %zu, deletes %zu, hits %zu notify %zu "
+		"merges %zu, merged hits %zu\n",
 		cache->search_cnt, cache->delete_cnt, cache->hit_cnt,
-		cache->notify_cnt);
+		cache->notify_cnt, cache->coalesce_cnt,
+		cache->coalesce_hit_cnt);
 
 	while (ofi_mr_cache_flush(cache, true))
 		;
+	util_mr_reap_cleanup(cache);
 
 	pthread_mutex_destroy(&cache->lock);
 	ofi_monitors_del_cache(cache);
 	ofi_rbmap_cleanup(&cache->tree);
+	if (cache->shards)
+		util_mr_shard_cleanup(cache);
 	if (cache->domain)
 		ofi_atomic_dec32(&cache->domain->ref);
 	ofi_bufpool_destroy(cache->entry_pool);
@@ -529,6 +1422,11 @@ int ofi_mr_cache_init(struct util_domain *domain,
 	cache->delete_cnt = 0;
 	cache->hit_cnt = 0;
 	cache->notify_cnt = 0;
+	cache->align = cache_params.align ?
+		       roundup_power_of_two(cache_params.align) : 0;
+	cache->merge = cache_params.merge;
+	cache->coalesce_cnt = 0;
+	cache->coalesce_hit_cnt = 0;
 	cache->domain = domain;
 	if (domain) {
 		cache->prov = domain->prov;
@@ -538,6 +1436,14 @@ int ofi_mr_cache_init(struct util_domain *domain,
 	}
 
 	ofi_rbmap_init(&cache->tree, util_mr_find_within);
+	cache->shards = NULL;
+	cache->shard_cnt = 0;
+	if (cache_params.shard_cnt) {
+		ret = util_mr_shard_init(cache);
+		if (ret)
+			goto destroy;
+	}
+
 	ret = ofi_monitors_add_cache(monitors, cache);
 	if (ret)
 		goto destroy;
@@ -545,15 +1451,19 @@ int ofi_mr_cache_init(struct util_domain *domain,
 	ret = ofi_bufpool_create(&cache->entry_pool,
 				 sizeof(struct ofi_mr_entry) +
 				 cache->entry_data_size,
-				 16, 0, 0, 0);
+				 16, 0, 0,
+				 cache->shards ? OFI_BUFPOOL_MAGAZINE : 0);
 	if (ret)
 		goto del;
 
+	util_mr_reap_init(cache);
 	return 0;
 del:
 	ofi_monitors_del_cache(cache);
 destroy:
 	ofi_rbmap_cleanup(&cache->tree);
+	if (cache->shards)
+		util_mr_shard_cleanup(cache);
 	if (domain) {
 		ofi_atomic_dec32(&cache->domain->ref);
 		cache->domain = NULL;
@@ -297,6 +297,15 @@ errend:
 	return -FI_ENOMEM;
 }
 
+void ofi_prof_fini(struct util_profile *prof)
+{
+	free(prof->varlist);
+	free(prof->vars);
+	free(prof->data);
+	free(prof->eventlist);
+	free(prof->pcb);
+}
+
 void ofi_prof_reset(struct util_profile *prof, uint64_t flags)
 {
 	prof->flags = flags;
@@ -472,3 +481,103 @@ int ofi_prof_reg_callback(struct util_profile *prof, uint32_t event,
 	return 0;
 }
 
+static void ofi_prof_fid_reset(struct fid_profile *prof_fid, uint64_t flags)
+{
+	struct util_profile *prof =
+		container_of(prof_fid, struct util_profile, prof_fid);
+
+	ofi_prof_reset(prof, flags);
+}
+
+static ssize_t ofi_prof_fid_query_vars(struct fid_profile *prof_fid,
+				       struct fi_profile_desc *varlist,
+				       size_t *count)
+{
+	struct util_profile *prof =
+		container_of(prof_fid, struct util_profile, prof_fid);
+
+	return ofi_prof_query_vars(prof, varlist, count);
+}
+
+static ssize_t ofi_prof_fid_query_events(struct fid_profile *prof_fid,
+					 struct fi_profile_desc *eventlist,
+					 size_t *count)
+{
+	struct util_profile *prof =
+		container_of(prof_fid, struct util_profile, prof_fid);
+
+	return ofi_prof_query_events(prof, eventlist, count);
+}
+
+static ssize_t ofi_prof_fid_read_var(struct fid_profile *prof_fid,
+				     uint32_t var_id, void *data, size_t *size)
+{
+	struct util_profile *prof =
+		container_of(prof_fid, struct util_profile, prof_fid);
+	int idx = ofi_prof_id2_idx(var_id, ofi_common_var_count);
+
+	if ((idx >= prof->varlist_size) ||
+	    !OFI_VAR_ENABLED(&prof->varlist[idx]) || !prof->vars[idx])
+		return -FI_EINVAL;
+
+	if (OFI_VAR_DATATYPE_U64(&prof->varlist[idx]))
+		return ofi_prof_read_u64(prof, idx, data, size);
+
+	if (OFI_PROF_DATA_CACHED(prof))
+		return ofi_prof_read_cached_data(prof, idx, data, size);
+
+	return 0;
+}
+
+static int ofi_prof_fid_reg_cb(struct fid_profile *prof_fid, uint32_t event,
+			       ofi_prof_callback_t cb, void *context)
+{
+	struct util_profile *prof =
+		container_of(prof_fid, struct util_profile, prof_fid);
+
+	return ofi_prof_reg_callback(prof, event, cb, context);
+}
+
+static void ofi_prof_fid_start_reads(struct fid_profile *prof_fid,
+				     uint64_t flags)
+{
+	struct util_profile *prof =
+		container_of(prof_fid, struct util_profile, prof_fid);
+	size_t size_u64 = sizeof(uint64_t);
+	size_t i;
+
+	OFI_PROF_END_READS(prof);
+	for (i = 0; i < prof->varlist_size; i++) {
+		if (!OFI_VAR_ENABLED(&prof->varlist[i]) || !prof->vars[i] ||
+		    !OFI_VAR_DATATYPE_U64(&prof->varlist[i]))
+			continue;
+
+		prof->data[i].size = ofi_prof_read_u64(prof, i,
+						&prof->data[i].value.u64,
+						&size_u64);
+	}
+	OFI_PROF_START_READS(prof);
+}
+
+static void ofi_prof_fid_end_reads(struct fid_profile *prof_fid,
+				   uint64_t flags)
+{
+	struct util_profile *prof =
+		container_of(prof_fid, struct util_profile, prof_fid);
+
+	OFI_PROF_END_READS(prof);
+}
+
+/* Generic fid_profile operations for profiles whose variables are all
+ * backed by memory registered through ofi_prof_add_var().
+ */
+struct fi_profile_ops ofi_prof_ops = {
+	.size = sizeof(struct fi_profile_ops),
+	.reset = ofi_prof_fid_reset,
+	.query_vars = ofi_prof_fid_query_vars,
+	.query_events = ofi_prof_fid_query_events,
+	.read_var = ofi_prof_fid_read_var,
+	.reg_callback = ofi_prof_fid_reg_cb,
+	.start_reads = ofi_prof_fid_start_reads,
+	.end_reads = ofi_prof_fid_end_reads,
+};
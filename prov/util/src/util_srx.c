@@ -35,6 +35,7 @@
 #include "ofi_enosys.h"
 #include "ofi_iov.h"
 #include "ofi_util.h"
+#include "ofi_profile.h"
 
 static struct util_rx_entry *util_alloc_rx_entry(struct util_srx_ctx *srx)
 {
@@ -53,6 +54,184 @@ static inline void **util_srx_desc(struct util_srx_ctx *srx,
 			(sizeof(struct iovec) * srx->iov_limit));
 }
 
+#ifdef HAVE_FABRIC_PROFILE
+
+extern struct ofi_common_locks common_locks;
+
+#define UTIL_SRX_PROF_SPECIFIC	(0x5c0 << 16)
+#define UTIL_SRX_HIST_SIZE	16
+
+enum {
+	UTIL_SRX_VAR_UNEXP_MAX = -UTIL_SRX_PROF_SPECIFIC,
+	UTIL_SRX_VAR_POSTED_CNT,
+	UTIL_SRX_VAR_POSTED_MAX,
+	UTIL_SRX_VAR_SEARCH_CNT,
+	UTIL_SRX_VAR_SEARCH_LEN,
+	UTIL_SRX_VAR_UNEXP_MATCHED,
+	UTIL_SRX_VAR_UNEXP_TIME,
+	UTIL_SRX_VAR_SEARCH_HIST,
+	UTIL_SRX_VAR_UNEXP_HIST = UTIL_SRX_VAR_SEARCH_HIST + UTIL_SRX_HIST_SIZE,
+};
+
+/* Histogram bucket i counts values in [2^(i-1), 2^i), bucket 0 counts 0
+ * and the last bucket everything above.  Search lengths are counted in
+ * entries, unexpected message lifetimes in microseconds.
+ */
+struct util_srx_prof {
+	struct util_profile	util_prof;
+	struct util_srx_ctx	*srx;
+	uint64_t		unexp_cnt;
+	uint64_t		unexp_max;
+	uint64_t		posted_cnt;
+	uint64_t		posted_max;
+	uint64_t		search_cnt;
+	uint64_t		search_len;
+	uint64_t		unexp_matched;
+	uint64_t		unexp_time;
+	uint64_t		search_hist[UTIL_SRX_HIST_SIZE];
+	uint64_t		unexp_hist[UTIL_SRX_HIST_SIZE];
+};
+
+#define UTIL_SRX_VAR(_id, _field, _name, _desc)				\
+	{								\
+	 .desc = {							\
+		.id = (uint32_t) (_id),					\
+		.datatype_sel = fi_primitive_type,			\
+		.datatype.primitive = FI_UINT64,			\
+		.flags = 0,						\
+		.size = sizeof(uint64_t),				\
+		.name = _name,						\
+		.desc = _desc						\
+	 },								\
+	 .offset = offsetof(struct util_srx_prof, _field)		\
+	}
+
+#define UTIL_SRX_SEARCH_HIST(i)						\
+	UTIL_SRX_VAR(UTIL_SRX_VAR_SEARCH_HIST + i, search_hist[i],	\
+		     "util_srx_search_hist_" #i,			\
+		     "Tag searches in log2 bucket " #i " of entries traversed")
+
+#define UTIL_SRX_UNEXP_HIST(i)						\
+	UTIL_SRX_VAR(UTIL_SRX_VAR_UNEXP_HIST + i, unexp_hist[i],	\
+		     "util_srx_unexp_hist_" #i,				\
+		     "Unexpected messages in log2 bucket " #i " of usec queued")
+
+static const struct {
+	struct fi_profile_desc	desc;
+	size_t			offset;
+} util_srx_vars[] = {
+	UTIL_SRX_VAR(UTIL_SRX_VAR_UNEXP_MAX, unexp_max,
+		     "util_srx_unexp_max",
+		     "Maximum unexpected message queue depth"),
+	UTIL_SRX_VAR(UTIL_SRX_VAR_POSTED_CNT, posted_cnt,
+		     "util_srx_posted_cnt", "Posted receive queue depth"),
+	UTIL_SRX_VAR(UTIL_SRX_VAR_POSTED_MAX, posted_max,
+		     "util_srx_posted_max",
+		     "Maximum posted receive queue depth"),
+	UTIL_SRX_VAR(UTIL_SRX_VAR_SEARCH_CNT, search_cnt,
+		     "util_srx_search_cnt", "Number of tag searches"),
+	UTIL_SRX_VAR(UTIL_SRX_VAR_SEARCH_LEN, search_len,
+		     "util_srx_search_len",
+		     "Total entries traversed by tag searches"),
+	UTIL_SRX_VAR(UTIL_SRX_VAR_UNEXP_MATCHED, unexp_matched,
+		     "util_srx_unexp_matched",
+		     "Number of unexpected messages timed until matched"),
+	UTIL_SRX_VAR(UTIL_SRX_VAR_UNEXP_TIME, unexp_time,
+		     "util_srx_unexp_time",
+		     "Total ns unexpected messages waited for a receive"),
+	UTIL_SRX_SEARCH_HIST(0), UTIL_SRX_SEARCH_HIST(1),
+	UTIL_SRX_SEARCH_HIST(2), UTIL_SRX_SEARCH_HIST(3),
+	UTIL_SRX_SEARCH_HIST(4), UTIL_SRX_SEARCH_HIST(5),
+	UTIL_SRX_SEARCH_HIST(6), UTIL_SRX_SEARCH_HIST(7),
+	UTIL_SRX_SEARCH_HIST(8), UTIL_SRX_SEARCH_HIST(9),
+	UTIL_SRX_SEARCH_HIST(10), UTIL_SRX_SEARCH_HIST(11),
+	UTIL_SRX_SEARCH_HIST(12), UTIL_SRX_SEARCH_HIST(13),
+	UTIL_SRX_SEARCH_HIST(14), UTIL_SRX_SEARCH_HIST(15),
+	UTIL_SRX_UNEXP_HIST(0), UTIL_SRX_UNEXP_HIST(1),
+	UTIL_SRX_UNEXP_HIST(2), UTIL_SRX_UNEXP_HIST(3),
+	UTIL_SRX_UNEXP_HIST(4), UTIL_SRX_UNEXP_HIST(5),
+	UTIL_SRX_UNEXP_HIST(6), UTIL_SRX_UNEXP_HIST(7),
+	UTIL_SRX_UNEXP_HIST(8), UTIL_SRX_UNEXP_HIST(9),
+	UTIL_SRX_UNEXP_HIST(10), UTIL_SRX_UNEXP_HIST(11),
+	UTIL_SRX_UNEXP_HIST(12), UTIL_SRX_UNEXP_HIST(13),
+	UTIL_SRX_UNEXP_HIST(14), UTIL_SRX_UNEXP_HIST(15),
+};
+
+static inline int util_srx_hist_idx(uint64_t val)
+{
+	return MIN(ofi_msb(val), UTIL_SRX_HIST_SIZE - 1);
+}
+
+static inline void util_srx_prof_posted(struct util_srx_ctx *srx, int delta)
+{
+	struct util_srx_prof *prof = srx->prof;
+
+	if (!prof)
+		return;
+
+	prof->posted_cnt += delta;
+	prof->posted_max = MAX(prof->posted_max, prof->posted_cnt);
+}
+
+static inline void util_srx_prof_search(struct util_srx_ctx *srx, size_t len)
+{
+	struct util_srx_prof *prof = srx->prof;
+
+	if (!prof)
+		return;
+
+	prof->search_cnt++;
+	prof->search_len += len;
+	prof->search_hist[util_srx_hist_idx(len)]++;
+}
+
+static inline void util_srx_prof_queue_unexp(struct util_srx_ctx *srx,
+					     struct util_rx_entry *rx_entry)
+{
+	struct util_srx_prof *prof = srx->prof;
+
+	rx_entry->unexp_ts = 0;
+	if (!prof)
+		return;
+
+	rx_entry->unexp_ts = ofi_gettime_ns();
+	prof->unexp_cnt++;
+	prof->unexp_max = MAX(prof->unexp_max, prof->unexp_cnt);
+	ofi_prof_event_notify(&prof->util_prof, FI_EVENT_UNEXP_MSG_RECVD,
+			      NULL, 0);
+}
+
+static inline void util_srx_prof_match_unexp(struct util_srx_ctx *srx,
+					     struct util_rx_entry *rx_entry)
+{
+	struct util_srx_prof *prof = srx->prof;
+	uint64_t lifetime;
+
+	if (!prof)
+		return;
+
+	if (prof->unexp_cnt)
+		prof->unexp_cnt--;
+
+	if (rx_entry->unexp_ts) {
+		lifetime = ofi_gettime_ns() - rx_entry->unexp_ts;
+		prof->unexp_matched++;
+		prof->unexp_time += lifetime;
+		prof->unexp_hist[util_srx_hist_idx(lifetime / 1000)]++;
+	}
+	ofi_prof_event_notify(&prof->util_prof, FI_EVENT_UNEXP_MSG_MATCHED,
+			      NULL, 0);
+}
+
+#else
+
+#define util_srx_prof_posted(srx, delta)		do {} while (0)
+#define util_srx_prof_search(srx, len)			do {} while (0)
+#define util_srx_prof_queue_unexp(srx, rx_entry)	do {} while (0)
+#define util_srx_prof_match_unexp(srx, rx_entry)	do {} while (0)
+
+#endif
+
 static void util_init_rx_entry(struct util_rx_entry *entry,
 			       const struct iovec *iov, void **desc,
 			       size_t count, fi_addr_t addr, void *context,
@@ -148,8 +327,10 @@ static struct util_rx_entry *util_process_multi_recv(struct util_srx_ctx *srx,
 		return NULL;
 
 	if (util_adjust_multi_recv(srx, &owner_entry->peer_entry,
-				   attr->msg_size))
+				   attr->msg_size)) {
 		slist_remove_head(queue);
+		util_srx_prof_posted(srx, -1);
+	}
 
 	util_entry->peer_entry.owner_context = owner_entry;
 	owner_entry->multi_recv_ref++;
@@ -188,6 +369,7 @@ static int util_match_msg(struct fid_peer_srx *srx,
 			}
 		} else {
 			(void) slist_remove_head(&srx_ctx->msg_queue);
+			util_srx_prof_posted(srx_ctx, -1);
 		}
 		util_entry->peer_entry.srx = srx;
 		srx_ctx->update_func(srx_ctx, util_entry);
@@ -236,6 +418,7 @@ static int util_get_msg(struct fid_peer_srx *srx,
 		}
 	} else {
 		(void) slist_remove_head(queue);
+		util_srx_prof_posted(srx_ctx, -1);
 	}
 	util_entry->peer_entry.srx = srx;
 	srx_ctx->update_func(srx_ctx, util_entry);
@@ -245,7 +428,7 @@ static int util_get_msg(struct fid_peer_srx *srx,
 
 static int util_match_tag(struct fid_peer_srx *srx,
 			  struct fi_peer_match_attr *attr,
-			  struct fi_peer_rx_entry **rx_entry)
+			  struct fi_peer_rx_entry **rx_entry, size_t len)
 {
 	struct util_srx_ctx *srx_ctx;
 	struct util_rx_entry *util_entry;
@@ -254,6 +437,7 @@ static int util_match_tag(struct fid_peer_srx *srx,
 
 	srx_ctx = srx->ep_fid.fid.context;
 	slist_foreach(&srx_ctx->tag_queue, item, prev) {
+		len++;
 		util_entry = container_of(item, struct util_rx_entry,
 					  peer_entry);
 		if (ofi_match_tag(util_entry->peer_entry.tag,
@@ -261,10 +445,13 @@ static int util_match_tag(struct fid_peer_srx *srx,
 			util_entry->peer_entry.srx = srx;
 			srx_ctx->update_func(srx_ctx, util_entry);
 			slist_remove(&srx_ctx->tag_queue, item, prev);
+			util_srx_prof_posted(srx_ctx, -1);
+			util_srx_prof_search(srx_ctx, len);
 			goto out;
 		}
 	}
 
+	util_srx_prof_search(srx_ctx, len);
 	util_entry = util_init_unexp(srx_ctx, attr, FI_TAGGED | FI_RECV);
 	if (!util_entry)
 		return -FI_ENOMEM;
@@ -277,6 +464,99 @@ out:
 	return ret;
 }
 
+static inline struct slist *util_tag_bucket(struct util_srx_ctx *srx,
+					     fi_addr_t addr, uint64_t tag)
+{
+	uint64_t hash;
+
+	hash = (tag ^ (addr * 0x9E3779B97F4A7C15ULL)) * 0xFF51AFD7ED558CCDULL;
+	return &srx->tag_buckets[(hash ^ (hash >> 32)) & srx->tag_bucket_mask];
+}
+
+struct util_tag_match {
+	struct slist		*queue;
+	struct slist_entry	*item;
+	struct slist_entry	*prev;
+	struct util_rx_entry	*rx_entry;
+	size_t			len;
+};
+
+/* Every queue is kept in posting order, so the search stops as soon as
+ * an entry was posted after the best match found in a previous queue.
+ */
+static void util_find_tag(struct slist *queue, fi_addr_t addr, uint64_t tag,
+			  bool exact, struct util_tag_match *match)
+{
+	struct util_rx_entry *util_entry;
+	struct slist_entry *item, *prev;
+
+	slist_foreach(queue, item, prev) {
+		match->len++;
+		util_entry = container_of(item, struct util_rx_entry,
+					  peer_entry);
+		if (match->rx_entry &&
+		    util_entry->seq_no > match->rx_entry->seq_no)
+			return;
+
+		if (exact ? (util_entry->peer_entry.tag == tag &&
+			     util_entry->peer_entry.addr == addr) :
+		    ofi_match_tag(util_entry->peer_entry.tag,
+				  util_entry->ignore, tag)) {
+			match->queue = queue;
+			match->item = item;
+			match->prev = prev;
+			match->rx_entry = util_entry;
+			return;
+		}
+	}
+}
+
+static int util_get_tag_hash(struct fid_peer_srx *srx,
+			     struct fi_peer_match_attr *attr,
+			     struct fi_peer_rx_entry **rx_entry)
+{
+	struct util_srx_ctx *srx_ctx;
+	struct util_tag_match match = {0};
+	struct util_rx_entry *util_entry;
+	struct slist *queue;
+
+	srx_ctx = srx->ep_fid.fid.context;
+
+	util_find_tag(util_tag_bucket(srx_ctx, FI_ADDR_UNSPEC, attr->tag),
+		      FI_ADDR_UNSPEC, attr->tag, true, &match);
+	if (srx_ctx->dir_recv && attr->addr != FI_ADDR_UNSPEC) {
+		util_find_tag(util_tag_bucket(srx_ctx, attr->addr, attr->tag),
+			      attr->addr, attr->tag, true, &match);
+		queue = ofi_array_at(&srx_ctx->src_trecv_queues, attr->addr);
+		if (queue)
+			util_find_tag(queue, attr->addr, attr->tag, false,
+				      &match);
+	}
+	util_find_tag(&srx_ctx->tag_queue, FI_ADDR_UNSPEC, attr->tag, false,
+		      &match);
+	util_srx_prof_search(srx_ctx, match.len);
+
+	if (!match.rx_entry) {
+		util_entry = util_init_unexp(srx_ctx, attr,
+					     FI_TAGGED | FI_RECV);
+		if (!util_entry)
+			return -FI_ENOMEM;
+		util_entry->peer_entry.srx = srx;
+		*rx_entry = &util_entry->peer_entry;
+		return -FI_ENOENT;
+	}
+
+	util_entry = match.rx_entry;
+	slist_remove(match.queue, match.item, match.prev);
+	util_srx_prof_posted(srx_ctx, -1);
+	util_entry->peer_entry.srx = srx;
+	srx_ctx->update_func(srx_ctx, util_entry);
+	util_entry->peer_entry.msg_size = MIN(util_entry->peer_entry.msg_size,
+					      attr->msg_size);
+	*rx_entry = &util_entry->peer_entry;
+	return FI_SUCCESS;
+}
+
 static int util_get_tag(struct fid_peer_srx *srx,
 			struct fi_peer_match_attr *attr,
 			struct fi_peer_rx_entry **rx_entry)
@@ -286,28 +566,34 @@ static int util_get_tag(struct fid_peer_srx *srx,
 	struct slist_entry *any_item, *any_prev;
 	struct slist_entry *item, *prev;
 	struct util_rx_entry *util_entry, *any_entry;
+	size_t len = 0;
 	int ret = FI_SUCCESS;
 
 	srx_ctx = srx->ep_fid.fid.context;
 	assert(ofi_genlock_held(srx_ctx->lock));
 
+	if (srx_ctx->tag_buckets)
+		return util_get_tag_hash(srx, attr, rx_entry);
+
 	queue = attr->addr == FI_ADDR_UNSPEC ? NULL:
 		ofi_array_at(&srx_ctx->src_trecv_queues, attr->addr);
 
 	if (!queue || slist_empty(queue))
-		return util_match_tag(srx, attr, rx_entry);
+		return util_match_tag(srx, attr, rx_entry, 0);
 
 	slist_foreach(queue, item, prev) {
+		len++;
 		util_entry = container_of(item, struct util_rx_entry,
 					  peer_entry);
 		if (ofi_match_tag(util_entry->peer_entry.tag,
 				  util_entry->ignore, attr->tag))
 			goto check_any;
 	}
-	return util_match_tag(srx, attr, rx_entry);
+	return util_match_tag(srx, attr, rx_entry, len);
 
 check_any:
 	slist_foreach(&srx_ctx->tag_queue, any_item, any_prev) {
+		len++;
 		any_entry = container_of(any_item, struct util_rx_entry,
 					 peer_entry);
 		if (any_entry->seq_no > util_entry->seq_no)
@@ -326,6 +612,8 @@ check_any:
 	srx_ctx->update_func(srx_ctx, util_entry);
 	*rx_entry = &util_entry->peer_entry;
 	slist_remove(queue, item, prev);
+	util_srx_prof_posted(srx_ctx, -1);
+	util_srx_prof_search(srx_ctx, len);
 	return ret;
 }
 
@@ -336,6 +624,8 @@ static int util_queue_msg(struct fi_peer_rx_entry *rx_entry)
 
 	assert(ofi_genlock_held(srx_ctx->lock));
 
+	util_srx_prof_queue_unexp(srx_ctx, container_of(rx_entry,
+				  struct util_rx_entry, peer_entry));
 	if (rx_entry->addr == FI_ADDR_UNSPEC) {
 		dlist_insert_tail((struct dlist_entry *) rx_entry,
 				  &srx_ctx->unspec_unexp_msg_queue);
@@ -359,6 +649,8 @@ static int util_queue_tag(struct fi_peer_rx_entry *rx_entry)
 
 	assert(ofi_genlock_held(srx_ctx->lock));
 
+	util_srx_prof_queue_unexp(srx_ctx, container_of(rx_entry,
+				  struct util_rx_entry, peer_entry));
 	if (rx_entry->addr == FI_ADDR_UNSPEC) {
 		dlist_insert_tail((struct dlist_entry *) rx_entry,
 				  &srx_ctx->unspec_unexp_tag_queue);
@@ -486,19 +778,24 @@ static struct util_rx_entry *util_search_unexp_msg(struct util_srx_ctx *srx,
 			dlist_pop_front(&srx->unspec_unexp_msg_queue,
 					struct util_rx_entry, rx_entry,
 					peer_entry);
-			return rx_entry;
+			goto out;
 		}
 
+		rx_entry = NULL;
 		dlist_foreach_container(&srx->unexp_peers,
 				struct util_unexp_peer, unexp_peer, entry) {
 			rx_entry = util_search_peer_msg(unexp_peer);
 			if (rx_entry)
-				return rx_entry;
+				break;
 		}
-		return NULL;
+	} else {
+		rx_entry = util_search_peer_msg(
+				ofi_array_at(&srx->src_unexp_peers, addr));
 	}
-
-	return util_search_peer_msg(ofi_array_at(&srx->src_unexp_peers, addr));
+out:
+	if (rx_entry)
+		util_srx_prof_match_unexp(srx, rx_entry);
+	return rx_entry;
 }
 
 static bool util_unexp_mrecv(struct util_srx_ctx *srx,
@@ -569,13 +866,15 @@ static ssize_t util_generic_mrecv(struct util_srx_ctx *srx,
 	assert(queue);
 	slist_insert_tail((struct slist_entry *)(&mrecv_entry->peer_entry),
 			  queue);
+	util_srx_prof_posted(srx, 1);
 out:
 	ofi_genlock_unlock(srx->lock);
 	return ret;
 }
 
 static struct util_rx_entry *util_search_peer_tag(struct util_unexp_peer *peer,
-				uint64_t tag, uint64_t ignore, bool remove)
+				uint64_t tag, uint64_t ignore, bool remove,
+				size_t *len)
 {
 	struct util_rx_entry *rx_entry;
 	struct slist_entry *item, *prev;
@@ -585,6 +884,7 @@ static struct util_rx_entry *util_search_peer_tag(struct util_unexp_peer *peer,
 		return NULL;
 
 	slist_foreach(&peer->tag_queue, item, prev) {
+		(*len)++;
 		rx_entry = (struct util_rx_entry *) item;
 		if (!ofi_match_tag(tag, ignore, rx_entry->peer_entry.tag))
 			continue;
@@ -604,12 +904,14 @@ static struct util_rx_entry *util_search_peer_tag(struct util_unexp_peer *peer,
 static struct util_rx_entry *util_search_unexp_tag(struct util_srx_ctx *srx,
 		fi_addr_t addr, uint64_t tag, uint64_t ignore, bool remove)
 {
-	struct util_rx_entry *rx_entry;
+	struct util_rx_entry *rx_entry = NULL;
 	struct util_unexp_peer *unexp_peer;
 	struct dlist_entry *entry;
+	size_t len = 0;
 
 	if (addr == FI_ADDR_UNSPEC) {
 		dlist_foreach(&srx->unspec_unexp_tag_queue, entry) {
+			len++;
 			rx_entry = container_of(entry, struct util_rx_entry,
 						peer_entry);
 			if (!ofi_match_tag(tag, ignore,
@@ -619,21 +921,27 @@ static struct util_rx_entry *util_search_unexp_tag(struct util_srx_ctx *srx,
 			if (remove)
 				dlist_remove(entry);
 
-			return rx_entry;
+			goto out;
 		}
 
+		rx_entry = NULL;
 		dlist_foreach_container(&srx->unexp_peers,
 				struct util_unexp_peer, unexp_peer, entry) {
 			rx_entry = util_search_peer_tag(unexp_peer, tag,
-							ignore, remove);
+							ignore, remove, &len);
 			if (rx_entry)
-				return rx_entry;
+				break;
 		}
-		return NULL;
+	} else {
+		rx_entry = util_search_peer_tag(
+				ofi_array_at(&srx->src_unexp_peers, addr),
+				tag, ignore, remove, &len);
 	}
-
-	return util_search_peer_tag(ofi_array_at(&srx->src_unexp_peers, addr),
-				    tag, ignore, remove);
+out:
+	util_srx_prof_search(srx, len);
+	if (rx_entry && remove)
+		util_srx_prof_match_unexp(srx, rx_entry);
+	return rx_entry;
 }
 
 static ssize_t util_srx_peek(struct util_srx_ctx *srx, const struct iovec *iov,
@@ -715,19 +1023,26 @@ ssize_t util_srx_generic_trecv(struct fid_ep *ep_fid, const struct iovec *iov,
 	} else {
 		rx_entry = util_search_unexp_tag(srx, addr, tag, ignore, true);
 		if (!rx_entry) {
-			queue = addr == FI_ADDR_UNSPEC ? &srx->tag_queue:
-				ofi_array_at(&srx->src_trecv_queues, addr);
+			if (srx->tag_buckets && !ignore)
+				queue = util_tag_bucket(srx, addr, tag);
+			else if (addr == FI_ADDR_UNSPEC)
+				queue = &srx->tag_queue;
+			else
+				queue = ofi_array_at(&srx->src_trecv_queues,
+						     addr);
 			assert(queue);
 			rx_entry = util_get_recv_entry(srx, iov, desc,
 						iov_count, addr, context, tag,
 						ignore,
 						flags | FI_TAGGED | FI_RECV);
-			if (!rx_entry)
+			if (!rx_entry) {
 				ret = -FI_ENOMEM;
-			else
+			} else {
 				slist_insert_tail((struct slist_entry *)
 						  (&rx_entry->peer_entry),
 						  queue);
+				util_srx_prof_posted(srx, 1);
+			}
 			goto out;
 		}
 	}
@@ -769,11 +1084,13 @@ ssize_t util_srx_generic_recv(struct fid_ep *ep_fid, const struct iovec *iov,
 		rx_entry = util_get_recv_entry(srx, iov, desc, iov_count, addr,
 					       context, 0, 0,
 					       flags | FI_MSG | FI_RECV);
-		if (!rx_entry)
+		if (!rx_entry) {
 			ret = -FI_ENOMEM;
-		else
+		} else {
 			slist_insert_tail((struct slist_entry *)
 					  (&rx_entry->peer_entry), queue);
+			util_srx_prof_posted(srx, 1);
+		}
 		goto out;
 	}
 
@@ -945,11 +1262,18 @@ int util_srx_close(struct fid *fid)
 	struct util_unexp_peer *unexp_peer;
 	struct util_rx_entry *rx_entry;
 	struct slist_entry *entry;
+	size_t i;
 
 	srx = container_of(fid, struct util_srx_ctx, peer_srx.ep_fid.fid);
 	if (!srx)
 		return -FI_EINVAL;
 
+#ifdef HAVE_FABRIC_PROFILE
+	/* An open profile may be closed concurrently, see
+	 * util_srx_prof_close().
+	 */
+	pthread_mutex_lock(&common_locks.prof_lock);
+#endif
 	ofi_genlock_lock(srx->lock);
 	(void)ofi_array_iter(&srx->src_recv_queues, srx, util_cleanup_queues);
 	(void)ofi_array_iter(&srx->src_trecv_queues, srx, util_cleanup_queues);
@@ -968,6 +1292,10 @@ int util_srx_close(struct fid *fid)
 				          peer_entry));
 	}
 
+	for (i = 0; srx->tag_buckets && i <= srx->tag_bucket_mask; i++)
+		(void) util_cleanup_queues(NULL, &srx->tag_buckets[i], srx);
+	free(srx->tag_buckets);
+
 	while (!dlist_empty(&srx->unspec_unexp_msg_queue)) {
 		dlist_pop_front(&srx->unspec_unexp_msg_queue,
 				struct util_rx_entry, rx_entry, peer_entry);
@@ -1010,21 +1338,169 @@ int util_srx_close(struct fid *fid)
 
 	ofi_array_destroy(&srx->src_unexp_peers);
 
+#ifdef HAVE_FABRIC_PROFILE
+	if (srx->prof)
+		srx->prof->srx = NULL;
+#endif
+
 	ofi_atomic_dec32(&srx->cq->ref);
 	ofi_bufpool_destroy(srx->rx_pool);
 
 	ofi_genlock_unlock(srx->lock);
+#ifdef HAVE_FABRIC_PROFILE
+	pthread_mutex_unlock(&common_locks.prof_lock);
+#endif
 	free(srx);
 
 	return FI_SUCCESS;
 }
 
+#ifdef HAVE_FABRIC_PROFILE
+
+/* The profile and the SRX may be closed in either order.  prof_lock is
+ * held by both close paths, so prof->srx cannot be freed while it is
+ * unlinked here.  Lock order is prof_lock, then srx->lock.
+ */
+static int util_srx_prof_close(struct fid *fid)
+{
+	struct util_srx_prof *prof;
+
+	prof = container_of(fid, struct util_srx_prof,
+			    util_prof.prof_fid.fid);
+	pthread_mutex_lock(&common_locks.prof_lock);
+	if (prof->srx) {
+		ofi_genlock_lock(prof->srx->lock);
+		prof->srx->prof = NULL;
+		ofi_genlock_unlock(prof->srx->lock);
+	}
+	pthread_mutex_unlock(&common_locks.prof_lock);
+
+	ofi_prof_fini(&prof->util_prof);
+	free(prof);
+	return FI_SUCCESS;
+}
+
+static struct fi_ops util_srx_prof_fi_ops = {
+	.size = sizeof(struct fi_ops),
+	.close = util_srx_prof_close,
+	.bind = fi_no_bind,
+	.control = fi_no_control,
+	.ops_open = fi_no_ops_open,
+};
+
+static int util_srx_count_queue(struct ofi_dyn_arr *arr, void *list,
+				void *context)
+{
+	struct slist_entry *item;
+	uint64_t *cnt = context;
+
+	for (item = ((struct slist *) list)->head; item; item = item->next)
+		(*cnt)++;
+	return 0;
+}
+
+/* Queue depths are tracked only while the profile is open, so seed them
+ * from the current queue contents.
+ */
+static void util_srx_prof_count(struct util_srx_ctx *srx,
+				struct util_srx_prof *prof)
+{
+	struct util_unexp_peer *unexp_peer;
+	struct dlist_entry *entry;
+	size_t i;
+
+	assert(ofi_genlock_held(srx->lock));
+	(void) util_srx_count_queue(NULL, &srx->msg_queue, &prof->posted_cnt);
+	(void) util_srx_count_queue(NULL, &srx->tag_queue, &prof->posted_cnt);
+	for (i = 0; srx->tag_buckets && i <= srx->tag_bucket_mask; i++)
+		(void) util_srx_count_queue(NULL, &srx->tag_buckets[i],
+					    &prof->posted_cnt);
+	(void) ofi_array_iter(&srx->src_recv_queues, &prof->posted_cnt,
+			      util_srx_count_queue);
+	(void) ofi_array_iter(&srx->src_trecv_queues, &prof->posted_cnt,
+			      util_srx_count_queue);
+	prof->posted_max = prof->posted_cnt;
+
+	dlist_foreach(&srx->unspec_unexp_msg_queue, entry)
+		prof->unexp_cnt++;
+	dlist_foreach(&srx->unspec_unexp_tag_queue, entry)
+		prof->unexp_cnt++;
+	dlist_foreach_container(&srx->unexp_peers, struct util_unexp_peer,
+				unexp_peer, entry)
+		prof->unexp_cnt += unexp_peer->cnt;
+	prof->unexp_max = prof->unexp_cnt;
+}
+
+static int util_srx_ops_open(struct fid *fid, const char *name,
+			     uint64_t flags, void **ops, void *context)
+{
+	struct util_srx_ctx *srx;
+	struct util_srx_prof *prof;
+	size_t i;
+	int ret;
+
+	if (strcmp(name, "fi_profile_ops"))
+		return -FI_ENOSYS;
+
+	srx = container_of(fid, struct util_srx_ctx, peer_srx.ep_fid.fid);
+	prof = calloc(1, sizeof(*prof));
+	if (!prof)
+		return -FI_ENOMEM;
+
+	prof->util_prof.prov = &core_prov;
+	ret = ofi_prof_init(&prof->util_prof, fid, flags, context,
+			    &ofi_prof_ops, ARRAY_SIZE(util_srx_vars), 0);
+	if (ret) {
+		free(prof);
+		return ret;
+	}
+	prof->util_prof.prof_fid.fid.ops = &util_srx_prof_fi_ops;
+
+	ret = ofi_prof_add_var(&prof->util_prof, FI_VAR_UNEXP_MSG_CNT, NULL,
+			       &prof->unexp_cnt);
+	for (i = 0; !ret && i < ARRAY_SIZE(util_srx_vars); i++) {
+		ret = ofi_prof_add_var(&prof->util_prof,
+				       util_srx_vars[i].desc.id,
+				       (struct fi_profile_desc *)
+				       &util_srx_vars[i].desc,
+				       (char *) prof + util_srx_vars[i].offset);
+	}
+	if (ret)
+		goto err;
+	ofi_prof_add_common_events(&prof->util_prof);
+
+	ofi_genlock_lock(srx->lock);
+	if (srx->prof) {
+		ofi_genlock_unlock(srx->lock);
+		ret = -FI_EALREADY;
+		goto err;
+	}
+	util_srx_prof_count(srx, prof);
+	prof->srx = srx;
+	srx->prof = prof;
+	ofi_genlock_unlock(srx->lock);
+
+	*ops = &prof->util_prof.prof_fid.ops;
+	return FI_SUCCESS;
+
+err:
+	ofi_prof_fini(&prof->util_prof);
+	free(prof);
+	return ret;
+}
+
+#else
+
+#define util_srx_ops_open fi_no_ops_open
+
+#endif
+
 static struct fi_ops util_srx_fid_ops = {
 	.size = sizeof(struct fi_ops),
 	.close = util_srx_close,
 	.bind = util_srx_bind,
 	.control = fi_no_control,
-	.ops_open = fi_no_ops_open,
+	.ops_open = util_srx_ops_open,
 };
 
 static bool util_cancel_recv(struct util_srx_ctx *srx, struct slist *queue,
@@ -1038,6 +1514,7 @@ static bool util_cancel_recv(struct util_srx_ctx *srx, struct slist *queue,
 		rx_entry = container_of(item, struct util_rx_entry, peer_entry);
 		if (rx_entry->peer_entry.context == context) {
 			slist_remove(queue, item, prev);
+			util_srx_prof_posted(srx, -1);
 			util_cancel_entry(srx, flags, rx_entry);
 			return true;
 		}
@@ -1062,6 +1539,7 @@ static int util_cancel_src(struct ofi_dyn_arr *arr, void *list, void *context)
 static ssize_t util_srx_cancel(fid_t ep_fid, void *context)
 {
 	struct util_srx_ctx *srx;
+	size_t i;
 
 	srx = container_of(ep_fid, struct util_srx_ctx, peer_srx.ep_fid);
 
@@ -1070,6 +1548,12 @@ static ssize_t util_srx_cancel(fid_t ep_fid, void *context)
 			     context))
 		goto out;
 
+	for (i = 0; srx->tag_buckets && i <= srx->tag_bucket_mask; i++) {
+		if (util_cancel_recv(srx, &srx->tag_buckets[i],
+				     FI_TAGGED | FI_RECV, context))
+			goto out;
+	}
+
 	if (util_cancel_recv(srx, &srx->msg_queue, FI_MSG | FI_RECV, context))
 		goto out;
 
@@ -1154,6 +1638,7 @@ int util_ep_srx_context(struct util_domain *domain, size_t rx_size,
 {
 	struct util_srx_ctx *srx;
 	struct ofi_bufpool_attr pool_attr = {0};
+	size_t i;
 	int ret = FI_SUCCESS;
 
 	srx = calloc(1, sizeof(*srx));
@@ -1190,6 +1675,20 @@ int util_ep_srx_context(struct util_domain *domain, size_t rx_size,
 		return ret;
 	}
 
+	if (ofi_srx_tag_buckets) {
+		srx->tag_bucket_mask =
+			roundup_power_of_two(ofi_srx_tag_buckets) - 1;
+		srx->tag_buckets = calloc(srx->tag_bucket_mask + 1,
+					  sizeof(*srx->tag_buckets));
+		if (!srx->tag_buckets) {
+			ofi_bufpool_destroy(srx->rx_pool);
+			free(srx);
+			return -FI_ENOMEM;
+		}
+		for (i = 0; i <= srx->tag_bucket_mask; i++)
+			slist_init(&srx->tag_buckets[i]);
+	}
+
 	srx->min_multi_recv_size = default_min_multi_recv;
 	srx->iov_limit = iov_limit;
 	srx->dir_recv = domain->info_domain_caps & FI_DIRECTED_RECV;
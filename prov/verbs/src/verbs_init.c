@@ -803,6 +803,7 @@ VERBS_INI
 #if HAVE_VERBS_DL
 	ofi_mem_init();
 	ofi_hmem_init();
+	ofi_copy_init();
 	ofi_monitors_init();
 #endif
 	ofi_mutex_init(&vrb_init_mutex);
@@ -82,10 +82,14 @@ struct fi_provider core_prov = {
 struct ofi_common_locks common_locks = {
 	.ini_lock = PTHREAD_MUTEX_INITIALIZER,
 	.util_fabric_lock = PTHREAD_MUTEX_INITIALIZER,
+	.prof_lock = PTHREAD_MUTEX_INITIALIZER,
+	.bufpool_mag_lock = PTHREAD_MUTEX_INITIALIZER,
 };
 
 size_t ofi_universe_size = 1024;
 int ofi_av_remove_cleanup;
+size_t ofi_srx_tag_buckets;
+size_t ofi_cq_mpsc_size;
 char *ofi_offload_coll_prov_name = NULL;
 
 
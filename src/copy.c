@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <ofi_mem.h>
+
+/*
+ * Copy kernels.  This file only depends on inline helpers so that it can
+ * be linked into util/fi_copy_bench as well as libfabric.
+ */
+
+static bool copy_memcpy_supported(void)
+{
+	return true;
+}
+
+static void copy_memcpy(void *dest, const void *src, size_t len)
+{
+	memcpy(dest, src, len);
+}
+
+#if defined(HAVE_CPUID) && (defined(__x86_64__) || defined(__amd64__)) && \
+    defined(__GNUC__)
+
+#include <immintrin.h>
+
+/* Prefetch the source this many bytes ahead of the loads. */
+#define COPY_PREFETCH_DIST	1024
+
+/* XCR0 state that the OS must save for the AVX registers to be usable. */
+#define COPY_XCR0_YMM		0x06
+#define COPY_XCR0_ZMM		0xe6
+
+static bool copy_cpu_supports(unsigned reg, unsigned bit, unsigned xcr0)
+{
+	unsigned cpuinfo[4] = { 0 };
+	unsigned lo, hi;
+
+	ofi_cpuid(0, 0, cpuinfo);
+	if (cpuinfo[0] < 7)
+		return false;
+
+	ofi_cpuid(1, 0, cpuinfo);
+	if (!(cpuinfo[OFI_OSXSAVE_REG] & OFI_OSXSAVE_BIT))
+		return false;
+
+	asm volatile("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+	if ((lo & xcr0) != xcr0)
+		return false;
+
+	ofi_cpuid(7, 0, cpuinfo);
+	return cpuinfo[reg] & bit;
+}
+
+static bool copy_avx2_supported(void)
+{
+	return copy_cpu_supports(OFI_AVX2_REG, OFI_AVX2_BIT, COPY_XCR0_YMM);
+}
+
+static bool copy_avx512_supported(void)
+{
+	return copy_cpu_supports(OFI_AVX512F_REG, OFI_AVX512F_BIT,
+				 COPY_XCR0_ZMM);
+}
+
+/*
+ * Both kernels copy up to the first destination alignment boundary with
+ * memcpy, stream four vectors per iteration with the source prefetched
+ * ahead, then finish the tail with memcpy.  The sfence orders the
+ * streaming stores before any following store, such as a flag telling a
+ * peer that the data is ready.
+ */
+__attribute__((target("avx2")))
+static void copy_avx2(void *dest, const void *src, size_t len)
+{
+	char *d = dest;
+	const char *s = src;
+	__m256i v0, v1, v2, v3;
+	size_t head;
+
+	head = MIN((size_t) (-(uintptr_t) d & 31), len);
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	len -= head;
+
+	for (; len >= 128; len -= 128, d += 128, s += 128) {
+		_mm_prefetch(s + COPY_PREFETCH_DIST, _MM_HINT_NTA);
+		_mm_prefetch(s + COPY_PREFETCH_DIST + 64, _MM_HINT_NTA);
+		v0 = _mm256_loadu_si256((const __m256i *) s);
+		v1 = _mm256_loadu_si256((const __m256i *) (s + 32));
+		v2 = _mm256_loadu_si256((const __m256i *) (s + 64));
+		v3 = _mm256_loadu_si256((const __m256i *) (s + 96));
+		_mm256_stream_si256((__m256i *) d, v0);
+		_mm256_stream_si256((__m256i *) (d + 32), v1);
+		_mm256_stream_si256((__m256i *) (d + 64), v2);
+		_mm256_stream_si256((__m256i *) (d + 96), v3);
+	}
+	_mm_sfence();
+	memcpy(d, s, len);
+}
+
+__attribute__((target("avx512f")))
+static void copy_avx512(void *dest, const void *src, size_t len)
+{
+	char *d = dest;
+	const char *s = src;
+	__m512i v0, v1, v2, v3;
+	size_t head;
+
+	head = MIN((size_t) (-(uintptr_t) d & 63), len);
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	len -= head;
+
+	for (; len >= 256; len -= 256, d += 256, s += 256) {
+		_mm_prefetch(s + COPY_PREFETCH_DIST, _MM_HINT_NTA);
+		_mm_prefetch(s + COPY_PREFETCH_DIST + 64, _MM_HINT_NTA);
+		_mm_prefetch(s + COPY_PREFETCH_DIST + 128, _MM_HINT_NTA);
+		_mm_prefetch(s + COPY_PREFETCH_DIST + 192, _MM_HINT_NTA);
+		v0 = _mm512_loadu_si512((const void *) s);
+		v1 = _mm512_loadu_si512((const void *) (s + 64));
+		v2 = _mm512_loadu_si512((const void *) (s + 128));
+		v3 = _mm512_loadu_si512((const void *) (s + 192));
+		_mm512_stream_si512((void *) d, v0);
+		_mm512_stream_si512((void *) (d + 64), v1);
+		_mm512_stream_si512((void *) (d + 128), v2);
+		_mm512_stream_si512((void *) (d + 192), v3);
+	}
+	_mm_sfence();
+	memcpy(d, s, len);
+}
+
+const struct ofi_copy_kernel ofi_copy_kernels[] = {
+	{ "avx512", copy_avx512_supported, copy_avx512 },
+	{ "avx2", copy_avx2_supported, copy_avx2 },
+	{ "memcpy", copy_memcpy_supported, copy_memcpy },
+	{ NULL },
+};
+
+#else
+
+const struct ofi_copy_kernel ofi_copy_kernels[] = {
+	{ "memcpy", copy_memcpy_supported, copy_memcpy },
+	{ NULL },
+};
+
+#endif
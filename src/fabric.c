@@ -481,6 +481,7 @@ static void ofi_ordered_provs_init(void)
 		 */
 		"ofi_hook_perf", "ofi_hook_trace", "ofi_hook_profile", "ofi_hook_debug",
 		"ofi_hook_noop", "ofi_hook_hmem", "ofi_hook_dmabuf_peer_mem",
+		"ofi_hook_latency", "ofi_hook_bintrace", "ofi_hook_stats",
 
 		/* So do the offload providers. */
 		"off_coll",
@@ -935,6 +936,7 @@ void fi_ini(void)
 	ofi_osd_init();
 	ofi_mem_init();
 	ofi_pmem_init();
+	ofi_copy_init();
 	ofi_perf_init();
 	ofi_hook_init();
 	ofi_hmem_init();
@@ -969,6 +971,26 @@ void fi_ini(void)
 			"(default: false)");
 	fi_param_get_bool(NULL, "av_remove_cleanup", &ofi_av_remove_cleanup);
 
+	fi_param_define(NULL, "srx_tag_buckets", FI_PARAM_SIZE_T,
+			"Number of hash buckets used by the shared receive "
+			"context to match tagged receives that do not set any "
+			"ignore bits.  Receives using ignore bits are still "
+			"matched in posting order against hashed receives.  "
+			"The value is rounded up to a power of 2.  A value of "
+			"0 selects list based matching only (default: 0)");
+	fi_param_get_size_t(NULL, "srx_tag_buckets", &ofi_srx_tag_buckets);
+
+	fi_param_define(NULL, "cq_mpsc_size", FI_PARAM_SIZE_T,
+			"Number of entries in a lock-free queue placed in "
+			"front of completion queues of thread safe domains.  "
+			"Completions are added to it without taking the CQ "
+			"lock and are moved to the CQ when it is read.  When "
+			"the queue is full, writers fall back to locking the "
+			"CQ.  Only applies to providers built on the utility "
+			"CQ.  The value is rounded up to a power of 2.  A "
+			"value of 0 disables the queue (default: 0)");
+	fi_param_get_size_t(NULL, "cq_mpsc_size", &ofi_cq_mpsc_size);
+
 	fi_param_define(NULL, "offload_coll_provider", FI_PARAM_STRING,
 			"The name of a colective offload provider (default: \
 			empty - no provider)");
@@ -1000,6 +1022,9 @@ void fi_ini(void)
 	ofi_register_provider(HOOK_TRACE_INIT, NULL);
 	ofi_register_provider(HOOK_PROFILE_INIT, NULL);
 	ofi_register_provider(HOOK_DEBUG_INIT, NULL);
+	ofi_register_provider(HOOK_LATENCY_INIT, NULL);
+	ofi_register_provider(HOOK_BINTRACE_INIT, NULL);
+	ofi_register_provider(HOOK_STATS_INIT, NULL);
 	ofi_register_provider(HOOK_HMEM_INIT, NULL);
 	ofi_register_provider(HOOK_DMABUF_PEER_MEM_INIT, NULL);
 	ofi_register_provider(HOOK_NOOP_INIT, NULL);
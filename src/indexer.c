@@ -115,9 +115,8 @@ void *ofi_idx_remove(struct indexer *idx, int index)
 
 void *ofi_idx_remove_ordered(struct indexer *idx, int index)
 {
-	struct ofi_idx_entry *chunk;
+	struct ofi_idx_entry *chunk, *prev;
 	void *item;
-	int temp_index;
 	int offset = ofi_idx_offset(index);
 
 	chunk = ofi_idx_chunk(idx, index);
@@ -128,12 +127,15 @@ void *ofi_idx_remove_ordered(struct indexer *idx, int index)
 		idx->free_list = index;
 		return item;
 	}
-	temp_index = idx->free_list;
-	while (chunk[ofi_idx_offset(temp_index)].next < index) {
-		temp_index = chunk[ofi_idx_offset(temp_index)].next;
-	}
-	chunk[offset].next = chunk[ofi_idx_offset(temp_index)].next;
-	chunk[ofi_idx_offset(temp_index)].next = index;
+
+	/* The free list may span chunks and ends with index 0. */
+	prev = ofi_idx_chunk(idx, idx->free_list) +
+	       ofi_idx_offset(idx->free_list);
+	while (prev->next && prev->next < index)
+		prev = ofi_idx_chunk(idx, prev->next) +
+		       ofi_idx_offset(prev->next);
+	chunk[offset].next = prev->next;
+	prev->next = index;
 
 	return item;
 }
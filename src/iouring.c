@@ -35,6 +35,7 @@
 
 #include <liburing.h>
 
+#include <ofi_mem.h>
 #include <ofi_net.h>
 
 int ofi_sockapi_connect_uring(struct ofi_sockapi *sockapi, SOCKET sock,
@@ -139,7 +140,7 @@ ssize_t ofi_sockapi_recv_uring(struct ofi_sockapi *sockapi, SOCKET sock,
 	struct ofi_sockapi_uring *uring;
 
 	uring = &sockapi->rx_uring;
-	if (ctx->uring_sqe_inuse || uring->credits == 0)
+	if (ctx->uring_sqe_inuse || ctx->uring_mshot || uring->credits == 0)
 		return -FI_EAGAIN;
 
 	sqe = io_uring_get_sqe(uring->io_uring);
@@ -161,7 +162,7 @@ ssize_t ofi_sockapi_recvv_uring(struct ofi_sockapi *sockapi, SOCKET sock,
 	struct ofi_sockapi_uring *uring;
 
 	uring = &sockapi->rx_uring;
-	if (ctx->uring_sqe_inuse || uring->credits == 0)
+	if (ctx->uring_sqe_inuse || ctx->uring_mshot || uring->credits == 0)
 		return -FI_EAGAIN;
 
 	sqe = io_uring_get_sqe(uring->io_uring);
@@ -221,6 +222,123 @@ int ofi_sockctx_uring_poll_add(struct ofi_sockapi_uring *uring,
 	return -OFI_EINPROGRESS_URING;
 }
 
+#if HAVE_DECL_IO_URING_PREP_RECV_MULTISHOT
+int ofi_sockctx_uring_recv_multishot(struct ofi_sockapi_uring *uring,
+				     int fd, struct ofi_uring_buf_ring *buf_ring,
+				     struct ofi_sockctx *ctx)
+{
+	struct io_uring_sqe *sqe;
+
+	if (ctx->uring_sqe_inuse || uring->credits == 0)
+		return -FI_EAGAIN;
+
+	sqe = io_uring_get_sqe(uring->io_uring);
+	if (!sqe)
+		return -FI_EOVERFLOW;
+
+	io_uring_prep_recv_multishot(sqe, fd, NULL, 0, 0);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = buf_ring->bgid;
+	io_uring_sqe_set_data(sqe, ctx);
+	ctx->uring_sqe_inuse = true;
+	uring->credits--;
+	return -OFI_EINPROGRESS_URING;
+}
+
+int ofi_uring_buf_ring_init(ofi_io_uring_t *io_uring,
+			    struct ofi_uring_buf_ring *buf_ring,
+			    uint16_t bgid, unsigned int count, size_t buf_size)
+{
+	struct io_uring_buf_reg reg;
+	struct io_uring_buf_ring *br;
+	unsigned int i;
+	int ret;
+
+	/* The kernel requires a power of 2 number of ring entries */
+	if (!count || count > (1 << 15) || (count & (count - 1)) || !buf_size)
+		return -FI_EINVAL;
+
+	ret = ofi_memalign((void **) &br, ofi_get_page_size(),
+			   count * sizeof(struct io_uring_buf));
+	if (ret)
+		return -FI_ENOMEM;
+
+	buf_ring->bufs = malloc(count * buf_size);
+	if (!buf_ring->bufs) {
+		ret = -FI_ENOMEM;
+		goto free_ring;
+	}
+
+	io_uring_buf_ring_init(br);
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uintptr_t) br;
+	reg.ring_entries = count;
+	reg.bgid = bgid;
+	ret = io_uring_register_buf_ring(io_uring, &reg, 0);
+	if (ret)
+		goto free_bufs;
+
+	buf_ring->ring = br;
+	buf_ring->buf_size = buf_size;
+	buf_ring->count = count;
+	buf_ring->bgid = bgid;
+	for (i = 0; i < count; i++) {
+		io_uring_buf_ring_add(br, ofi_uring_buf_ring_buf(buf_ring, i),
+				      buf_size, i, count - 1, i);
+	}
+	io_uring_buf_ring_advance(br, count);
+	return 0;
+
+free_bufs:
+	free(buf_ring->bufs);
+free_ring:
+	ofi_freealign(br);
+	return ret;
+}
+
+void ofi_uring_buf_ring_destroy(ofi_io_uring_t *io_uring,
+				struct ofi_uring_buf_ring *buf_ring)
+{
+	(void) io_uring_unregister_buf_ring(io_uring, buf_ring->bgid);
+	ofi_freealign(buf_ring->ring);
+	free(buf_ring->bufs);
+}
+
+void ofi_uring_buf_ring_recycle(struct ofi_uring_buf_ring *buf_ring,
+				uint16_t bid)
+{
+	struct io_uring_buf_ring *br = buf_ring->ring;
+
+	io_uring_buf_ring_add(br, ofi_uring_buf_ring_buf(buf_ring, bid),
+			      buf_ring->buf_size, bid, buf_ring->count - 1, 0);
+	io_uring_buf_ring_advance(br, 1);
+}
+#else
+int ofi_sockctx_uring_recv_multishot(struct ofi_sockapi_uring *uring,
+				     int fd, struct ofi_uring_buf_ring *buf_ring,
+				     struct ofi_sockctx *ctx)
+{
+	return -FI_ENOSYS;
+}
+
+int ofi_uring_buf_ring_init(ofi_io_uring_t *io_uring,
+			    struct ofi_uring_buf_ring *buf_ring,
+			    uint16_t bgid, unsigned int count, size_t buf_size)
+{
+	return -FI_ENOSYS;
+}
+
+void ofi_uring_buf_ring_destroy(ofi_io_uring_t *io_uring,
+				struct ofi_uring_buf_ring *buf_ring)
+{
+}
+
+void ofi_uring_buf_ring_recycle(struct ofi_uring_buf_ring *buf_ring,
+				uint16_t bid)
+{
+}
+#endif
+
 int ofi_uring_init(ofi_io_uring_t *io_uring, size_t entries)
 {
 	struct io_uring_params params;
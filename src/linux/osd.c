@@ -146,6 +146,91 @@ ssize_t ofi_get_hugepage_size(void)
 	return val * 1024;
 }
 
+/* Avoid a dependency on libnuma for the few calls needed. */
+#define OFI_MPOL_PREFERRED	1
+#define OFI_NUMA_MAX_NODES	1024
+
+int ofi_numa_node(void)
+{
+	unsigned cpu, node;
+
+	if (syscall(__NR_getcpu, &cpu, &node, NULL))
+		return -ofi_syserr();
+
+	return (int) node;
+}
+
+/*
+ * Prefer, rather than require, the given node so that allocations still
+ * succeed when the node runs out of memory.  Only pages that have not
+ * been touched yet are placed according to the policy.
+ */
+int ofi_numa_bind(void *addr, size_t len, int node)
+{
+	unsigned long mask[OFI_NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+	size_t bits = 8 * sizeof(unsigned long);
+
+	if (node < 0 || node >= OFI_NUMA_MAX_NODES)
+		return -FI_EINVAL;
+
+	memset(mask, 0, sizeof(mask));
+	mask[node / bits] = 1UL << (node % bits);
+	if (syscall(__NR_mbind, addr, len, OFI_MPOL_PREFERRED, mask,
+		    OFI_NUMA_MAX_NODES + 1, 0))
+		return -ofi_syserr();
+
+	return 0;
+}
+
+static int ofi_sysfs_numa_node(const char *path)
+{
+	FILE *file;
+	int node;
+
+	file = fopen(path, "r");
+	if (!file)
+		return -FI_ENOENT;
+
+	if (fscanf(file, "%d", &node) != 1)
+		node = -1;
+	fclose(file);
+
+	/* The kernel reports -1 when the device is not tied to a node. */
+	return node < 0 ? -FI_ENODATA : node;
+}
+
+int ofi_nic_numa_node(const struct fid_nic *nic)
+{
+	const struct fi_pci_attr *pci;
+	char path[PATH_MAX];
+	int ret;
+
+	if (!nic)
+		return -FI_EINVAL;
+
+	if (nic->bus_attr && nic->bus_attr->bus_type == FI_BUS_PCI) {
+		pci = &nic->bus_attr->attr.pci;
+		snprintf(path, sizeof(path),
+			 "/sys/bus/pci/devices/%04x:%02x:%02x.%x/numa_node",
+			 pci->domain_id, pci->bus_id, pci->device_id,
+			 pci->function_id);
+		return ofi_sysfs_numa_node(path);
+	}
+
+	if (!nic->device_attr || !nic->device_attr->name)
+		return -FI_ENODATA;
+
+	snprintf(path, sizeof(path), "/sys/class/infiniband/%s/device/numa_node",
+		 nic->device_attr->name);
+	ret = ofi_sysfs_numa_node(path);
+	if (ret != -FI_ENOENT)
+		return ret;
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node",
+		 nic->device_attr->name);
+	return ofi_sysfs_numa_node(path);
+}
+
 #ifdef HAVE_ETHTOOL
 
 #if HAVE_DECL_ETHTOOL_CMD_SPEED
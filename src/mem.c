@@ -175,3 +175,49 @@ void ofi_pmem_init(void)
 	if (ofi_pmem_commit)
 		OFI_RMA_PMEM = FI_RMA_PMEM;
 }
+
+size_t ofi_copy_nt_threshold = SIZE_MAX;
+void (*ofi_copy_nt)(void *dest, const void *src, size_t len) = NULL;
+
+void ofi_copy_init(void)
+{
+	const struct ofi_copy_kernel *kernel;
+	size_t threshold = 0;
+	char *name = NULL;
+
+	fi_param_define(NULL, "copy_nt_threshold", FI_PARAM_SIZE_T,
+			"Copies of at least this many bytes made by the shm "
+			"provider and the utility iov copy routines use "
+			"non-temporal stores, which avoid polluting the "
+			"copying CPU's cache (default: 0, disabled)");
+	fi_param_define(NULL, "copy_kernel", FI_PARAM_STRING,
+			"Copy kernel used above FI_COPY_NT_THRESHOLD: "
+			"avx512, avx2, or memcpy (default: best supported)");
+	fi_param_get_size_t(NULL, "copy_nt_threshold", &threshold);
+	fi_param_get_str(NULL, "copy_kernel", &name);
+
+	if (!threshold)
+		return;
+
+	for (kernel = ofi_copy_kernels; kernel->name; kernel++) {
+		if (name && strcasecmp(name, kernel->name))
+			continue;
+		if (kernel->supported())
+			break;
+	}
+
+	if (!kernel->name) {
+		FI_WARN(&core_prov, FI_LOG_CORE,
+			"copy kernel %s not supported\n", name);
+		return;
+	}
+
+	if (!strcmp(kernel->name, "memcpy"))
+		return;
+
+	FI_INFO(&core_prov, FI_LOG_CORE,
+		"using %s copy kernel for copies of %zu bytes or more\n",
+		kernel->name, threshold);
+	ofi_copy_nt = kernel->copy;
+	ofi_copy_nt_threshold = threshold;
+}
@@ -204,6 +204,8 @@ static BOOL CALLBACK ofi_init_once_cb(PINIT_ONCE once, void* data, void** ctx)
 
 	InitializeCriticalSection(&locks->ini_lock);
 	InitializeCriticalSection(&locks->util_fabric_lock);
+	InitializeCriticalSection(&locks->prof_lock);
+	InitializeCriticalSection(&locks->bufpool_mag_lock);
 
 	return TRUE;
 }
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Converts a trace file written by the bintrace hook to the Chrome trace
+ * event JSON format, which can be loaded by Perfetto or chrome://tracing.
+ * Every call becomes a complete event on the thread that made it.
+ * Operations that generate a completion are also shown as async events,
+ * from posting until their completion was read from the CQ.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "uthash.h"
+#include "hook_bintrace.h"
+
+#define BT_STR(X) #X
+static const char * const bt_api_names[] = {
+	BT_APIS(BT_STR)
+};
+
+/* Skip the "bt_" prefix */
+#define bt_api_name(api) (bt_api_names[api] + 3)
+
+struct bt_op {
+	uint64_t	context;
+	uint32_t	api;
+	UT_hash_handle	hh;
+};
+
+struct bt_cursor {
+	struct bt_ring	*ring;
+	uint64_t	seq;
+	uint64_t	head;
+};
+
+static const struct bt_hdr *hdr;
+static double ns_per_tick = 1.0;
+static struct bt_op *ops;
+static FILE *out;
+static bool first = true;
+
+static void usage(const char *argv0)
+{
+	printf("Usage: %s [-o OUTPUT] TRACE_FILE\n", argv0);
+	printf("\n");
+	printf("Converts a trace file written by the bintrace hook provider\n");
+	printf("to Chrome trace event JSON, for Perfetto or chrome://tracing.\n");
+	printf("\n");
+	printf("  -o OUTPUT  write the JSON to OUTPUT instead of stdout\n");
+}
+
+static double bt_us(uint64_t ticks)
+{
+	return (int64_t) (ticks - hdr->ticks[0]) * ns_per_tick / 1000;
+}
+
+static void bt_begin_event(void)
+{
+	fprintf(out, first ? "\n" : ",\n");
+	first = false;
+}
+
+static void bt_async(const char *ph, uint32_t api, int32_t tid,
+		     const struct bt_event *event, uint64_t ticks)
+{
+	bt_begin_event();
+	fprintf(out, "{\"name\":\"%s\",\"cat\":\"op\",\"ph\":\"%s\","
+		"\"id\":\"0x%" PRIx64 "\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f}",
+		bt_api_name(api), ph, event->context, hdr->pid, tid,
+		bt_us(ticks));
+}
+
+static void bt_post(int32_t tid, const struct bt_event *event)
+{
+	struct bt_op *op;
+
+	HASH_FIND(hh, ops, &event->context, sizeof(event->context), op);
+	if (!op) {
+		op = calloc(1, sizeof(*op));
+		if (!op)
+			return;
+		op->context = event->context;
+		HASH_ADD(hh, ops, context, sizeof(op->context), op);
+	} else {
+		/* The context was reused before its completion was read */
+		bt_async("e", op->api, tid, event, event->start);
+	}
+	op->api = event->api;
+	bt_async("b", op->api, tid, event, event->start);
+}
+
+static void bt_comp(int32_t tid, const struct bt_event *event)
+{
+	struct bt_op *op;
+
+	HASH_FIND(hh, ops, &event->context, sizeof(event->context), op);
+	if (!op)
+		return;
+
+	bt_async("e", op->api, tid, event, event->end);
+	HASH_DEL(ops, op);
+	free(op);
+}
+
+static void bt_convert(int32_t tid, const struct bt_event *event)
+{
+	if (event->api >= bt_api_max)
+		return;
+
+	if (event->api == bt_cq_comp) {
+		bt_begin_event();
+		fprintf(out, "{\"name\":\"completion\",\"cat\":\"cq\","
+			"\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,"
+			"\"ts\":%.3f,\"args\":{\"cq\":\"0x%" PRIx64 "\","
+			"\"context\":\"0x%" PRIx64 "\",\"len\":%" PRIu64 ","
+			"\"tag\":\"0x%" PRIx64 "\",\"err\":%" PRId64 "}}",
+			hdr->pid, tid, bt_us(event->end), event->fid,
+			event->context, event->len, event->tag, -event->ret);
+		if (event->context)
+			bt_comp(tid, event);
+		return;
+	}
+
+	bt_begin_event();
+	fprintf(out, "{\"name\":\"%s\",\"cat\":\"api\",\"ph\":\"X\","
+		"\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+		"\"args\":{\"fid\":\"0x%" PRIx64 "\",\"context\":\"0x%" PRIx64
+		"\",\"len\":%" PRIu64 ",\"tag\":\"0x%" PRIx64 "\","
+		"\"ret\":%" PRId64 "}}",
+		bt_api_name(event->api), hdr->pid, tid, bt_us(event->start),
+		bt_us(event->end) - bt_us(event->start), event->fid,
+		event->context, event->len, event->tag, event->ret);
+
+	if (bt_api_posted(event->api) && !event->ret && event->context)
+		bt_post(tid, event);
+}
+
+/* Merge the events of all rings in time order */
+static int bt_merge(void)
+{
+	struct bt_cursor *cursors;
+	struct bt_event *event, *next;
+	uint32_t i, min;
+	uint64_t wrapped = 0;
+
+	cursors = calloc(hdr->ring_used, sizeof(*cursors));
+	if (!cursors)
+		return -ENOMEM;
+
+	for (i = 0; i < hdr->ring_used; i++) {
+		cursors[i].ring = bt_ring(hdr, i);
+		cursors[i].head = cursors[i].ring->head;
+		if (cursors[i].head > hdr->ring_events) {
+			cursors[i].seq = cursors[i].head - hdr->ring_events;
+			wrapped += cursors[i].seq;
+		}
+	}
+
+	for (;;) {
+		event = NULL;
+		for (i = 0, min = 0; i < hdr->ring_used; i++) {
+			if (cursors[i].seq == cursors[i].head)
+				continue;
+			next = bt_ring_event(hdr, cursors[i].ring,
+					     cursors[i].seq);
+			if (!event || next->start < event->start) {
+				event = next;
+				min = i;
+			}
+		}
+		if (!event)
+			break;
+
+		bt_convert(cursors[min].ring->tid, event);
+		cursors[min].seq++;
+	}
+
+	if (wrapped)
+		fprintf(stderr, "%" PRIu64 " older events were overwritten\n",
+			wrapped);
+	if (hdr->dropped)
+		fprintf(stderr, "%" PRIu64 " events of untraced threads were "
+			"dropped\n", hdr->dropped);
+	free(cursors);
+	return 0;
+}
+
+static int bt_check(size_t size)
+{
+	if (size < BT_HDR_SIZE || hdr->magic != BT_MAGIC) {
+		fprintf(stderr, "not a bintrace file\n");
+		return -EINVAL;
+	}
+	if (hdr->version != BT_VERSION ||
+	    hdr->event_size != sizeof(struct bt_event)) {
+		fprintf(stderr, "unsupported trace version %u\n",
+			hdr->version);
+		return -EINVAL;
+	}
+	if (!hdr->ring_events ||
+	    (hdr->ring_events & (hdr->ring_events - 1)) ||
+	    hdr->ring_used > hdr->ring_cnt ||
+	    size < BT_HDR_SIZE + hdr->ring_cnt * bt_ring_size(hdr)) {
+		fprintf(stderr, "trace file is truncated or corrupt\n");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bt_op *op, *tmp;
+	struct stat st;
+	void *map;
+	int op_char, fd, ret;
+
+	out = stdout;
+	while ((op_char = getopt(argc, argv, "o:h")) != -1) {
+		switch (op_char) {
+		case 'o':
+			out = fopen(optarg, "w");
+			if (!out) {
+				perror(optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return EXIT_FAILURE;
+	}
+
+	hdr = map;
+	ret = bt_check(st.st_size);
+	if (ret)
+		goto out;
+
+	if (hdr->ticks[1] > hdr->ticks[0] && hdr->ns[1] > hdr->ns[0])
+		ns_per_tick = (double) (hdr->ns[1] - hdr->ns[0]) /
+			      (hdr->ticks[1] - hdr->ticks[0]);
+
+	fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	ret = bt_merge();
+	fprintf(out, "\n]}\n");
+
+	HASH_ITER(hh, ops, op, tmp) {
+		HASH_DEL(ops, op);
+		free(op);
+	}
+out:
+	munmap(map, st.st_size);
+	if (out != stdout)
+		fclose(out);
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
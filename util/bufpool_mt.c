@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under the BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Stresses OFI_BUFPOOL_MAGAZINE pools from multiple threads.  Every
+ * thread allocates buffers, stamps them with its id, and frees half of
+ * them itself.  The other half is handed to other threads through a
+ * shared stack, so buffers move between magazines.  The stamp is cleared
+ * on free, so a buffer allocated with a stamp, or freed without one, was
+ * handed out twice.  Once
+ * all threads are done, they exit while the pool is destroyed, which
+ * races with the destructors that release their magazines.
+ */
+
+#include "config.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ofi_mem.h>
+
+static size_t thread_cnt = 8;
+static size_t iter_cnt = 100;
+static size_t alloc_cnt = 10000;
+static size_t batch_cnt = 64;
+
+static struct ofi_bufpool *pool;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static size_t done_cnt;
+static bool drained;
+static bool released;
+static void **shared;
+static size_t shared_cnt;
+static size_t errors;
+
+static void usage(char *name)
+{
+	printf("usage: %s [OPTIONS]\n", name);
+	printf("  -t count  number of threads (default: %zu)\n", thread_cnt);
+	printf("  -i count  number of pools created (default: %zu)\n",
+	       iter_cnt);
+	printf("  -c count  allocations per thread and pool (default: %zu)\n",
+	       alloc_cnt);
+	printf("  -h        display this help\n");
+}
+
+static void put_shared(void *buf)
+{
+	pthread_mutex_lock(&lock);
+	shared[shared_cnt++] = buf;
+	pthread_mutex_unlock(&lock);
+}
+
+static void *get_shared(void)
+{
+	void *buf = NULL;
+
+	pthread_mutex_lock(&lock);
+	if (shared_cnt)
+		buf = shared[--shared_cnt];
+	pthread_mutex_unlock(&lock);
+	return buf;
+}
+
+static void init_buf(struct ofi_bufpool_region *region, void *buf)
+{
+	OFI_UNUSED(region);
+	*(uintptr_t *) buf = 0;
+}
+
+static void check_stamp(void *buf, uintptr_t stamp)
+{
+	if ((*(uintptr_t *) buf == 0) == (stamp == 0)) {
+		pthread_mutex_lock(&lock);
+		errors++;
+		pthread_mutex_unlock(&lock);
+	}
+	*(uintptr_t *) buf = stamp;
+}
+
+static void free_buf(void *buf)
+{
+	check_stamp(buf, 0);
+	ofi_buf_free(buf);
+}
+
+static void *run(void *arg)
+{
+	uintptr_t id = (uintptr_t) arg;
+	void *bufs[64], *buf;
+	size_t i, j;
+
+	for (i = 0; i < alloc_cnt; i += batch_cnt) {
+		for (j = 0; j < batch_cnt; j++) {
+			bufs[j] = ofi_buf_alloc(pool);
+			if (!bufs[j])
+				break;
+			check_stamp(bufs[j], id);
+		}
+
+		while (j--) {
+			if (j & 1)
+				free_buf(bufs[j]);
+			else
+				put_shared(bufs[j]);
+		}
+
+		while ((buf = get_shared()))
+			free_buf(buf);
+	}
+
+	/* The last thread frees what is left. */
+	pthread_mutex_lock(&lock);
+	if (++done_cnt == thread_cnt) {
+		pthread_mutex_unlock(&lock);
+		while ((buf = get_shared()))
+			free_buf(buf);
+		pthread_mutex_lock(&lock);
+		drained = true;
+		pthread_cond_broadcast(&cond);
+	}
+
+	/* Exit, and release the magazine, as the pool is destroyed. */
+	while (!released)
+		pthread_cond_wait(&cond, &lock);
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ofi_bufpool_attr attr = {
+		.size = sizeof(uintptr_t),
+		.flags = OFI_BUFPOOL_MAGAZINE,
+		.init_fn = init_buf,
+		.magazine_size = 8,
+	};
+	pthread_t *threads;
+	size_t i, iter;
+	int op;
+
+	while ((op = getopt(argc, argv, "t:i:c:h")) != -1) {
+		switch (op) {
+		case 't':
+			thread_cnt = strtoull(optarg, NULL, 0);
+			break;
+		case 'i':
+			iter_cnt = strtoull(optarg, NULL, 0);
+			break;
+		case 'c':
+			alloc_cnt = strtoull(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!thread_cnt) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	threads = calloc(thread_cnt, sizeof(*threads));
+	shared = calloc(thread_cnt * batch_cnt, sizeof(*shared));
+	if (!threads || !shared) {
+		printf("ERROR: unable to allocate thread state\n");
+		return EXIT_FAILURE;
+	}
+
+	ofi_mem_init();
+	for (iter = 0; iter < iter_cnt && !errors; iter++) {
+		if (ofi_bufpool_create_attr(&attr, &pool)) {
+			printf("ERROR: unable to create pool\n");
+			return EXIT_FAILURE;
+		}
+
+		done_cnt = 0;
+		drained = false;
+		released = false;
+		for (i = 0; i < thread_cnt; i++) {
+			if (pthread_create(&threads[i], NULL, run,
+					   (void *) (i + 1))) {
+				printf("ERROR: unable to start thread\n");
+				return EXIT_FAILURE;
+			}
+		}
+
+		pthread_mutex_lock(&lock);
+		while (!drained)
+			pthread_cond_wait(&cond, &lock);
+		released = true;
+		pthread_cond_broadcast(&cond);
+		pthread_mutex_unlock(&lock);
+		ofi_bufpool_destroy(pool);
+
+		for (i = 0; i < thread_cnt; i++)
+			pthread_join(threads[i], NULL);
+	}
+	ofi_mem_fini();
+
+	free(threads);
+	free(shared);
+	if (errors) {
+		printf("ERROR: %zu buffers were handed out twice\n", errors);
+		return EXIT_FAILURE;
+	}
+	printf("%zu pools, %zu threads, %zu allocations each: passed\n",
+	       iter_cnt, thread_cnt, alloc_cnt);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under the BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Checks where the kernel placed the memory of OFI_BUFPOOL_NUMA pools.
+ * For every node with memory, a pool bound to that node is created and
+ * its buffers are allocated and touched.  A thread pinned to the node's
+ * CPUs then does the same with a magazine pool created with
+ * OFI_BUFPOOL_NUMA_LOCAL.  The node backing each page is queried with
+ * move_pages(), which only reports placement when no target nodes are
+ * given.  Pages found on another node are counted as misplaced.  Since
+ * pools only prefer their node, a node that is short of memory may
+ * legitimately cause some.
+ */
+
+#include "config.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <ofi_mem.h>
+
+static size_t buf_size = 1024;
+static size_t buf_cnt = 16384;
+static int only_node = -1;
+
+struct numa_test {
+	cpu_set_t cpus;
+	int node;
+	size_t misplaced;
+	int ret;
+};
+
+static void usage(char *name)
+{
+	printf("usage: %s [OPTIONS]\n", name);
+	printf("  -n node   only check the given node (default: all)\n");
+	printf("  -s size   size of each buffer (default: %zu)\n", buf_size);
+	printf("  -c count  number of buffers allocated (default: %zu)\n",
+	       buf_cnt);
+	printf("  -h        display this help\n");
+}
+
+/* Parses a sysfs list, such as "0-3,8", into a set. */
+static int read_list(const char *path, cpu_set_t *set)
+{
+	FILE *file;
+	int first, last, ret;
+	char sep;
+
+	CPU_ZERO(set);
+	file = fopen(path, "r");
+	if (!file)
+		return -1;
+
+	while ((ret = fscanf(file, "%d", &first)) == 1) {
+		last = first;
+		sep = (char) fgetc(file);
+		if (sep == '-') {
+			if (fscanf(file, "%d", &last) != 1)
+				break;
+			sep = (char) fgetc(file);
+		}
+		for (; first <= last && first < CPU_SETSIZE; first++)
+			CPU_SET(first, set);
+		if (sep != ',')
+			break;
+	}
+	fclose(file);
+	return CPU_COUNT(set) ? 0 : -1;
+}
+
+static int check_pages(struct ofi_bufpool *pool, void **bufs,
+		       struct numa_test *test)
+{
+	size_t page_size = ofi_get_page_size();
+	void **pages;
+	int *status;
+	size_t i, cnt = 0;
+	char *page;
+
+	pages = calloc(buf_cnt * (buf_size / page_size + 2), sizeof(*pages));
+	status = calloc(buf_cnt * (buf_size / page_size + 2), sizeof(*status));
+	if (!pages || !status) {
+		printf("ERROR: unable to allocate page list\n");
+		test->ret = -1;
+		goto out;
+	}
+
+	/* Buffers are handed out in address order, skip repeated pages. */
+	for (i = 0; i < buf_cnt; i++) {
+		page = (char *) ((uintptr_t) bufs[i] & ~(page_size - 1));
+		for (; page < (char *) bufs[i] + buf_size; page += page_size) {
+			if (!cnt || pages[cnt - 1] != page)
+				pages[cnt++] = page;
+		}
+	}
+
+	if (syscall(SYS_move_pages, 0, cnt, pages, NULL, status, 0)) {
+		perror("move_pages");
+		test->ret = -1;
+		goto out;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		if (status[i] != test->node)
+			test->misplaced++;
+	}
+	printf("%-6d %-8s %10zu %10zu\n", test->node,
+	       pool->attr.numa_node == OFI_BUFPOOL_NUMA_LOCAL ?
+	       "local" : "bound", cnt, test->misplaced);
+out:
+	free(pages);
+	free(status);
+	return test->ret;
+}
+
+static void run(struct numa_test *test, int numa_node, int flags)
+{
+	struct ofi_bufpool_attr attr = {
+		.size = buf_size,
+		.alignment = 64,
+		.chunk_cnt = 256,
+		.flags = OFI_BUFPOOL_NUMA | flags,
+		.numa_node = numa_node,
+	};
+	struct ofi_bufpool *pool;
+	void **bufs;
+	size_t i;
+
+	test->misplaced = 0;
+	bufs = calloc(buf_cnt, sizeof(*bufs));
+	if (!bufs || ofi_bufpool_create_attr(&attr, &pool)) {
+		printf("ERROR: unable to create pool\n");
+		free(bufs);
+		test->ret = -1;
+		return;
+	}
+
+	for (i = 0; i < buf_cnt; i++) {
+		bufs[i] = ofi_buf_alloc(pool);
+		if (!bufs[i]) {
+			printf("ERROR: unable to allocate buffer\n");
+			test->ret = -1;
+			goto out;
+		}
+		memset(bufs[i], 0, buf_size);
+	}
+
+	check_pages(pool, bufs, test);
+out:
+	while (i--)
+		ofi_buf_free(bufs[i]);
+	ofi_bufpool_destroy(pool);
+	free(bufs);
+}
+
+static void *run_local(void *arg)
+{
+	struct numa_test *test = arg;
+
+	if (sched_setaffinity(0, sizeof(test->cpus), &test->cpus)) {
+		perror("sched_setaffinity");
+		test->ret = -1;
+		return NULL;
+	}
+
+	run(test, OFI_BUFPOOL_NUMA_LOCAL, OFI_BUFPOOL_MAGAZINE);
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct numa_test test;
+	char path[64];
+	cpu_set_t nodes;
+	pthread_t thread;
+	size_t misplaced = 0;
+	int op, node, ret = EXIT_SUCCESS;
+
+	while ((op = getopt(argc, argv, "n:s:c:h")) != -1) {
+		switch (op) {
+		case 'n':
+			only_node = atoi(optarg);
+			break;
+		case 's':
+			buf_size = strtoull(optarg, NULL, 0);
+			break;
+		case 'c':
+			buf_cnt = strtoull(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!buf_size || !buf_cnt) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (read_list("/sys/devices/system/node/has_memory", &nodes)) {
+		printf("ERROR: unable to read the list of nodes\n");
+		return EXIT_FAILURE;
+	}
+
+	memset(&test, 0, sizeof(test));
+	ofi_mem_init();
+	printf("%-6s %-8s %10s %10s\n", "node", "pool", "pages", "misplaced");
+	for (node = 0; node < CPU_SETSIZE; node++) {
+		if (!CPU_ISSET(node, &nodes) ||
+		    (only_node >= 0 && node != only_node))
+			continue;
+
+		memset(&test, 0, sizeof(test));
+		test.node = node;
+		run(&test, node, 0);
+		misplaced += test.misplaced;
+		if (test.ret)
+			break;
+
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/node/node%d/cpulist", node);
+		if (read_list(path, &test.cpus))
+			continue;
+
+		if (pthread_create(&thread, NULL, run_local, &test) ||
+		    pthread_join(thread, NULL)) {
+			printf("ERROR: unable to start thread\n");
+			test.ret = -1;
+		}
+		misplaced += test.misplaced;
+		if (test.ret)
+			break;
+	}
+	ofi_mem_fini();
+
+	if (test.ret)
+		ret = EXIT_FAILURE;
+	else if (misplaced)
+		printf("%zu pages are not on the node of their pool\n",
+		       misplaced);
+	return misplaced ? EXIT_FAILURE : ret;
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under the BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Compares the copy kernels selectable through FI_COPY_KERNEL.  For each
+ * copy size, every supported kernel copies between two buffers and then
+ * reads a separate working set, as a process would after handing data
+ * to a peer.  Reported are the copy bandwidth and the time taken to read
+ * the working set, which grows when the copy evicted it from the cache.
+ */
+
+#include "config.h"
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <ofi_mem.h>
+
+static size_t min_size = 4096;
+static size_t max_size = 64 * 1024 * 1024;
+static size_t ws_size = 512 * 1024;
+static size_t total = 1024 * 1024 * 1024;
+static volatile uint64_t sink;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t read_ws(const uint64_t *ws, size_t cnt)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < cnt; i += 8)
+		sum += ws[i];
+	return sum;
+}
+
+/* Unaligned ends exercise the head and tail handling of the kernels. */
+static int check(const struct ofi_copy_kernel *kernel, char *dst,
+		 const char *src, size_t size)
+{
+	memset(dst, 0, size);
+	kernel->copy(dst + 3, src + 1, size - 8);
+	return memcmp(dst + 3, src + 1, size - 8) || dst[2] ||
+	       dst[size - 5];
+}
+
+static void run(const struct ofi_copy_kernel *kernel, char *dst,
+		const char *src, uint64_t *ws, size_t size)
+{
+	uint64_t start, copy_ns = 0, ws_ns = 0;
+	size_t i, iters;
+
+	iters = MAX(total / size, 16);
+	/* warm up */
+	kernel->copy(dst, src, size);
+	sink += read_ws(ws, ws_size / sizeof(*ws));
+
+	for (i = 0; i < iters; i++) {
+		start = now_ns();
+		kernel->copy(dst, src, size);
+		copy_ns += now_ns() - start;
+
+		start = now_ns();
+		sink += read_ws(ws, ws_size / sizeof(*ws));
+		ws_ns += now_ns() - start;
+	}
+
+	printf("%-10zu %-8s %12.1f %12.1f\n", size, kernel->name,
+	       (double) size * iters * 1000000000 / copy_ns / (1024 * 1024),
+	       (double) ws_ns / iters);
+}
+
+static void usage(const char *argv0)
+{
+	printf("Usage: %s [OPTIONS]\n", argv0);
+	printf("\n");
+	printf("Compares the libfabric copy kernels supported by this CPU.\n");
+	printf("\n");
+	printf("  -s SIZE   smallest copy size (default %zu)\n", min_size);
+	printf("  -S SIZE   largest copy size (default %zu)\n", max_size);
+	printf("  -w SIZE   working set read after every copy (default %zu)\n",
+	       ws_size);
+	printf("  -t SIZE   bytes copied per size and kernel (default %zu)\n",
+	       total);
+	printf("  -h        display this help\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const struct ofi_copy_kernel *kernel;
+	char *src, *dst;
+	uint64_t *ws;
+	size_t size;
+	int op;
+
+	while ((op = getopt(argc, argv, "s:S:w:t:h")) != -1) {
+		switch (op) {
+		case 's':
+			min_size = strtoull(optarg, NULL, 0);
+			break;
+		case 'S':
+			max_size = strtoull(optarg, NULL, 0);
+			break;
+		case 'w':
+			ws_size = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			total = strtoull(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (min_size < 64 || min_size > max_size || ws_size < 64) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (posix_memalign((void **) &src, 4096, max_size) ||
+	    posix_memalign((void **) &dst, 4096, max_size) ||
+	    posix_memalign((void **) &ws, 4096, ws_size)) {
+		printf("ERROR: unable to allocate buffers\n");
+		return EXIT_FAILURE;
+	}
+	for (size = 0; size < max_size; size++)
+		src[size] = (char) (size * 7 + 1);
+	memset(dst, 0, max_size);
+	memset(ws, 1, ws_size);
+
+	printf("%-10s %-8s %12s %12s\n", "bytes", "kernel", "copy MB/s",
+	       "ws read ns");
+	for (size = min_size; size <= max_size; size *= 2) {
+		for (kernel = ofi_copy_kernels; kernel->name; kernel++) {
+			if (!kernel->supported())
+				continue;
+
+			if (check(kernel, dst, src, size)) {
+				printf("ERROR: %s copy mismatch\n",
+				       kernel->name);
+				return EXIT_FAILURE;
+			}
+			run(kernel, dst, src, ws, size);
+		}
+		if (size > max_size / 2)
+			break;
+	}
+
+	free(src);
+	free(dst);
+	free(ws);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL); Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Displays the statistics that processes running with the stats hook
+ * provider publish in shared memory.  Segments are found by name under
+ * /dev/shm, or selected by process id.  Every endpoint and CQ of a
+ * process is listed with its counters.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hook_stats.h"
+
+#define ST_RETRY_MAX	1000
+
+static const char *name = "fi_stats";
+static bool parseable;
+
+static const char * const kind_names[] = {
+	[ST_FREE] = "free",
+	[ST_EP] = "ep",
+	[ST_CQ] = "cq",
+};
+
+static void usage(const char *argv0)
+{
+	printf("Usage: %s [-n NAME] [-i SECONDS] [-c COUNT] [-p] [PID...]\n",
+	       argv0);
+	printf("\n");
+	printf("Displays the statistics published by the stats hook provider\n");
+	printf("of the given processes, or of all processes found.\n");
+	printf("\n");
+	printf("  -n NAME     segment name, FI_OFI_HOOK_STATS_NAME (default fi_stats)\n");
+	printf("  -i SECONDS  repeat the display every SECONDS\n");
+	printf("  -c COUNT    stop after COUNT displays (default 1, or forever with -i)\n");
+	printf("  -p          print one 'pid kind fid name value' line per counter\n");
+}
+
+static uint64_t st_now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Copy a slot, retrying while the publisher updates it */
+static int st_read_slot(const struct st_slot *slot, struct st_slot *copy)
+{
+	uint64_t seq;
+	int i;
+
+	for (i = 0; i < ST_RETRY_MAX; i++) {
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		memcpy(copy, slot, sizeof(*copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq)
+			return 0;
+	}
+	return -EAGAIN;
+}
+
+static void st_print_slot(const struct st_hdr *hdr, const struct st_slot *slot)
+{
+	uint32_t i, cnt;
+
+	cnt = slot->var_cnt < ST_VAR_MAX ? slot->var_cnt : ST_VAR_MAX;
+	if (parseable) {
+		for (i = 0; i < cnt; i++)
+			printf("%d %s 0x%" PRIx64 " %.*s %" PRIu64 "\n",
+			       hdr->pid, kind_names[slot->kind], slot->fid,
+			       ST_NAME_LEN, slot->vars[i].name,
+			       slot->vars[i].value);
+		return;
+	}
+
+	printf("  %s 0x%" PRIx64, kind_names[slot->kind], slot->fid);
+	if (slot->prov[0])
+		printf(" %.*s %.*s", ST_NAME_LEN, slot->prov,
+		       ST_NAME_LEN, slot->domain);
+	printf("\n");
+	for (i = 0; i < cnt; i++)
+		printf("    %-24.*s %20" PRIu64 "\n", ST_NAME_LEN,
+		       slot->vars[i].name, slot->vars[i].value);
+}
+
+static int st_check(const struct st_hdr *hdr, size_t size)
+{
+	if (size < ST_HDR_SIZE ||
+	    __atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != ST_MAGIC)
+		return -EINVAL;
+
+	if (hdr->version != ST_VERSION) {
+		fprintf(stderr, "unsupported stats version %u\n", hdr->version);
+		return -EINVAL;
+	}
+
+	if (hdr->slot_size < sizeof(struct st_slot) ||
+	    ST_HDR_SIZE + (uint64_t) hdr->slot_cnt * hdr->slot_size > size)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int st_show(const char *path)
+{
+	const struct st_hdr *hdr;
+	struct st_slot slot;
+	struct stat st;
+	uint32_t i;
+	void *map;
+	int fd, ret;
+
+	fd = shm_open(path, O_RDONLY, 0);
+	if (fd < 0 || fstat(fd, &st)) {
+		ret = -errno;
+		perror(path);
+		if (fd >= 0)
+			close(fd);
+		return ret;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		ret = -errno;
+		perror("mmap");
+		return ret;
+	}
+
+	hdr = map;
+	ret = st_check(hdr, st.st_size);
+	if (ret) {
+		fprintf(stderr, "%s: not a stats segment\n", path);
+		goto out;
+	}
+
+	if (!parseable) {
+		printf("%d (%.*s)", hdr->pid, ST_NAME_LEN, hdr->comm);
+		if (kill(hdr->pid, 0) && errno == ESRCH)
+			printf(" exited\n");
+		else
+			printf(" updated %.1fs ago\n",
+			       (st_now_ns() - __atomic_load_n(&hdr->update_ns,
+						__ATOMIC_ACQUIRE)) / 1e9);
+	}
+
+	for (i = 0; i < hdr->slot_cnt; i++) {
+		if (st_read_slot(st_slot(hdr, i), &slot) ||
+		    slot.kind == ST_FREE || slot.kind > ST_CQ)
+			continue;
+		st_print_slot(hdr, &slot);
+	}
+out:
+	munmap(map, st.st_size);
+	return ret;
+}
+
+/* Show every segment named <name>.<pid> */
+static int st_show_all(void)
+{
+	char path[NAME_MAX + 2];
+	struct dirent *entry;
+	size_t len;
+	DIR *dir;
+	char *end;
+
+	dir = opendir("/dev/shm");
+	if (!dir) {
+		perror("/dev/shm");
+		return -errno;
+	}
+
+	len = strlen(name);
+	while ((entry = readdir(dir))) {
+		if (strncmp(entry->d_name, name, len) ||
+		    entry->d_name[len] != '.')
+			continue;
+
+		strtol(&entry->d_name[len + 1], &end, 10);
+		if (end == &entry->d_name[len + 1] || *end)
+			continue;
+
+		snprintf(path, sizeof(path), "/%s", entry->d_name);
+		st_show(path);
+	}
+	closedir(dir);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	char path[NAME_MAX + 2];
+	int op, i, interval = 0, count = 0, iter, ret = 0;
+
+	while ((op = getopt(argc, argv, "n:i:c:ph")) != -1) {
+		switch (op) {
+		case 'n':
+			name = optarg;
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 'c':
+			count = atoi(optarg);
+			break;
+		case 'p':
+			parseable = true;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!count && !interval)
+		count = 1;
+
+	for (iter = 0; !count || iter < count; iter++) {
+		if (iter) {
+			sleep(interval);
+			if (!parseable)
+				printf("\n");
+		}
+
+		if (optind == argc) {
+			ret = st_show_all();
+			continue;
+		}
+
+		for (i = optind; i < argc; i++) {
+			snprintf(path, sizeof(path), "/%s.%s", name, argv[i]);
+			ret = st_show(path);
+		}
+		fflush(stdout);
+	}
+
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}